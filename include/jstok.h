@@ -6,7 +6,8 @@
  *   - Strict JSON grammar (optional, recommended)
  *   - Useful token semantics (object.size = pair count, array.size = element count)
  *   - Count-only mode (tokens == NULL)
- *   - Incremental-friendly (if you call again with the same buffer + more bytes)
+ *   - Incremental: call again with the same buffer + more bytes, or use chunked mode
+ *     (jstok_init_chunked) and pass only the new bytes each call
  *   - Tiny helpers for navigating tokens (object get, array at, subtree skip)
  *
  * Usage
@@ -34,6 +35,15 @@
  *   >= 0: number of tokens used (or required if tokens == NULL)
  *   JSTOK_ERROR_*: negative error code, parser.error_pos set when possible
  *
+ * Chunked mode
+ *   - jstok_init_chunked: each jstok_parse call gets only the bytes after the previous call
+ *   - a string, number or literal cut by a chunk boundary is carried in the parser
+ *     and finished on the next call; nothing is rescanned
+ *   - start/end are offsets into the whole stream, not into the current chunk
+ *   - pass the same tokens (or a grown copy) on every call; indices never move
+ *   - JSTOK_ERROR_PART means "feed more"; other errors are final, except
+ *     JSTOK_ERROR_NOMEM: grow tokens and feed again from stream offset parser.pos
+ *
  * This software is distributed under the MIT license
  */
 
@@ -103,12 +113,30 @@ typedef struct jstok_frame {
     int tok; /* token index for this container, or -1 in count-only */
 } jstok_frame_t;
 
+/* Scalar value cut off by the end of input */
+typedef enum {
+    JSTOK_PART_NONE = 0,
+    JSTOK_PART_KEY,
+    JSTOK_PART_STRING,
+    JSTOK_PART_NUMBER,
+    JSTOK_PART_TRUE,
+    JSTOK_PART_FALSE,
+    JSTOK_PART_NULL
+} jstok_part_t;
+
 typedef struct jstok_parser {
     int pos;       /* current scan position */
     int toknext;   /* next token index / token count in count-only */
     int depth;     /* number of active container frames */
     int root_done; /* parsed one top-level value */
 
+    int chunked;    /* json passed to jstok_parse starts at stream offset base */
+    int base;       /* stream offset of json[0] (always 0 unless chunked) */
+    int part;       /* jstok_part_t of the value in progress */
+    int part_start; /* start offset of the value in progress */
+    int part_st;    /* string escape, number grammar or literal position */
+    int delim;      /* a literal just ended, the next byte must be a delimiter */
+
     int error_pos;
     int error_code;
 
@@ -117,6 +145,9 @@ typedef struct jstok_parser {
 
 JSTOK_API void jstok_init(jstok_parser* p);
 
+/* Like jstok_init, but every jstok_parse call receives only the next chunk */
+JSTOK_API void jstok_init_chunked(jstok_parser* p);
+
 JSTOK_API int jstok_parse(jstok_parser* p, const char* json, int json_len, jstoktok_t* tokens, int max_tokens);
 
 #ifndef JSTOK_NO_HELPERS
@@ -201,10 +232,22 @@ JSTOK_API void jstok_init(jstok_parser* p) {
     p->toknext = 0;
     p->depth = 0;
     p->root_done = 0;
+    p->chunked = 0;
+    p->base = 0;
+    p->part = JSTOK_PART_NONE;
+    p->part_start = 0;
+    p->part_st = 0;
+    p->delim = 0;
     p->error_pos = -1;
     p->error_code = 0;
 }
 
+JSTOK_API void jstok_init_chunked(jstok_parser* p) {
+    if (!p) return;
+    jstok_init(p);
+    p->chunked = 1;
+}
+
 static int jstok_push(jstok_parser* p, jstoktype_t type, jstok_state_t st, int tok) {
     if (p->depth >= JSTOK_MAX_DEPTH) {
         jstok_set_error(p, JSTOK_ERROR_DEPTH, p->pos);
@@ -319,214 +362,223 @@ static int jstok_accept_key(jstok_parser* p) {
     return 0;
 }
 
-static int jstok_parse_string_token(jstok_parser* p, const char* json, int json_len, jstoktok_t* toks, int max_tokens,
-                                    int parent) {
-    int start_quote;
-    int i;
-
-    start_quote = p->pos;
-    if (p->pos >= json_len || json[p->pos] != '"') {
-        jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
-        return JSTOK_ERROR_INVAL;
-    }
-
-    p->pos++; /* after opening quote */
-
-    while (p->pos < json_len) {
-        char c = json[p->pos];
-
-        if ((unsigned char)c < 0x20) {
-            jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
-            return JSTOK_ERROR_INVAL;
-        }
+/* Number grammar positions kept in part_st while a number is in progress */
+enum {
+    JSTOK_NUM_MINUS = 0, /* after '-', need a digit */
+    JSTOK_NUM_ZERO,      /* leading 0 */
+    JSTOK_NUM_INT,
+    JSTOK_NUM_DOT, /* after '.', need a digit */
+    JSTOK_NUM_FRAC,
+    JSTOK_NUM_EXP,      /* after e/E, need sign or digit */
+    JSTOK_NUM_EXP_SIGN, /* after exponent sign, need a digit */
+    JSTOK_NUM_EXP_DIGITS
+};
+
+/* String positions kept in part_st: 0 body, 1 after '\\', 2..5 inside \\uXXXX */
+enum { JSTOK_STR_BODY = 0, JSTOK_STR_ESCAPE = 1, JSTOK_STR_HEX = 2 };
+
+static int jstok_parent_tok(jstok_parser* p) {
+    jstok_frame_t* fr = jstok_top(p);
+    return fr ? fr->tok : -1;
+}
 
-        if (c == '"') {
-            /* end exclusive is at the closing quote position */
-            i = jstok_new_token(p, toks, max_tokens, JSTOK_STRING, start_quote + 1, p->pos, parent);
-            if (i < 0) return i;
-            p->pos++; /* consume closing quote */
-            return i;
-        }
+/* Scan the rest of a string or key. Leaves p->part set if the input ends first. */
+static int jstok_resume_string(jstok_parser* p, const char* json, int json_len, jstoktok_t* toks, int max_tokens) {
+    while (p->pos - p->base < json_len) {
+        char c = json[p->pos - p->base];
 
-        if (c == '\\') {
-            p->pos++;
-            if (p->pos >= json_len) {
-                jstok_set_error(p, JSTOK_ERROR_PART, p->pos);
-                p->pos = start_quote; /* Rewind for resume */
-                return JSTOK_ERROR_PART;
+        if (p->part_st == JSTOK_STR_BODY) {
+            if ((unsigned char)c < 0x20) {
+                jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
+                return JSTOK_ERROR_INVAL;
             }
-            c = json[p->pos];
-
-            if (c == '"' || c == '\\' || c == '/' || c == 'b' || c == 'f' || c == 'n' || c == 'r' || c == 't') {
-                p->pos++;
-                continue;
+            if (c == '"') {
+                /* end exclusive is at the closing quote position */
+                int i = jstok_new_token(p, toks, max_tokens, JSTOK_STRING, p->part_start, p->pos, jstok_parent_tok(p));
+                if (i < 0) return i;
+                p->pos++; /* consume closing quote */
+                if (p->part == JSTOK_PART_KEY) {
+                    p->part = JSTOK_PART_NONE;
+                    return jstok_accept_key(p);
+                }
+                p->part = JSTOK_PART_NONE;
+                return 0;
             }
+            if (c == '\\') p->part_st = JSTOK_STR_ESCAPE;
+            p->pos++;
+            continue;
+        }
 
-            if (c == 'u') {
-                /* \uXXXX */
-                for (i = 0; i < 4; i++) {
-                    p->pos++;
-                    if (p->pos >= json_len) {
-                        jstok_set_error(p, JSTOK_ERROR_PART, p->pos);
-                        p->pos = start_quote; /* Rewind for resume */
-                        return JSTOK_ERROR_PART;
-                    }
-                    if (!jstok_is_hex(json[p->pos])) {
-                        jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
-                        return JSTOK_ERROR_INVAL;
-                    }
-                }
-                p->pos++;
-                continue;
+        if (p->part_st == JSTOK_STR_ESCAPE) {
+            if (c == '"' || c == '\\' || c == '/' || c == 'b' || c == 'f' || c == 'n' || c == 'r' || c == 't') {
+                p->part_st = JSTOK_STR_BODY;
+            } else if (c == 'u') {
+                p->part_st = JSTOK_STR_HEX;
+            } else {
+                jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
+                return JSTOK_ERROR_INVAL;
             }
+            p->pos++;
+            continue;
+        }
 
+        /* \uXXXX */
+        if (!jstok_is_hex(c)) {
             jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
             return JSTOK_ERROR_INVAL;
         }
-
+        p->part_st = (p->part_st == JSTOK_STR_HEX + 3) ? JSTOK_STR_BODY : p->part_st + 1;
         p->pos++;
     }
-
-    jstok_set_error(p, JSTOK_ERROR_PART, p->pos);
-    p->pos = start_quote; /* Rewind for resume */
-    return JSTOK_ERROR_PART;
+    return 0;
 }
 
-static int jstok_parse_literal(jstok_parser* p, const char* json, int json_len, const char* lit) {
-    int i = 0;
-    while (lit[i] != '\0') {
-        if (p->pos + i >= json_len) {
-            jstok_set_error(p, JSTOK_ERROR_PART, p->pos + i);
-            return JSTOK_ERROR_PART;
-        }
-        if (json[p->pos + i] != lit[i]) {
-            jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos + i);
-            return JSTOK_ERROR_INVAL;
+/* A number only ends at a delimiter, so one at the end of input stays in progress. */
+static int jstok_resume_number(jstok_parser* p, const char* json, int json_len, jstoktok_t* toks, int max_tokens) {
+    while (p->pos - p->base < json_len) {
+        char c = json[p->pos - p->base];
+        int digit = jstok_is_digit(c);
+        int done = 0;
+
+        switch (p->part_st) {
+            case JSTOK_NUM_MINUS:
+                if (c == '0') {
+                    p->part_st = JSTOK_NUM_ZERO;
+                } else if (digit) {
+                    p->part_st = JSTOK_NUM_INT;
+                } else {
+                    jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
+                    return JSTOK_ERROR_INVAL;
+                }
+                break;
+            case JSTOK_NUM_ZERO:
+            case JSTOK_NUM_INT:
+            case JSTOK_NUM_FRAC:
+                if (digit && p->part_st != JSTOK_NUM_ZERO) {
+                    /* stay */
+                } else if (c == '.' && p->part_st != JSTOK_NUM_FRAC) {
+                    p->part_st = JSTOK_NUM_DOT;
+                } else if (c == 'e' || c == 'E') {
+                    p->part_st = JSTOK_NUM_EXP;
+                } else {
+                    done = 1;
+                }
+                break;
+            case JSTOK_NUM_DOT:
+            case JSTOK_NUM_EXP_SIGN:
+                if (!digit) {
+                    jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
+                    return JSTOK_ERROR_INVAL;
+                }
+                p->part_st = (p->part_st == JSTOK_NUM_DOT) ? JSTOK_NUM_FRAC : JSTOK_NUM_EXP_DIGITS;
+                break;
+            case JSTOK_NUM_EXP:
+                if (c == '+' || c == '-') {
+                    p->part_st = JSTOK_NUM_EXP_SIGN;
+                } else if (digit) {
+                    p->part_st = JSTOK_NUM_EXP_DIGITS;
+                } else {
+                    jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
+                    return JSTOK_ERROR_INVAL;
+                }
+                break;
+            default: /* JSTOK_NUM_EXP_DIGITS */
+                if (!digit) done = 1;
+                break;
         }
-        i++;
-    }
-    /* Next must be delimiter or EOF */
-    if (p->pos + i < json_len && !jstok_is_delim(json[p->pos + i])) {
-        jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos + i);
-        return JSTOK_ERROR_INVAL;
-    }
-    return i;
-}
 
-static int jstok_parse_number_span(jstok_parser* p, const char* json, int json_len, int* out_end) {
-    int i = p->pos;
-
-    if (i >= json_len) {
-        jstok_set_error(p, JSTOK_ERROR_PART, i);
-        return JSTOK_ERROR_PART;
-    }
-
-    if (json[i] == '-') {
-        i++;
-        if (i >= json_len) {
-            jstok_set_error(p, JSTOK_ERROR_PART, i);
-            return JSTOK_ERROR_PART;
+        if (done) {
+            int i;
+            /* no leading zeros or trailing garbage: next must be a delimiter */
+            if (!jstok_is_delim(c)) {
+                jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
+                return JSTOK_ERROR_INVAL;
+            }
+            i = jstok_new_token(p, toks, max_tokens, JSTOK_PRIMITIVE, p->part_start, p->pos, jstok_parent_tok(p));
+            if (i < 0) return i;
+            p->part = JSTOK_PART_NONE;
+            return 0;
         }
+        p->pos++;
     }
+    return 0;
+}
 
-    if (json[i] == '0') {
-        i++;
-        /* no leading zeros in strict JSON, but allow 0.<frac> or 0e... */
-        if (i < json_len && jstok_is_digit(json[i])) {
-#ifdef JSTOK_STRICT
-            jstok_set_error(p, JSTOK_ERROR_INVAL, i);
-            return JSTOK_ERROR_INVAL;
-#endif
-        }
-    } else if (json[i] >= '1' && json[i] <= '9') {
-        i++;
-        while (i < json_len && jstok_is_digit(json[i])) i++;
-    } else {
-        jstok_set_error(p, JSTOK_ERROR_INVAL, i);
-        return JSTOK_ERROR_INVAL;
-    }
+static int jstok_resume_literal(jstok_parser* p, const char* json, int json_len, jstoktok_t* toks, int max_tokens) {
+    const char* lit = (p->part == JSTOK_PART_TRUE) ? "true" : (p->part == JSTOK_PART_FALSE) ? "false" : "null";
 
-    if (i < json_len && json[i] == '.') {
-        i++;
-        if (i >= json_len) {
-            jstok_set_error(p, JSTOK_ERROR_PART, i);
-            return JSTOK_ERROR_PART;
-        }
-        if (!jstok_is_digit(json[i])) {
-            jstok_set_error(p, JSTOK_ERROR_INVAL, i);
+    while (p->pos - p->base < json_len) {
+        if (json[p->pos - p->base] != lit[p->part_st]) {
+            jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
             return JSTOK_ERROR_INVAL;
         }
-        while (i < json_len && jstok_is_digit(json[i])) i++;
-    }
-
-    if (i < json_len && (json[i] == 'e' || json[i] == 'E')) {
-        i++;
-        if (i >= json_len) {
-            jstok_set_error(p, JSTOK_ERROR_PART, i);
-            return JSTOK_ERROR_PART;
-        }
-        if (json[i] == '+' || json[i] == '-') {
-            i++;
-            if (i >= json_len) {
-                jstok_set_error(p, JSTOK_ERROR_PART, i);
-                return JSTOK_ERROR_PART;
-            }
-        }
-        if (!jstok_is_digit(json[i])) {
-            jstok_set_error(p, JSTOK_ERROR_INVAL, i);
-            return JSTOK_ERROR_INVAL;
+        if (lit[p->part_st + 1] == '\0') {
+            int i = jstok_new_token(p, toks, max_tokens, JSTOK_PRIMITIVE, p->part_start, p->pos + 1,
+                                    jstok_parent_tok(p));
+            if (i < 0) return i;
+            p->pos++;
+            p->part = JSTOK_PART_NONE;
+            p->delim = 1; /* next must be delimiter or EOF */
+            return 0;
         }
-        while (i < json_len && jstok_is_digit(json[i])) i++;
-    }
-
-    /* Resume safety: If we hit EOF, we don't know if the number is done. */
-    if (i >= json_len) {
-        jstok_set_error(p, JSTOK_ERROR_PART, i);
-        return JSTOK_ERROR_PART;
-    }
-
-    if (i < json_len && !jstok_is_delim(json[i])) {
-        jstok_set_error(p, JSTOK_ERROR_INVAL, i);
-        return JSTOK_ERROR_INVAL;
+        p->part_st++;
+        p->pos++;
     }
-
-    *out_end = i;
     return 0;
 }
 
-static int jstok_parse_primitive_token(jstok_parser* p, const char* json, int json_len, jstoktok_t* toks,
-                                       int max_tokens, int parent) {
-    int start = p->pos;
-    int n, endpos;
-
-    if (p->pos >= json_len) {
-        jstok_set_error(p, JSTOK_ERROR_PART, p->pos);
-        return JSTOK_ERROR_PART;
+static int jstok_resume(jstok_parser* p, const char* json, int json_len, jstoktok_t* toks, int max_tokens) {
+    switch (p->part) {
+        case JSTOK_PART_KEY:
+        case JSTOK_PART_STRING:
+            return jstok_resume_string(p, json, json_len, toks, max_tokens);
+        case JSTOK_PART_NUMBER:
+            return jstok_resume_number(p, json, json_len, toks, max_tokens);
+        default:
+            return jstok_resume_literal(p, json, json_len, toks, max_tokens);
     }
+}
 
-    if (json[p->pos] == 't') {
-        n = jstok_parse_literal(p, json, json_len, "true");
-        if (n < 0) return n;
-        p->pos += n;
-        return jstok_new_token(p, toks, max_tokens, JSTOK_PRIMITIVE, start, p->pos, parent);
-    } else if (json[p->pos] == 'f') {
-        n = jstok_parse_literal(p, json, json_len, "false");
-        if (n < 0) return n;
-        p->pos += n;
-        return jstok_new_token(p, toks, max_tokens, JSTOK_PRIMITIVE, start, p->pos, parent);
-    } else if (json[p->pos] == 'n') {
-        n = jstok_parse_literal(p, json, json_len, "null");
-        if (n < 0) return n;
-        p->pos += n;
-        return jstok_new_token(p, toks, max_tokens, JSTOK_PRIMITIVE, start, p->pos, parent);
-    } else {
-        /* number */
-        endpos = 0;
-        n = jstok_parse_number_span(p, json, json_len, &endpos);
-        if (n < 0) return n;
-        p->pos = endpos;
-        return jstok_new_token(p, toks, max_tokens, JSTOK_PRIMITIVE, start, p->pos, parent);
+/* Start a string, number or literal at p->pos; the caller has accepted the value slot. */
+static int jstok_begin_scalar(jstok_parser* p, char c) {
+    p->part_start = p->pos;
+    p->part_st = 0;
+    switch (c) {
+        case '"':
+            p->part = JSTOK_PART_STRING;
+            p->part_start = p->pos + 1; /* string tokens exclude quotes */
+            p->part_st = JSTOK_STR_BODY;
+            break;
+        case 't':
+            p->part = JSTOK_PART_TRUE;
+            break;
+        case 'f':
+            p->part = JSTOK_PART_FALSE;
+            break;
+        case 'n':
+            p->part = JSTOK_PART_NULL;
+            break;
+        case '-':
+            p->part = JSTOK_PART_NUMBER;
+            p->part_st = JSTOK_NUM_MINUS;
+            break;
+        case '0':
+            p->part = JSTOK_PART_NUMBER;
+            p->part_st = JSTOK_NUM_ZERO;
+            break;
+        default:
+            if (c < '1' || c > '9') {
+                jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
+                return JSTOK_ERROR_INVAL;
+            }
+            p->part = JSTOK_PART_NUMBER;
+            p->part_st = JSTOK_NUM_INT;
+            break;
+    }
+    if (p->part == JSTOK_PART_NUMBER || p->part == JSTOK_PART_STRING) {
+        p->pos++;
     }
+    return 0;
 }
 
 static int jstok_start_container(jstok_parser* p, const char* json, int json_len, jstoktok_t* toks, int max_tokens,
@@ -542,15 +594,16 @@ static int jstok_start_container(jstok_parser* p, const char* json, int json_len
     fr = jstok_top(p);
     if (fr) parent_idx = fr->tok;
 
+    /* Allocate first so JSTOK_ERROR_NOMEM leaves the parser as it was */
+    tok_idx = jstok_new_token(p, toks, max_tokens, type, p->pos, -1, parent_idx);
+    if (tok_idx < 0) return tok_idx;
+
     /* This container token is a value for its parent */
     {
         int r = jstok_accept_value(p, toks);
         if (r < 0) return r;
     }
 
-    tok_idx = jstok_new_token(p, toks, max_tokens, type, p->pos, -1, parent_idx);
-    if (tok_idx < 0) return tok_idx;
-
     st = (type == JSTOK_OBJECT) ? JSTOK_ST_OBJ_KEY_OR_END : JSTOK_ST_ARR_VALUE_OR_END;
 
     /* Push new frame, tok_idx is -1 in count-only but that is fine */
@@ -623,24 +676,28 @@ static int jstok_end_container(jstok_parser* p, const char* json, int json_len,
     return 0;
 }
 
-JSTOK_API int jstok_parse(jstok_parser* p, const char* json, int json_len, jstoktok_t* tokens, int max_tokens) {
+static int jstok_parse_chunk(jstok_parser* p, const char* json, int json_len, jstoktok_t* tokens, int max_tokens) {
     int r;
 
-    if (!p || !json || json_len < 0) {
-        if (p) jstok_set_error(p, JSTOK_ERROR_INVAL, 0);
-        return JSTOK_ERROR_INVAL;
-    }
-
-    /* Reset error reporting for this call */
-    p->error_pos = -1;
-    p->error_code = 0;
-
-    while (p->pos < json_len) {
+    while (p->pos - p->base < json_len) {
         char c;
         jstok_frame_t* fr;
-        int parent_idx;
 
-        c = json[p->pos];
+        if (p->part != JSTOK_PART_NONE) {
+            r = jstok_resume(p, json, json_len, tokens, max_tokens);
+            if (r < 0) return r;
+            continue;
+        }
+
+        c = json[p->pos - p->base];
+
+        if (p->delim) {
+            if (!jstok_is_delim(c)) {
+                jstok_set_error(p, JSTOK_ERROR_INVAL, p->pos);
+                return JSTOK_ERROR_INVAL;
+            }
+            p->delim = 0;
+        }
 
         if (jstok_is_space(c)) {
             p->pos++;
@@ -648,12 +705,8 @@ JSTOK_API int jstok_parse(jstok_parser* p, const char* json, int json_len, jstok
         }
 
         fr = jstok_top(p);
-        parent_idx = fr ? fr->tok : -1;
 
         if (c == '{') {
-            /* Container start also calls accept_value internally.
-               Ideally we'd rollback there too, but start_container is atomic enough
-               (only fails on depth/mem). PART on '{' isn't possible (1 char). */
             r = jstok_start_container(p, json, json_len, tokens, max_tokens, JSTOK_OBJECT);
             if (r < 0) return r;
             continue;
@@ -709,74 +762,27 @@ JSTOK_API int jstok_parse(jstok_parser* p, const char* json, int json_len, jstok
             }
         }
 
-        if (c == '"') {
-            int tok_idx;
-
-            /* If we're in an object expecting a key, treat as key */
-            if (fr && fr->type == JSTOK_OBJECT && (fr->st == JSTOK_ST_OBJ_KEY_OR_END || fr->st == JSTOK_ST_OBJ_KEY)) {
-                jstok_state_t saved_st = fr->st;
-
-                tok_idx = jstok_parse_string_token(p, json, json_len, tokens, max_tokens, parent_idx);
-                if (tok_idx < 0) {
-                    if (tok_idx == JSTOK_ERROR_PART) {
-                        fr->st = saved_st; /* Rollback state (likely irrelevant as parse_string didn't change it, but
-                                              consistent) */
-                    }
-                    return tok_idx;
-                }
-                r = jstok_accept_key(p);
-                if (r < 0) return r;
-                continue;
-            }
-
-            /* Otherwise treat as a value */
-            {
-                jstok_state_t saved_st = fr ? fr->st : 0;
-                int saved_root_done = p->root_done;
-
-                r = jstok_accept_value(p, tokens);
-                if (r < 0) return r;
-
-                tok_idx = jstok_parse_string_token(p, json, json_len, tokens, max_tokens, parent_idx);
-                if (tok_idx < 0) {
-                    if (tok_idx == JSTOK_ERROR_PART) {
-                        /* Rollback accept_value side effects */
-                        if (fr) {
-                            fr->st = saved_st;
-                            if (tokens && fr->tok >= 0) tokens[fr->tok].size--;
-                        } else {
-                            p->root_done = saved_root_done;
-                        }
-                    }
-                    return tok_idx;
-                }
-            }
+        /* If we're in an object expecting a key, treat the string as key */
+        if (c == '"' && fr && fr->type == JSTOK_OBJECT &&
+            (fr->st == JSTOK_ST_OBJ_KEY_OR_END || fr->st == JSTOK_ST_OBJ_KEY)) {
+            r = jstok_begin_scalar(p, c);
+            if (r < 0) return r;
+            p->part = JSTOK_PART_KEY;
             continue;
         }
 
-        /* Primitive value */
-        {
-            jstok_state_t saved_st = fr ? fr->st : 0;
-            int saved_root_done = p->root_done;
-
-            r = jstok_accept_value(p, tokens);
-            if (r < 0) return r;
+        /* Otherwise a string or primitive value. The slot is taken now; the token is
+           emitted once the value ends, possibly in a later call. */
+        r = jstok_accept_value(p, tokens);
+        if (r < 0) return r;
+        r = jstok_begin_scalar(p, c);
+        if (r < 0) return r;
+    }
 
-            r = jstok_parse_primitive_token(p, json, json_len, tokens, max_tokens, parent_idx);
-            if (r < 0) {
-                if (r == JSTOK_ERROR_PART) {
-                    /* Rollback accept_value side effects */
-                    if (fr) {
-                        fr->st = saved_st;
-                        if (tokens && fr->tok >= 0) tokens[fr->tok].size--;
-                    } else {
-                        p->root_done = saved_root_done;
-                    }
-                }
-                return r;
-            }
-        }
-        continue;
+    /* A value cut off by the end of input (a number always is, it needs a delimiter) */
+    if (p->part != JSTOK_PART_NONE) {
+        jstok_set_error(p, JSTOK_ERROR_PART, p->pos);
+        return JSTOK_ERROR_PART;
     }
 
 #ifdef JSTOK_STRICT
@@ -793,15 +799,29 @@ JSTOK_API int jstok_parse(jstok_parser* p, const char* json, int json_len, jstok
         return JSTOK_ERROR_PART;
     }
 
-    /* If we parsed a top-level value, allow trailing whitespace only in strict mode */
-#ifdef JSTOK_STRICT
-    /* root_done already ensures single value, scan ensures no extra tokens were accepted */
-#endif
-
     /* Success: tokens used or required token count */
     return p->toknext;
 }
 
+JSTOK_API int jstok_parse(jstok_parser* p, const char* json, int json_len, jstoktok_t* tokens, int max_tokens) {
+    int r;
+
+    if (!p || !json || json_len < 0) {
+        if (p) jstok_set_error(p, JSTOK_ERROR_INVAL, 0);
+        return JSTOK_ERROR_INVAL;
+    }
+
+    /* Reset error reporting for this call */
+    p->error_pos = -1;
+    p->error_code = 0;
+
+    r = jstok_parse_chunk(p, json, json_len, tokens, max_tokens);
+    /* The next chunk starts at the first unconsumed byte: the end of this one,
+       or the byte that hit JSTOK_ERROR_NOMEM */
+    if (p->chunked) p->base = p->pos;
+    return r;
+}
+
 #ifndef JSTOK_NO_HELPERS
 
 JSTOK_API jstok_span_t jstok_span(const char* json, const jstoktok_t* t) {
@@ -3,9 +3,12 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "llm/llm.h"
+
 // String span (non-owning)
 typedef struct {
     const char* ptr;
@@ -28,16 +31,61 @@ static inline bool span_eq_lit(const span_t a, const char* lit) {
     return a.len == lit_len && memcmp(a.ptr, lit, lit_len) == 0;
 }
 
+// Allocation through an optional client allocator (NULL or unset hooks use libc).
+static inline bool mem_allocator_custom(const llm_allocator_t* a) { return a && a->alloc && a->realloc && a->free; }
+
+static inline void* mem_alloc(const llm_allocator_t* a, size_t size) {
+    if (mem_allocator_custom(a)) return a->alloc(a->user_data, size ? size : 1);
+    return malloc(size ? size : 1);
+}
+
+static inline void* mem_realloc(const llm_allocator_t* a, void* ptr, size_t size) {
+    if (mem_allocator_custom(a)) return a->realloc(a->user_data, ptr, size ? size : 1);
+    return realloc(ptr, size ? size : 1);
+}
+
+static inline void mem_free(const llm_allocator_t* a, void* ptr) {
+    if (!ptr) return;
+    if (mem_allocator_custom(a)) {
+        a->free(a->user_data, ptr);
+        return;
+    }
+    free(ptr);
+}
+
+static inline void* mem_calloc(const llm_allocator_t* a, size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    void* p = mem_alloc(a, count * size);
+    if (p) memset(p, 0, count * size);
+    return p;
+}
+
+static inline char* mem_strndup(const llm_allocator_t* a, const char* ptr, size_t len) {
+    if (!ptr || len == SIZE_MAX) return NULL;
+    char* s = mem_alloc(a, len + 1);
+    if (s) {
+        memcpy(s, ptr, len);
+        s[len] = '\0';
+    }
+    return s;
+}
+
+static inline char* mem_strdup(const llm_allocator_t* a, const char* str) {
+    return str ? mem_strndup(a, str, strlen(str)) : NULL;
+}
+
 // Growable buffer
 struct growbuf {
     char* data;
     size_t len;
     size_t cap;
     bool nomem;
+    const llm_allocator_t* alloc;
 };
 
-static inline void growbuf_init(struct growbuf* b, size_t initial_cap) {
-    b->data = initial_cap ? malloc(initial_cap) : NULL;
+static inline void growbuf_init(struct growbuf* b, size_t initial_cap, const llm_allocator_t* alloc) {
+    b->alloc = alloc;
+    b->data = initial_cap ? mem_alloc(alloc, initial_cap) : NULL;
     b->len = 0;
     b->cap = initial_cap;
     b->nomem = initial_cap && !b->data;
@@ -53,7 +101,7 @@ static inline bool growbuf_append(struct growbuf* b, const char* data, size_t le
         if (max_cap && next_cap > max_cap) {
             next_cap = max_cap;
         }
-        char* new_data = realloc(b->data, next_cap);
+        char* new_data = mem_realloc(b->alloc, b->data, next_cap);
         if (!new_data) {
             b->nomem = true;
             return false;
@@ -67,7 +115,7 @@ static inline bool growbuf_append(struct growbuf* b, const char* data, size_t le
 }
 
 static inline void growbuf_free(struct growbuf* b) {
-    free(b->data);
+    mem_free(b->alloc, b->data);
     b->data = NULL;
     b->len = b->cap = 0;
 }
@@ -12,6 +12,55 @@ extern "C" {
 // Opaque client handle
 typedef struct llm_client llm_client_t;
 
+// Allocator hooks. All three functions must be set to take effect; otherwise libc is used.
+// realloc(ptr == NULL) must behave like alloc; free(NULL) is never called.
+typedef struct {
+    void* (*alloc)(void* user_data, size_t size);
+    void* (*realloc)(void* user_data, void* ptr, size_t size);
+    void (*free)(void* user_data, void* ptr);
+    void* user_data;
+} llm_allocator_t;
+
+// Counting allocator for benchmarks and allocation-budget tests.
+// Wraps a backing allocator (NULL = libc) and tracks calls and live bytes.
+// Allocations fail once live bytes would exceed max_live_bytes (0 = unlimited).
+// Not thread-safe; use one counter per thread or synchronize externally.
+typedef struct {
+    llm_allocator_t backing;
+    size_t max_live_bytes;
+    size_t alloc_calls;
+    size_t realloc_calls;
+    size_t free_calls;
+    size_t failed_calls;
+    size_t live_allocs;
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t total_bytes;
+} llm_counting_allocator_t;
+
+void llm_counting_allocator_init(llm_counting_allocator_t* counter, const llm_allocator_t* backing,
+                                 size_t max_live_bytes);
+// Returns hooks bound to counter; counter must outlive every allocation made through them.
+llm_allocator_t llm_counting_allocator(llm_counting_allocator_t* counter);
+
+// Bump arena over a caller-provided buffer. Allocation never touches the heap and fails once
+// the buffer is exhausted. free() only reclaims the most recent block; llm_arena_reset drops
+// everything in O(1). Never free a block from before a reset: its offset may now hold a live block,
+// which the free would reclaim. Only used/peak/failed_calls are meant to be read; not thread-safe.
+typedef struct {
+    unsigned char* base;
+    size_t cap;
+    size_t used;
+    size_t peak;
+    size_t failed_calls;
+    size_t last;
+} llm_arena_t;
+
+void llm_arena_init(llm_arena_t* arena, void* buf, size_t cap);
+// Invalidates every result allocated from the arena; do not pass them to their *_free functions afterwards.
+void llm_arena_reset(llm_arena_t* arena);
+llm_allocator_t llm_arena_allocator(llm_arena_t* arena);
+
 // Timeout configuration
 typedef struct {
     long connect_timeout_ms;
@@ -78,6 +127,9 @@ typedef struct llm_tls_config {
 // Client creation options (opt-in behaviors).
 typedef struct {
     bool enable_last_error;
+    // Optional allocator copied into the client. Every internal allocation made on behalf of the
+    // client (request bodies, response buffers, tokens, results, SSE state) goes through it.
+    const llm_allocator_t* allocator;
 } llm_client_init_opts_t;
 
 // Model identifier
@@ -98,6 +150,7 @@ typedef enum {
     LLM_ERR_NONE = 0,
     LLM_ERR_CANCELLED,
     LLM_ERR_FAILED,
+    LLM_ERR_INVALID_TOOL_ARGS,  // streamed tool-call arguments are not valid JSON
 } llm_error_t;
 
 typedef enum {
@@ -123,6 +176,7 @@ typedef struct {
     const char* raw_body;
     size_t raw_body_len;
     void* _internal;  // Internal buffer for raw error body
+    llm_allocator_t _allocator;  // Allocator owning _internal
 } llm_error_detail_t;
 
 // Message role
@@ -213,6 +267,7 @@ typedef struct {
     const char* tool_calls_json;  // raw JSON array
     size_t tool_calls_json_len;
     void* _internal;  // Internal buffer for spans
+    llm_allocator_t _allocator;  // Allocator owning result storage
 } llm_chat_result_t;
 
 // Tool call delta (streaming partial)
@@ -246,6 +301,37 @@ typedef struct {
     bool has_total_tokens;
 } llm_usage_t;
 
+enum { LLM_STREAM_STATS_BUCKETS = 112 };
+
+// Timing of one streamed response, filled in when llm_stream_callbacks_t.stats is set. Durations are microseconds
+// on a monotonic clock, counted from the start of the call. A delta is a non-empty content or reasoning delta,
+// timed when it arrives (before any stop-string hold-back); TTFT is the first one. The gaps between consecutive
+// deltas are counted in gap_buckets, a fixed log-linear histogram with four buckets per power of two (see
+// llm_stream_stats_bucket_floor_us), and the percentiles are estimated from it. Nothing is allocated per delta.
+typedef struct {
+    bool has_first_byte;
+    bool has_first_delta;
+    uint64_t first_byte_us;  // first response byte
+    uint64_t ttft_us;        // first delta
+    uint64_t total_us;       // end of the transfer
+    size_t delta_count;
+    uint64_t gap_mean_us;
+    uint64_t gap_p50_us;
+    uint64_t gap_p99_us;
+    uint64_t gap_max_us;
+    double deltas_per_sec;  // deltas after the first, over the time from the first to the last
+    uint32_t gap_buckets[LLM_STREAM_STATS_BUCKETS];
+    // Running state, reset at the start of each call
+    uint64_t _start_ns;
+    uint64_t _first_delta_ns;
+    uint64_t _last_delta_ns;
+    uint64_t _gap_sum_us;
+} llm_stream_stats_t;
+
+// Smallest gap, in microseconds, counted by gap_buckets[bucket]; the bucket ends where the next one starts.
+// The last bucket also takes every longer gap.
+uint64_t llm_stream_stats_bucket_floor_us(size_t bucket);
+
 // Streaming callbacks
 typedef struct {
     void* user_data;
@@ -257,10 +343,33 @@ typedef struct {
     void (*on_usage)(void* user_data, const llm_usage_t* usage);
     void (*on_finish_reason)(void* user_data, llm_finish_reason_t reason);
     bool include_usage;
+    // Optional client-side stop strings (plain, unescaped bytes), enforced on content deltas even when the
+    // backend ignores "stop". Content is cut right before the first match, on_finish_reason reports STOP and
+    // the transfer is aborted; the call still succeeds. Matching content is held back until it can no longer
+    // be part of a stop string, so deltas may be delayed or split differently.
+    const char* const* stop_list;
+    const size_t* stop_lens;
+    size_t stop_count;
+    // Optional timing for the call, valid once it returns (whatever the result). A streaming tool loop reports
+    // its last turn; llm_chat_stream_choices_ex times each choice's deltas against its own callbacks.
+    llm_stream_stats_t* stats;
 } llm_stream_callbacks_t;
 
 typedef bool (*llm_abort_cb)(void* user_data);
 
+// Cancel token: pass llm_cancel_abort_cb as the abort callback and the token as its user data to any call that
+// takes one. Triggering it from another thread makes a blocked streaming transfer return LLM_ERR_CANCELLED right
+// away (the transport waits on the token's fd, not just on incoming bytes) and closes its connection. A token
+// may be shared by several calls; llm_cancel_reset rearms it once none of them is running.
+typedef struct llm_cancel llm_cancel_t;
+llm_cancel_t* llm_cancel_create(void);
+void llm_cancel_destroy(llm_cancel_t* cancel);
+// Thread-safe and idempotent.
+void llm_cancel_trigger(llm_cancel_t* cancel);
+bool llm_cancel_triggered(const llm_cancel_t* cancel);
+void llm_cancel_reset(llm_cancel_t* cancel);
+bool llm_cancel_abort_cb(void* cancel);
+
 // Client creation and destruction
 llm_client_t* llm_client_create_with_headers_opts(const char* base_url, const llm_model_t* model,
                                                   const llm_timeout_t* timeout, const llm_limits_t* limits,
@@ -274,7 +383,14 @@ llm_client_t* llm_client_create(const char* base_url, const llm_model_t* model,
 llm_client_t* llm_client_create_with_headers(const char* base_url, const llm_model_t* model,
                                              const llm_timeout_t* timeout, const llm_limits_t* limits,
                                              const char* const* headers, size_t headers_count);
+// Destroys one handle; configuration shared with contexts is freed with the last of them.
 void llm_client_destroy(llm_client_t* client);
+// Requests only read client configuration, so threads may share one client as long as nobody calls a setter
+// meanwhile and the allocator is thread-safe; last_error is the exception. A context is a cheap handle that
+// shares client's configuration and has its own last_error: one per thread keeps a shared client safe with
+// last_error enabled. Setters on any handle first give it a private copy, so they never affect other handles.
+// Destroy contexts with llm_client_destroy, in any order.
+llm_client_t* llm_client_context_create(const llm_client_t* client);
 // Copies model name into the client; caller must synchronize with in-flight requests.
 bool llm_client_set_model(llm_client_t* client, const llm_model_t* model);
 // Copies api_key into a per-client Authorization header. Pass NULL to clear.
@@ -287,7 +403,7 @@ bool llm_client_set_proxy(llm_client_t* client, const char* proxy_url);
 bool llm_client_set_no_proxy(llm_client_t* client, const char* no_proxy_list);
 // Returns NULL unless last-error storage was enabled at client creation.
 // The pointer is owned by the client and cleared at the start of each request.
-// Not thread-safe with concurrent requests on the same client.
+// Not thread-safe with concurrent requests on the same handle; see llm_client_context_create.
 const llm_error_detail_t* llm_client_last_error(const llm_client_t* client);
 
 // Error detail lifetime: free any owned raw body buffer.
@@ -304,6 +420,7 @@ llm_error_t llm_health_with_headers_ex(llm_client_t* client, const char* const*
                                        llm_error_detail_t* detail);
 
 // Models list (simple string array)
+// The returned array is allocated with libc malloc; release it with llm_models_list_free.
 char** llm_models_list(llm_client_t* client, size_t* count);
 char** llm_models_list_with_headers(llm_client_t* client, size_t* count, const char* const* headers,
                                     size_t headers_count);
@@ -333,6 +450,7 @@ typedef struct {
     llm_completion_choice_t* choices;  // array
     size_t choices_count;
     void* _internal;  // Internal buffer for spans
+    llm_allocator_t _allocator;  // Allocator owning result storage
 } llm_completions_result_t;
 
 typedef struct {
@@ -349,6 +467,7 @@ typedef struct {
     llm_embedding_item_t* data;  // array
     size_t data_count;
     void* _internal;  // Internal buffer for spans
+    llm_allocator_t _allocator;  // Allocator owning result storage
 } llm_embeddings_result_t;
 
 // Completions (non-stream)
@@ -365,6 +484,13 @@ llm_error_t llm_completions_with_headers_ex(llm_client_t* client, const char* pr
                                             const char* const* headers, size_t headers_count,
                                             llm_error_detail_t* detail);
 void llm_completions_free(llm_completions_result_t* result);
+// Arena-backed variant: response body, tokens and choices come from arena instead of the client
+// allocator. The result stays valid until llm_arena_reset; llm_completions_free is optional, and only
+// allowed before that reset.
+// Error details are copied out with the client allocator and do not reference the arena.
+llm_error_t llm_completions_arena_ex(llm_client_t* client, const char* prompt, size_t prompt_len,
+                                     const char* params_json, llm_arena_t* arena, llm_completions_result_t* result,
+                                     const char* const* headers, size_t headers_count, llm_error_detail_t* detail);
 
 // Completions (stream)
 bool llm_completions_stream(llm_client_t* client, const char* prompt, size_t prompt_len, const char* params_json,
@@ -426,6 +552,57 @@ llm_error_t llm_embeddings_with_headers_ex(llm_client_t* client, const llm_embed
                                            llm_embeddings_result_t* result, const char* const* headers,
                                            size_t headers_count, llm_error_detail_t* detail);
 void llm_embeddings_free(llm_embeddings_result_t* result);
+// Arena-backed variant; same lifetime rules as llm_completions_arena_ex.
+llm_error_t llm_embeddings_arena_ex(llm_client_t* client, const llm_embedding_input_t* inputs, size_t inputs_count,
+                                    const char* params_json, llm_arena_t* arena, llm_embeddings_result_t* result,
+                                    const char* const* headers, size_t headers_count, llm_error_detail_t* detail);
+
+// Sharding for llm_embeddings_opts_ex.
+typedef struct {
+    // Inputs per sub-request; the smaller non-zero of this and limits.max_embedding_inputs applies.
+    size_t max_inputs_per_request;
+    size_t max_parallel_requests;  // sub-requests in flight at once; 0 means 1
+    // Optional, inputs_count entries: LLM_ERR_FAILED for every input whose sub-request failed.
+    llm_error_t* input_errors;
+} llm_embeddings_opts_t;
+
+// Splits inputs into sub-requests that respect the client limits, runs them concurrently over pooled
+// connections and merges the embeddings back in input order. An input over max_embedding_input_bytes is sent
+// on its own, so it fails alone. When some sub-requests fail, result still covers every input, with empty
+// entries at failed indices, and detail describes the first failed sub-request in input order. opts NULL is
+// llm_embeddings_with_headers_ex.
+llm_error_t llm_embeddings_opts_ex(llm_client_t* client, const llm_embedding_input_t* inputs, size_t inputs_count,
+                                   const char* params_json, llm_embeddings_result_t* result,
+                                   const char* const* headers, size_t headers_count,
+                                   const llm_embeddings_opts_t* opts, llm_error_detail_t* detail);
+
+typedef enum {
+    LLM_EMBEDDING_ENCODING_FLOAT = 0,  // JSON number arrays
+    LLM_EMBEDDING_ENCODING_BASE64,     // base64 of little-endian float32, ~4x smaller on the wire
+} llm_embedding_encoding_t;
+
+// Decodes one embedding span (JSON number array or base64 float32 string) into out.
+// out_dims receives the vector length; pass out == NULL to size without writing.
+bool llm_embedding_decode_f32(const char* span, size_t span_len, float* out, size_t out_cap, size_t* out_dims);
+
+// Embeddings decoded straight into a caller-provided row-major matrix: row i is inputs[i].
+// Every vector must have the same length; out_dims receives it. Fails if inputs_count * dims > out_cap.
+llm_error_t llm_embeddings_f32_ex(llm_client_t* client, const llm_embedding_input_t* inputs, size_t inputs_count,
+                                  const char* params_json, llm_embedding_encoding_t encoding, float* out,
+                                  size_t out_cap, size_t* out_dims, const char* const* headers, size_t headers_count,
+                                  llm_error_detail_t* detail);
+
+// Called once per returned vector, in response order. index is data[i].index when present, else the
+// position in data[]. vector points into the caller's row buffer and is overwritten by the next call.
+// Return false to cancel.
+typedef bool (*llm_embedding_vector_cb)(void* user_data, size_t index, const float* vector, size_t dims);
+
+// Streams the embeddings response instead of buffering it: each vector is decoded into row (row_cap floats)
+// as bytes arrive and handed to on_vector, so memory stays bounded by one vector however large the batch.
+llm_error_t llm_embeddings_stream_ex(llm_client_t* client, const llm_embedding_input_t* inputs, size_t inputs_count,
+                                     const char* params_json, llm_embedding_encoding_t encoding, float* row,
+                                     size_t row_cap, llm_embedding_vector_cb on_vector, void* user_data,
+                                     const char* const* headers, size_t headers_count, llm_error_detail_t* detail);
 
 // Chat non-stream
 bool llm_chat(llm_client_t* client, const llm_message_t* messages, size_t messages_count,
@@ -444,7 +621,36 @@ llm_error_t llm_chat_with_headers_ex(llm_client_t* client, const llm_message_t*
                                      const char* response_format_json, llm_chat_result_t* result,
                                      const char* const* headers, size_t headers_count, llm_error_detail_t* detail);
 void llm_chat_result_free(llm_chat_result_t* result);
+// Arena-backed variant; same lifetime rules as llm_completions_arena_ex.
+llm_error_t llm_chat_arena_ex(llm_client_t* client, const llm_message_t* messages, size_t messages_count,
+                              const char* params_json, const char* tooling_json, const char* response_format_json,
+                              llm_arena_t* arena, llm_chat_result_t* result, const char* const* headers,
+                              size_t headers_count, llm_error_detail_t* detail);
 bool llm_chat_choice_get(const llm_chat_result_t* result, size_t index, const llm_chat_choice_t** out_choice);
+
+// One independent request of a chat batch; fields mean what they do for llm_chat_ex.
+typedef struct {
+    const llm_message_t* messages;
+    size_t messages_count;
+    const char* params_json;           // optional
+    const char* tooling_json;          // optional
+    const char* response_format_json;  // optional
+} llm_chat_batch_request_t;
+
+typedef struct {
+    llm_error_t error;
+    llm_chat_result_t result;   // valid when error == LLM_ERR_NONE
+    llm_error_detail_t detail;  // filled when error != LLM_ERR_NONE
+} llm_chat_batch_result_t;
+
+// Runs count independent chat requests from the calling thread with at most concurrency in flight (0 means
+// 1), reusing pooled connections across requests. Request bodies are built as slots free up, so memory tracks
+// concurrency rather than count. results[i] always reports requests[i], whatever order responses arrive in.
+// Returns LLM_ERR_NONE when every request succeeded and LLM_ERR_FAILED otherwise; last_error then describes
+// the last failure to complete. Free results with llm_chat_batch_results_free.
+llm_error_t llm_chat_batch_ex(llm_client_t* client, const llm_chat_batch_request_t* requests, size_t count,
+                              size_t concurrency, llm_chat_batch_result_t* results);
+void llm_chat_batch_results_free(llm_chat_batch_result_t* results, size_t count);
 bool llm_completions_choice_get(const llm_completions_result_t* result, size_t index,
                                 const llm_completion_choice_t** out_choice);
 
@@ -505,11 +711,49 @@ llm_error_t llm_chat_stream_choice_with_headers_detail_ex(llm_client_t* client,
                                                           llm_abort_cb abort_cb, void* abort_user_data,
                                                           const char* const* headers, size_t headers_count,
                                                           llm_error_detail_t* detail);
+// Multi-choice stream (request n > 1 through params_json): every choice in each chunk is routed to
+// choice_callbacks[index], and each choice keeps its own tool-call accumulators, stop strings and finish
+// reason, so n samples cost one request and one prompt evaluation. Choices at or beyond choices_count are
+// ignored. include_usage is taken from choice_callbacks[0], which also receives on_usage. A stop string
+// ends only its own choice; the transfer is cut once every choice has stopped.
+llm_error_t llm_chat_stream_choices_ex(llm_client_t* client, const llm_message_t* messages, size_t messages_count,
+                                       const char* params_json, const char* tooling_json,
+                                       const char* response_format_json, const llm_stream_callbacks_t* choice_callbacks,
+                                       size_t choices_count, llm_abort_cb abort_cb, void* abort_user_data,
+                                       const char* const* headers, size_t headers_count, llm_error_detail_t* detail);
 
 // Tool loop runner
+// result_json is owned by the caller's allocation scheme: it must be malloc-compatible and is released with free().
 typedef bool (*llm_tool_dispatch_cb)(void* user_data, const char* tool_name, size_t name_len, const char* args_json,
                                      size_t args_len, char** result_json, size_t* result_len);
 
+// Tool loop counters, filled in when the loop returns.
+typedef struct {
+    size_t dispatches;    // calls handed to dispatch
+    size_t cache_hits;    // calls answered from the result cache instead
+    size_t cache_misses;  // cacheable calls that had to be dispatched
+} llm_tool_loop_stats_t;
+
+// Tool loop options (opt-in behaviors).
+typedef struct {
+    // Run up to this many tool calls of one turn at once on worker threads; dispatch must then be safe to
+    // call concurrently. Results still enter history in call order and max_tool_output_bytes_total is
+    // checked in that order. 0 or 1 dispatches sequentially on the calling thread (the streaming loop uses
+    // one helper thread).
+    size_t max_parallel_dispatch;
+    // Memoize results of idempotent tools for the rest of the run. Only tools named in cacheable_tools
+    // qualify; a later call with the same name and equivalent arguments (whitespace and object key order are
+    // ignored) is answered with the stored result, without dispatch. Up to cache_max_entries results are
+    // kept, oldest evicted first; 0 disables the cache. The names are borrowed for the duration of the run.
+    const char* const* cacheable_tools;
+    size_t cacheable_tools_count;
+    size_t cache_max_entries;
+    llm_tool_loop_stats_t* stats;  // optional
+} llm_tool_loop_opts_t;
+
+// The tool loops borrow initial_messages instead of copying them: every string they reference must stay valid
+// and unchanged until the call returns. Messages the loop generates live in a per-run arena that is released
+// on return, so memory per run follows the generated content, not the size of the seed conversation.
 bool llm_tool_loop_run(llm_client_t* client, const llm_message_t* initial_messages, size_t initial_count,
                        const char* params_json, const char* tooling_json, const char* response_format_json,
                        llm_tool_dispatch_cb dispatch, void* dispatch_user_data, size_t max_turns);
@@ -526,6 +770,44 @@ llm_error_t llm_tool_loop_run_with_headers_ex(llm_client_t* client, const llm_me
                                               const char* response_format_json, llm_tool_dispatch_cb dispatch,
                                               void* dispatch_user_data, llm_abort_cb abort_cb, void* abort_user_data,
                                               size_t max_turns, const char* const* headers, size_t headers_count);
+// Streaming tool loop: each turn is streamed and every tool call is dispatched as soon as its arguments close,
+// while the model is still generating the remaining calls. Results are appended to history in call order.
+// callbacks (optional) receive the streamed deltas too; their stop strings and include_usage apply to every
+// turn, and their on_tool_args_complete fires as each call closes rather than at finish_reason.
+//
+// Threading and timing: dispatch runs on a helper thread owned by the loop, never on the thread delivering the
+// stream (unless no thread can be started at all), so a slow tool does not hold up the transfer or trip its
+// idle timeout. Calls run one at a time in the order they close unless max_parallel_dispatch allows more;
+// they overlap the stream, so dispatch must not use the client. Calls of the last allowed turn, and calls
+// that so far match a recent turn the loop guard would refuse as a repeat (by name and arguments, ignoring
+// whitespace and key order), are held until the turn ends and run only if the loop accepts it. Because other
+// calls run before finish_reason is known, a turn that ends in anything but tool_calls may already have run
+// some of its tools; their results are dropped with the turn.
+llm_error_t llm_tool_loop_run_stream_ex(llm_client_t* client, const llm_message_t* initial_messages,
+                                        size_t initial_count, const char* params_json, const char* tooling_json,
+                                        const char* response_format_json, const llm_stream_callbacks_t* callbacks,
+                                        llm_tool_dispatch_cb dispatch, void* dispatch_user_data, llm_abort_cb abort_cb,
+                                        void* abort_user_data, size_t max_turns);
+llm_error_t llm_tool_loop_run_stream_with_headers_ex(llm_client_t* client, const llm_message_t* initial_messages,
+                                                     size_t initial_count, const char* params_json,
+                                                     const char* tooling_json, const char* response_format_json,
+                                                     const llm_stream_callbacks_t* callbacks,
+                                                     llm_tool_dispatch_cb dispatch, void* dispatch_user_data,
+                                                     llm_abort_cb abort_cb, void* abort_user_data, size_t max_turns,
+                                                     const char* const* headers, size_t headers_count);
+llm_error_t llm_tool_loop_run_opts(llm_client_t* client, const llm_message_t* initial_messages, size_t initial_count,
+                                   const char* params_json, const char* tooling_json, const char* response_format_json,
+                                   llm_tool_dispatch_cb dispatch, void* dispatch_user_data, llm_abort_cb abort_cb,
+                                   void* abort_user_data, size_t max_turns, const char* const* headers,
+                                   size_t headers_count, const llm_tool_loop_opts_t* opts);
+// As llm_tool_loop_run_stream_with_headers_ex; max_parallel_dispatch sets how many calls run at once.
+llm_error_t llm_tool_loop_run_stream_opts(llm_client_t* client, const llm_message_t* initial_messages,
+                                          size_t initial_count, const char* params_json, const char* tooling_json,
+                                          const char* response_format_json, const llm_stream_callbacks_t* callbacks,
+                                          llm_tool_dispatch_cb dispatch, void* dispatch_user_data,
+                                          llm_abort_cb abort_cb, void* abort_user_data, size_t max_turns,
+                                          const char* const* headers, size_t headers_count,
+                                          const llm_tool_loop_opts_t* opts);
 
 // Utility functions
 llm_finish_reason_t llm_finish_reason_from_string(const char* str, size_t len);
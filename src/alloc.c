@@ -0,0 +1,179 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "llm/internal.h"
+#include "llm/llm.h"
+
+// Each block carries its size in a max-aligned header so frees can be accounted.
+#define COUNTING_HEADER_SIZE (sizeof(max_align_t) > sizeof(size_t) ? sizeof(max_align_t) : sizeof(size_t))
+#define ARENA_ALIGN _Alignof(max_align_t)
+#define ARENA_NO_LAST SIZE_MAX
+
+static bool counting_reserve(llm_counting_allocator_t* c, size_t old_size, size_t new_size) {
+    size_t live = c->live_bytes - old_size;
+    if (new_size > SIZE_MAX - COUNTING_HEADER_SIZE) return false;
+    if (c->max_live_bytes && (new_size > c->max_live_bytes || live > c->max_live_bytes - new_size)) return false;
+    return true;
+}
+
+static void counting_commit(llm_counting_allocator_t* c, size_t old_size, size_t new_size) {
+    c->live_bytes = c->live_bytes - old_size + new_size;
+    if (new_size > old_size) c->total_bytes += new_size - old_size;
+    if (c->live_bytes > c->peak_bytes) c->peak_bytes = c->live_bytes;
+}
+
+static void* counting_alloc(void* user_data, size_t size) {
+    llm_counting_allocator_t* c = user_data;
+    c->alloc_calls++;
+    if (!counting_reserve(c, 0, size)) {
+        c->failed_calls++;
+        return NULL;
+    }
+    unsigned char* block = mem_alloc(&c->backing, COUNTING_HEADER_SIZE + size);
+    if (!block) {
+        c->failed_calls++;
+        return NULL;
+    }
+    memcpy(block, &size, sizeof(size));
+    c->live_allocs++;
+    counting_commit(c, 0, size);
+    return block + COUNTING_HEADER_SIZE;
+}
+
+static void* counting_realloc(void* user_data, void* ptr, size_t size) {
+    llm_counting_allocator_t* c = user_data;
+    if (!ptr) {
+        void* p = counting_alloc(user_data, size);
+        if (p) {
+            c->alloc_calls--;
+            c->realloc_calls++;
+        }
+        return p;
+    }
+    c->realloc_calls++;
+    unsigned char* block = (unsigned char*)ptr - COUNTING_HEADER_SIZE;
+    size_t old_size;
+    memcpy(&old_size, block, sizeof(old_size));
+    if (!counting_reserve(c, old_size, size)) {
+        c->failed_calls++;
+        return NULL;
+    }
+    unsigned char* next = mem_realloc(&c->backing, block, COUNTING_HEADER_SIZE + size);
+    if (!next) {
+        c->failed_calls++;
+        return NULL;
+    }
+    memcpy(next, &size, sizeof(size));
+    counting_commit(c, old_size, size);
+    return next + COUNTING_HEADER_SIZE;
+}
+
+static void counting_free(void* user_data, void* ptr) {
+    llm_counting_allocator_t* c = user_data;
+    if (!ptr) return;
+    unsigned char* block = (unsigned char*)ptr - COUNTING_HEADER_SIZE;
+    size_t size;
+    memcpy(&size, block, sizeof(size));
+    c->free_calls++;
+    c->live_allocs--;
+    c->live_bytes -= size;
+    mem_free(&c->backing, block);
+}
+
+void llm_counting_allocator_init(llm_counting_allocator_t* counter, const llm_allocator_t* backing,
+                                 size_t max_live_bytes) {
+    if (!counter) return;
+    memset(counter, 0, sizeof(*counter));
+    if (backing) counter->backing = *backing;
+    counter->max_live_bytes = max_live_bytes;
+}
+
+llm_allocator_t llm_counting_allocator(llm_counting_allocator_t* counter) {
+    llm_allocator_t a = {counting_alloc, counting_realloc, counting_free, counter};
+    return a;
+}
+
+// Arena blocks reuse the counting header layout: [size][pad][payload], payload max-aligned.
+static bool arena_place(const llm_arena_t* arena, size_t size, size_t* out_hdr) {
+    uintptr_t base = (uintptr_t)arena->base;
+    uintptr_t top = base + arena->used;
+    uintptr_t payload = (top + COUNTING_HEADER_SIZE + (ARENA_ALIGN - 1)) & ~(uintptr_t)(ARENA_ALIGN - 1);
+    if (payload < top) return false;
+    size_t hdr = (size_t)(payload - base) - COUNTING_HEADER_SIZE;
+    if (hdr > arena->cap || arena->cap - hdr < COUNTING_HEADER_SIZE) return false;
+    if (size > arena->cap - hdr - COUNTING_HEADER_SIZE) return false;
+    *out_hdr = hdr;
+    return true;
+}
+
+static void arena_commit(llm_arena_t* arena, size_t hdr, size_t size) {
+    memcpy(arena->base + hdr, &size, sizeof(size));
+    arena->used = hdr + COUNTING_HEADER_SIZE + size;
+    arena->last = hdr;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+}
+
+static void* arena_alloc(void* user_data, size_t size) {
+    llm_arena_t* arena = user_data;
+    size_t hdr;
+    if (!arena->base || !arena_place(arena, size, &hdr)) {
+        arena->failed_calls++;
+        return NULL;
+    }
+    arena_commit(arena, hdr, size);
+    return arena->base + hdr + COUNTING_HEADER_SIZE;
+}
+
+static void* arena_realloc(void* user_data, void* ptr, size_t size) {
+    llm_arena_t* arena = user_data;
+    if (!ptr) return arena_alloc(user_data, size);
+    size_t hdr = (size_t)((unsigned char*)ptr - arena->base) - COUNTING_HEADER_SIZE;
+    size_t old_size;
+    memcpy(&old_size, arena->base + hdr, sizeof(old_size));
+    if (hdr == arena->last) {
+        // Top block grows or shrinks in place.
+        if (size > arena->cap - hdr - COUNTING_HEADER_SIZE) {
+            arena->failed_calls++;
+            return NULL;
+        }
+        arena_commit(arena, hdr, size);
+        return ptr;
+    }
+    if (size <= old_size) return ptr;
+    void* next = arena_alloc(user_data, size);
+    if (!next) return NULL;
+    memcpy(next, ptr, old_size);
+    return next;
+}
+
+static void arena_free(void* user_data, void* ptr) {
+    llm_arena_t* arena = user_data;
+    if (!ptr) return;
+    size_t hdr = (size_t)((unsigned char*)ptr - arena->base) - COUNTING_HEADER_SIZE;
+    // Only the most recent block is reclaimed; everything else waits for llm_arena_reset. A block from before
+    // a reset cannot be told apart from a live one at the same offset, which is why llm.h forbids freeing it.
+    if (hdr == arena->last) {
+        arena->used = hdr;
+        arena->last = ARENA_NO_LAST;
+    }
+}
+
+void llm_arena_init(llm_arena_t* arena, void* buf, size_t cap) {
+    if (!arena) return;
+    memset(arena, 0, sizeof(*arena));
+    arena->base = buf;
+    arena->cap = buf ? cap : 0;
+    arena->last = ARENA_NO_LAST;
+}
+
+void llm_arena_reset(llm_arena_t* arena) {
+    if (!arena) return;
+    arena->used = 0;
+    arena->last = ARENA_NO_LAST;
+}
+
+llm_allocator_t llm_arena_allocator(llm_arena_t* arena) {
+    llm_allocator_t a = {arena_alloc, arena_realloc, arena_free, arena};
+    return a;
+}
@@ -1,15 +1,87 @@
+#define _GNU_SOURCE
 #include "http1_server.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
+#if defined(DESI_HTTP_IO_URING) && defined(__linux__)
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+// Multishot accept and provided buffer rings came with 5.19; the headers of 6.0 are the first with both.
+#if defined(IORING_ACCEPT_MULTISHOT) && defined(IORING_RECV_MULTISHOT) && defined(IORING_POLL_ADD_MULTI)
+#define DESI_HAVE_URING 1
+#endif
+#endif
 
-enum { DESI_HTTP_MAX_HEADER_BYTES = 8192 };
+#include "../sse.h"
+
+enum {
+    DESI_HTTP_MAX_HEADER_BYTES = 8192,
+    DESI_HTTP_DEFAULT_HEADER_TIMEOUT_MS = 10000,
+    DESI_HTTP_DEFAULT_MAX_REQUESTS = 1000,
+    DESI_HTTP_DEFAULT_MAX_BODY_BYTES = 1024 * 1024,
+    DESI_HTTP_MAX_HEADERS = 64,
+    DESI_HTTP_MAX_CHUNK_LINE = 4096,
+    DESI_HTTP_BODY_PIECE = 16384,
+    DESI_MAX_CPUS = 1024,
+    DESI_EPOLL_BATCH = 256,
+    DESI_WHEEL_SLOTS = 256,
+    DESI_WHEEL_TICK_MS = 50,
+    DESI_STREAM_HIGH_WATER = 64 * 1024,
+    DESI_STREAM_MAX_WRITE = 1 << 30,
+    DESI_STREAM_CHUNK_HEAD = 10,  // "%08zx\r\n"
+};
+
+// Wakes a worker for streams written on other threads: producers push onto pending and signal fd.
+struct desi_wake {
+    int fd;  // eventfd in the worker's epoll set
+    pthread_mutex_t mu;
+    desi_http_stream_t* pending;
+};
+
+struct desi_conn;
+
+struct desi_http_stream {
+    pthread_mutex_t mu;
+    pthread_cond_t drained;
+    bool chunked;  // fixed at creation by the request's version
+    // Everything below is guarded by mu.
+    int refs;                // the producer's, the connection's and one while on wake->pending
+    struct desi_conn* conn;  // set once the head is queued, cleared when the connection lets go
+    struct desi_wake* wake;
+    char* buf;  // queued body bytes, chunk framing included, not yet handed to the connection
+    size_t len;
+    size_t cap;
+    bool idle;  // the connection has sent everything and waits for a wake-up
+    bool finished;
+    bool truncated;  // the end of the body could not be queued; the connection closes instead
+    bool closed;
+    bool busy;  // someone was refused or waits since the queue last drained
+    desi_http_stream_t* wake_next;
+    void (*on_drain)(void* user_data, desi_http_stream_t* stream);
+    void* drain_user_data;
+};
 
 static const char* desi_reason_phrase(int status) {
     switch (status) {
@@ -23,6 +95,8 @@ static const char* desi_reason_phrase(int status) {
             return "Method Not Allowed";
         case 413:
             return "Payload Too Large";
+        case 431:
+            return "Request Header Fields Too Large";
         case 500:
             return "Internal Server Error";
         default:
@@ -30,25 +104,29 @@ static const char* desi_reason_phrase(int status) {
     }
 }
 
-static int desi_write_all(int fd, const char* buf, size_t len) {
-    size_t off = 0;
-    while (off < len) {
-        ssize_t wrote = send(fd, buf + off, len - off, 0);
-        if (wrote < 0) {
-            if (errno == EINTR) continue;
-            return -1;
-        }
-        if (wrote == 0) return -1;
-        off += (size_t)wrote;
-    }
-    return 0;
+static int desi_format_head(char* dst, size_t cap, int status, const char* content_type, const char* framing,
+                            const char* headers, bool keep_alive) {
+    return snprintf(dst, cap,
+                    "HTTP/1.1 %d %s\r\n"
+                    "%s%s%s%s%s"
+                    "Connection: %s\r\n"
+                    "\r\n",
+                    status, desi_reason_phrase(status), content_type ? "Content-Type: " : "",
+                    content_type ? content_type : "", content_type ? "\r\n" : "", framing, headers,
+                    keep_alive ? "keep-alive" : "close");
 }
 
-static int desi_send_response(int fd, const desi_http_resp_t* resp) {
-    const char* body = resp->body;
-    size_t body_len = resp->body_len;
+// Formats the response head, followed by a copy of the body unless copy_body is false, into one buffer, so the
+// handler's body only has to live until the handler returns and a partial write can resume anywhere. An uncopied
+// body (static) or a streamed one follows the head on its own.
+static int desi_format_response(const desi_http_resp_t* resp, bool keep_alive, bool copy_body, char** out,
+                                size_t* out_len) {
+    const desi_http_stream_t* stream = resp->stream;
+    const char* body = stream ? NULL : resp->body;
+    size_t body_len = stream ? 0 : resp->body_len;
     int status = resp->status;
     const char* content_type = resp->content_type;
+    const char* headers = resp->headers ? resp->headers : "";
     static const char k_default_type[] = "text/plain; charset=utf-8";
     static const char k_internal_body[] = "Internal Server Error\n";
 
@@ -58,43 +136,42 @@ static int desi_send_response(int fd, const desi_http_resp_t* resp) {
         body = k_internal_body;
         body_len = sizeof(k_internal_body) - 1;
         content_type = k_default_type;
+        headers = "";
     }
-    if (body_len > 0 && content_type == NULL) {
+    if (body_len == 0 && !stream) {
+        content_type = NULL;
+    } else if (content_type == NULL) {
         content_type = k_default_type;
     }
 
-    char header[512];
-    int header_len = 0;
-    if (body_len > 0 && content_type) {
-        header_len = snprintf(header, sizeof(header),
-                              "HTTP/1.1 %d %s\r\n"
-                              "Content-Type: %s\r\n"
-                              "Content-Length: %zu\r\n"
-                              "Connection: close\r\n"
-                              "\r\n",
-                              status, desi_reason_phrase(status), content_type, body_len);
+    char length[48];
+    const char* framing = length;
+    if (stream) {
+        framing = stream->chunked ? "Transfer-Encoding: chunked\r\n" : "";
     } else {
-        header_len = snprintf(header, sizeof(header),
-                              "HTTP/1.1 %d %s\r\n"
-                              "Content-Length: %zu\r\n"
-                              "Connection: close\r\n"
-                              "\r\n",
-                              status, desi_reason_phrase(status), body_len);
-    }
-    if (header_len < 0 || (size_t)header_len >= sizeof(header)) return -1;
-    if (desi_write_all(fd, header, (size_t)header_len) != 0) return -1;
-    if (body_len > 0) {
-        return desi_write_all(fd, body, body_len);
+        snprintf(length, sizeof(length), "Content-Length: %zu\r\n", body_len);
     }
+    int header_len = desi_format_head(NULL, 0, status, content_type, framing, headers, keep_alive);
+    if (header_len < 0) return -1;
+    if (body_len > SIZE_MAX - (size_t)header_len - 1) return -1;
+    size_t copied = copy_body ? body_len : 0;
+    char* buf = malloc((size_t)header_len + 1 + copied);
+    if (!buf) return -1;
+    desi_format_head(buf, (size_t)header_len + 1, status, content_type, framing, headers, keep_alive);
+    if (copied > 0) memcpy(buf + header_len, body, copied);
+    *out = buf;
+    *out_len = (size_t)header_len + copied;
     return 0;
 }
 
+// Finds the end of the line starting at start: LF, CRLF or a bare CR. memchr finds the LF and bounds the search
+// for an earlier CR, so a line is scanned with the C library's vectorized loops, not byte by byte.
 static bool desi_next_line(const char* buf, size_t len, size_t start, size_t* line_end, size_t* next) {
-    size_t i = start;
-    while (i < len && buf[i] != '\n' && buf[i] != '\r') {
-        i++;
-    }
-    if (i == len) return false;
+    const char* lf = memchr(buf + start, '\n', len - start);
+    size_t limit = lf ? (size_t)(lf - buf) : len;
+    const char* cr = memchr(buf + start, '\r', limit - start);
+    if (!cr && !lf) return false;
+    size_t i = cr ? (size_t)(cr - buf) : limit;
     *line_end = i;
     i++;
     if (buf[*line_end] == '\r' && i < len && buf[i] == '\n') {
@@ -104,24 +181,8 @@ static bool desi_next_line(const char* buf, size_t len, size_t start, size_t* li
     return true;
 }
 
-static bool desi_find_header_end(const char* buf, size_t len, size_t* header_end) {
-    size_t pos = 0;
-    size_t line_end = 0;
-    size_t next = 0;
-    while (desi_next_line(buf, len, pos, &line_end, &next)) {
-        if (line_end == pos) {
-            *header_end = next;
-            return true;
-        }
-        pos = next;
-    }
-    return false;
-}
-
-static int desi_parse_request_line(const char* buf, size_t len, desi_http_req_t* req) {
-    size_t line_end = 0;
-    size_t next = 0;
-    if (!desi_next_line(buf, len, 0, &line_end, &next)) return -1;
+// Splits the request line, without its terminator, into method and path.
+static int desi_parse_request_line(const char* buf, size_t line_end, desi_http_req_t* req) {
     size_t method_end = 0;
     while (method_end < line_end && buf[method_end] != ' ') {
         method_end++;
@@ -138,61 +199,1158 @@ static int desi_parse_request_line(const char* buf, size_t len, desi_http_req_t*
     req->method_len = method_end;
     req->path = buf + path_start;
     req->path_len = path_end - path_start;
+    req->http11 = line_end - path_end - 1 == 8 && memcmp(buf + path_end + 1, "HTTP/1.1", 8) == 0;
     return 0;
 }
 
-static int desi_read_request(int fd, char* buf, size_t cap, size_t* out_header_end) {
-    size_t len = 0;
-    while (len < cap) {
-        size_t header_end = 0;
-        if (desi_find_header_end(buf, len, &header_end)) {
-            *out_header_end = header_end;
-            return 0;
+static bool desi_header_name_is(const char* name, size_t len, const char* want) {
+    return strlen(want) == len && strncasecmp(name, want, len) == 0;
+}
+
+// Whether a comma-separated header value lists token, ignoring case and surrounding whitespace.
+static bool desi_header_has_token(const char* value, size_t len, const char* token) {
+    size_t token_len = strlen(token);
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && (value[i] == ' ' || value[i] == '\t' || value[i] == ',')) i++;
+        size_t start = i;
+        while (i < len && value[i] != ',') i++;
+        size_t end = i;
+        while (end > start && (value[end - 1] == ' ' || value[end - 1] == '\t')) end--;
+        if (end - start == token_len && strncasecmp(value + start, token, token_len) == 0) return true;
+    }
+    return false;
+}
+
+const desi_http_header_t* desi_http_req_header(const desi_http_req_t* req, const char* name) {
+    for (size_t i = 0; i < req->header_count; i++) {
+        if (desi_header_name_is(req->headers[i].name, req->headers[i].name_len, name)) return &req->headers[i];
+    }
+    return NULL;
+}
+
+// Splits a header line, without its terminator, into name and trimmed value. Folded (obsolete) continuation
+// lines are malformed.
+static int desi_parse_header_line(const char* line, size_t len, desi_http_header_t* header) {
+    const char* end = line + len;
+    const char* colon = memchr(line, ':', len);
+    if (!colon || colon == line || line[0] == ' ' || line[0] == '\t') return -1;
+    if (colon[-1] == ' ' || colon[-1] == '\t') return -1;
+    const char* value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    *header = (desi_http_header_t){line, (size_t)(colon - line), value, (size_t)(end - value)};
+    return 0;
+}
+
+// Whether the connection may stay open after answering this request. HTTP/1.1 persists unless the client
+// sends "Connection: close"; HTTP/1.0 only with "Connection: keep-alive".
+static bool desi_request_keep_alive(const desi_http_req_t* req) {
+    bool keep_alive = req->http11;
+    for (size_t i = 0; i < req->header_count; i++) {
+        const desi_http_header_t* h = &req->headers[i];
+        if (!desi_header_name_is(h->name, h->name_len, "connection")) continue;
+        if (desi_header_has_token(h->value, h->value_len, "close")) return false;
+        if (desi_header_has_token(h->value, h->value_len, "keep-alive")) keep_alive = true;
+    }
+    return keep_alive;
+}
+
+enum desi_body_framing { DESI_BODY_NONE, DESI_BODY_LENGTH, DESI_BODY_CHUNKED };
+
+// How the request body is delimited. Returns -1 for framing that cannot be trusted: a transfer coding other
+// than plain chunked, Transfer-Encoding together with Content-Length, or malformed or conflicting lengths.
+static int desi_body_framing(const desi_http_req_t* req, enum desi_body_framing* framing, uint64_t* length) {
+    *framing = DESI_BODY_NONE;
+    *length = 0;
+    bool has_length = false;
+    for (size_t i = 0; i < req->header_count; i++) {
+        const desi_http_header_t* h = &req->headers[i];
+        if (desi_header_name_is(h->name, h->name_len, "transfer-encoding")) {
+            if (*framing == DESI_BODY_CHUNKED || !desi_header_name_is(h->value, h->value_len, "chunked")) return -1;
+            *framing = DESI_BODY_CHUNKED;
+        } else if (desi_header_name_is(h->name, h->name_len, "content-length")) {
+            if (h->value_len == 0 || h->value_len > 18) return -1;
+            uint64_t value = 0;
+            for (size_t j = 0; j < h->value_len; j++) {
+                if (h->value[j] < '0' || h->value[j] > '9') return -1;
+                value = value * 10 + (uint64_t)(h->value[j] - '0');
+            }
+            if (has_length && value != *length) return -1;
+            has_length = true;
+            *length = value;
+        }
+    }
+    if (*framing == DESI_BODY_CHUNKED) return has_length ? -1 : 0;
+    if (has_length && *length > 0) *framing = DESI_BODY_LENGTH;
+    return 0;
+}
+
+static int desi_hex_digit(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+// Parses a chunk-size line; chunk extensions are ignored.
+static int desi_parse_chunk_size(const char* line, size_t len, uint64_t* size) {
+    uint64_t value = 0;
+    size_t i = 0;
+    for (; i < len && desi_hex_digit(line[i]) >= 0; i++) {
+        if (i == 15) return -1;
+        value = value * 16 + (uint64_t)desi_hex_digit(line[i]);
+    }
+    if (i == 0) return -1;
+    while (i < len && (line[i] == ' ' || line[i] == '\t')) i++;
+    if (i < len && line[i] != ';') return -1;
+    *size = value;
+    return 0;
+}
+
+desi_http_stream_t* desi_http_resp_stream(const desi_http_req_t* req, desi_http_resp_t* resp) {
+    if (!req || !resp) return NULL;
+    desi_http_stream_t* s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    pthread_condattr_t attr;
+    if (pthread_condattr_init(&attr) != 0) {
+        free(s);
+        return NULL;
+    }
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int rc = pthread_cond_init(&s->drained, &attr);
+    pthread_condattr_destroy(&attr);
+    if (rc != 0) {
+        free(s);
+        return NULL;
+    }
+    if (pthread_mutex_init(&s->mu, NULL) != 0) {
+        pthread_cond_destroy(&s->drained);
+        free(s);
+        return NULL;
+    }
+    s->chunked = req->http11;
+    s->refs = 2;
+    resp->stream = s;
+    return s;
+}
+
+static void desi_stream_unref(desi_http_stream_t* s) {
+    pthread_mutex_lock(&s->mu);
+    bool last = --s->refs == 0;
+    pthread_mutex_unlock(&s->mu);
+    if (!last) return;
+    pthread_cond_destroy(&s->drained);
+    pthread_mutex_destroy(&s->mu);
+    free(s->buf);
+    free(s);
+}
+
+// Hands the stream to its connection's worker if the connection is waiting for more. Called with mu held.
+static void desi_stream_notify(desi_http_stream_t* s) {
+    if (!s->wake || !s->idle) return;
+    s->idle = false;
+    s->refs++;
+    struct desi_wake* wake = s->wake;
+    pthread_mutex_lock(&wake->mu);
+    bool first = wake->pending == NULL;
+    s->wake_next = wake->pending;
+    wake->pending = s;
+    pthread_mutex_unlock(&wake->mu);
+    if (!first) return;
+    uint64_t one = 1;
+    ssize_t n;
+    do {
+        n = write(wake->fd, &one, sizeof(one));
+    } while (n < 0 && errno == EINTR);
+}
+
+// Whether a write may be queued now, as a DESI_STREAM_* code. Called with mu held.
+static int desi_stream_writable(desi_http_stream_t* s) {
+    if (s->closed) return DESI_STREAM_CLOSED;
+    if (s->finished) return DESI_STREAM_ERROR;
+    if (s->len >= DESI_STREAM_HIGH_WATER) {
+        s->busy = true;
+        return DESI_STREAM_BUSY;
+    }
+    return DESI_STREAM_OK;
+}
+
+// Makes room for extra more queued bytes. Called with mu held.
+static bool desi_stream_reserve(desi_http_stream_t* s, size_t extra) {
+    if (extra <= s->cap - s->len) return true;
+    if (extra > SIZE_MAX / 4 - s->len) return false;
+    size_t cap = s->cap ? s->cap : 1024;
+    while (cap - s->len < extra) cap *= 2;
+    char* buf = realloc(s->buf, cap);
+    if (!buf) return false;
+    s->buf = buf;
+    s->cap = cap;
+    return true;
+}
+
+// Queues the payload already placed past the end of the queue, after room for its chunk head. Chunk sizes have
+// a fixed width, so a payload can be formatted in place before its size is known. Called with mu held.
+static void desi_stream_commit(desi_http_stream_t* s, size_t payload) {
+    if (s->chunked) {
+        char head[DESI_STREAM_CHUNK_HEAD + 1];
+        snprintf(head, sizeof(head), "%08zx\r\n", payload);
+        memcpy(s->buf + s->len, head, DESI_STREAM_CHUNK_HEAD);
+        memcpy(s->buf + s->len + DESI_STREAM_CHUNK_HEAD + payload, "\r\n", 2);
+        s->len += DESI_STREAM_CHUNK_HEAD + payload + 2;
+    } else {
+        s->len += payload;
+    }
+    desi_stream_notify(s);
+}
+
+int desi_http_stream_write(desi_http_stream_t* s, const char* data, size_t len) {
+    if (!s || (len > 0 && !data) || len > DESI_STREAM_MAX_WRITE) return DESI_STREAM_ERROR;
+    pthread_mutex_lock(&s->mu);
+    int rc = desi_stream_writable(s);
+    // An empty chunk would end the body.
+    if (rc == DESI_STREAM_OK && len > 0) {
+        size_t head = s->chunked ? DESI_STREAM_CHUNK_HEAD : 0;
+        if (desi_stream_reserve(s, head + len + 2)) {
+            memcpy(s->buf + s->len + head, data, len);
+            desi_stream_commit(s, len);
+        } else {
+            rc = DESI_STREAM_ERROR;
         }
-        ssize_t got = recv(fd, buf + len, cap - len, 0);
+    }
+    pthread_mutex_unlock(&s->mu);
+    return rc;
+}
+
+// Formats an SSE event (or a keepalive comment) straight into the queue, growing it until the frame fits.
+static int desi_stream_sse(desi_http_stream_t* s, bool keepalive, const char* event_type, size_t event_len,
+                           const char* data, size_t data_len) {
+    if (!s || data_len > DESI_STREAM_MAX_WRITE || event_len > DESI_STREAM_MAX_WRITE) return DESI_STREAM_ERROR;
+    pthread_mutex_lock(&s->mu);
+    int rc = desi_stream_writable(s);
+    size_t head = s->chunked ? DESI_STREAM_CHUNK_HEAD : 0;
+    size_t want = event_len + data_len + 64;
+    while (rc == DESI_STREAM_OK) {
+        if (!desi_stream_reserve(s, head + want + 2)) {
+            rc = DESI_STREAM_ERROR;
+            break;
+        }
+        char* out = s->buf + s->len + head;
+        size_t cap = s->cap - s->len - head - 2;
+        size_t n = 0;
+        int sse_rc = keepalive ? sse_write_keepalive(NULL, out, cap, &n)
+                               : sse_write_event(NULL, event_type, event_len, data, data_len, out, cap, &n);
+        if (sse_rc == SSE_OK && n <= DESI_STREAM_MAX_WRITE) {
+            desi_stream_commit(s, n);
+            break;
+        }
+        if (sse_rc != SSE_ERR_OVERFLOW_BUFFER) rc = DESI_STREAM_ERROR;
+        want = cap * 2;
+    }
+    pthread_mutex_unlock(&s->mu);
+    return rc;
+}
+
+int desi_http_stream_sse_event(desi_http_stream_t* s, const char* event_type, size_t event_len, const char* data,
+                               size_t data_len) {
+    return desi_stream_sse(s, false, event_type, event_len, data, data_len);
+}
+
+int desi_http_stream_sse_keepalive(desi_http_stream_t* s) {
+    return desi_stream_sse(s, true, NULL, 0, NULL, 0);
+}
+
+int desi_http_stream_wait(desi_http_stream_t* s, uint32_t timeout_ms) {
+    if (!s) return DESI_STREAM_ERROR;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += (time_t)(timeout_ms / 1000u);
+    deadline.tv_nsec += (long)(timeout_ms % 1000u) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&s->mu);
+    while (!s->closed && s->len >= DESI_STREAM_HIGH_WATER) {
+        s->busy = true;
+        if (pthread_cond_timedwait(&s->drained, &s->mu, &deadline) == ETIMEDOUT) break;
+    }
+    int rc = s->closed ? DESI_STREAM_CLOSED : s->len >= DESI_STREAM_HIGH_WATER ? DESI_STREAM_BUSY : DESI_STREAM_OK;
+    pthread_mutex_unlock(&s->mu);
+    return rc;
+}
+
+void desi_http_stream_on_drain(desi_http_stream_t* s, void (*cb)(void* user_data, desi_http_stream_t* stream),
+                               void* user_data) {
+    if (!s) return;
+    pthread_mutex_lock(&s->mu);
+    s->on_drain = cb;
+    s->drain_user_data = user_data;
+    pthread_mutex_unlock(&s->mu);
+}
+
+void desi_http_stream_finish(desi_http_stream_t* s) {
+    if (!s) return;
+    pthread_mutex_lock(&s->mu);
+    if (!s->finished && !s->closed) {
+        s->finished = true;
+        if (s->chunked) {
+            if (desi_stream_reserve(s, 5)) {
+                memcpy(s->buf + s->len, "0\r\n\r\n", 5);
+                s->len += 5;
+            } else {
+                s->truncated = true;
+            }
+        }
+        desi_stream_notify(s);
+    }
+    pthread_mutex_unlock(&s->mu);
+    desi_stream_unref(s);
+}
+
+// The connection lets go of its stream: later writes see DESI_STREAM_CLOSED and waiters wake up.
+static void desi_stream_detach(desi_http_stream_t* s) {
+    pthread_mutex_lock(&s->mu);
+    s->closed = true;
+    s->conn = NULL;
+    s->wake = NULL;
+    pthread_cond_broadcast(&s->drained);
+    pthread_mutex_unlock(&s->mu);
+    desi_stream_unref(s);
+}
+
+// STREAMING: the head is queued and the body follows from a desi_http_stream_t.
+#ifdef DESI_HAVE_URING
+// The io_uring backend. One ring per worker, driven through the raw system calls: the worker queues receives,
+// sends, a multishot accept and multishot polls on its eventfds, and one io_uring_enter submits them all and
+// waits for completions. Receives pick a buffer from a ring of provided buffers only once data is there, so an
+// idle connection holds none.
+enum {
+    DESI_URING_SQ_ENTRIES = 256,
+    DESI_URING_CQ_ENTRIES = 4096,
+    DESI_URING_BUFS = 256,  // a power of two, as the buffer ring requires
+    DESI_URING_BUF_SIZE = 4096,
+    DESI_URING_BGID = 0,
+    DESI_URING_DRAIN_TICKS = 20,  // how long a stopping worker waits for closed connections' operations
+    // Connection completions carry the connection's address with the operation in its low bits.
+    DESI_URING_RECV = 1,
+    DESI_URING_SEND = 2,
+    DESI_URING_KIND_MASK = 3,
+};
+
+struct desi_uring {
+    int fd;
+    void* rings;  // the submission and completion rings, one mapping
+    size_t rings_len;
+    struct io_uring_sqe* sqes;
+    size_t sqes_len;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_queued;  // our tail; published to the kernel on the next enter
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    struct io_uring_buf_ring* bufs;
+    char* buf_mem;
+    uint16_t buf_tail;
+    size_t held;  // buffers received into and not yet given back
+};
+
+// Gives buffer bid back to the kernel.
+static void desi_uring_recycle(struct desi_uring* r, unsigned bid) {
+    struct io_uring_buf* b = &r->bufs->bufs[r->buf_tail & (DESI_URING_BUFS - 1)];
+    b->addr = (uint64_t)(uintptr_t)(r->buf_mem + (size_t)bid * DESI_URING_BUF_SIZE);
+    b->len = DESI_URING_BUF_SIZE;
+    b->bid = (uint16_t)bid;
+    r->buf_tail++;
+    __atomic_store_n(&r->bufs->tail, r->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void desi_uring_free(struct desi_uring* r) {
+    if (r->sqes) munmap(r->sqes, r->sqes_len);
+    if (r->rings) munmap(r->rings, r->rings_len);
+    if (r->fd >= 0) close(r->fd);
+    if (r->bufs) munmap(r->bufs, DESI_URING_BUFS * sizeof(struct io_uring_buf));
+    free(r->buf_mem);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+// Sets up the ring and its provided buffers. Returns -1 where the kernel lacks io_uring or a feature this
+// backend needs, and the worker runs on epoll instead.
+static int desi_uring_init(struct desi_uring* r) {
+    memset(r, 0, sizeof(*r));
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = DESI_URING_CQ_ENTRIES;
+    r->fd = (int)syscall(__NR_io_uring_setup, DESI_URING_SQ_ENTRIES, &p);
+    if (r->fd < 0) return -1;
+    unsigned need = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((p.features & need) != need) {
+        desi_uring_free(r);
+        return -1;
+    }
+    size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->rings_len = sq_len > cq_len ? sq_len : cq_len;
+    r->rings = mmap(NULL, r->rings_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->rings == MAP_FAILED) r->rings = NULL;
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) r->sqes = NULL;
+    r->bufs = mmap(NULL, DESI_URING_BUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r->bufs == MAP_FAILED) r->bufs = NULL;
+    r->buf_mem = malloc((size_t)DESI_URING_BUFS * DESI_URING_BUF_SIZE);
+    if (!r->rings || !r->sqes || !r->bufs || !r->buf_mem) {
+        desi_uring_free(r);
+        return -1;
+    }
+    char* base = r->rings;
+    r->sq_head = (unsigned*)(base + p.sq_off.head);
+    r->sq_tail = (unsigned*)(base + p.sq_off.tail);
+    r->sq_mask = *(unsigned*)(base + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->sq_queued = *r->sq_tail;
+    unsigned* array = (unsigned*)(base + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; i++) array[i] = i;
+    r->cq_head = (unsigned*)(base + p.cq_off.head);
+    r->cq_tail = (unsigned*)(base + p.cq_off.tail);
+    r->cq_mask = *(unsigned*)(base + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(base + p.cq_off.cqes);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)r->bufs;
+    reg.ring_entries = DESI_URING_BUFS;
+    reg.bgid = DESI_URING_BGID;
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        desi_uring_free(r);
+        return -1;
+    }
+    for (unsigned i = 0; i < DESI_URING_BUFS; i++) desi_uring_recycle(r, i);
+    return 0;
+}
+
+// Submits what is queued and, with wait set, blocks for a completion or timeout_ms (-1: no limit). Returns -1
+// only on a broken ring; a timeout or signal just returns.
+static int desi_uring_enter(struct desi_uring* r, bool wait, int timeout_ms) {
+    __atomic_store_n(r->sq_tail, r->sq_queued, __ATOMIC_RELEASE);
+    unsigned submit = r->sq_queued - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (submit == 0 && !wait) return 0;
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec ts = {.tv_sec = timeout_ms / 1000, .tv_nsec = (long long)(timeout_ms % 1000) * 1000000};
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+    void* argp = NULL;
+    size_t argsz = 0;
+    if (wait && timeout_ms >= 0) {
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argsz = sizeof(arg);
+    }
+    if (syscall(__NR_io_uring_enter, r->fd, submit, wait ? 1u : 0u, flags, argp, argsz) >= 0) return 0;
+    // EBUSY and EAGAIN: completions have to be reaped before more is submitted; the rest stays queued.
+    return errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN ? 0 : -1;
+}
+
+// The next free submission entry, zeroed, or NULL when the ring stays full even after submitting.
+static struct io_uring_sqe* desi_uring_sqe(struct desi_uring* r) {
+    if (r->sq_queued - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) == r->sq_entries) {
+        if (desi_uring_enter(r, false, -1) != 0) return NULL;
+        if (r->sq_queued - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) == r->sq_entries) return NULL;
+    }
+    struct io_uring_sqe* sqe = &r->sqes[r->sq_queued & r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_queued++;
+    return sqe;
+}
+
+// Takes the oldest completion off the ring.
+static bool desi_uring_next(struct desi_uring* r, struct io_uring_cqe* out) {
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) return false;
+    *out = r->cqes[head & r->cq_mask];
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static int desi_uring_poll(struct desi_uring* r, int fd, void* tag) {
+    struct io_uring_sqe* sqe = desi_uring_sqe(r);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = (uint64_t)(uintptr_t)tag;
+    return 0;
+}
+
+static int desi_uring_accept(struct desi_uring* r, int listen_fd, void* tag) {
+    struct io_uring_sqe* sqe = desi_uring_sqe(r);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = (uint64_t)(uintptr_t)tag;
+    return 0;
+}
+#endif
+
+enum desi_conn_state { DESI_CONN_READING, DESI_CONN_BODY, DESI_CONN_WRITING, DESI_CONN_STREAMING, DESI_CONN_DONE };
+
+enum desi_chunk_state { DESI_CHUNK_SIZE, DESI_CHUNK_DATA, DESI_CHUNK_DATA_END, DESI_CHUNK_TRAILER, DESI_CHUNK_DONE };
+
+// What a connection needs from its server; shared by every connection of a pool.
+struct desi_conn_config {
+    desi_request_handler_t handler;
+    desi_body_chunk_handler_t body_chunk;
+    void* user_data;
+    uint32_t max_requests;
+    uint64_t max_body_bytes;
+    bool tcp_cork;
+    uint32_t zerocopy_min_bytes;
+};
+
+// One client connection. The same state machine runs on blocking sockets (one call reads the whole request) and
+// under the event loop, where reads and writes stop at EAGAIN and resume on the next readiness event.
+struct desi_conn {
+    int fd;
+    enum desi_conn_state state;
+    const struct desi_conn_config* conf;
+    char* in;  // allocated on the first read, freed once no unhandled bytes are left in it
+    size_t in_len;
+    size_t in_off;   // start of the current request; pipelined requests wait past it in arrival order
+    size_t in_used;  // end of the current request's bytes in in: its head and any body bytes read with it
+    desi_http_header_t* headers;  // allocated with in
+    desi_http_req_t req;          // spans into in and body, valid until the response is queued
+    // The head is tokenized line by line as it arrives. head_scan is where its next unfinished line starts and
+    // head_seen how far that line is known to run without a terminator; head_error is the first status it
+    // earned, answered once the whole head is in.
+    size_t head_scan;
+    size_t head_seen;
+    int head_error;
+    // Body being read. Content-Length bytes and chunk data are received straight into body[body_len..];
+    // chunked framing is received after it as body[raw_off, raw_end) and decoded in place. In streaming mode
+    // body holds one piece at a time.
+    char* body;
+    size_t body_cap;
+    size_t body_len;
+    size_t raw_off;
+    size_t raw_end;
+    bool chunked;
+    enum desi_chunk_state chunk;
+    uint64_t body_left;  // of the Content-Length body or the current chunk
+    uint64_t body_total;
+    bool streaming;  // body_chunk owes this request its final call
+    void* body_state;
+    uint32_t requests_left;  // before the connection closes even if the client wants it kept
+    bool keep_alive;         // the queued response leaves the connection open for another request
+    char* out;
+    size_t out_len;
+    size_t out_off;
+    // A static body is sent from where it is, after out: gathered into the same sendmsg, or on its own with
+    // MSG_ZEROCOPY once past zerocopy_min_bytes.
+    const char* body_ref;
+    size_t body_ref_len;
+    size_t body_ref_off;
+    bool zerocopy;  // SO_ZEROCOPY is on; completions are reaped from the error queue
+    bool corked;
+    uint32_t events;  // registered with epoll
+    desi_http_stream_t* stream;  // while STREAMING
+    struct desi_wake* wake;      // the worker's; NULL on a blocking socket
+#ifdef DESI_HAVE_URING
+    // Under io_uring a connection has at most one receive and one send in flight. Their results wait here until
+    // the state machine asks, as if from recv and sendmsg; a closed connection is freed once both are back.
+    struct desi_uring* ring;  // NULL under epoll
+    bool recv_armed;
+    bool send_armed;
+    bool send_done;   // send_res is the result of the last send
+    bool rx_eof;
+    bool rx_starved;  // the receive found no free buffer and is armed again once one is back
+    bool retired;
+    int rx_error;
+    ssize_t send_res;
+    unsigned rx_bid;  // the provided buffer holding rx_len bytes at rx_off
+    size_t rx_off;
+    size_t rx_len;
+    struct iovec send_iov[2];
+    struct msghdr send_msg;
+#endif
+    uint64_t header_deadline_ms;  // the request head must be complete by then; 0 while a body or response is due
+    uint64_t idle_deadline_ms;    // pushed back on every event; 0 without an idle timeout
+    struct desi_conn* prev;  // the worker's open connections
+    struct desi_conn* next;
+    struct desi_conn* timer_next;  // timer wheel slot
+    struct desi_conn* timer_prev;
+    bool timer_linked;
+    size_t timer_slot;
+};
+
+static void desi_conn_init(struct desi_conn* c, int fd, const struct desi_conn_config* conf) {
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    c->state = DESI_CONN_READING;
+    c->conf = conf;
+    c->requests_left = conf->max_requests;
+    c->events = EPOLLIN;
+}
+
+// Drops the current request's body, giving the streaming body callback its final call.
+static void desi_conn_end_body(struct desi_conn* c) {
+    if (c->streaming) {
+        c->streaming = false;
+        c->conf->body_chunk(c->conf->user_data, &c->req, &c->body_state, NULL, 0);
+    }
+    free(c->body);
+    c->body = NULL;
+    c->body_cap = 0;
+    c->body_len = 0;
+    c->raw_off = 0;
+    c->raw_end = 0;
+    c->body_total = 0;
+    c->body_state = NULL;
+}
+
+static void desi_conn_release(struct desi_conn* c) {
+    if (c->stream) desi_stream_detach(c->stream);
+    c->stream = NULL;
+    desi_conn_end_body(c);
+    free(c->in);
+    free(c->headers);
+    free(c->out);
+    c->in = NULL;
+    c->headers = NULL;
+    c->out = NULL;
+}
+
+#ifdef DESI_HAVE_URING
+static int desi_conn_arm_recv(struct desi_conn* c) {
+    struct io_uring_sqe* sqe = desi_uring_sqe(c->ring);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->len = DESI_URING_BUF_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = DESI_URING_BGID;
+    sqe->user_data = (uint64_t)(uintptr_t)c | DESI_URING_RECV;
+    c->recv_armed = true;
+    return 0;
+}
+
+// Gives back the buffer holding the connection's unread input, dropping the bytes.
+static void desi_conn_drop_rx(struct desi_conn* c) {
+    if (c->rx_len == 0) return;
+    desi_uring_recycle(c->ring, c->rx_bid);
+    c->ring->held--;
+    c->rx_len = 0;
+}
+#endif
+
+// recv on the connection's socket. Under io_uring the bytes come from the buffer the last receive completed
+// into; with none left a receive is armed and the call fails with EAGAIN, as on a non-blocking socket.
+static ssize_t desi_conn_recv(struct desi_conn* c, char* buf, size_t len) {
+#ifdef DESI_HAVE_URING
+    if (c->ring) {
+        if (c->rx_len > 0) {
+            size_t n = len < c->rx_len ? len : c->rx_len;
+            memcpy(buf, c->ring->buf_mem + (size_t)c->rx_bid * DESI_URING_BUF_SIZE + c->rx_off, n);
+            c->rx_off += n;
+            c->rx_len -= n;
+            if (c->rx_len == 0) {
+                desi_uring_recycle(c->ring, c->rx_bid);
+                c->ring->held--;
+            }
+            return (ssize_t)n;
+        }
+        if (c->rx_eof) return 0;
+        if (c->rx_error) {
+            errno = c->rx_error;
+            return -1;
+        }
+        if (!c->recv_armed && !c->rx_starved && desi_conn_arm_recv(c) != 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+        errno = EAGAIN;
+        return -1;
+    }
+#endif
+    return recv(c->fd, buf, len, 0);
+}
+
+// Queues the response to the current request. The bytes past it are the start of the next request, kept only
+// if the connection is.
+static int desi_conn_respond(struct desi_conn* c, const desi_http_resp_t* resp, bool keep_alive) {
+    size_t consumed = c->in_used;
+    // Bytes read past a chunked body join whatever is left in in; they come from one bounded read.
+    size_t spill = c->body ? c->raw_end - c->raw_off : 0;
+    if (spill > DESI_HTTP_MAX_HEADER_BYTES - (c->in_len - consumed)) keep_alive = false;
+    // Without chunked encoding a streamed body ends with the connection.
+    if (resp->stream && !resp->stream->chunked) keep_alive = false;
+    bool by_ref = resp->body_static && resp->body && !resp->stream;
+    if (desi_format_response(resp, keep_alive, !by_ref, &c->out, &c->out_len) != 0) return -1;
+    c->out_off = 0;
+    c->body_ref = by_ref ? resp->body : NULL;
+    c->body_ref_len = by_ref ? resp->body_len : 0;
+    c->body_ref_off = 0;
+    c->keep_alive = keep_alive;
+    c->in_off = consumed;
+    if (keep_alive && spill > 0) {
+        size_t rest = c->in_len - c->in_off;
+        memmove(c->in, c->in + c->in_off, rest);
+        memcpy(c->in + rest, c->body + c->raw_off, spill);
+        c->in_off = 0;
+        c->in_len = rest + spill;
+    }
+    desi_conn_end_body(c);
+    memset(&c->req, 0, sizeof(c->req));
+    if (!keep_alive || c->in_off == c->in_len) {
+        free(c->in);
+        free(c->headers);
+        c->in = NULL;
+        c->headers = NULL;
+        c->in_len = 0;
+        c->in_off = 0;
+    }
+    c->head_scan = c->in_off;
+    c->head_seen = c->in_off;
+    c->head_error = 0;
+    c->header_deadline_ms = 0;
+    c->state = resp->stream ? DESI_CONN_STREAMING : DESI_CONN_WRITING;
+    return 0;
+}
+
+static int desi_conn_reject(struct desi_conn* c, int status) {
+    desi_http_resp_t resp = {.status = status};
+    switch (status) {
+        case 400:
+            resp.body = "Bad Request\n";
+            resp.body_len = 12;
+            break;
+        case 413:
+            resp.body = "Request Too Large\n";
+            resp.body_len = 18;
+            break;
+        default:
+            resp.body = "Request Header Fields Too Large\n";
+            resp.body_len = 32;
+            break;
+    }
+    return desi_conn_respond(c, &resp, false);
+}
+
+// Runs the handler on the complete request.
+static int desi_conn_dispatch(struct desi_conn* c) {
+    const struct desi_conn_config* conf = c->conf;
+    if (c->requests_left > 0) c->requests_left--;
+    bool keep_alive = c->requests_left > 0 && desi_request_keep_alive(&c->req);
+    c->req.body = c->streaming ? NULL : c->body;
+    c->req.body_len = (size_t)c->body_total;
+    c->req.body_state = c->body_state;
+
+    desi_http_resp_t resp = {0};
+    int handler_rc = conf->handler(conf->user_data, &c->req, &resp);
+    desi_http_stream_t* stream = resp.stream;
+    if (handler_rc < 0) resp = (desi_http_resp_t){.status = 500, .body = "Internal Server Error\n", .body_len = 22};
+    int rc = desi_conn_respond(c, &resp, keep_alive);
+    if (!stream) return rc;
+    if (rc != 0 || !resp.stream) {
+        // The head never went out; the producer finds the stream closed.
+        desi_stream_detach(stream);
+        return rc;
+    }
+    // Whatever the producer queued so far follows the head once it is written.
+    c->stream = stream;
+    pthread_mutex_lock(&stream->mu);
+    stream->conn = c;
+    stream->wake = c->wake;
+    pthread_mutex_unlock(&stream->mu);
+    return 0;
+}
+
+// Decodes what has arrived of the body: moves chunk data down to body_len and consumes chunk framing. Returns
+// 0 when it needs more bytes or the body is complete (DESI_CHUNK_DONE), else the status to reject with.
+static int desi_conn_decode_body(struct desi_conn* c) {
+    for (;;) {
+        char* raw = c->body + c->raw_off;
+        size_t avail = c->raw_end - c->raw_off;
+        if (c->chunk == DESI_CHUNK_DONE) return 0;
+        if (c->chunk == DESI_CHUNK_DATA) {
+            if (c->body_left == 0) {
+                c->chunk = c->chunked ? DESI_CHUNK_DATA_END : DESI_CHUNK_DONE;
+                continue;
+            }
+            if (avail == 0) return 0;
+            size_t n = avail < c->body_left ? avail : (size_t)c->body_left;
+            if (c->raw_off != c->body_len) memmove(c->body + c->body_len, raw, n);
+            c->body_len += n;
+            c->raw_off += n;
+            c->body_left -= n;
+            c->body_total += n;
+            continue;
+        }
+        size_t line_end = 0;
+        size_t next = 0;
+        if (!desi_next_line(raw, avail, 0, &line_end, &next)) return avail > DESI_HTTP_MAX_CHUNK_LINE ? 400 : 0;
+        if (raw[line_end] == '\r' && next == line_end + 1 && next == avail) return 0;  // its '\n' is yet to come
+        c->raw_off += next;
+        if (c->chunk == DESI_CHUNK_SIZE) {
+            uint64_t size = 0;
+            if (desi_parse_chunk_size(raw, line_end, &size) != 0) return 400;
+            if (size > c->conf->max_body_bytes - c->body_total) return 413;
+            c->body_left = size;
+            c->chunk = size > 0 ? DESI_CHUNK_DATA : DESI_CHUNK_TRAILER;
+        } else if (c->chunk == DESI_CHUNK_DATA_END) {
+            if (line_end != 0) return 400;
+            c->chunk = DESI_CHUNK_SIZE;
+        } else if (line_end == 0) {
+            c->chunk = DESI_CHUNK_DONE;  // trailer fields are skipped
+        }
+    }
+}
+
+// Reads until the body is complete, then runs the handler. Returns as desi_conn_read.
+static int desi_conn_read_body(struct desi_conn* c) {
+    const struct desi_conn_config* conf = c->conf;
+    for (;;) {
+        int status = desi_conn_decode_body(c);
+        if (status != 0) return desi_conn_reject(c, status);
+        if (c->streaming && c->body_len > 0) {
+            if (conf->body_chunk(conf->user_data, &c->req, &c->body_state, c->body, c->body_len) != 0) {
+                return desi_conn_reject(c, 400);
+            }
+            c->body_len = 0;
+        }
+        if (c->chunk == DESI_CHUNK_DONE) return desi_conn_dispatch(c);
+        if (c->raw_off > c->body_len) {
+            memmove(c->body + c->body_len, c->body + c->raw_off, c->raw_end - c->raw_off);
+            c->raw_end -= c->raw_off - c->body_len;
+            c->raw_off = c->body_len;
+        }
+
+        // Chunk data is read exactly, like a Content-Length body; framing in bounded reads, so that what is
+        // read past the last chunk always fits back into in.
+        size_t want = DESI_HTTP_MAX_HEADER_BYTES;
+        if (c->chunk == DESI_CHUNK_DATA && c->raw_off == c->raw_end) {
+            want = c->body_left < SIZE_MAX ? (size_t)c->body_left : SIZE_MAX;
+        }
+        if (c->raw_end == c->body_cap) {
+            size_t limit = DESI_HTTP_BODY_PIECE;
+            if (!c->streaming) limit = (size_t)conf->max_body_bytes + DESI_HTTP_MAX_HEADER_BYTES;
+            size_t cap = c->body_cap < limit / 2 ? c->body_cap * 2 : limit;
+            if (cap <= c->body_cap) return desi_conn_reject(c, 413);
+            char* grown = realloc(c->body, cap);
+            if (!grown) return -1;
+            c->body = grown;
+            c->body_cap = cap;
+        }
+        if (want > c->body_cap - c->raw_end) want = c->body_cap - c->raw_end;
+        ssize_t got = desi_conn_recv(c, c->body + c->raw_end, want);
         if (got < 0) {
             if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
             return -1;
         }
         if (got == 0) return -1;
-        len += (size_t)got;
+        c->raw_end += (size_t)got;
     }
-    size_t header_end = 0;
-    if (desi_find_header_end(buf, len, &header_end)) {
-        *out_header_end = header_end;
-        return 0;
+}
+
+// Starts the request whose head ends at head_end: parses it, then runs the handler or starts reading the body.
+static int desi_conn_begin(struct desi_conn* c, size_t head_end) {
+    const struct desi_conn_config* conf = c->conf;
+    c->in_used = head_end;
+    c->header_deadline_ms = 0;
+    c->req.headers = c->headers;
+    if (c->head_error) return desi_conn_reject(c, c->head_error);
+    enum desi_body_framing framing;
+    uint64_t length = 0;
+    if (desi_body_framing(&c->req, &framing, &length) != 0) return desi_conn_reject(c, 400);
+    if (framing == DESI_BODY_NONE) return desi_conn_dispatch(c);
+    if (length > conf->max_body_bytes) return desi_conn_reject(c, 413);
+
+    size_t early = c->in_len - head_end;
+    const desi_http_header_t* expect = desi_http_req_header(&c->req, "expect");
+    if (c->req.http11 && early == 0 && expect &&
+        desi_header_has_token(expect->value, expect->value_len, "100-continue")) {
+        static const char k_continue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        ssize_t sent = send(c->fd, k_continue, sizeof(k_continue) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent != (ssize_t)sizeof(k_continue) - 1) return -1;
+    }
+
+    c->chunked = framing == DESI_BODY_CHUNKED;
+    c->chunk = c->chunked ? DESI_CHUNK_SIZE : DESI_CHUNK_DATA;
+    c->body_left = length;
+    c->streaming = conf->body_chunk != NULL;
+    if (c->streaming) {
+        c->body_cap = DESI_HTTP_BODY_PIECE;
+    } else {
+        c->body_cap = c->chunked ? DESI_HTTP_BODY_PIECE : (size_t)length;
+    }
+    c->body = malloc(c->body_cap);
+    if (!c->body) {
+        c->streaming = false;
+        return -1;
     }
-    return 1;
+    // Body bytes that arrived with the head; with Content-Length whatever follows them is the next request.
+    if (!c->chunked && early > length) early = (size_t)length;
+    if (early > c->body_cap) early = c->body_cap;
+    memcpy(c->body, c->in + head_end, early);
+    c->raw_end = early;
+    c->in_used = head_end + early;
+    c->state = DESI_CONN_BODY;
+    return desi_conn_read_body(c);
 }
 
-static int desi_handle_client(int fd, desi_request_handler_t handler, void* user_data) {
-    char buf[DESI_HTTP_MAX_HEADER_BYTES];
-    size_t header_end = 0;
-    int rc = desi_read_request(fd, buf, sizeof(buf), &header_end);
-    if (rc == 1) {
-        desi_http_resp_t resp = {.status = 413, .body = "Request Too Large\n", .body_len = 18};
-        return desi_send_response(fd, &resp);
+// Tokenizes the lines of the current head that arrived since the last call, so a head that trickles in is
+// still scanned once in all. Returns true once the blank line ending it is in, with *head_end just past it.
+static bool desi_conn_scan_head(struct desi_conn* c, size_t* head_end) {
+    size_t from = c->head_seen > c->head_scan ? c->head_seen : c->head_scan;
+    size_t line_end = 0;
+    size_t next = 0;
+    while (desi_next_line(c->in, c->in_len, from, &line_end, &next)) {
+        if (c->in[line_end] == '\r' && next == line_end + 1 && next == c->in_len) {
+            c->head_seen = line_end;  // its '\n' is yet to come
+            return false;
+        }
+        const char* line = c->in + c->head_scan;
+        size_t len = line_end - c->head_scan;
+        c->head_scan = next;
+        from = next;
+        if (len == 0) {
+            if (!c->req.method && !c->head_error) c->head_error = 400;
+            *head_end = next;
+            return true;
+        }
+        if (c->head_error) continue;
+        if (!c->req.method) {
+            if (desi_parse_request_line(line, len, &c->req) != 0) c->head_error = 400;
+        } else if (c->req.header_count == DESI_HTTP_MAX_HEADERS) {
+            c->head_error = 431;
+        } else if (desi_parse_header_line(line, len, &c->headers[c->req.header_count]) != 0) {
+            c->head_error = 400;
+        } else {
+            c->req.header_count++;
+        }
+    }
+    c->head_seen = c->in_len;
+    return false;
+}
+
+// Reads until the next request is complete, then runs the handler and queues the response. A pipelined request
+// already in the buffer is handled without reading. Returns 0 when more data is needed or the response is
+// queued, -1 when the connection should be dropped.
+static int desi_conn_read(struct desi_conn* c) {
+    if (c->state == DESI_CONN_BODY) return desi_conn_read_body(c);
+    if (!c->in) {
+        c->in = malloc(DESI_HTTP_MAX_HEADER_BYTES);
+        c->headers = malloc(DESI_HTTP_MAX_HEADERS * sizeof(*c->headers));
+        if (!c->in || !c->headers) return -1;
+    }
+    for (;;) {
+        size_t head_end = 0;
+        if (desi_conn_scan_head(c, &head_end)) return desi_conn_begin(c, head_end);
+        if (c->in_len == DESI_HTTP_MAX_HEADER_BYTES) {
+            if (c->in_off > 0) {
+                // A pipelined head runs past the end of the buffer; move it to the front and tokenize it again,
+                // since the spans so far point into the old place.
+                memmove(c->in, c->in + c->in_off, c->in_len - c->in_off);
+                c->in_len -= c->in_off;
+                c->in_off = 0;
+                memset(&c->req, 0, sizeof(c->req));
+                c->head_scan = 0;
+                c->head_seen = 0;
+                c->head_error = 0;
+                continue;
+            }
+            c->in_used = c->in_len;
+            return desi_conn_reject(c, 413);
+        }
+        ssize_t got = desi_conn_recv(c, c->in + c->in_len, DESI_HTTP_MAX_HEADER_BYTES - c->in_len);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        if (got == 0) return -1;
+        c->in_len += (size_t)got;
     }
-    if (rc != 0) return -1;
+}
 
-    desi_http_req_t req = {0};
-    if (desi_parse_request_line(buf, header_end, &req) != 0) {
-        desi_http_resp_t resp = {.status = 400, .body = "Bad Request\n", .body_len = 12};
-        return desi_send_response(fd, &resp);
+// Takes over what the stream has queued once the previous bytes are out. Returns true with more to write; false
+// when the stream is idle until its producer writes again, or has ended and the response with it.
+static bool desi_conn_stream_next(struct desi_conn* c) {
+    desi_http_stream_t* s = c->stream;
+    pthread_mutex_lock(&s->mu);
+    if (s->len > 0) {
+        c->out = s->buf;
+        c->out_len = s->len;
+        c->out_off = 0;
+        s->buf = NULL;
+        s->len = 0;
+        s->cap = 0;
+        void (*on_drain)(void*, desi_http_stream_t*) = NULL;
+        if (s->busy) {
+            s->busy = false;
+            on_drain = s->on_drain;
+            pthread_cond_broadcast(&s->drained);
+        }
+        void* drain_user_data = s->drain_user_data;
+        pthread_mutex_unlock(&s->mu);
+        if (on_drain) on_drain(drain_user_data, s);
+        return true;
     }
+    bool ended = s->finished;
+    bool truncated = s->truncated;
+    s->idle = !ended;
+    pthread_mutex_unlock(&s->mu);
+    if (!ended) return false;
+    c->stream = NULL;
+    desi_stream_detach(s);
+    c->state = c->keep_alive && !truncated ? DESI_CONN_READING : DESI_CONN_DONE;
+    return false;
+}
 
-    desi_http_resp_t resp = {0};
-    int handler_rc = handler(user_data, &req, &resp);
-    if (handler_rc < 0) {
-        resp.status = 500;
-        resp.body = "Internal Server Error\n";
-        resp.body_len = 22;
+// sendmsg on the connection's socket. Under io_uring the first call queues the send and fails with EAGAIN, and
+// the first call after its completion returns its result; msg describes the same bytes both times, since
+// nothing moves while a send is in flight.
+static ssize_t desi_conn_sendmsg(struct desi_conn* c, const struct msghdr* msg, int flags) {
+#ifdef DESI_HAVE_URING
+    if (c->ring) {
+        if (c->send_done) {
+            c->send_done = false;
+            if (c->send_res >= 0) return c->send_res;
+            if (c->send_res != -EAGAIN && c->send_res != -EINTR) {
+                errno = (int)-c->send_res;
+                return -1;
+            }
+        }
+        if (!c->send_armed) {
+            struct io_uring_sqe* sqe = desi_uring_sqe(c->ring);
+            if (!sqe) {
+                errno = ENOMEM;
+                return -1;
+            }
+            c->send_msg = *msg;
+            memcpy(c->send_iov, msg->msg_iov, msg->msg_iovlen * sizeof(struct iovec));
+            c->send_msg.msg_iov = c->send_iov;
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = c->fd;
+            sqe->addr = (uint64_t)(uintptr_t)&c->send_msg;
+            sqe->len = 1;
+            sqe->msg_flags = (uint32_t)flags;
+            sqe->user_data = (uint64_t)(uintptr_t)c | DESI_URING_SEND;
+            c->send_armed = true;
+        }
+        errno = EAGAIN;
+        return -1;
+    }
+#endif
+    return sendmsg(c->fd, msg, flags);
+}
+
+static void desi_conn_cork(struct desi_conn* c, bool on) {
+    int opt = on ? 1 : 0;
+    if (setsockopt(c->fd, IPPROTO_TCP, TCP_CORK, &opt, sizeof(opt)) == 0) c->corked = on;
+}
+
+// One sendmsg of what is left of out and the static body. A body sent with MSG_ZEROCOPY goes on its own: the
+// kernel may read it after the call returns, which out, freed right after, does not allow.
+static ssize_t desi_conn_send(struct desi_conn* c) {
+    struct iovec iov[2];
+    size_t count = 0;
+    int flags = MSG_NOSIGNAL;
+    size_t out_left = c->out_len - c->out_off;
+    size_t body_left = c->body_ref_len - c->body_ref_off;
+    bool zerocopy = c->zerocopy && body_left >= c->conf->zerocopy_min_bytes;
+    if (out_left > 0) iov[count++] = (struct iovec){c->out + c->out_off, out_left};
+    if (out_left > 0 && zerocopy) {
+        flags |= MSG_MORE;
+    } else if (body_left > 0) {
+        iov[count++] = (struct iovec){(void*)(c->body_ref + c->body_ref_off), body_left};
+#ifdef MSG_ZEROCOPY
+        if (zerocopy) flags |= MSG_ZEROCOPY;
+#endif
+    }
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = count};
+    ssize_t wrote = desi_conn_sendmsg(c, &msg, flags);
+    if (wrote < 0 && errno == ENOBUFS && zerocopy) {
+        // Out of option memory to track zerocopy sends; this connection copies from now on.
+        c->zerocopy = false;
+        errno = EINTR;
+    }
+    return wrote;
+}
+
+#ifdef __linux__
+// Drains the MSG_ZEROCOPY completions that the kernel queues on the socket's error queue and epoll reports as
+// EPOLLERR. Bodies sent that way outlive the server, so nothing waits on them. Returns 1 when some were
+// drained, 0 when there were none, -1 when the queue held a real error.
+static int desi_conn_reap_zerocopy(struct desi_conn* c) {
+    int reaped = 0;
+    for (;;) {
+        char control[128];
+        struct msghdr msg = {.msg_control = control, .msg_controllen = sizeof(control)};
+        if (recvmsg(c->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? reaped : -1;
+        }
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err ee;
+            memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+            if (ee.ee_errno != 0 || ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY) return -1;
+        }
+        reaped = 1;
+    }
+}
+#endif
+
+// Writes as much of the queued response as the socket takes. Returns 0 on progress (once all of it is out,
+// READING again on a kept-alive connection, DONE otherwise; a stream stays STREAMING until it ends), -1 on
+// error.
+static int desi_conn_write(struct desi_conn* c) {
+    for (;;) {
+        if (c->conf->tcp_cork && !c->corked && c->state == DESI_CONN_WRITING && c->out_off == 0) {
+            desi_conn_cork(c, true);
+        }
+        while (c->out_off < c->out_len || c->body_ref_off < c->body_ref_len) {
+            ssize_t wrote = desi_conn_send(c);
+            if (wrote < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+                return -1;
+            }
+            if (wrote == 0) return -1;
+            size_t n = (size_t)wrote;
+            size_t out_part = c->out_len - c->out_off < n ? c->out_len - c->out_off : n;
+            c->out_off += out_part;
+            c->body_ref_off += n - out_part;
+        }
+        free(c->out);
+        c->out = NULL;
+        c->out_len = 0;
+        c->out_off = 0;
+        c->body_ref = NULL;
+        c->body_ref_len = 0;
+        c->body_ref_off = 0;
+        if (c->corked) desi_conn_cork(c, false);
+        if (c->state != DESI_CONN_STREAMING) {
+            c->state = c->keep_alive ? DESI_CONN_READING : DESI_CONN_DONE;
+            return 0;
+        }
+        if (!desi_conn_stream_next(c)) return 0;
     }
-    return desi_send_response(fd, &resp);
 }
 
-static int desi_listen_socket(const desi_server_config_t* conf) {
-    int fd = socket(AF_INET, SOCK_STREAM, 0);
+static int desi_listen_socket(const desi_server_config_t* conf, uint16_t port, bool reuse_port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (fd < 0) return -1;
 
     int opt = 1;
@@ -200,11 +1358,19 @@ static int desi_listen_socket(const desi_server_config_t* conf) {
         close(fd);
         return -1;
     }
+#ifdef SO_REUSEPORT
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) != 0) {
+        close(fd);
+        return -1;
+    }
+#else
+    (void)reuse_port;
+#endif
 
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(conf->port);
+    addr.sin_port = htons(port);
     if (!conf->bind_host || conf->bind_host[0] == '\0' || strcmp(conf->bind_host, "0.0.0.0") == 0) {
         addr.sin_addr.s_addr = htonl(INADDR_ANY);
     } else if (strcmp(conf->bind_host, "127.0.0.1") == 0) {
@@ -229,25 +1395,689 @@ static int desi_listen_socket(const desi_server_config_t* conf) {
     return fd;
 }
 
-int desi_server_run(const desi_server_config_t* conf, desi_request_handler_t handler, void* user_data) {
-    if (!conf || !handler) return -1;
+static uint16_t desi_bound_port(int fd) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(fd, (struct sockaddr*)&addr, &len) != 0) return 0;
+    return ntohs(addr.sin_port);
+}
 
-    signal(SIGPIPE, SIG_IGN);
+// CPUs this process may run on, in order; falls back to 0..n-1 where affinity masks are unavailable.
+static size_t desi_usable_cpus(int* cpus, size_t cap) {
+    size_t count = 0;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE && count < cap; cpu++) {
+            if (CPU_ISSET(cpu, &set)) cpus[count++] = cpu;
+        }
+    }
+#endif
+    if (count == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long cpu = 0; cpu < online && count < cap; cpu++) cpus[count++] = (int)cpu;
+    }
+    if (count == 0) cpus[count++] = 0;
+    return count;
+}
 
-    int listen_fd = desi_listen_socket(conf);
-    if (listen_fd < 0) return -1;
+static uint64_t desi_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+struct desi_server_pool;
+
+// A worker owns an epoll set, its listening socket and every connection accepted on it; nothing in it is
+// touched by other threads.
+struct desi_worker {
+    struct desi_server_pool* pool;
+    int listen_fd;
+    int cpu;  // -1 when not pinned
+    pthread_t thread;
+    bool started;
+    int epoll_fd;
+    bool accept_paused;          // out of descriptors; accepting resumes at accept_resume_ms
+    uint64_t accept_resume_ms;
+    struct desi_wake wake;
+    struct desi_conn* conns;
+#ifdef DESI_HAVE_URING
+    struct desi_uring ring;
+    bool uring;                 // the loop runs on ring; epoll_fd is unused
+    struct desi_conn* retired;  // closed, waiting for their operations in flight
+    size_t starved;             // connections whose receive waits for a free buffer
+#endif
+    // Timer wheel: a connection sits in the slot of its earliest deadline's tick. Deadlines almost only move
+    // later, so a slot is checked lazily: anything not yet due is refiled. The exception, a kept-alive
+    // connection's new header deadline, relinks.
+    struct desi_conn* wheel[DESI_WHEEL_SLOTS];
+    uint64_t wheel_tick;  // next tick to expire
+    size_t timed_count;
+};
+
+struct desi_server_pool {
+    struct desi_conn_config conn_conf;
+    uint32_t idle_timeout_ms;
+    uint32_t header_timeout_ms;
+    bool nagle;
+    bool epoll_only;
+    struct desi_worker* workers;
+    size_t count;
+    int stop_fd;  // eventfd in every worker's epoll set
+    atomic_bool stopping;
+};
+
+static uint64_t desi_conn_deadline(const struct desi_conn* c) {
+    uint64_t deadline = c->idle_deadline_ms;
+    if (c->header_deadline_ms && (!deadline || c->header_deadline_ms < deadline)) deadline = c->header_deadline_ms;
+    return deadline;
+}
+
+static void desi_timer_link(struct desi_worker* w, struct desi_conn* c) {
+    uint64_t deadline = desi_conn_deadline(c);
+    if (deadline == 0) return;
+    uint64_t tick = deadline / DESI_WHEEL_TICK_MS;
+    if (tick < w->wheel_tick) tick = w->wheel_tick;
+    size_t slot = (size_t)(tick % DESI_WHEEL_SLOTS);
+    c->timer_slot = slot;
+    c->timer_prev = NULL;
+    c->timer_next = w->wheel[slot];
+    if (c->timer_next) c->timer_next->timer_prev = c;
+    w->wheel[slot] = c;
+    c->timer_linked = true;
+    w->timed_count++;
+}
+
+static void desi_timer_unlink(struct desi_worker* w, struct desi_conn* c) {
+    if (!c->timer_linked) return;
+    if (c->timer_prev) {
+        c->timer_prev->timer_next = c->timer_next;
+    } else {
+        w->wheel[c->timer_slot] = c->timer_next;
+    }
+    if (c->timer_next) c->timer_next->timer_prev = c->timer_prev;
+    c->timer_prev = NULL;
+    c->timer_next = NULL;
+    c->timer_linked = false;
+    w->timed_count--;
+}
 
+#ifdef DESI_HAVE_URING
+// Frees a closed connection once nothing in flight refers to it.
+static void desi_conn_reap(struct desi_worker* w, struct desi_conn* c) {
+    desi_conn_drop_rx(c);
+    if (c->recv_armed || c->send_armed) return;
+    if (c->prev) {
+        c->prev->next = c->next;
+    } else {
+        w->retired = c->next;
+    }
+    if (c->next) c->next->prev = c->prev;
+    desi_conn_release(c);
+    free(c);
+}
+#endif
+
+static void desi_conn_close(struct desi_worker* w, struct desi_conn* c) {
+    desi_timer_unlink(w, c);
+    if (c->prev) {
+        c->prev->next = c->next;
+    } else {
+        w->conns = c->next;
+    }
+    if (c->next) c->next->prev = c->prev;
+#ifdef DESI_HAVE_URING
+    if (c->ring) {
+        // The kernel may still write into c's buffers or read its response: shutting the socket down ends what
+        // is in flight, and c moves to the retired list until the completions are back.
+        if (c->stream) desi_stream_detach(c->stream);
+        c->stream = NULL;
+        if (c->rx_starved) w->starved--;
+        c->rx_starved = false;
+        if (c->recv_armed || c->send_armed) (void)shutdown(c->fd, SHUT_RDWR);
+        close(c->fd);
+        c->retired = true;
+        c->prev = NULL;
+        c->next = w->retired;
+        if (c->next) c->next->prev = c;
+        w->retired = c;
+        desi_conn_reap(w, c);
+        return;
+    }
+#endif
+    close(c->fd);
+    desi_conn_release(c);
+    free(c);
+}
+
+static void desi_wheel_advance(struct desi_worker* w, uint64_t now) {
+    uint64_t now_tick = now / DESI_WHEEL_TICK_MS;
+    // After a long sleep every slot is due once, not once per missed tick.
+    if (w->wheel_tick + DESI_WHEEL_SLOTS <= now_tick) w->wheel_tick = now_tick + 1 - DESI_WHEEL_SLOTS;
+    while (w->wheel_tick <= now_tick) {
+        size_t slot = (size_t)(w->wheel_tick % DESI_WHEEL_SLOTS);
+        struct desi_conn* c = w->wheel[slot];
+        w->wheel[slot] = NULL;
+        w->wheel_tick++;
+        while (c) {
+            struct desi_conn* next = c->timer_next;
+            c->timer_linked = false;
+            w->timed_count--;
+            uint64_t deadline = desi_conn_deadline(c);
+            if (deadline != 0 && deadline <= now) {
+                desi_conn_close(w, c);
+            } else {
+                desi_timer_link(w, c);
+            }
+            c = next;
+        }
+    }
+}
+
+static void desi_conn_event(struct desi_worker* w, struct desi_conn* c, uint32_t events, uint64_t now) {
+    struct desi_server_pool* pool = w->pool;
+    int rc = 0;
+#ifdef __linux__
+    if ((events & EPOLLERR) && c->zerocopy) {
+        int reaped = desi_conn_reap_zerocopy(c);
+        if (reaped < 0) {
+            desi_conn_close(w, c);
+            return;
+        }
+        if (reaped > 0) events &= ~(uint32_t)EPOLLERR;
+    }
+#endif
+    if (c->state == DESI_CONN_STREAMING && (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+        // The client went away mid-stream; the producer learns it from its next write.
+        desi_conn_close(w, c);
+        return;
+    }
+    bool reading = c->state == DESI_CONN_READING || c->state == DESI_CONN_BODY;
+    if (reading && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        rc = desi_conn_read(c);
+    }
+    // A fresh response is written right away; most fit in the socket buffer and never need EPOLLOUT. Once it is
+    // out, a kept-alive connection moves on to its next request, which may already be buffered.
+    while (rc == 0 && (c->state == DESI_CONN_WRITING || c->state == DESI_CONN_STREAMING)) {
+        rc = desi_conn_write(c);
+        if (rc != 0 || c->state != DESI_CONN_READING) break;
+        rc = desi_conn_read(c);
+    }
+    if (rc != 0 || c->state == DESI_CONN_DONE) {
+        desi_conn_close(w, c);
+        return;
+    }
+    if (pool->idle_timeout_ms) c->idle_deadline_ms = now + pool->idle_timeout_ms;
+    if (c->state == DESI_CONN_READING && c->header_deadline_ms == 0) {
+        // The next request head is due within the header timeout of the last response.
+        c->header_deadline_ms = now + pool->header_timeout_ms;
+        desi_timer_unlink(w, c);
+        desi_timer_link(w, c);
+    }
+#ifdef DESI_HAVE_URING
+    if (c->ring) {
+        // Nothing to register: what is in flight completes on its own. A stream keeps a receive armed to see the
+        // client hang up, as EPOLLRDHUP does; input left over from its request is never read.
+        if (c->state == DESI_CONN_STREAMING) desi_conn_drop_rx(c);
+        if (c->state == DESI_CONN_STREAMING && !c->recv_armed && !c->rx_starved && desi_conn_arm_recv(c) != 0) {
+            desi_conn_close(w, c);
+        }
+        return;
+    }
+#endif
+    // An idle stream only listens for the client hanging up.
+    uint32_t want = EPOLLIN;
+    if (c->state == DESI_CONN_WRITING) want = EPOLLOUT;
+    if (c->state == DESI_CONN_STREAMING) want = c->out ? EPOLLOUT | EPOLLRDHUP : EPOLLRDHUP;
+    if (want != c->events) {
+        struct epoll_event ev = {.events = want, .data.ptr = c};
+        if (epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) != 0) {
+            desi_conn_close(w, c);
+            return;
+        }
+        c->events = want;
+    }
+}
+
+// Runs the connections whose streams were written on other threads since the last wake-up.
+static void desi_worker_wake(struct desi_worker* w, uint64_t now) {
+    uint64_t count;
+    while (read(w->wake.fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+    pthread_mutex_lock(&w->wake.mu);
+    desi_http_stream_t* s = w->wake.pending;
+    w->wake.pending = NULL;
+    pthread_mutex_unlock(&w->wake.mu);
+    while (s) {
+        desi_http_stream_t* next = s->wake_next;
+        pthread_mutex_lock(&s->mu);
+        struct desi_conn* c = s->conn;
+        pthread_mutex_unlock(&s->mu);
+        if (c) desi_conn_event(w, c, 0, now);
+        desi_stream_unref(s);
+        s = next;
+    }
+}
+
+// Hands a freshly accepted connection to the worker's event loop.
+static bool desi_worker_attach(struct desi_worker* w, struct desi_conn* c) {
+#ifdef DESI_HAVE_URING
+    if (w->uring) {
+        // No MSG_ZEROCOPY here: nothing would reap its completions.
+        c->ring = &w->ring;
+        return desi_conn_arm_recv(c) == 0;
+    }
+#endif
+#ifdef SO_ZEROCOPY
+    if (w->pool->conn_conf.zerocopy_min_bytes) {
+        int on = 1;
+        c->zerocopy = setsockopt(c->fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0;
+    }
+#endif
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+    return epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, c->fd, &ev) == 0;
+}
+
+static void desi_worker_adopt(struct desi_worker* w, int fd, uint64_t now) {
+    struct desi_server_pool* pool = w->pool;
+    struct desi_conn* c = malloc(sizeof(*c));
+    if (!c) {
+        close(fd);
+        return;
+    }
+    desi_conn_init(c, fd, &pool->conn_conf);
+    c->wake = &w->wake;
+    int on = 1;
+    if (!pool->nagle) (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (!desi_worker_attach(w, c)) {
+        close(fd);
+        free(c);
+        return;
+    }
+    c->header_deadline_ms = now + pool->header_timeout_ms;
+    if (pool->idle_timeout_ms) c->idle_deadline_ms = now + pool->idle_timeout_ms;
+    c->next = w->conns;
+    if (c->next) c->next->prev = c;
+    w->conns = c;
+    desi_timer_link(w, c);
+}
+
+static int desi_worker_accept(struct desi_worker* w, uint64_t now) {
     for (;;) {
-        int client_fd = accept(listen_fd, NULL, NULL);
-        if (client_fd < 0) {
-            if (errno == EINTR) continue;
-            close(listen_fd);
+        int fd = accept4(w->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // The backlog keeps the connection; stop polling the socket until a tick has passed.
+                if (epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, w->listen_fd, NULL) != 0) return -1;
+                w->accept_paused = true;
+                w->accept_resume_ms = now + DESI_WHEEL_TICK_MS;
+                return 0;
+            }
             return -1;
         }
-
-        (void)desi_handle_client(client_fd, handler, user_data);
-        close(client_fd);
+        desi_worker_adopt(w, fd, now);
     }
+}
 
+static int desi_wake_init(struct desi_wake* wake) {
+    wake->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake->fd < 0) return -1;
+    pthread_mutex_init(&wake->mu, NULL);
+    wake->pending = NULL;
     return 0;
 }
+
+// Called once every connection is closed, which detaches their streams, so no producer queues another.
+static void desi_wake_destroy(struct desi_wake* wake) {
+    while (wake->pending) {
+        desi_http_stream_t* s = wake->pending;
+        wake->pending = s->wake_next;
+        desi_stream_unref(s);
+    }
+    pthread_mutex_destroy(&wake->mu);
+    close(wake->fd);
+}
+
+#ifdef DESI_HAVE_URING
+// Hands a connection's completion to the state machine as the readiness epoll would have reported.
+static void desi_conn_complete(struct desi_worker* w, struct desi_conn* c, uintptr_t kind,
+                               const struct io_uring_cqe* cqe, uint64_t now) {
+    uint32_t events = 0;
+    if (kind == DESI_URING_SEND) {
+        c->send_armed = false;
+        c->send_done = true;
+        c->send_res = cqe->res;
+        events = EPOLLOUT;
+    } else if (cqe->res > 0 && c->state == DESI_CONN_STREAMING) {
+        // A stream reads nothing more from its client: whatever it sends goes straight back to the buffer ring,
+        // or a few stray bytes per subscriber would pin every buffer for the life of the streams.
+        c->recv_armed = false;
+        desi_uring_recycle(&w->ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if (!c->retired && desi_conn_arm_recv(c) != 0) {
+            desi_conn_close(w, c);
+            return;
+        }
+    } else if (cqe->res > 0) {
+        c->recv_armed = false;
+        c->rx_bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        c->rx_off = 0;
+        c->rx_len = (size_t)cqe->res;
+        w->ring.held++;
+        events = EPOLLIN;
+    } else {
+        c->recv_armed = false;
+        if (cqe->res == 0) {
+            c->rx_eof = true;
+            events = EPOLLIN | EPOLLRDHUP;
+        } else if (cqe->res == -ENOBUFS) {
+            // Every buffer is taken; desi_worker_feed arms the receive again once one is back.
+            if (!c->retired) {
+                c->rx_starved = true;
+                w->starved++;
+            }
+        } else if (cqe->res == -EAGAIN || cqe->res == -EINTR) {
+            events = EPOLLIN;  // the next read arms it again
+        } else {
+            c->rx_error = -cqe->res;
+            events = EPOLLIN | EPOLLERR;
+        }
+    }
+    if (c->retired) {
+        desi_conn_reap(w, c);
+        return;
+    }
+    if (events) desi_conn_event(w, c, events, now);
+}
+
+// Arms the receives that found no free buffer, once one is back.
+static void desi_worker_feed(struct desi_worker* w) {
+    if (w->starved == 0 || w->ring.held >= DESI_URING_BUFS) return;
+    struct desi_conn* c = w->conns;
+    while (c && w->starved > 0) {
+        struct desi_conn* next = c->next;
+        if (c->rx_starved) {
+            c->rx_starved = false;
+            w->starved--;
+            if (desi_conn_arm_recv(c) != 0) desi_conn_close(w, c);
+        }
+        c = next;
+    }
+}
+
+// Handles one completion that is not a connection's. Returns -1 when the worker cannot go on.
+static int desi_worker_complete(struct desi_worker* w, const struct io_uring_cqe* cqe, uint64_t now, bool* woken) {
+    struct desi_server_pool* pool = w->pool;
+    uintptr_t tag = (uintptr_t)cqe->user_data;
+    // A multishot request that ends without IORING_CQE_F_MORE is queued again.
+    bool more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    if (tag == (uintptr_t)&pool->stop_fd) return more ? 0 : desi_uring_poll(&w->ring, pool->stop_fd, &pool->stop_fd);
+    if (tag == (uintptr_t)&w->wake) {
+        *woken = true;
+        return more ? 0 : desi_uring_poll(&w->ring, w->wake.fd, &w->wake);
+    }
+    int err = -cqe->res;
+    if (cqe->res >= 0) {
+        desi_worker_adopt(w, cqe->res, now);
+    } else if (err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM) {
+        // The backlog keeps the connection; accepting resumes once a tick has passed.
+        if (!more) {
+            w->accept_paused = true;
+            w->accept_resume_ms = now + DESI_WHEEL_TICK_MS;
+        }
+        return 0;
+    } else if (err != EINTR && err != ECONNABORTED && err != EAGAIN) {
+        return -1;
+    }
+    return more ? 0 : desi_uring_accept(&w->ring, w->listen_fd, &w->listen_fd);
+}
+
+// The worker loop on io_uring: the same connection state machine, fed completions instead of readiness. Each
+// round submits everything queued since the last one in the same io_uring_enter that waits for the next
+// completions, so a broadcast to many streams costs a few system calls rather than one per stream.
+static int desi_worker_loop_uring(struct desi_worker* w) {
+    struct desi_server_pool* pool = w->pool;
+    struct desi_uring* r = &w->ring;
+    if (desi_wake_init(&w->wake) != 0) {
+        desi_uring_free(r);
+        return -1;
+    }
+    if (desi_uring_accept(r, w->listen_fd, &w->listen_fd) != 0 ||
+        desi_uring_poll(r, pool->stop_fd, &pool->stop_fd) != 0 || desi_uring_poll(r, w->wake.fd, &w->wake) != 0) {
+        desi_wake_destroy(&w->wake);
+        desi_uring_free(r);
+        return -1;
+    }
+    w->wheel_tick = desi_now_ms() / DESI_WHEEL_TICK_MS;
+
+    int rc = 0;
+    while (rc == 0 && !atomic_load(&pool->stopping)) {
+        int timeout = (w->timed_count > 0 || w->accept_paused || w->starved > 0) ? DESI_WHEEL_TICK_MS : -1;
+        if (desi_uring_enter(r, true, timeout) != 0) {
+            rc = -1;
+            break;
+        }
+        uint64_t now = desi_now_ms();
+        bool woken = false;
+        struct io_uring_cqe cqe;
+        while (rc == 0 && desi_uring_next(r, &cqe)) {
+            uintptr_t tag = (uintptr_t)cqe.user_data;
+            uintptr_t kind = tag & DESI_URING_KIND_MASK;
+            if (kind != 0) {
+                desi_conn_complete(w, (struct desi_conn*)(tag - kind), kind, &cqe, now);
+            } else {
+                rc = desi_worker_complete(w, &cqe, now, &woken);
+            }
+        }
+        if (woken) desi_worker_wake(w, now);
+        desi_wheel_advance(w, now);
+        desi_worker_feed(w);
+        if (rc == 0 && w->accept_paused && now >= w->accept_resume_ms) {
+            rc = desi_uring_accept(r, w->listen_fd, &w->listen_fd);
+            w->accept_paused = false;
+        }
+    }
+    while (w->conns) desi_conn_close(w, w->conns);
+    desi_wake_destroy(&w->wake);
+    // The shut-down sockets complete what they had in flight right away; a connection still waiting after that
+    // is freed with the ring, which cancels its requests.
+    for (int i = 0; w->retired && i < DESI_URING_DRAIN_TICKS; i++) {
+        if (desi_uring_enter(r, true, DESI_WHEEL_TICK_MS) != 0) break;
+        struct io_uring_cqe cqe;
+        while (desi_uring_next(r, &cqe)) {
+            uintptr_t tag = (uintptr_t)cqe.user_data;
+            uintptr_t kind = tag & DESI_URING_KIND_MASK;
+            if (kind != 0) {
+                desi_conn_complete(w, (struct desi_conn*)(tag - kind), kind, &cqe, 0);
+            } else if (tag == (uintptr_t)&w->listen_fd && cqe.res >= 0) {
+                close(cqe.res);
+            }
+        }
+    }
+    desi_uring_free(r);
+    while (w->retired) {
+        struct desi_conn* c = w->retired;
+        w->retired = c->next;
+        desi_conn_release(c);
+        free(c);
+    }
+    return rc;
+}
+#endif
+
+static int desi_worker_loop(struct desi_worker* w) {
+    struct desi_server_pool* pool = w->pool;
+#ifdef DESI_HAVE_URING
+    if (!pool->epoll_only && desi_uring_init(&w->ring) == 0) {
+        w->uring = true;
+        return desi_worker_loop_uring(w);
+    }
+#endif
+    w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (w->epoll_fd < 0) return -1;
+    if (desi_wake_init(&w->wake) != 0) {
+        close(w->epoll_fd);
+        return -1;
+    }
+    struct epoll_event listen_ev = {.events = EPOLLIN, .data.ptr = &w->listen_fd};
+    struct epoll_event stop_ev = {.events = EPOLLIN, .data.ptr = &pool->stop_fd};
+    struct epoll_event wake_ev = {.events = EPOLLIN, .data.ptr = &w->wake};
+    if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->listen_fd, &listen_ev) != 0 ||
+        epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, pool->stop_fd, &stop_ev) != 0 ||
+        epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->wake.fd, &wake_ev) != 0) {
+        desi_wake_destroy(&w->wake);
+        close(w->epoll_fd);
+        return -1;
+    }
+    w->wheel_tick = desi_now_ms() / DESI_WHEEL_TICK_MS;
+
+    struct epoll_event events[DESI_EPOLL_BATCH];
+    int rc = 0;
+    while (rc == 0 && !atomic_load(&pool->stopping)) {
+        int timeout = (w->timed_count > 0 || w->accept_paused) ? DESI_WHEEL_TICK_MS : -1;
+        int n = epoll_wait(w->epoll_fd, events, DESI_EPOLL_BATCH, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            rc = -1;
+            break;
+        }
+        uint64_t now = desi_now_ms();
+        bool woken = false;
+        for (int i = 0; rc == 0 && i < n; i++) {
+            void* tag = events[i].data.ptr;
+            if (tag == &pool->stop_fd) continue;
+            // After the batch: a stream may finish and close a connection that still has an event in it.
+            if (tag == &w->wake) {
+                woken = true;
+                continue;
+            }
+            if (tag == &w->listen_fd) {
+                rc = desi_worker_accept(w, now);
+                continue;
+            }
+            desi_conn_event(w, tag, events[i].events, now);
+        }
+        if (woken) desi_worker_wake(w, now);
+        desi_wheel_advance(w, now);
+        if (rc == 0 && w->accept_paused && now >= w->accept_resume_ms) {
+            if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->listen_fd, &listen_ev) != 0) rc = -1;
+            w->accept_paused = false;
+        }
+    }
+    while (w->conns) desi_conn_close(w, w->conns);
+    desi_wake_destroy(&w->wake);
+    close(w->epoll_fd);
+    return rc;
+}
+
+static void desi_pool_stop(struct desi_server_pool* pool) {
+    if (atomic_exchange(&pool->stopping, true)) return;
+    uint64_t one = 1;
+    ssize_t n;
+    do {
+        n = write(pool->stop_fd, &one, sizeof(one));
+    } while (n < 0 && errno == EINTR);
+}
+
+static void* desi_worker_main(void* arg) {
+    struct desi_worker* w = arg;
+#ifdef __linux__
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        (void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+    (void)desi_worker_loop(w);
+    desi_pool_stop(w->pool);
+    return NULL;
+}
+
+int desi_server_run(const desi_server_config_t* conf, desi_request_handler_t handler, void* user_data) {
+    if (!conf || !handler) return -1;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int cpus[DESI_MAX_CPUS];
+    size_t cpu_count = desi_usable_cpus(cpus, sizeof(cpus) / sizeof(cpus[0]));
+    size_t count = conf->workers > 0 ? conf->workers : cpu_count;
+
+    struct desi_server_pool pool = {.conn_conf = {.handler = handler,
+                                                  .body_chunk = conf->body_chunk,
+                                                  .user_data = user_data,
+                                                  .max_requests = conf->max_requests_per_conn,
+                                                  .max_body_bytes = conf->max_body_bytes,
+                                                  .tcp_cork = conf->tcp_cork,
+                                                  .zerocopy_min_bytes = conf->zerocopy_min_bytes},
+                                    .idle_timeout_ms = conf->idle_timeout_ms,
+                                    .header_timeout_ms = conf->header_timeout_ms,
+                                    .nagle = conf->nagle,
+                                    .epoll_only = conf->epoll_only,
+                                    .count = count};
+    if (pool.header_timeout_ms == 0) pool.header_timeout_ms = DESI_HTTP_DEFAULT_HEADER_TIMEOUT_MS;
+    if (pool.conn_conf.max_requests == 0) pool.conn_conf.max_requests = DESI_HTTP_DEFAULT_MAX_REQUESTS;
+    if (pool.conn_conf.max_body_bytes == 0) pool.conn_conf.max_body_bytes = DESI_HTTP_DEFAULT_MAX_BODY_BYTES;
+    atomic_init(&pool.stopping, false);
+    pool.stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (pool.stop_fd < 0) return -1;
+    pool.workers = calloc(count, sizeof(*pool.workers));
+    if (!pool.workers) {
+        close(pool.stop_fd);
+        return -1;
+    }
+
+    // Every worker gets its own listening socket on the same port and the kernel spreads connections across
+    // them. Without SO_REUSEPORT the workers share one socket instead.
+    int rc = 0;
+    uint16_t port = conf->port;
+    for (size_t i = 0; i < count; i++) {
+        struct desi_worker* w = &pool.workers[i];
+        w->pool = &pool;
+        w->cpu = conf->pin_cpus ? cpus[i % cpu_count] : -1;
+#ifdef SO_REUSEPORT
+        w->listen_fd = desi_listen_socket(conf, port, count > 1);
+#else
+        w->listen_fd = i == 0 ? desi_listen_socket(conf, port, false) : dup(pool.workers[0].listen_fd);
+#endif
+        if (w->listen_fd < 0) {
+            rc = -1;
+            pool.count = i;
+            break;
+        }
+        // With port 0 the first bind picks the port and the other workers join it.
+        if (port == 0) port = desi_bound_port(w->listen_fd);
+        if (port == 0) {
+            rc = -1;
+            pool.count = i + 1;
+            break;
+        }
+    }
+
+    // The calling thread serves as worker 0.
+    for (size_t i = 1; rc == 0 && i < count; i++) {
+        struct desi_worker* w = &pool.workers[i];
+        if (pthread_create(&w->thread, NULL, desi_worker_main, w) != 0) {
+            rc = -1;
+            break;
+        }
+        w->started = true;
+    }
+    if (rc == 0) {
+        desi_worker_main(&pool.workers[0]);
+        rc = -1;
+    }
+    desi_pool_stop(&pool);
+    for (size_t i = 0; i < pool.count; i++) {
+        if (pool.workers[i].started) pthread_join(pool.workers[i].thread, NULL);
+    }
+    for (size_t i = 0; i < pool.count; i++) {
+        if (pool.workers[i].listen_fd >= 0) close(pool.workers[i].listen_fd);
+    }
+    free(pool.workers);
+    close(pool.stop_fd);
+    return rc;
+}
@@ -1,32 +1,129 @@
 #ifndef DESI_INTERNAL_HTTP1_SERVER_H
 #define DESI_INTERNAL_HTTP1_SERVER_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 typedef struct {
-    const char* bind_host;
-    uint16_t port;
-    int backlog;
-    uint32_t idle_timeout_ms;
-} desi_server_config_t;
+    const char* name;
+    size_t name_len;
+    const char* value;  // surrounding whitespace trimmed
+    size_t value_len;
+} desi_http_header_t;
 
 typedef struct {
     const char* method;
     size_t method_len;
     const char* path;
     size_t path_len;
+    // Spans into the connection's buffers, like every pointer here; valid until the handler returns.
+    const desi_http_header_t* headers;
+    size_t header_count;
+    // The body, decoded from Content-Length or chunked framing. In streaming body mode body is NULL,
+    // body_len is the total that passed through the body callback and body_state is what it left.
+    const char* body;
+    size_t body_len;
+    void* body_state;
+    bool http11;
 } desi_http_req_t;
 
+// Streaming body mode: each decoded piece of a request body is passed here as it arrives instead of being
+// buffered, so large bodies can be validated without holding them. *state is NULL when a request starts and
+// reaches the handler as req->body_state. A final call with data == NULL, after the handler or when the request
+// fails first, releases it. Returning nonzero rejects the request with 400.
+typedef int (*desi_body_chunk_handler_t)(void* user_data, const desi_http_req_t* req, void** state, const char* data,
+                                         size_t len);
+
+typedef struct {
+    const char* bind_host;
+    uint16_t port;
+    int backlog;
+    // A connection with no read or write progress for this long is closed; 0 disables the timeout.
+    uint32_t idle_timeout_ms;
+    // The request head must arrive within this long of accept (or of the previous response on a kept-alive
+    // connection), however slowly it trickles in; 0 means 10 s.
+    uint32_t header_timeout_ms;
+    // Requests served on one persistent connection before the server closes it; 0 means 1000.
+    uint32_t max_requests_per_conn;
+    // Larger request bodies are refused with 413; 0 means 1 MiB.
+    uint64_t max_body_bytes;
+    // Optional; see desi_body_chunk_handler_t. Called with desi_server_run's user_data.
+    desi_body_chunk_handler_t body_chunk;
+    // Accept loops, each on its own SO_REUSEPORT socket; 0 means one per usable CPU.
+    unsigned workers;
+    // Pin worker i to the i-th usable CPU (Linux only).
+    bool pin_cpus;
+    // Connections get TCP_NODELAY: a response leaves in one write, and streamed chunks should not wait for an
+    // ACK. Set to keep Nagle's algorithm instead.
+    bool nagle;
+    // Cork every fixed-size response (TCP_CORK) from its first byte to its last, so one that takes several
+    // writes still leaves in full segments. Costs two setsockopt calls per response.
+    bool tcp_cork;
+    // Static bodies at least this large are sent with MSG_ZEROCOPY (Linux only); 0 disables it.
+    uint32_t zerocopy_min_bytes;
+    // A server built with io_uring support (meson -Dio_uring) runs each worker on a ring and falls back to epoll
+    // where the kernel refuses one. Set to use epoll regardless.
+    bool epoll_only;
+} desi_server_config_t;
+
+// A response body written after the handler returns; see desi_http_resp_stream.
+typedef struct desi_http_stream desi_http_stream_t;
+
 typedef struct {
     int status;
     const char* content_type;
     const char* body;
     size_t body_len;
+    // The body outlives the server (a literal, a table, a long-lived mapping), so it is sent from where it is
+    // instead of being copied.
+    bool body_static;
+    // Extra header lines, each ending in "\r\n"; copied before the handler's return like the body.
+    const char* headers;
+    // Set by desi_http_resp_stream; body and body_len are then ignored.
+    desi_http_stream_t* stream;
 } desi_http_resp_t;
 
 typedef int (*desi_request_handler_t)(void* user_data, const desi_http_req_t* req, desi_http_resp_t* resp);
 
+enum {
+    DESI_STREAM_OK = 0,
+    DESI_STREAM_BUSY = 1,     // the queue is full; nothing was written
+    DESI_STREAM_CLOSED = -1,  // the client is gone or the response failed; further writes are pointless
+    DESI_STREAM_ERROR = -2,   // bad input or out of memory; nothing was written
+};
+
+// Turns resp into a streamed response: the head (resp's status, content_type and headers) is sent when the
+// handler returns and the body follows as it is written, in chunked transfer encoding for HTTP/1.1 clients and
+// until the connection closes for HTTP/1.0 ones. The stream may be written from any thread, including the
+// handler before it returns. Returns NULL when out of memory.
+//
+// Writes are queued and sent by the connection's worker. Once the queue holds 64 KiB a write is refused with
+// DESI_STREAM_BUSY; wait for room with desi_http_stream_wait, or from an event loop register
+// desi_http_stream_on_drain. desi_http_stream_finish must be called exactly once, whatever the writes returned.
+desi_http_stream_t* desi_http_resp_stream(const desi_http_req_t* req, desi_http_resp_t* resp);
+int desi_http_stream_write(desi_http_stream_t* stream, const char* data, size_t len);
+// One SSE event or ": ping" comment, formatted by sse_write_event / sse_write_keepalive.
+int desi_http_stream_sse_event(desi_http_stream_t* stream, const char* event_type, size_t event_len, const char* data,
+                               size_t data_len);
+int desi_http_stream_sse_keepalive(desi_http_stream_t* stream);
+// Blocks until a write would be accepted, the stream closes or timeout_ms passes (DESI_STREAM_BUSY). Never call
+// it on a worker thread, handler included: the worker is what makes room.
+int desi_http_stream_wait(desi_http_stream_t* stream, uint32_t timeout_ms);
+// After a write was refused, cb runs on the connection's worker once the queue has gone to the socket. It must
+// not block; it may write.
+void desi_http_stream_on_drain(desi_http_stream_t* stream, void (*cb)(void* user_data, desi_http_stream_t* stream),
+                               void* user_data);
+// Ends the body once everything queued is sent and releases the caller's hold on the stream.
+void desi_http_stream_finish(desi_http_stream_t* stream);
+
+// The first header with this name (case-insensitive), or NULL.
+const desi_http_header_t* desi_http_req_header(const desi_http_req_t* req, const char* name);
+
+// Serves until a worker hits a fatal error, then stops every worker and returns -1. Each worker runs one event
+// loop (epoll, or io_uring; see epoll_only) over non-blocking connections, so idle or slow clients cost memory,
+// not threads. The handler and user_data are shared by all workers, so the handler must be safe to call from
+// several threads at once. It runs on the worker's loop and should not block.
 int desi_server_run(const desi_server_config_t* conf, desi_request_handler_t handler, void* user_data);
 
 #endif
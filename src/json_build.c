@@ -61,7 +61,8 @@ static void append_json_raw(struct growbuf* b, const char* json, size_t len) {
     }
 }
 
-static bool validate_content_json_array(const char* json, size_t len, size_t max_parts, size_t max_bytes) {
+static bool validate_content_json_array(const char* json, size_t len, size_t max_parts, size_t max_bytes,
+                                        const llm_allocator_t* alloc) {
     if (!json || len == 0 || len > (size_t)INT_MAX) return false;
     if (max_bytes && len > max_bytes) return false;
 
@@ -71,7 +72,7 @@ static bool validate_content_json_array(const char* json, size_t len, size_t max
     if (needed <= 0) return false;
     if ((size_t)needed > SIZE_MAX / sizeof(jstoktok_t)) return false;
 
-    jstoktok_t* tokens = malloc((size_t)needed * sizeof(*tokens));
+    jstoktok_t* tokens = mem_alloc(alloc, (size_t)needed * sizeof(*tokens));
     if (!tokens) return false;
     jstok_init(&parser);
     int parsed = jstok_parse(&parser, json, (int)len, tokens, needed);
@@ -81,7 +82,7 @@ static bool validate_content_json_array(const char* json, size_t len, size_t max
             ok = false;
         }
     }
-    free(tokens);
+    mem_free(alloc, tokens);
     return ok;
 }
 
@@ -335,9 +336,10 @@ bool llm_request_opts_json_write(const llm_request_opts_t* opts, char* out, size
 
 char* build_chat_request(const char* model, const llm_message_t* messages, size_t messages_count, bool stream,
                          bool include_usage, const char* params_json, const char* tooling_json,
-                         const char* response_format_json, size_t max_content_parts, size_t max_content_bytes) {
+                         const char* response_format_json, size_t max_content_parts, size_t max_content_bytes,
+                         const llm_allocator_t* alloc) {
     struct growbuf b;
-    growbuf_init(&b, 4096);
+    growbuf_init(&b, 4096, alloc);
 
     append_lit(&b, "{\"model\":");
     append_json_string(&b, model, strlen(model));
@@ -369,7 +371,7 @@ char* build_chat_request(const char* model, const llm_message_t* messages, size_
                 return NULL;
             }
             if (!validate_content_json_array(messages[i].content_json, messages[i].content_json_len, max_content_parts,
-                                             max_content_bytes)) {
+                                             max_content_bytes, alloc)) {
                 growbuf_free(&b);
                 return NULL;
             }
@@ -460,9 +462,9 @@ char* build_chat_request(const char* model, const llm_message_t* messages, size_
 }
 
 char* build_completions_request(const char* model, const char* prompt, size_t prompt_len, bool stream,
-                                bool include_usage, const char* params_json) {
+                                bool include_usage, const char* params_json, const llm_allocator_t* alloc) {
     struct growbuf b;
-    growbuf_init(&b, 4096);
+    growbuf_init(&b, 4096, alloc);
 
     append_lit(&b, "{\"model\":");
     append_json_string(&b, model, strlen(model));
@@ -499,7 +501,8 @@ char* build_completions_request(const char* model, const char* prompt, size_t pr
 }
 
 char* build_embeddings_request(const char* model, const llm_embedding_input_t* inputs, size_t inputs_count,
-                               const char* params_json, size_t max_input_bytes, size_t max_inputs) {
+                               const char* params_json, const char* encoding_format, size_t max_input_bytes,
+                               size_t max_inputs, const llm_allocator_t* alloc) {
     if (!model) return NULL;
     if (inputs_count == 0) return NULL;
     if (inputs_count > 0 && !inputs) return NULL;
@@ -510,7 +513,7 @@ char* build_embeddings_request(const char* model, const llm_embedding_input_t* i
     }
 
     struct growbuf b;
-    growbuf_init(&b, 4096);
+    growbuf_init(&b, 4096, alloc);
 
     append_lit(&b, "{\"model\":");
     append_json_string(&b, model, strlen(model));
@@ -520,6 +523,10 @@ char* build_embeddings_request(const char* model, const llm_embedding_input_t* i
         append_json_string(&b, inputs[i].text, inputs[i].text_len);
     }
     append_char(&b, ']');
+    if (encoding_format) {
+        append_lit(&b, ",\"encoding_format\":");
+        append_json_string(&b, encoding_format, strlen(encoding_format));
+    }
 
     if (params_json) {
         size_t p_len = strlen(params_json);
@@ -7,12 +7,15 @@
 
 char* build_chat_request(const char* model, const llm_message_t* messages, size_t messages_count, bool stream,
                          bool include_usage, const char* params_json, const char* tooling_json,
-                         const char* response_format_json, size_t max_content_parts, size_t max_content_bytes);
+                         const char* response_format_json, size_t max_content_parts, size_t max_content_bytes,
+                         const llm_allocator_t* alloc);
 
 char* build_completions_request(const char* model, const char* prompt, size_t prompt_len, bool stream,
-                                bool include_usage, const char* params_json);
+                                bool include_usage, const char* params_json, const llm_allocator_t* alloc);
 
+// encoding_format is optional ("float" or "base64"); NULL leaves it to the server default.
 char* build_embeddings_request(const char* model, const llm_embedding_input_t* inputs, size_t inputs_count,
-                               const char* params_json, size_t max_input_bytes, size_t max_inputs);
+                               const char* params_json, const char* encoding_format, size_t max_input_bytes,
+                               size_t max_inputs, const llm_allocator_t* alloc);
 
 #endif  // JSON_BUILD_H
@@ -3,16 +3,27 @@
 
 #include "json_build.h"
 #include "llm/internal.h"
+#include "protocol_embeddings.h"
 #include "sse.h"
+#include "stop_match.h"
 #include "tools_accum.h"
+#include "tools_loop.h"
 #include "transport_curl.h"
 #define JSTOK_HEADER
 #include <jstok.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 struct llm_client {
     char* base_url;
@@ -37,9 +48,19 @@ struct llm_client {
     size_t headers_cap;
     bool last_error_enabled;
     llm_error_detail_t last_error;
+    llm_allocator_t allocator;
+    struct llm_client_shared* shared;  // owner of everything above but last_error
+};
+
+// Handles made by llm_client_context_create share one copy of the configuration strings; the last handle
+// destroyed frees them.
+struct llm_client_shared {
+    atomic_size_t refs;
 };
 
 enum { LLM_ERROR_DETAIL_TOKENS_MAX = 64 };
+// Streaming embeddings keep at most this much of the body for error details.
+enum { LLM_EMBEDDINGS_STREAM_CAPTURE_MAX = 64 * 1024 };
 
 void llm_client_destroy(llm_client_t* client);
 static bool header_list_validate(const char* const* headers, size_t headers_count);
@@ -54,7 +75,7 @@ static void error_detail_clear(llm_error_detail_t* detail) {
 
 void llm_error_detail_free(llm_error_detail_t* detail) {
     if (!detail) return;
-    free(detail->_internal);
+    mem_free(&detail->_allocator, detail->_internal);
     error_detail_clear(detail);
 }
 
@@ -66,6 +87,8 @@ const char* llm_errstr(llm_error_t code) {
             return "cancelled";
         case LLM_ERR_FAILED:
             return "failed";
+        case LLM_ERR_INVALID_TOOL_ARGS:
+            return "invalid tool arguments";
         default:
             return "unknown";
     }
@@ -110,10 +133,11 @@ static void error_detail_parse_openai(llm_error_detail_t* detail, const char* js
     }
 }
 
-static void error_detail_fill(llm_error_detail_t* detail, llm_error_t code, llm_error_stage_t stage, long http_status,
-                              char* body, size_t body_len, bool parse_error) {
+static void error_detail_fill(llm_error_detail_t* detail, const llm_allocator_t* alloc, llm_error_t code,
+                              llm_error_stage_t stage, long http_status, char* body, size_t body_len,
+                              bool parse_error) {
     if (!detail) {
-        free(body);
+        mem_free(alloc, body);
         return;
     }
     llm_error_detail_free(detail);
@@ -121,6 +145,7 @@ static void error_detail_fill(llm_error_detail_t* detail, llm_error_t code, llm_
     detail->stage = stage;
     error_detail_set_http_status(detail, http_status);
     if (body) {
+        if (alloc) detail->_allocator = *alloc;
         detail->_internal = body;
         detail->raw_body = body;
         detail->raw_body_len = body_len;
@@ -135,38 +160,53 @@ static void last_error_reset(llm_client_t* client) {
     llm_error_detail_free(&client->last_error);
 }
 
+static const llm_allocator_t* client_allocator(const llm_client_t* client) {
+    return client ? &client->allocator : NULL;
+}
+
 static void error_detail_capture(llm_client_t* client, llm_error_detail_t* detail, llm_error_t code,
                                  llm_error_stage_t stage, long http_status, char* body, size_t body_len,
                                  bool parse_error) {
+    const llm_allocator_t* alloc = client_allocator(client);
     if (detail) {
-        error_detail_fill(detail, code, stage, http_status, body, body_len, parse_error);
+        error_detail_fill(detail, alloc, code, stage, http_status, body, body_len, parse_error);
         if (client && client->last_error_enabled) {
             char* body_copy = NULL;
             size_t body_copy_len = 0;
             if (detail->raw_body && detail->raw_body_len > 0) {
                 body_copy_len = detail->raw_body_len;
-                body_copy = malloc(body_copy_len);
+                body_copy = mem_alloc(alloc, body_copy_len);
                 if (body_copy) {
                     memcpy(body_copy, detail->raw_body, body_copy_len);
                 } else {
                     body_copy_len = 0;
                 }
             }
-            error_detail_fill(&client->last_error, code, stage, http_status, body_copy, body_copy_len, parse_error);
+            error_detail_fill(&client->last_error, alloc, code, stage, http_status, body_copy, body_copy_len,
+                              parse_error);
         }
         return;
     }
     if (client && client->last_error_enabled) {
-        error_detail_fill(&client->last_error, code, stage, http_status, body, body_len, parse_error);
+        error_detail_fill(&client->last_error, alloc, code, stage, http_status, body, body_len, parse_error);
         return;
     }
-    free(body);
+    mem_free(alloc, body);
+}
+
+// Moves a response body allocated from a per-request allocator (arena) into client memory so error
+// details never reference storage the caller may reset.
+static char* body_adopt(llm_client_t* client, const llm_allocator_t* alloc, char* body, size_t len) {
+    if (!body || alloc == &client->allocator) return body;
+    char* copy = mem_strndup(&client->allocator, body, len);
+    mem_free(alloc, body);
+    return copy;
 }
 
 static void last_error_set_simple_if_empty(llm_client_t* client, llm_error_t code, llm_error_stage_t stage) {
     if (!client || !client->last_error_enabled) return;
     if (client->last_error.code != LLM_ERR_NONE) return;
-    error_detail_fill(&client->last_error, code, stage, 0, NULL, 0, false);
+    error_detail_fill(&client->last_error, &client->allocator, code, stage, 0, NULL, 0, false);
 }
 
 static llm_error_stage_t transport_stage(const llm_transport_status_t* status) {
@@ -178,9 +218,9 @@ static void llm_client_headers_free(llm_client_t* client) {
     if (!client) return;
     if (client->headers) {
         for (size_t i = 0; i < client->custom_headers_count; i++) {
-            free(client->headers[i]);
+            mem_free(&client->allocator, client->headers[i]);
         }
-        free(client->headers);
+        mem_free(&client->allocator, client->headers);
     }
     client->headers = NULL;
     client->headers_count = 0;
@@ -200,7 +240,7 @@ static bool llm_client_headers_init(llm_client_t* client, const char* const* hea
     }
 
     client->headers_cap = headers_count + 1;
-    client->headers = calloc(client->headers_cap, sizeof(char*));
+    client->headers = mem_calloc(&client->allocator, client->headers_cap, sizeof(char*));
     if (!client->headers) return false;
 
     for (size_t i = 0; i < headers_count; i++) {
@@ -208,7 +248,7 @@ static bool llm_client_headers_init(llm_client_t* client, const char* const* hea
             llm_client_headers_free(client);
             return false;
         }
-        client->headers[i] = strdup(headers[i]);
+        client->headers[i] = mem_strdup(&client->allocator, headers[i]);
         if (!client->headers[i]) {
             llm_client_headers_free(client);
             return false;
@@ -224,13 +264,16 @@ llm_client_t* llm_client_create_with_headers_opts(const char* base_url, const ll
                                                   const llm_timeout_t* timeout, const llm_limits_t* limits,
                                                   const char* const* headers, size_t headers_count,
                                                   const llm_client_init_opts_t* opts) {
-    llm_client_t* client = malloc(sizeof(*client));
+    const llm_allocator_t* alloc = opts ? opts->allocator : NULL;
+    if (alloc && !mem_allocator_custom(alloc)) return NULL;
+    llm_client_t* client = mem_alloc(alloc, sizeof(*client));
     if (!client) return NULL;
     memset(client, 0, sizeof(*client));
+    if (alloc) client->allocator = *alloc;
 
-    client->base_url = strdup(base_url);
+    client->base_url = mem_strdup(&client->allocator, base_url);
     if (model) {
-        client->model.name = strdup(model->name);
+        client->model.name = mem_strdup(&client->allocator, model->name);
     }
     if (timeout) {
         client->timeout = *timeout;
@@ -256,6 +299,12 @@ llm_client_t* llm_client_create_with_headers_opts(const char* base_url, const ll
     client->tls_verify_peer = true;
     client->tls_verify_host = true;
     client->last_error_enabled = opts && opts->enable_last_error;
+    client->shared = mem_alloc(&client->allocator, sizeof(*client->shared));
+    if (!client->shared) {
+        llm_client_destroy(client);
+        return NULL;
+    }
+    atomic_init(&client->shared->refs, 1);
 
     if (!llm_client_headers_init(client, headers, headers_count)) {
         llm_client_destroy(client);
@@ -281,40 +330,120 @@ llm_client_t* llm_client_create(const char* base_url, const llm_model_t* model,
     return llm_client_create_with_headers_opts(base_url, model, timeout, limits, NULL, 0, NULL);
 }
 
+static void llm_client_config_free(llm_client_t* client) {
+    mem_free(&client->allocator, client->base_url);
+    mem_free(&client->allocator, (char*)client->model.name);
+    llm_client_headers_free(client);
+    mem_free(&client->allocator, client->auth_header);
+    mem_free(&client->allocator, client->tls_ca_bundle_path);
+    mem_free(&client->allocator, client->tls_ca_dir_path);
+    mem_free(&client->allocator, client->tls_client_cert_path);
+    mem_free(&client->allocator, client->tls_client_key_path);
+    mem_free(&client->allocator, client->proxy_url);
+    mem_free(&client->allocator, client->no_proxy);
+    mem_free(&client->allocator, client->shared);
+}
+
 void llm_client_destroy(llm_client_t* client) {
     if (client) {
-        free(client->base_url);
-        free((char*)client->model.name);
-        llm_client_headers_free(client);
-        free(client->auth_header);
-        free(client->tls_ca_bundle_path);
-        free(client->tls_ca_dir_path);
-        free(client->tls_client_cert_path);
-        free(client->tls_client_key_path);
-        free(client->proxy_url);
-        free(client->no_proxy);
+        if (!client->shared || atomic_fetch_sub(&client->shared->refs, 1) == 1) {
+            llm_client_config_free(client);
+        }
         llm_error_detail_free(&client->last_error);
-        free(client);
+        llm_allocator_t alloc = client->allocator;
+        mem_free(&alloc, client);
+    }
+}
+
+llm_client_t* llm_client_context_create(const llm_client_t* client) {
+    if (!client || !client->shared) return NULL;
+    llm_client_t* ctx = mem_alloc(&client->allocator, sizeof(*ctx));
+    if (!ctx) return NULL;
+    *ctx = *client;
+    error_detail_clear(&ctx->last_error);
+    atomic_fetch_add(&client->shared->refs, 1);
+    return ctx;
+}
+
+static bool config_dup(const llm_allocator_t* alloc, char** dst, const char* src) {
+    *dst = mem_strdup(alloc, src);
+    return *dst || !src;
+}
+
+// Gives client private copies of the configuration it shares with other handles, so a setter changes this
+// handle only and never frees strings another thread is reading.
+static bool llm_client_detach(llm_client_t* client) {
+    struct llm_client_shared* shared = client->shared;
+    if (atomic_load(&shared->refs) == 1) return true;
+
+    llm_client_t copy = *client;
+    const llm_allocator_t* alloc = &client->allocator;
+    copy.base_url = NULL;
+    copy.model.name = NULL;
+    copy.headers = NULL;
+    copy.headers_count = 0;
+    copy.custom_headers_count = 0;
+    copy.auth_header = NULL;
+    copy.tls_ca_bundle_path = NULL;
+    copy.tls_ca_dir_path = NULL;
+    copy.tls_client_cert_path = NULL;
+    copy.tls_client_key_path = NULL;
+    copy.proxy_url = NULL;
+    copy.no_proxy = NULL;
+    copy.shared = mem_alloc(alloc, sizeof(*copy.shared));
+    char* model_name = NULL;
+    bool ok = copy.shared && config_dup(alloc, &copy.base_url, client->base_url) &&
+              config_dup(alloc, &model_name, client->model.name) &&
+              config_dup(alloc, &copy.auth_header, client->auth_header) &&
+              config_dup(alloc, &copy.tls_ca_bundle_path, client->tls_ca_bundle_path) &&
+              config_dup(alloc, &copy.tls_ca_dir_path, client->tls_ca_dir_path) &&
+              config_dup(alloc, &copy.tls_client_cert_path, client->tls_client_cert_path) &&
+              config_dup(alloc, &copy.tls_client_key_path, client->tls_client_key_path) &&
+              config_dup(alloc, &copy.proxy_url, client->proxy_url) &&
+              config_dup(alloc, &copy.no_proxy, client->no_proxy);
+    copy.model.name = model_name;
+    if (ok && client->headers) {
+        copy.headers = mem_calloc(alloc, client->headers_cap, sizeof(char*));
+        ok = copy.headers != NULL;
+        for (size_t i = 0; ok && i < client->custom_headers_count; i++) {
+            ok = config_dup(alloc, &copy.headers[i], client->headers[i]);
+            if (ok) copy.custom_headers_count++;
+        }
+        if (ok && client->headers_count > client->custom_headers_count) {
+            copy.headers[copy.custom_headers_count] = copy.auth_header;
+        }
+        copy.headers_count = client->headers_count;
     }
+    if (!ok) {
+        llm_client_config_free(&copy);
+        return false;
+    }
+    atomic_init(&copy.shared->refs, 1);
+
+    llm_client_t old = *client;
+    *client = copy;
+    if (atomic_fetch_sub(&shared->refs, 1) == 1) llm_client_config_free(&old);
+    return true;
 }
 
 bool llm_client_set_model(llm_client_t* client, const llm_model_t* model) {
     if (!client || !model || !model->name) return false;
     if (client->model.name && strcmp(client->model.name, model->name) == 0) return true;
+    if (!llm_client_detach(client)) return false;
 
-    char* name = strdup(model->name);
+    char* name = mem_strdup(&client->allocator, model->name);
     if (!name) return false;
 
-    free((char*)client->model.name);
+    mem_free(&client->allocator, (char*)client->model.name);
     client->model.name = name;
     return true;
 }
 
 bool llm_client_set_api_key(llm_client_t* client, const char* api_key) {
-    if (!client) return false;
+    if (!client || !llm_client_detach(client)) return false;
 
     if (!api_key) {
-        free(client->auth_header);
+        mem_free(&client->allocator, client->auth_header);
         client->auth_header = NULL;
         if (client->headers && client->headers_count > client->custom_headers_count) {
             client->headers[client->custom_headers_count] = NULL;
@@ -328,7 +457,7 @@ bool llm_client_set_api_key(llm_client_t* client, const char* api_key) {
     const char* prefix = "Authorization: Bearer ";
     size_t prefix_len = strlen(prefix);
     size_t key_len = strlen(api_key);
-    char* header = malloc(prefix_len + key_len + 1);
+    char* header = mem_alloc(&client->allocator, prefix_len + key_len + 1);
     if (!header) return false;
     memcpy(header, prefix, prefix_len);
     memcpy(header + prefix_len, api_key, key_len);
@@ -336,17 +465,17 @@ bool llm_client_set_api_key(llm_client_t* client, const char* api_key) {
 
     if (!client->headers) {
         size_t new_cap = client->custom_headers_count ? client->custom_headers_count + 1 : 1;
-        client->headers = calloc(new_cap, sizeof(char*));
+        client->headers = mem_calloc(&client->allocator, new_cap, sizeof(char*));
         if (!client->headers) {
-            free(header);
+            mem_free(&client->allocator, header);
             return false;
         }
         client->headers_cap = new_cap;
     } else if (client->headers_cap < client->custom_headers_count + 1) {
         size_t new_cap = client->custom_headers_count + 1;
-        char** next = realloc(client->headers, new_cap * sizeof(char*));
+        char** next = mem_realloc(&client->allocator, client->headers, new_cap * sizeof(char*));
         if (!next) {
-            free(header);
+            mem_free(&client->allocator, header);
             return false;
         }
         for (size_t i = client->headers_cap; i < new_cap; i++) {
@@ -356,7 +485,7 @@ bool llm_client_set_api_key(llm_client_t* client, const char* api_key) {
         client->headers_cap = new_cap;
     }
 
-    free(client->auth_header);
+    mem_free(&client->allocator, client->auth_header);
     client->auth_header = header;
     client->headers[client->custom_headers_count] = client->auth_header;
     client->headers_count = client->custom_headers_count + 1;
@@ -364,13 +493,13 @@ bool llm_client_set_api_key(llm_client_t* client, const char* api_key) {
 }
 
 bool llm_client_set_tls_config(llm_client_t* client, const llm_tls_config_t* tls) {
-    if (!client) return false;
+    if (!client || !llm_client_detach(client)) return false;
 
     if (!tls) {
-        free(client->tls_ca_bundle_path);
-        free(client->tls_ca_dir_path);
-        free(client->tls_client_cert_path);
-        free(client->tls_client_key_path);
+        mem_free(&client->allocator, client->tls_ca_bundle_path);
+        mem_free(&client->allocator, client->tls_ca_dir_path);
+        mem_free(&client->allocator, client->tls_client_cert_path);
+        mem_free(&client->allocator, client->tls_client_key_path);
         client->tls_ca_bundle_path = NULL;
         client->tls_ca_dir_path = NULL;
         client->tls_client_cert_path = NULL;
@@ -385,41 +514,41 @@ bool llm_client_set_tls_config(llm_client_t* client, const llm_tls_config_t* tls
 
     char* ca_path = NULL;
     if (tls->ca_bundle_path) {
-        ca_path = strdup(tls->ca_bundle_path);
+        ca_path = mem_strdup(&client->allocator, tls->ca_bundle_path);
         if (!ca_path) return false;
     }
     char* ca_dir = NULL;
     if (tls->ca_dir_path) {
-        ca_dir = strdup(tls->ca_dir_path);
+        ca_dir = mem_strdup(&client->allocator, tls->ca_dir_path);
         if (!ca_dir) {
-            free(ca_path);
+            mem_free(&client->allocator, ca_path);
             return false;
         }
     }
     char* cert_path = NULL;
     if (tls->client_cert_path) {
-        cert_path = strdup(tls->client_cert_path);
+        cert_path = mem_strdup(&client->allocator, tls->client_cert_path);
         if (!cert_path) {
-            free(ca_path);
-            free(ca_dir);
+            mem_free(&client->allocator, ca_path);
+            mem_free(&client->allocator, ca_dir);
             return false;
         }
     }
     char* key_path = NULL;
     if (tls->client_key_path) {
-        key_path = strdup(tls->client_key_path);
+        key_path = mem_strdup(&client->allocator, tls->client_key_path);
         if (!key_path) {
-            free(ca_path);
-            free(ca_dir);
-            free(cert_path);
+            mem_free(&client->allocator, ca_path);
+            mem_free(&client->allocator, ca_dir);
+            mem_free(&client->allocator, cert_path);
             return false;
         }
     }
 
-    free(client->tls_ca_bundle_path);
-    free(client->tls_ca_dir_path);
-    free(client->tls_client_cert_path);
-    free(client->tls_client_key_path);
+    mem_free(&client->allocator, client->tls_ca_bundle_path);
+    mem_free(&client->allocator, client->tls_ca_dir_path);
+    mem_free(&client->allocator, client->tls_client_cert_path);
+    mem_free(&client->allocator, client->tls_client_key_path);
     client->tls_ca_bundle_path = ca_path;
     client->tls_ca_dir_path = ca_dir;
     client->tls_client_cert_path = cert_path;
@@ -451,39 +580,113 @@ bool llm_client_set_tls_config(llm_client_t* client, const llm_tls_config_t* tls
 }
 
 bool llm_client_set_proxy(llm_client_t* client, const char* proxy_url) {
-    if (!client) return false;
+    if (!client || !llm_client_detach(client)) return false;
 
     if (!proxy_url || proxy_url[0] == '\0') {
-        free(client->proxy_url);
+        mem_free(&client->allocator, client->proxy_url);
         client->proxy_url = NULL;
         return true;
     }
 
-    char* copy = strdup(proxy_url);
+    char* copy = mem_strdup(&client->allocator, proxy_url);
     if (!copy) return false;
 
-    free(client->proxy_url);
+    mem_free(&client->allocator, client->proxy_url);
     client->proxy_url = copy;
     return true;
 }
 
 bool llm_client_set_no_proxy(llm_client_t* client, const char* no_proxy_list) {
-    if (!client) return false;
+    if (!client || !llm_client_detach(client)) return false;
 
     if (!no_proxy_list || no_proxy_list[0] == '\0') {
-        free(client->no_proxy);
+        mem_free(&client->allocator, client->no_proxy);
         client->no_proxy = NULL;
         return true;
     }
 
-    char* copy = strdup(no_proxy_list);
+    char* copy = mem_strdup(&client->allocator, no_proxy_list);
     if (!copy) return false;
 
-    free(client->no_proxy);
+    mem_free(&client->allocator, client->no_proxy);
     client->no_proxy = copy;
     return true;
 }
 
+// The flag answers llm_cancel_abort_cb without a syscall; the fd is what transports block on. Linux uses one
+// eventfd for both ends, elsewhere a non-blocking pipe.
+struct llm_cancel {
+    atomic_bool triggered;
+    int read_fd;
+    int write_fd;
+};
+
+llm_cancel_t* llm_cancel_create(void) {
+    llm_cancel_t* cancel = mem_alloc(NULL, sizeof(*cancel));
+    if (!cancel) return NULL;
+    atomic_init(&cancel->triggered, false);
+#ifdef __linux__
+    cancel->read_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    cancel->write_fd = cancel->read_fd;
+    if (cancel->read_fd < 0) {
+        mem_free(NULL, cancel);
+        return NULL;
+    }
+#else
+    int fds[2];
+    if (pipe(fds) != 0) {
+        mem_free(NULL, cancel);
+        return NULL;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    cancel->read_fd = fds[0];
+    cancel->write_fd = fds[1];
+#endif
+    return cancel;
+}
+
+void llm_cancel_destroy(llm_cancel_t* cancel) {
+    if (!cancel) return;
+    close(cancel->read_fd);
+    if (cancel->write_fd != cancel->read_fd) close(cancel->write_fd);
+    mem_free(NULL, cancel);
+}
+
+void llm_cancel_trigger(llm_cancel_t* cancel) {
+    if (!cancel || atomic_exchange(&cancel->triggered, true)) return;
+    uint64_t one = 1;
+    ssize_t n;
+    do {
+        n = write(cancel->write_fd, &one, cancel->write_fd == cancel->read_fd ? sizeof(one) : 1);
+    } while (n < 0 && errno == EINTR);
+}
+
+bool llm_cancel_triggered(const llm_cancel_t* cancel) { return cancel && atomic_load(&cancel->triggered); }
+
+void llm_cancel_reset(llm_cancel_t* cancel) {
+    if (!cancel) return;
+    uint64_t drain[8];
+    while (read(cancel->read_fd, drain, sizeof(drain)) > 0) {
+    }
+    atomic_store(&cancel->triggered, false);
+}
+
+bool llm_cancel_abort_cb(void* cancel) { return llm_cancel_triggered(cancel); }
+
+static bool tool_stream_abort(void* user_data);
+static int tool_stream_wake_fd(void* user_data);
+
+// Lets a transport wake on a cancel token instead of waiting for the next chunk to poll the callback. The
+// streaming tool loop wraps the caller's callback in its own; the token behind it still counts.
+static int abort_wake_fd(llm_abort_cb abort_cb, void* abort_user_data) {
+    if (abort_cb == tool_stream_abort) return tool_stream_wake_fd(abort_user_data);
+    if (abort_cb != llm_cancel_abort_cb || !abort_user_data) return -1;
+    return ((const llm_cancel_t*)abort_user_data)->read_fd;
+}
+
 const llm_error_detail_t* llm_client_last_error(const llm_client_t* client) {
     if (!client || !client->last_error_enabled) return NULL;
     return &client->last_error;
@@ -493,17 +696,19 @@ struct header_set {
     const char* const* headers;
     size_t count;
     const char** owned;
+    const llm_allocator_t* alloc;
 };
 
 static void header_set_clear(struct header_set* set) {
     set->headers = NULL;
     set->count = 0;
     set->owned = NULL;
+    set->alloc = NULL;
 }
 
 static void header_set_free(struct header_set* set) {
     if (!set) return;
-    free((void*)set->owned);
+    mem_free(set->alloc, (void*)set->owned);
     header_set_clear(set);
 }
 
@@ -581,7 +786,7 @@ static bool llm_header_set_init(struct header_set* set, const llm_client_t* clie
     }
 
     size_t max_headers = client->headers_count + headers_count;
-    const char** merged = malloc(max_headers * sizeof(*merged));
+    const char** merged = mem_alloc(&client->allocator, max_headers * sizeof(*merged));
     if (!merged) return false;
 
     size_t out_count = 0;
@@ -599,6 +804,7 @@ static bool llm_header_set_init(struct header_set* set, const llm_client_t* clie
     set->headers = merged;
     set->count = out_count;
     set->owned = merged;
+    set->alloc = &client->allocator;
     return true;
 }
 
@@ -632,7 +838,7 @@ llm_error_t llm_health_with_headers_ex(llm_client_t* client, const char* const*
     const llm_tls_config_t* tls_ptr = llm_client_tls_config(client, &tls);
     llm_transport_status_t status;
     bool ok = http_get(url, client->timeout.connect_timeout_ms, 1024, header_set.headers, header_set.count, tls_ptr,
-                       client->proxy_url, client->no_proxy, &body, &len, &status);
+                       client->proxy_url, client->no_proxy, &client->allocator, &body, &len, &status);
     header_set_free(&header_set);
     if (!ok) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, transport_stage(&status), 0, NULL, 0, false);
@@ -643,7 +849,7 @@ llm_error_t llm_health_with_headers_ex(llm_client_t* client, const char* const*
                              true);
         return LLM_ERR_FAILED;
     }
-    free(body);
+    mem_free(&client->allocator, body);
     return LLM_ERR_NONE;
 }
 
@@ -682,7 +888,8 @@ llm_error_t llm_models_list_with_headers_ex(llm_client_t* client, char*** models
     const llm_tls_config_t* tls_ptr = llm_client_tls_config(client, &tls);
     llm_transport_status_t status;
     if (!http_get(url, client->timeout.connect_timeout_ms, client->limits.max_response_bytes, header_set.headers,
-                  header_set.count, tls_ptr, client->proxy_url, client->no_proxy, &body, &len, &status)) {
+                  header_set.count, tls_ptr, client->proxy_url, client->no_proxy, &client->allocator, &body, &len,
+                  &status)) {
         header_set_free(&header_set);
         error_detail_capture(client, detail, LLM_ERR_FAILED, transport_stage(&status), 0, NULL, 0, false);
         return LLM_ERR_FAILED;
@@ -704,21 +911,21 @@ llm_error_t llm_models_list_with_headers_ex(llm_client_t* client, char*** models
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_JSON, status.http_status, body, len, true);
         return LLM_ERR_FAILED;
     }
-    tokens = malloc(needed * sizeof(jstoktok_t));
+    tokens = mem_alloc(&client->allocator, needed * sizeof(jstoktok_t));
     if (!tokens) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_JSON, status.http_status, body, len, true);
         return LLM_ERR_FAILED;
     }
     jstok_init(&parser);
     if (jstok_parse(&parser, body, (int)len, tokens, needed) <= 0) {
-        free(tokens);
+        mem_free(&client->allocator, tokens);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_JSON, status.http_status, body, len, true);
         return LLM_ERR_FAILED;
     }
     tok_count = needed;
 
     if (tok_count == 0 || tokens[0].type != JSTOK_OBJECT) {
-        free(tokens);
+        mem_free(&client->allocator, tokens);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, status.http_status, body, len,
                              true);
         return LLM_ERR_FAILED;
@@ -726,7 +933,7 @@ llm_error_t llm_models_list_with_headers_ex(llm_client_t* client, char*** models
 
     int data_idx = jstok_object_get(body, tokens, tok_count, 0, "data");
     if (data_idx < 0 || tokens[data_idx].type != JSTOK_ARRAY) {
-        free(tokens);
+        mem_free(&client->allocator, tokens);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, status.http_status, body, len,
                              true);
         return LLM_ERR_FAILED;
@@ -734,16 +941,17 @@ llm_error_t llm_models_list_with_headers_ex(llm_client_t* client, char*** models
 
     int n = tokens[data_idx].size;
     if (n <= 0) {
-        free(tokens);
-        free(body);
+        mem_free(&client->allocator, tokens);
+        mem_free(&client->allocator, body);
         *models = NULL;
         *count = 0;
         return LLM_ERR_NONE;
     }
 
+    // The list is handed to the caller and released by llm_models_list_free(), so it stays on libc.
     char** out = malloc((size_t)n * sizeof(char*));
     if (!out) {
-        free(tokens);
+        mem_free(&client->allocator, tokens);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_JSON, status.http_status, body, len, true);
         return LLM_ERR_FAILED;
     }
@@ -772,7 +980,7 @@ llm_error_t llm_models_list_with_headers_ex(llm_client_t* client, char*** models
         out_count++;
     }
 
-    free(tokens);
+    mem_free(&client->allocator, tokens);
 
     if (!ok) {
         for (size_t i = 0; i < out_count; i++) {
@@ -784,7 +992,7 @@ llm_error_t llm_models_list_with_headers_ex(llm_client_t* client, char*** models
         return LLM_ERR_FAILED;
     }
 
-    free(body);
+    mem_free(&client->allocator, body);
     *models = out;
     *count = out_count;
     return LLM_ERR_NONE;
@@ -838,20 +1046,34 @@ llm_error_t llm_props_get_with_headers_ex(llm_client_t* client, const char** jso
     llm_tls_config_t tls;
     const llm_tls_config_t* tls_ptr = llm_client_tls_config(client, &tls);
     llm_transport_status_t status;
+    char* body = NULL;
+    size_t body_len = 0;
     bool ok = http_get(url, client->timeout.connect_timeout_ms, client->limits.max_response_bytes, header_set.headers,
-                       header_set.count, tls_ptr, client->proxy_url, client->no_proxy, (char**)json, len, &status);
+                       header_set.count, tls_ptr, client->proxy_url, client->no_proxy, &client->allocator, &body,
+                       &body_len, &status);
     header_set_free(&header_set);
     if (!ok) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, transport_stage(&status), 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
     if (status.http_status >= 400) {
-        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, status.http_status, (char*)*json,
-                             *len, true);
-        *json = NULL;
-        *len = 0;
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, status.http_status, body,
+                             body_len, true);
         return LLM_ERR_FAILED;
     }
+    // The props buffer is handed to the caller, who releases it with free().
+    if (mem_allocator_custom(&client->allocator)) {
+        char* copy = mem_strndup(NULL, body, body_len);
+        mem_free(&client->allocator, body);
+        if (!copy) {
+            error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_TRANSPORT, status.http_status, NULL, 0,
+                                 false);
+            return LLM_ERR_FAILED;
+        }
+        body = copy;
+    }
+    *json = body;
+    *len = body_len;
     return LLM_ERR_NONE;
 }
 
@@ -869,32 +1091,38 @@ bool llm_props_get(llm_client_t* client, const char** json, size_t* len) {
 }
 
 // Forward declarations from other modules
-int parse_chat_response(const char* json, size_t len, llm_chat_result_t* result);
+int parse_chat_response(const char* json, size_t len, llm_chat_result_t* result, const llm_allocator_t* alloc);
 int parse_chat_chunk(const char* json, size_t len, llm_chat_chunk_delta_t* delta, llm_usage_t* usage,
-                     bool* usage_present);
+                     bool* usage_present, const llm_allocator_t* alloc);
 int parse_chat_chunk_choice(const char* json, size_t len, size_t choice_index, llm_chat_chunk_delta_t* delta,
-                            llm_usage_t* usage, bool* usage_present);
-int parse_completions_response(const char* json, size_t len, llm_completions_result_t* result);
+                            llm_usage_t* usage, bool* usage_present, const llm_allocator_t* alloc);
+int parse_chat_chunk_choices(const char* json, size_t len, llm_chat_chunk_delta_t* deltas, size_t deltas_count,
+                             llm_usage_t* usage, bool* usage_present, const llm_allocator_t* alloc);
+int parse_completions_response(const char* json, size_t len, llm_completions_result_t* result,
+                               const llm_allocator_t* alloc);
 int parse_completions_chunk(const char* json, size_t len, span_t* text_delta, llm_finish_reason_t* finish_reason,
-                            llm_usage_t* usage, bool* usage_present);
+                            llm_usage_t* usage, bool* usage_present, const llm_allocator_t* alloc);
 int parse_completions_chunk_choice(const char* json, size_t len, size_t choice_index, span_t* text_delta,
-                                   llm_finish_reason_t* finish_reason, llm_usage_t* usage, bool* usage_present);
-int parse_embeddings_response(const char* json, size_t len, llm_embeddings_result_t* result);
-
-llm_error_t llm_completions_with_headers_ex(llm_client_t* client, const char* prompt, size_t prompt_len,
-                                            const char* params_json, llm_completions_result_t* result,
-                                            const char* const* headers, size_t headers_count,
-                                            llm_error_detail_t* detail) {
+                                   llm_finish_reason_t* finish_reason, llm_usage_t* usage, bool* usage_present,
+                                   const llm_allocator_t* alloc);
+int parse_embeddings_response(const char* json, size_t len, llm_embeddings_result_t* result,
+                              const llm_allocator_t* alloc);
+
+static llm_error_t completions_request(llm_client_t* client, const char* prompt, size_t prompt_len,
+                                       const char* params_json, const llm_allocator_t* result_alloc,
+                                       llm_completions_result_t* result, const char* const* headers,
+                                       size_t headers_count, llm_error_detail_t* detail) {
     if (detail) llm_error_detail_free(detail);
     last_error_reset(client);
-    if (!result) {
+    if (!result || !result_alloc) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
     char url[1024];
     snprintf(url, sizeof(url), "%s/v1/completions", client->base_url);
 
-    char* request_json = build_completions_request(client->model.name, prompt, prompt_len, false, false, params_json);
+    char* request_json = build_completions_request(client->model.name, prompt, prompt_len, false, false, params_json,
+                                                   &client->allocator);
     if (!request_json) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
@@ -904,7 +1132,7 @@ llm_error_t llm_completions_with_headers_ex(llm_client_t* client, const char* pr
     size_t response_len = 0;
     struct header_set header_set;
     if (!llm_header_set_init(&header_set, client, headers, headers_count)) {
-        free(request_json);
+        mem_free(&client->allocator, request_json);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
@@ -913,32 +1141,51 @@ llm_error_t llm_completions_with_headers_ex(llm_client_t* client, const char* pr
     llm_transport_status_t status;
     bool ok = http_post(url, request_json, client->timeout.overall_timeout_ms, client->limits.max_response_bytes,
                         header_set.headers, header_set.count, tls_ptr, client->proxy_url, client->no_proxy,
-                        &response_body, &response_len, &status);
+                        result_alloc, &response_body, &response_len, &status);
     header_set_free(&header_set);
-    free(request_json);
+    mem_free(&client->allocator, request_json);
 
     if (!ok) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, transport_stage(&status), 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
     if (status.http_status >= 400) {
+        response_body = body_adopt(client, result_alloc, response_body, response_len);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, status.http_status,
                              response_body, response_len, true);
         return LLM_ERR_FAILED;
     }
 
     memset(result, 0, sizeof(*result));
-    int res = parse_completions_response(response_body, response_len, result);
+    int res = parse_completions_response(response_body, response_len, result, result_alloc);
     if (res < 0) {
+        response_body = body_adopt(client, result_alloc, response_body, response_len);
         llm_error_stage_t stage = (res == LLM_PARSE_ERR_PROTOCOL) ? LLM_ERROR_STAGE_PROTOCOL : LLM_ERROR_STAGE_JSON;
         error_detail_capture(client, detail, LLM_ERR_FAILED, stage, status.http_status, response_body, response_len,
                              true);
         return LLM_ERR_FAILED;
     }
     result->_internal = response_body;
+    result->_allocator = *result_alloc;
     return LLM_ERR_NONE;
 }
 
+llm_error_t llm_completions_with_headers_ex(llm_client_t* client, const char* prompt, size_t prompt_len,
+                                            const char* params_json, llm_completions_result_t* result,
+                                            const char* const* headers, size_t headers_count,
+                                            llm_error_detail_t* detail) {
+    return completions_request(client, prompt, prompt_len, params_json, client_allocator(client), result, headers,
+                               headers_count, detail);
+}
+
+llm_error_t llm_completions_arena_ex(llm_client_t* client, const char* prompt, size_t prompt_len,
+                                     const char* params_json, llm_arena_t* arena, llm_completions_result_t* result,
+                                     const char* const* headers, size_t headers_count, llm_error_detail_t* detail) {
+    llm_allocator_t alloc = llm_arena_allocator(arena);
+    return completions_request(client, prompt, prompt_len, params_json, arena ? &alloc : NULL, result, headers,
+                               headers_count, detail);
+}
+
 llm_error_t llm_completions_ex(llm_client_t* client, const char* prompt, size_t prompt_len, const char* params_json,
                                llm_completions_result_t* result, llm_error_detail_t* detail) {
     return llm_completions_with_headers_ex(client, prompt, prompt_len, params_json, result, NULL, 0, detail);
@@ -957,24 +1204,143 @@ bool llm_completions(llm_client_t* client, const char* prompt, size_t prompt_len
 
 void llm_completions_free(llm_completions_result_t* result) {
     if (result) {
-        free(result->choices);
-        free(result->_internal);
+        mem_free(&result->_allocator, result->choices);
+        mem_free(&result->_allocator, result->_internal);
         memset(result, 0, sizeof(*result));
     }
 }
 
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Four buckets per power of two: gaps below 4us get one bucket each, then the two bits after the leading one
+// pick the quarter.
+static size_t stream_stats_bucket(uint64_t us) {
+    if (us < 4) return (size_t)us;
+    unsigned msb = 2;
+    while (msb < 63 && (us >> (msb + 1)) != 0) msb++;
+    size_t bucket = (size_t)(msb - 1) * 4 + (size_t)((us >> (msb - 2)) & 3);
+    return bucket < LLM_STREAM_STATS_BUCKETS ? bucket : LLM_STREAM_STATS_BUCKETS - 1;
+}
+
+uint64_t llm_stream_stats_bucket_floor_us(size_t bucket) {
+    if (bucket >= LLM_STREAM_STATS_BUCKETS) return UINT64_MAX;
+    if (bucket < 4) return bucket;
+    unsigned msb = (unsigned)(bucket / 4) + 1;
+    return (uint64_t)(4 + bucket % 4) << (msb - 2);
+}
+
+static void stream_stats_start(llm_stream_stats_t* stats, uint64_t now_ns) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    stats->_start_ns = now_ns;
+}
+
+static void stream_stats_first_byte(llm_stream_stats_t* stats) {
+    if (!stats || stats->has_first_byte) return;
+    stats->has_first_byte = true;
+    stats->first_byte_us = (mono_ns() - stats->_start_ns) / 1000;
+}
+
+static void stream_stats_delta(llm_stream_stats_t* stats) {
+    if (!stats) return;
+    uint64_t now = mono_ns();
+    if (!stats->has_first_delta) {
+        stats->has_first_delta = true;
+        stats->ttft_us = (now - stats->_start_ns) / 1000;
+        stats->_first_delta_ns = now;
+    } else {
+        uint64_t gap = (now - stats->_last_delta_ns) / 1000;
+        stats->gap_buckets[stream_stats_bucket(gap)]++;
+        stats->_gap_sum_us += gap;
+        if (gap > stats->gap_max_us) stats->gap_max_us = gap;
+    }
+    stats->_last_delta_ns = now;
+    stats->delta_count++;
+}
+
+// Midpoint of the bucket holding the q-th gap, capped at the largest gap seen.
+static uint64_t stream_stats_percentile(const llm_stream_stats_t* stats, size_t gaps, double q) {
+    size_t rank = (size_t)(q * (double)gaps);
+    if ((double)rank < q * (double)gaps) rank++;
+    if (rank == 0) rank = 1;
+    size_t seen = 0;
+    for (size_t b = 0; b < LLM_STREAM_STATS_BUCKETS; b++) {
+        seen += stats->gap_buckets[b];
+        if (seen < rank) continue;
+        if (b + 1 == LLM_STREAM_STATS_BUCKETS) return stats->gap_max_us;
+        uint64_t lo = llm_stream_stats_bucket_floor_us(b);
+        uint64_t mid = lo + (llm_stream_stats_bucket_floor_us(b + 1) - lo) / 2;
+        return mid < stats->gap_max_us ? mid : stats->gap_max_us;
+    }
+    return stats->gap_max_us;
+}
+
+static void stream_stats_finish(llm_stream_stats_t* stats) {
+    if (!stats) return;
+    stats->total_us = (mono_ns() - stats->_start_ns) / 1000;
+    if (stats->delta_count < 2) return;
+    size_t gaps = stats->delta_count - 1;
+    stats->gap_mean_us = stats->_gap_sum_us / gaps;
+    stats->gap_p50_us = stream_stats_percentile(stats, gaps, 0.50);
+    stats->gap_p99_us = stream_stats_percentile(stats, gaps, 0.99);
+    uint64_t span_ns = stats->_last_delta_ns - stats->_first_delta_ns;
+    if (span_ns > 0) stats->deltas_per_sec = (double)gaps * 1e9 / (double)span_ns;
+}
+
+// Closes the stats of every choice; early failures report them too, with no deltas.
+static void stream_stats_finish_all(const llm_stream_callbacks_t* callbacks, size_t count) {
+    for (size_t c = 0; c < count; c++) stream_stats_finish(callbacks[c].stats);
+}
+
 struct completions_stream_ctx {
     const llm_stream_callbacks_t* callbacks;
     size_t choice_index;
     bool include_usage;
     bool done;
+    const llm_allocator_t* alloc;
+    stop_matcher_t stop;
+    bool stop_active;
+    bool stopped;
 };
 
+static bool stream_stop_init(stop_matcher_t* stop, bool* active, const llm_stream_callbacks_t* callbacks,
+                             const llm_allocator_t* alloc) {
+    *active = false;
+    if (!callbacks || callbacks->stop_count == 0) return true;
+    if (!stop_matcher_init(stop, callbacks->stop_list, callbacks->stop_lens, callbacks->stop_count, alloc)) {
+        return false;
+    }
+    *active = true;
+    return true;
+}
+
+// Delivers a content delta, through the client-side stop matcher when one is active. Returns true when a
+// stop string matched; the caller reports STOP and ends the stream.
+static bool stream_content_delta(const llm_stream_callbacks_t* callbacks, stop_matcher_t* stop, bool stop_active,
+                                 const char* delta, size_t len) {
+    if (stop_active) return stop_matcher_feed(stop, delta, len, callbacks->on_content_delta, callbacks->user_data);
+    if (callbacks->on_content_delta) callbacks->on_content_delta(callbacks->user_data, delta, len);
+    return false;
+}
+
+static void stream_content_flush(const llm_stream_callbacks_t* callbacks, stop_matcher_t* stop, bool stop_active) {
+    if (stop_active) stop_matcher_flush(stop, callbacks->on_content_delta, callbacks->user_data);
+}
+
+static void stream_stopped(const llm_stream_callbacks_t* callbacks) {
+    if (callbacks->on_finish_reason) callbacks->on_finish_reason(callbacks->user_data, LLM_FINISH_REASON_STOP);
+}
+
 static bool on_sse_completions_event(void* user_data, const sse_event_t* event) {
     struct completions_stream_ctx* ctx = user_data;
-    if (ctx->done) return true;
+    if (ctx->done || ctx->stopped) return true;
     if (event->data.len == 6 && memcmp(event->data.ptr, "[DONE]", 6) == 0) {
         ctx->done = true;
+        stream_content_flush(ctx->callbacks, &ctx->stop, ctx->stop_active);
         return true;
     }
     if (!event->data.ptr || event->data.len == 0) return true;
@@ -983,15 +1349,22 @@ static bool on_sse_completions_event(void* user_data, const sse_event_t* event)
     llm_usage_t usage;
     bool usage_present = false;
     if (parse_completions_chunk_choice(event->data.ptr, event->data.len, ctx->choice_index, &text_delta, &finish_reason,
-                                       &usage, &usage_present) == 0) {
-        if (text_delta.ptr && ctx->callbacks->on_content_delta) {
-            ctx->callbacks->on_content_delta(ctx->callbacks->user_data, text_delta.ptr, text_delta.len);
+                                       &usage, &usage_present, ctx->alloc) == 0) {
+        if (text_delta.ptr && text_delta.len > 0) stream_stats_delta(ctx->callbacks->stats);
+        if (text_delta.ptr &&
+            stream_content_delta(ctx->callbacks, &ctx->stop, ctx->stop_active, text_delta.ptr, text_delta.len)) {
+            ctx->stopped = true;
+            stream_stopped(ctx->callbacks);
+            return true;
         }
         if (ctx->include_usage && usage_present && ctx->callbacks->on_usage) {
             ctx->callbacks->on_usage(ctx->callbacks->user_data, &usage);
         }
-        if (finish_reason != LLM_FINISH_REASON_UNKNOWN && ctx->callbacks->on_finish_reason) {
-            ctx->callbacks->on_finish_reason(ctx->callbacks->user_data, finish_reason);
+        if (finish_reason != LLM_FINISH_REASON_UNKNOWN) {
+            stream_content_flush(ctx->callbacks, &ctx->stop, ctx->stop_active);
+            if (ctx->callbacks->on_finish_reason) {
+                ctx->callbacks->on_finish_reason(ctx->callbacks->user_data, finish_reason);
+            }
         }
     }
     return true;
@@ -1003,6 +1376,8 @@ struct sse_stream_ctx {
     llm_abort_cb abort_cb;
     void* abort_user_data;
     llm_error_t error;
+    const bool* stopped;  // set by the event handler when a stop string matched
+    llm_stream_stats_t* stats;
 };
 
 struct stream_capture_ctx {
@@ -1014,13 +1389,13 @@ struct stream_capture_ctx {
 };
 
 static void stream_capture_init(struct stream_capture_ctx* cap, stream_cb inner, void* inner_user_data,
-                                size_t max_bytes, bool enable) {
+                                size_t max_bytes, bool enable, const llm_allocator_t* alloc) {
     memset(cap, 0, sizeof(*cap));
     cap->inner = inner;
     cap->inner_user_data = inner_user_data;
     cap->max_bytes = max_bytes;
     if (enable) {
-        growbuf_init(&cap->buf, 4096);
+        growbuf_init(&cap->buf, 4096, alloc);
         cap->capture = !cap->buf.nomem;
         if (!cap->capture) {
             growbuf_free(&cap->buf);
@@ -1065,6 +1440,7 @@ static bool on_sse_frame_abort(void* user_data) {
 
 static bool sse_stream_cb(const char* chunk, size_t len, void* user_data) {
     struct sse_stream_ctx* cs = user_data;
+    stream_stats_first_byte(cs->stats);
     if (cs->abort_cb && cs->abort_cb(cs->abort_user_data)) {
         if (cs->error == LLM_ERR_NONE) {
             cs->error = LLM_ERR_CANCELLED;
@@ -1079,6 +1455,7 @@ static bool sse_stream_cb(const char* chunk, size_t len, void* user_data) {
         }
         return false;
     }
+    if (cs->stopped && *cs->stopped) return false;
     if (cs->abort_cb && cs->abort_cb(cs->abort_user_data)) {
         if (cs->error == LLM_ERR_NONE) {
             cs->error = LLM_ERR_CANCELLED;
@@ -1094,23 +1471,39 @@ static llm_error_t llm_completions_stream_with_headers_choice_ex(
     size_t headers_count, llm_error_detail_t* detail) {
     if (detail) llm_error_detail_free(detail);
     last_error_reset(client);
+    llm_stream_stats_t* stats = callbacks ? callbacks->stats : NULL;
+    stream_stats_start(stats, mono_ns());
     char url[1024];
     snprintf(url, sizeof(url), "%s/v1/completions", client->base_url);
 
     const bool include_usage = callbacks && callbacks->include_usage;
     char* request_json =
-        build_completions_request(client->model.name, prompt, prompt_len, true, include_usage, params_json);
+        build_completions_request(client->model.name, prompt, prompt_len, true, include_usage, params_json,
+                                  &client->allocator);
     if (!request_json) {
+        stream_stats_finish(stats);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
 
-    struct completions_stream_ctx ctx = {
-        .callbacks = callbacks, .choice_index = choice_index, .include_usage = include_usage, .done = false};
-    sse_parser_t* sse = sse_create(client->limits.max_line_bytes, client->limits.max_frame_bytes,
-                                   client->limits.max_sse_buffer_bytes, client->limits.max_response_bytes);
+    struct completions_stream_ctx ctx = {.callbacks = callbacks,
+                                         .choice_index = choice_index,
+                                         .include_usage = include_usage,
+                                         .done = false,
+                                         .alloc = &client->allocator};
+    if (!stream_stop_init(&ctx.stop, &ctx.stop_active, callbacks, &client->allocator)) {
+        mem_free(&client->allocator, request_json);
+        stream_stats_finish(stats);
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
+        return LLM_ERR_FAILED;
+    }
+    sse_parser_t* sse = sse_create_with_allocator(client->limits.max_line_bytes, client->limits.max_frame_bytes,
+                                                  client->limits.max_sse_buffer_bytes,
+                                                  client->limits.max_response_bytes, &client->allocator);
     if (!sse) {
-        free(request_json);
+        if (ctx.stop_active) stop_matcher_free(&ctx.stop);
+        mem_free(&client->allocator, request_json);
+        stream_stats_finish(stats);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
@@ -1120,28 +1513,39 @@ static llm_error_t llm_completions_stream_with_headers_choice_ex(
                                 .sse_error = SSE_OK,
                                 .abort_cb = abort_cb,
                                 .abort_user_data = abort_user_data,
-                                .error = LLM_ERR_NONE};
+                                .error = LLM_ERR_NONE,
+                                .stopped = &ctx.stopped,
+                                .stats = stats};
     sse_set_frame_callback(sse, on_sse_frame_abort, &cs);
     struct header_set header_set;
     if (!llm_header_set_init(&header_set, client, headers, headers_count)) {
+        if (ctx.stop_active) stop_matcher_free(&ctx.stop);
         sse_destroy(sse);
-        free(request_json);
+        mem_free(&client->allocator, request_json);
+        stream_stats_finish(stats);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
     llm_tls_config_t tls;
     const llm_tls_config_t* tls_ptr = llm_client_tls_config(client, &tls);
     struct stream_capture_ctx capture;
-    stream_capture_init(&capture, sse_stream_cb, &cs, client->limits.max_response_bytes, detail != NULL);
+    stream_capture_init(&capture, sse_stream_cb, &cs, client->limits.max_response_bytes, detail != NULL,
+                        &client->allocator);
     stream_cb cb = detail ? stream_capture_cb : sse_stream_cb;
     void* cb_user_data = detail ? (void*)&capture : (void*)&cs;
     llm_transport_status_t status;
     bool ok = http_post_stream(url, request_json, client->timeout.overall_timeout_ms,
                                client->timeout.read_idle_timeout_ms, header_set.headers, header_set.count, tls_ptr,
-                               client->proxy_url, client->no_proxy, cb, cb_user_data, &status);
+                               client->proxy_url, client->no_proxy, cb, cb_user_data,
+                               abort_wake_fd(abort_cb, abort_user_data), &status);
+    stream_stats_finish(stats);
     header_set_free(&header_set);
+    if (!ok && cs.error == LLM_ERR_NONE && abort_cb && abort_cb(abort_user_data)) cs.error = LLM_ERR_CANCELLED;
+    if (ctx.stopped) ok = true;  // aborted on purpose after a stop string
+    if (ok) stream_content_flush(callbacks, &ctx.stop, ctx.stop_active);
+    if (ctx.stop_active) stop_matcher_free(&ctx.stop);
     sse_destroy(sse);
-    free(request_json);
+    mem_free(&client->allocator, request_json);
 
     if (!ok) {
         llm_error_t err = (cs.error != LLM_ERR_NONE) ? cs.error : LLM_ERR_FAILED;
@@ -1274,13 +1678,15 @@ llm_error_t llm_completions_stream_choice_with_headers_detail_ex(
                                                          detail);
 }
 
-llm_error_t llm_embeddings_with_headers_ex(llm_client_t* client, const llm_embedding_input_t* inputs,
-                                           size_t inputs_count, const char* params_json,
-                                           llm_embeddings_result_t* result, const char* const* headers,
-                                           size_t headers_count, llm_error_detail_t* detail) {
+static llm_error_t embeddings_request(llm_client_t* client, const llm_embedding_input_t* inputs, size_t inputs_count,
+                                      const char* params_json, const char* encoding_format,
+                                      const llm_allocator_t* result_alloc,
+                                      llm_embeddings_result_t* result, size_t* body_len,
+                                      const char* const* headers, size_t headers_count,
+                                      llm_error_detail_t* detail) {
     if (detail) llm_error_detail_free(detail);
     last_error_reset(client);
-    if (!result) {
+    if (!result || !result_alloc) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
@@ -1288,8 +1694,9 @@ llm_error_t llm_embeddings_with_headers_ex(llm_client_t* client, const llm_embed
     snprintf(url, sizeof(url), "%s/v1/embeddings", client->base_url);
 
     char* request_json =
-        build_embeddings_request(client->model.name, inputs, inputs_count, params_json,
-                                 client->limits.max_embedding_input_bytes, client->limits.max_embedding_inputs);
+        build_embeddings_request(client->model.name, inputs, inputs_count, params_json, encoding_format,
+                                 client->limits.max_embedding_input_bytes, client->limits.max_embedding_inputs,
+                                 &client->allocator);
     if (!request_json) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
@@ -1299,7 +1706,7 @@ llm_error_t llm_embeddings_with_headers_ex(llm_client_t* client, const llm_embed
     size_t response_len = 0;
     struct header_set header_set;
     if (!llm_header_set_init(&header_set, client, headers, headers_count)) {
-        free(request_json);
+        mem_free(&client->allocator, request_json);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
@@ -1308,29 +1715,384 @@ llm_error_t llm_embeddings_with_headers_ex(llm_client_t* client, const llm_embed
     llm_transport_status_t status;
     bool ok = http_post(url, request_json, client->timeout.overall_timeout_ms, client->limits.max_response_bytes,
                         header_set.headers, header_set.count, tls_ptr, client->proxy_url, client->no_proxy,
-                        &response_body, &response_len, &status);
+                        result_alloc, &response_body, &response_len, &status);
     header_set_free(&header_set);
-    free(request_json);
+    mem_free(&client->allocator, request_json);
 
     if (!ok) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, transport_stage(&status), 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
     if (status.http_status >= 400) {
+        response_body = body_adopt(client, result_alloc, response_body, response_len);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, status.http_status,
                              response_body, response_len, true);
         return LLM_ERR_FAILED;
     }
 
     memset(result, 0, sizeof(*result));
-    int res = parse_embeddings_response(response_body, response_len, result);
+    int res = parse_embeddings_response(response_body, response_len, result, result_alloc);
     if (res < 0) {
+        response_body = body_adopt(client, result_alloc, response_body, response_len);
         llm_error_stage_t stage = (res == LLM_PARSE_ERR_PROTOCOL) ? LLM_ERROR_STAGE_PROTOCOL : LLM_ERROR_STAGE_JSON;
         error_detail_capture(client, detail, LLM_ERR_FAILED, stage, status.http_status, response_body, response_len,
                              true);
         return LLM_ERR_FAILED;
     }
     result->_internal = response_body;
+    result->_allocator = *result_alloc;
+    if (body_len) *body_len = response_len;
+    return LLM_ERR_NONE;
+}
+
+llm_error_t llm_embeddings_with_headers_ex(llm_client_t* client, const llm_embedding_input_t* inputs,
+                                           size_t inputs_count, const char* params_json,
+                                           llm_embeddings_result_t* result, const char* const* headers,
+                                           size_t headers_count, llm_error_detail_t* detail) {
+    return embeddings_request(client, inputs, inputs_count, params_json, NULL, client_allocator(client), result,
+                              NULL, headers, headers_count, detail);
+}
+
+llm_error_t llm_embeddings_arena_ex(llm_client_t* client, const llm_embedding_input_t* inputs, size_t inputs_count,
+                                    const char* params_json, llm_arena_t* arena, llm_embeddings_result_t* result,
+                                    const char* const* headers, size_t headers_count, llm_error_detail_t* detail) {
+    llm_allocator_t alloc = llm_arena_allocator(arena);
+    return embeddings_request(client, inputs, inputs_count, params_json, NULL, arena ? &alloc : NULL, result,
+                              NULL, headers, headers_count, detail);
+}
+
+// One sub-request of a sharded embeddings call, covering inputs [first, first + count).
+struct emb_shard {
+    size_t first;
+    size_t count;
+    char* request_json;
+    bool failed;
+    llm_error_stage_t stage;
+    long http_status;
+    char* body;  // kept for the error detail of a failed shard
+    size_t body_len;
+    bool parse_error;
+};
+
+struct emb_shard_ctx {
+    llm_client_t* client;
+    const llm_embedding_input_t* inputs;
+    const char* params_json;
+    struct emb_shard* shards;
+    struct growbuf text;  // embedding spans of every shard that succeeded
+    size_t* offsets;      // per input, into text
+    size_t* lens;
+    bool oom;
+};
+
+static void emb_shard_fail(struct emb_shard* shard, llm_error_stage_t stage, long http_status, char* body,
+                           size_t body_len, bool parse_error) {
+    shard->failed = true;
+    shard->stage = stage;
+    shard->http_status = http_status;
+    shard->body = body;
+    shard->body_len = body_len;
+    shard->parse_error = parse_error;
+}
+
+static const char* emb_shard_body(size_t index, void* user_data) {
+    struct emb_shard_ctx* ctx = user_data;
+    llm_client_t* client = ctx->client;
+    struct emb_shard* shard = &ctx->shards[index];
+    shard->request_json = build_embeddings_request(client->model.name, ctx->inputs + shard->first, shard->count,
+                                                   ctx->params_json, NULL, client->limits.max_embedding_input_bytes,
+                                                   client->limits.max_embedding_inputs, &client->allocator);
+    return shard->request_json;
+}
+
+static void emb_shard_done(size_t index, bool ok, char* body, size_t len, const llm_transport_status_t* status,
+                           void* user_data) {
+    struct emb_shard_ctx* ctx = user_data;
+    const llm_allocator_t* alloc = &ctx->client->allocator;
+    struct emb_shard* shard = &ctx->shards[index];
+    bool built = shard->request_json != NULL;
+    mem_free(alloc, shard->request_json);
+    shard->request_json = NULL;
+    if (!ok) {
+        emb_shard_fail(shard, built ? transport_stage(status) : LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
+        return;
+    }
+    if (status->http_status >= 400) {
+        emb_shard_fail(shard, LLM_ERROR_STAGE_PROTOCOL, status->http_status, body, len, true);
+        return;
+    }
+    llm_embeddings_result_t part;
+    memset(&part, 0, sizeof(part));
+    int res = parse_embeddings_response(body, len, &part, alloc);
+    if (res < 0 || part.data_count != shard->count) {
+        mem_free(alloc, part.data);
+        bool syntax = res < 0 && res != LLM_PARSE_ERR_PROTOCOL;
+        llm_error_stage_t stage = syntax ? LLM_ERROR_STAGE_JSON : LLM_ERROR_STAGE_PROTOCOL;
+        emb_shard_fail(shard, stage, status->http_status, body, len, true);
+        return;
+    }
+    // parse_embeddings_response has put every row at its index within the shard's request.
+    for (size_t i = 0; i < part.data_count; i++) {
+        ctx->offsets[shard->first + i] = ctx->text.len;
+        ctx->lens[shard->first + i] = part.data[i].embedding_len;
+        if (!growbuf_append(&ctx->text, part.data[i].embedding, part.data[i].embedding_len, 0)) ctx->oom = true;
+    }
+    mem_free(alloc, part.data);
+    mem_free(alloc, body);
+}
+
+// Cuts inputs into shards of at most per_shard inputs. An input over max_embedding_input_bytes gets a shard of its
+// own, so it fails alone instead of taking its neighbours with it.
+static size_t emb_plan_shards(const llm_client_t* client, const llm_embedding_input_t* inputs, size_t inputs_count,
+                              size_t per_shard, struct emb_shard* shards) {
+    size_t max_bytes = client->limits.max_embedding_input_bytes;
+    size_t n = 0;
+    for (size_t i = 0; i < inputs_count;) {
+        struct emb_shard* shard = &shards[n++];
+        memset(shard, 0, sizeof(*shard));
+        shard->first = i;
+        bool oversized = max_bytes && inputs[i].text_len > max_bytes;
+        do {
+            shard->count++;
+            i++;
+        } while (!oversized && i < inputs_count && (!per_shard || shard->count < per_shard) &&
+                 !(max_bytes && inputs[i].text_len > max_bytes));
+    }
+    return n;
+}
+
+llm_error_t llm_embeddings_opts_ex(llm_client_t* client, const llm_embedding_input_t* inputs, size_t inputs_count,
+                                   const char* params_json, llm_embeddings_result_t* result,
+                                   const char* const* headers, size_t headers_count,
+                                   const llm_embeddings_opts_t* opts, llm_error_detail_t* detail) {
+    if (!opts) {
+        return llm_embeddings_with_headers_ex(client, inputs, inputs_count, params_json, result, headers,
+                                              headers_count, detail);
+    }
+    if (detail) llm_error_detail_free(detail);
+    last_error_reset(client);
+    if (!result || inputs_count == 0 || !inputs) {
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
+        return LLM_ERR_FAILED;
+    }
+    memset(result, 0, sizeof(*result));
+    const llm_allocator_t* alloc = &client->allocator;
+    size_t per_shard = client->limits.max_embedding_inputs;
+    if (opts->max_inputs_per_request && (!per_shard || opts->max_inputs_per_request < per_shard)) {
+        per_shard = opts->max_inputs_per_request;
+    }
+
+    struct emb_shard_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.client = client;
+    ctx.inputs = inputs;
+    ctx.params_json = params_json;
+    ctx.shards = mem_alloc(alloc, inputs_count * sizeof(*ctx.shards));
+    ctx.offsets = mem_alloc(alloc, inputs_count * sizeof(*ctx.offsets));
+    ctx.lens = mem_alloc(alloc, inputs_count * sizeof(*ctx.lens));
+    struct header_set header_set;
+    if (!ctx.shards || !ctx.offsets || !ctx.lens || !llm_header_set_init(&header_set, client, headers, headers_count)) {
+        mem_free(alloc, ctx.shards);
+        mem_free(alloc, ctx.offsets);
+        mem_free(alloc, ctx.lens);
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
+        return LLM_ERR_FAILED;
+    }
+    growbuf_init(&ctx.text, 4096, alloc);
+    size_t shards_count = emb_plan_shards(client, inputs, inputs_count, per_shard, ctx.shards);
+
+    char url[1024];
+    snprintf(url, sizeof(url), "%s/v1/embeddings", client->base_url);
+    llm_tls_config_t tls;
+    const llm_tls_config_t* tls_ptr = llm_client_tls_config(client, &tls);
+    http_post_batch(url, shards_count, opts->max_parallel_requests, client->timeout.overall_timeout_ms,
+                    client->limits.max_response_bytes, header_set.headers, header_set.count, tls_ptr,
+                    client->proxy_url, client->no_proxy, alloc, emb_shard_body, emb_shard_done, &ctx);
+    header_set_free(&header_set);
+
+    // Report the first failed shard in input order; completion order is not deterministic.
+    struct emb_shard* first_failed = NULL;
+    size_t succeeded = 0;
+    for (size_t s = 0; s < shards_count; s++) {
+        struct emb_shard* shard = &ctx.shards[s];
+        if (!shard->failed && !ctx.oom) succeeded += shard->count;
+        if (opts->input_errors) {
+            llm_error_t code = (shard->failed || ctx.oom) ? LLM_ERR_FAILED : LLM_ERR_NONE;
+            for (size_t i = 0; i < shard->count; i++) opts->input_errors[shard->first + i] = code;
+        }
+        if (!shard->failed) continue;
+        if (!first_failed) {
+            first_failed = shard;
+        } else {
+            mem_free(alloc, shard->body);
+        }
+    }
+    if (succeeded > 0) {
+        result->data = mem_calloc(alloc, inputs_count, sizeof(*result->data));
+        if (result->data) {
+            for (size_t s = 0; s < shards_count; s++) {
+                const struct emb_shard* shard = &ctx.shards[s];
+                if (shard->failed) continue;
+                for (size_t i = shard->first; i < shard->first + shard->count; i++) {
+                    result->data[i].embedding = ctx.text.data + ctx.offsets[i];
+                    result->data[i].embedding_len = ctx.lens[i];
+                }
+            }
+            result->data_count = inputs_count;
+            result->_internal = ctx.text.data;
+            result->_allocator = *alloc;
+            ctx.text.data = NULL;
+        } else {
+            succeeded = 0;
+            ctx.oom = true;
+            if (opts->input_errors) {
+                for (size_t i = 0; i < inputs_count; i++) opts->input_errors[i] = LLM_ERR_FAILED;
+            }
+        }
+    }
+    growbuf_free(&ctx.text);
+    mem_free(alloc, ctx.offsets);
+    mem_free(alloc, ctx.lens);
+
+    llm_error_t err = LLM_ERR_NONE;
+    if (first_failed) {
+        error_detail_capture(client, detail, LLM_ERR_FAILED, first_failed->stage, first_failed->http_status,
+                             first_failed->body, first_failed->body_len, first_failed->parse_error);
+        err = LLM_ERR_FAILED;
+    } else if (ctx.oom) {
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
+        err = LLM_ERR_FAILED;
+    }
+    mem_free(alloc, ctx.shards);
+    return err;
+}
+
+llm_error_t llm_embeddings_f32_ex(llm_client_t* client, const llm_embedding_input_t* inputs, size_t inputs_count,
+                                  const char* params_json, llm_embedding_encoding_t encoding, float* out,
+                                  size_t out_cap, size_t* out_dims, const char* const* headers, size_t headers_count,
+                                  llm_error_detail_t* detail) {
+    if (!out || !out_dims) {
+        if (detail) llm_error_detail_free(detail);
+        last_error_reset(client);
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
+        return LLM_ERR_FAILED;
+    }
+    *out_dims = 0;
+    const char* encoding_format = (encoding == LLM_EMBEDDING_ENCODING_BASE64) ? "base64" : NULL;
+    llm_embeddings_result_t result;
+    size_t body_len = 0;
+    llm_error_t err = embeddings_request(client, inputs, inputs_count, params_json, encoding_format,
+                                         client_allocator(client), &result, &body_len, headers, headers_count,
+                                         detail);
+    if (err != LLM_ERR_NONE) return err;
+
+    bool ok = result.data_count == inputs_count;
+    size_t dims = 0;
+    for (size_t i = 0; ok && i < result.data_count; i++) {
+        const llm_embedding_item_t* item = &result.data[i];
+        size_t row_dims = 0;
+        if (i == 0) {
+            ok = llm_embedding_decode_f32(item->embedding, item->embedding_len, NULL, 0, &dims) && dims > 0 &&
+                 dims <= out_cap / inputs_count;
+            if (!ok) break;
+        }
+        ok = llm_embedding_decode_f32(item->embedding, item->embedding_len, out + i * dims, dims, &row_dims) &&
+             row_dims == dims;
+    }
+    if (!ok) {
+        char* body = result._internal;
+        result._internal = NULL;
+        llm_embeddings_free(&result);
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, body, body_len, false);
+        return LLM_ERR_FAILED;
+    }
+    llm_embeddings_free(&result);
+    *out_dims = dims;
+    return LLM_ERR_NONE;
+}
+
+static bool embeddings_stream_cb(const char* chunk, size_t len, void* user_data) {
+    return emb_stream_feed(user_data, chunk, len) == EMB_STREAM_OK;
+}
+
+llm_error_t llm_embeddings_stream_ex(llm_client_t* client, const llm_embedding_input_t* inputs, size_t inputs_count,
+                                     const char* params_json, llm_embedding_encoding_t encoding, float* row,
+                                     size_t row_cap, llm_embedding_vector_cb on_vector, void* user_data,
+                                     const char* const* headers, size_t headers_count, llm_error_detail_t* detail) {
+    if (detail) llm_error_detail_free(detail);
+    last_error_reset(client);
+    if (!row || row_cap == 0 || !on_vector) {
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
+        return LLM_ERR_FAILED;
+    }
+    char url[1024];
+    snprintf(url, sizeof(url), "%s/v1/embeddings", client->base_url);
+
+    const char* encoding_format = (encoding == LLM_EMBEDDING_ENCODING_BASE64) ? "base64" : NULL;
+    char* request_json =
+        build_embeddings_request(client->model.name, inputs, inputs_count, params_json, encoding_format,
+                                 client->limits.max_embedding_input_bytes, client->limits.max_embedding_inputs,
+                                 &client->allocator);
+    if (!request_json) {
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
+        return LLM_ERR_FAILED;
+    }
+
+    struct header_set header_set;
+    if (!llm_header_set_init(&header_set, client, headers, headers_count)) {
+        mem_free(&client->allocator, request_json);
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
+        return LLM_ERR_FAILED;
+    }
+    emb_stream_t scan;
+    emb_stream_init(&scan, row, row_cap, on_vector, user_data);
+    size_t capture_max = LLM_EMBEDDINGS_STREAM_CAPTURE_MAX;
+    if (client->limits.max_response_bytes && client->limits.max_response_bytes < capture_max) {
+        capture_max = client->limits.max_response_bytes;
+    }
+    struct stream_capture_ctx capture;
+    stream_capture_init(&capture, embeddings_stream_cb, &scan, capture_max, detail != NULL, &client->allocator);
+    stream_cb cb = detail ? stream_capture_cb : embeddings_stream_cb;
+    void* cb_user_data = detail ? (void*)&capture : (void*)&scan;
+    llm_tls_config_t tls;
+    const llm_tls_config_t* tls_ptr = llm_client_tls_config(client, &tls);
+    llm_transport_status_t status;
+    bool ok = http_post_stream(url, request_json, client->timeout.overall_timeout_ms,
+                               client->timeout.read_idle_timeout_ms, header_set.headers, header_set.count, tls_ptr,
+                               client->proxy_url, client->no_proxy, cb, cb_user_data, -1, &status);
+    header_set_free(&header_set);
+    mem_free(&client->allocator, request_json);
+
+    char* err_body = NULL;
+    size_t err_len = 0;
+    if (status.http_status >= 400) {
+        stream_capture_release(&capture, &err_body, &err_len);
+        growbuf_free(&capture.buf);
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, status.http_status, err_body,
+                             err_len, true);
+        return LLM_ERR_FAILED;
+    }
+    if (scan.error == EMB_STREAM_ERR_ABORT) {
+        growbuf_free(&capture.buf);
+        error_detail_capture(client, detail, LLM_ERR_CANCELLED, LLM_ERROR_STAGE_NONE, status.http_status, NULL, 0,
+                             false);
+        return LLM_ERR_CANCELLED;
+    }
+    if (!ok && scan.error == EMB_STREAM_OK) {
+        growbuf_free(&capture.buf);
+        error_detail_capture(client, detail, LLM_ERR_FAILED, transport_stage(&status), status.http_status, NULL, 0,
+                             false);
+        return LLM_ERR_FAILED;
+    }
+    int rc = emb_stream_finish(&scan);
+    if (rc != EMB_STREAM_OK || scan.items == 0) {
+        stream_capture_release(&capture, &err_body, &err_len);
+        growbuf_free(&capture.buf);
+        llm_error_stage_t stage = (rc == EMB_STREAM_ERR_SYNTAX) ? LLM_ERROR_STAGE_JSON : LLM_ERROR_STAGE_PROTOCOL;
+        error_detail_capture(client, detail, LLM_ERR_FAILED, stage, status.http_status, err_body, err_len, false);
+        return LLM_ERR_FAILED;
+    }
+    growbuf_free(&capture.buf);
     return LLM_ERR_NONE;
 }
 
@@ -1353,19 +2115,19 @@ bool llm_embeddings(llm_client_t* client, const llm_embedding_input_t* inputs, s
 
 void llm_embeddings_free(llm_embeddings_result_t* result) {
     if (result) {
-        free(result->data);
-        free(result->_internal);
+        mem_free(&result->_allocator, result->data);
+        mem_free(&result->_allocator, result->_internal);
         memset(result, 0, sizeof(*result));
     }
 }
 
-llm_error_t llm_chat_with_headers_ex(llm_client_t* client, const llm_message_t* messages, size_t messages_count,
-                                     const char* params_json, const char* tooling_json,
-                                     const char* response_format_json, llm_chat_result_t* result,
-                                     const char* const* headers, size_t headers_count, llm_error_detail_t* detail) {
+static llm_error_t chat_request(llm_client_t* client, const llm_message_t* messages, size_t messages_count,
+                                const char* params_json, const char* tooling_json, const char* response_format_json,
+                                const llm_allocator_t* result_alloc, llm_chat_result_t* result,
+                                const char* const* headers, size_t headers_count, llm_error_detail_t* detail) {
     if (detail) llm_error_detail_free(detail);
     last_error_reset(client);
-    if (!result) {
+    if (!result || !result_alloc) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
@@ -1374,7 +2136,8 @@ llm_error_t llm_chat_with_headers_ex(llm_client_t* client, const llm_message_t*
 
     char* request_json =
         build_chat_request(client->model.name, messages, messages_count, false, false, params_json, tooling_json,
-                           response_format_json, client->limits.max_content_parts, client->limits.max_content_bytes);
+                           response_format_json, client->limits.max_content_parts, client->limits.max_content_bytes,
+                           &client->allocator);
     if (!request_json) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
@@ -1384,7 +2147,7 @@ llm_error_t llm_chat_with_headers_ex(llm_client_t* client, const llm_message_t*
     size_t response_len = 0;
     struct header_set header_set;
     if (!llm_header_set_init(&header_set, client, headers, headers_count)) {
-        free(request_json);
+        mem_free(&client->allocator, request_json);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
@@ -1393,32 +2156,52 @@ llm_error_t llm_chat_with_headers_ex(llm_client_t* client, const llm_message_t*
     llm_transport_status_t status;
     bool ok = http_post(url, request_json, client->timeout.overall_timeout_ms, client->limits.max_response_bytes,
                         header_set.headers, header_set.count, tls_ptr, client->proxy_url, client->no_proxy,
-                        &response_body, &response_len, &status);
+                        result_alloc, &response_body, &response_len, &status);
     header_set_free(&header_set);
-    free(request_json);
+    mem_free(&client->allocator, request_json);
 
     if (!ok) {
         error_detail_capture(client, detail, LLM_ERR_FAILED, transport_stage(&status), 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
     if (status.http_status >= 400) {
+        response_body = body_adopt(client, result_alloc, response_body, response_len);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, status.http_status,
                              response_body, response_len, true);
         return LLM_ERR_FAILED;
     }
 
     memset(result, 0, sizeof(*result));
-    int res = parse_chat_response(response_body, response_len, result);
+    int res = parse_chat_response(response_body, response_len, result, result_alloc);
     if (res < 0) {
+        response_body = body_adopt(client, result_alloc, response_body, response_len);
         llm_error_stage_t stage = (res == LLM_PARSE_ERR_PROTOCOL) ? LLM_ERROR_STAGE_PROTOCOL : LLM_ERROR_STAGE_JSON;
         error_detail_capture(client, detail, LLM_ERR_FAILED, stage, status.http_status, response_body, response_len,
                              true);
         return LLM_ERR_FAILED;
     }
     result->_internal = response_body;
+    result->_allocator = *result_alloc;
     return LLM_ERR_NONE;
 }
 
+llm_error_t llm_chat_with_headers_ex(llm_client_t* client, const llm_message_t* messages, size_t messages_count,
+                                     const char* params_json, const char* tooling_json,
+                                     const char* response_format_json, llm_chat_result_t* result,
+                                     const char* const* headers, size_t headers_count, llm_error_detail_t* detail) {
+    return chat_request(client, messages, messages_count, params_json, tooling_json, response_format_json,
+                        client_allocator(client), result, headers, headers_count, detail);
+}
+
+llm_error_t llm_chat_arena_ex(llm_client_t* client, const llm_message_t* messages, size_t messages_count,
+                              const char* params_json, const char* tooling_json, const char* response_format_json,
+                              llm_arena_t* arena, llm_chat_result_t* result, const char* const* headers,
+                              size_t headers_count, llm_error_detail_t* detail) {
+    llm_allocator_t alloc = llm_arena_allocator(arena);
+    return chat_request(client, messages, messages_count, params_json, tooling_json, response_format_json,
+                        arena ? &alloc : NULL, result, headers, headers_count, detail);
+}
+
 llm_error_t llm_chat_ex(llm_client_t* client, const llm_message_t* messages, size_t messages_count,
                         const char* params_json, const char* tooling_json, const char* response_format_json,
                         llm_chat_result_t* result, llm_error_detail_t* detail) {
@@ -1443,15 +2226,111 @@ void llm_chat_result_free(llm_chat_result_t* result) {
     if (result) {
         if (result->choices) {
             for (size_t i = 0; i < result->choices_count; i++) {
-                free(result->choices[i].tool_calls);
+                mem_free(&result->_allocator, result->choices[i].tool_calls);
             }
-            free(result->choices);
+            mem_free(&result->_allocator, result->choices);
         }
-        free(result->_internal);
+        mem_free(&result->_allocator, result->_internal);
         memset(result, 0, sizeof(*result));
     }
 }
 
+struct chat_batch_ctx {
+    llm_client_t* client;
+    const llm_chat_batch_request_t* requests;
+    llm_chat_batch_result_t* results;
+    char** request_json;  // built when an item is sent, freed when it completes
+    size_t failed;
+};
+
+static const char* chat_batch_body(size_t index, void* user_data) {
+    struct chat_batch_ctx* ctx = user_data;
+    llm_client_t* client = ctx->client;
+    const llm_chat_batch_request_t* req = &ctx->requests[index];
+    ctx->request_json[index] =
+        build_chat_request(client->model.name, req->messages, req->messages_count, false, false, req->params_json,
+                           req->tooling_json, req->response_format_json, client->limits.max_content_parts,
+                           client->limits.max_content_bytes, &client->allocator);
+    return ctx->request_json[index];
+}
+
+static void chat_batch_done(size_t index, bool ok, char* body, size_t len, const llm_transport_status_t* status,
+                            void* user_data) {
+    struct chat_batch_ctx* ctx = user_data;
+    llm_client_t* client = ctx->client;
+    llm_chat_batch_result_t* out = &ctx->results[index];
+    bool built = ctx->request_json[index] != NULL;
+    mem_free(&client->allocator, ctx->request_json[index]);
+    ctx->request_json[index] = NULL;
+
+    out->error = LLM_ERR_FAILED;
+    if (!ok) {
+        llm_error_stage_t stage = built ? transport_stage(status) : LLM_ERROR_STAGE_PROTOCOL;
+        error_detail_capture(client, &out->detail, LLM_ERR_FAILED, stage, 0, NULL, 0, false);
+        ctx->failed++;
+        return;
+    }
+    if (status->http_status >= 400) {
+        error_detail_capture(client, &out->detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, status->http_status,
+                             body, len, true);
+        ctx->failed++;
+        return;
+    }
+    int res = parse_chat_response(body, len, &out->result, &client->allocator);
+    if (res < 0) {
+        llm_error_stage_t stage = (res == LLM_PARSE_ERR_PROTOCOL) ? LLM_ERROR_STAGE_PROTOCOL : LLM_ERROR_STAGE_JSON;
+        error_detail_capture(client, &out->detail, LLM_ERR_FAILED, stage, status->http_status, body, len, true);
+        ctx->failed++;
+        return;
+    }
+    out->result._internal = body;
+    out->result._allocator = client->allocator;
+    out->error = LLM_ERR_NONE;
+}
+
+llm_error_t llm_chat_batch_ex(llm_client_t* client, const llm_chat_batch_request_t* requests, size_t count,
+                              size_t concurrency, llm_chat_batch_result_t* results) {
+    last_error_reset(client);
+    if (!client || (count > 0 && (!requests || !results))) {
+        last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
+        return LLM_ERR_FAILED;
+    }
+    if (count == 0) return LLM_ERR_NONE;
+    memset(results, 0, count * sizeof(*results));
+    for (size_t i = 0; i < count; i++) results[i].error = LLM_ERR_FAILED;
+
+    char** request_json = mem_calloc(&client->allocator, count, sizeof(*request_json));
+    struct header_set header_set;
+    if (!request_json || !llm_header_set_init(&header_set, client, NULL, 0)) {
+        mem_free(&client->allocator, request_json);
+        for (size_t i = 0; i < count; i++) {
+            error_detail_capture(client, &results[i].detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0,
+                                 false);
+        }
+        return LLM_ERR_FAILED;
+    }
+    char url[1024];
+    snprintf(url, sizeof(url), "%s/v1/chat/completions", client->base_url);
+    llm_tls_config_t tls;
+    const llm_tls_config_t* tls_ptr = llm_client_tls_config(client, &tls);
+    struct chat_batch_ctx ctx = {client, requests, results, request_json, 0};
+    http_post_batch(url, count, concurrency, client->timeout.overall_timeout_ms, client->limits.max_response_bytes,
+                    header_set.headers, header_set.count, tls_ptr, client->proxy_url, client->no_proxy,
+                    &client->allocator, chat_batch_body, chat_batch_done, &ctx);
+    header_set_free(&header_set);
+    mem_free(&client->allocator, request_json);
+    return ctx.failed ? LLM_ERR_FAILED : LLM_ERR_NONE;
+}
+
+void llm_chat_batch_results_free(llm_chat_batch_result_t* results, size_t count) {
+    if (!results) return;
+    for (size_t i = 0; i < count; i++) {
+        llm_chat_result_free(&results[i].result);
+        llm_error_detail_free(&results[i].detail);
+        results[i].error = LLM_ERR_NONE;
+    }
+}
+
 bool llm_chat_choice_get(const llm_chat_result_t* result, size_t index, const llm_chat_choice_t** out_choice) {
     if (!out_choice) return false;
     *out_choice = NULL;
@@ -1491,16 +2370,6 @@ bool llm_tool_message_init(llm_message_t* msg, const char* content, size_t conte
     return true;
 }
 
-static void llm_message_free_content(llm_message_t* msg) {
-    if (msg) {
-        free((char*)msg->content);
-        free((char*)msg->tool_call_id);
-        free((char*)msg->tool_calls_json);
-        free((char*)msg->content_json);
-        // Do not free name, it's not dynamically allocated in the tool loop
-    }
-}
-
 enum { TOOL_LOOP_HASH_WINDOW = 8 };
 
 struct tool_loop_guard {
@@ -1572,29 +2441,34 @@ static bool tool_loop_hash_turn(const llm_chat_result_t* result, uint64_t* out_h
     return true;
 }
 
-static void tool_loop_free_history(llm_message_t** history, size_t* history_count) {
-    if (!history || !*history) return;
-    for (size_t i = 0; i < *history_count; i++) {
-        llm_message_free_content(&(*history)[i]);
-    }
-    free(*history);
-    *history = NULL;
-    *history_count = 0;
-}
-
-struct stream_ctx {
+// Per-choice stream state: one for a single-choice stream, one per choice index when demultiplexing.
+struct stream_choice {
     const llm_stream_callbacks_t* callbacks;
-    size_t choice_index;
     struct tool_call_accumulator* accums;
     size_t accums_count;
-    size_t max_tool_args;
     bool tool_calls_finalized;
+    stop_matcher_t stop;
+    bool stop_active;
+    bool stopped;
+};
+
+struct stream_ctx {
+    struct stream_choice* choices;
+    size_t choices_count;
+    size_t choice_index;  // the choice a single-choice stream follows
+    bool demux;           // every choice index below choices_count, each to its own state
+    bool early_tool_args;  // hand each tool call out as soon as its arguments close (the streaming tool loop)
+    size_t max_tool_args;
     bool saw_done;
     bool include_usage;
     bool protocol_error;
     llm_abort_cb abort_cb;
     void* abort_user_data;
     llm_error_t error;
+    const llm_allocator_t* alloc;
+    size_t stopped_count;
+    bool stopped;  // every choice hit a stop string; the transfer can end
+    bool saw_first_byte;
 };
 
 static void stream_set_error(struct stream_ctx* ctx, llm_error_t err) {
@@ -1619,118 +2493,156 @@ static bool unescape_json_string_inplace(char* buf, size_t len, size_t* out_len)
     return true;
 }
 
-static bool validate_json_span(const char* json, size_t len) {
-    if (!json || len == 0 || len > (size_t)INT_MAX) return false;
-
-    jstok_parser parser;
-    jstok_init(&parser);
-    int needed = jstok_parse(&parser, json, (int)len, NULL, 0);
-    return needed > 0;
+// Unescapes a call's arguments in place and hands them to on_tool_args_complete.
+static bool complete_tool_call(struct stream_ctx* ctx, struct stream_choice* ch, size_t index) {
+    struct tool_call_accumulator* acc = &ch->accums[index];
+    size_t unescaped_len = 0;
+    if (!unescape_json_string_inplace(acc->args_buf.data, acc->args_buf.len, &unescaped_len)) {
+        stream_set_error(ctx, LLM_ERR_INVALID_TOOL_ARGS);
+        return false;
+    }
+    acc->args_buf.len = unescaped_len;
+    if (ch->callbacks && ch->callbacks->on_tool_args_complete) {
+        ch->callbacks->on_tool_args_complete(ch->callbacks->user_data, index, acc->args_buf.data, acc->args_buf.len);
+    }
+    return true;
 }
 
-static bool finalize_tool_calls(struct stream_ctx* ctx) {
-    if (ctx->tool_calls_finalized) return true;
-    ctx->tool_calls_finalized = true;
+static bool finalize_tool_calls(struct stream_ctx* ctx, struct stream_choice* ch) {
+    if (ch->tool_calls_finalized) return true;
+    ch->tool_calls_finalized = true;
 
-    for (size_t i = 0; i < ctx->accums_count; i++) {
-        struct tool_call_accumulator* acc = &ctx->accums[i];
-        if (!acc->active) continue;
+    for (size_t i = 0; i < ch->accums_count; i++) {
+        struct tool_call_accumulator* acc = &ch->accums[i];
+        if (!acc->active || acc->completed) continue;
         acc->frozen = true;
         if (!acc->saw_args) {
             stream_set_error(ctx, LLM_ERR_FAILED);
             return false;
         }
-        size_t unescaped_len = 0;
-        if (!unescape_json_string_inplace(acc->args_buf.data, acc->args_buf.len, &unescaped_len)) {
-            stream_set_error(ctx, LLM_ERR_FAILED);
+        // The arguments were validated as they streamed in; only a complete value is left to check.
+        if (!accum_args_complete(acc)) {
+            stream_set_error(ctx, LLM_ERR_INVALID_TOOL_ARGS);
             return false;
         }
-        acc->args_buf.len = unescaped_len;
-        if (!validate_json_span(acc->args_buf.data, acc->args_buf.len)) {
-            stream_set_error(ctx, LLM_ERR_FAILED);
+        if (!complete_tool_call(ctx, ch, i)) return false;
+    }
+
+    return true;
+}
+
+// Delivers one choice's part of a chunk. Returns false on a protocol error, which ends the stream.
+static bool stream_choice_apply(struct stream_ctx* ctx, struct stream_choice* ch, const llm_chat_chunk_delta_t* delta,
+                                const llm_usage_t* usage) {
+    const llm_stream_callbacks_t* cb = ch->callbacks;
+    if ((delta->content_delta && delta->content_delta_len > 0) ||
+        (delta->reasoning_delta && delta->reasoning_delta_len > 0)) {
+        stream_stats_delta(cb->stats);
+    }
+    if (delta->content_delta &&
+        stream_content_delta(cb, &ch->stop, ch->stop_active, delta->content_delta, delta->content_delta_len)) {
+        ch->stopped = true;
+        stream_stopped(cb);
+        if (++ctx->stopped_count == ctx->choices_count) ctx->stopped = true;
+        return true;
+    }
+    if (delta->reasoning_delta && cb->on_reasoning_delta) {
+        cb->on_reasoning_delta(cb->user_data, delta->reasoning_delta, delta->reasoning_delta_len);
+    }
+    if (usage && cb->on_usage) cb->on_usage(cb->user_data, usage);
+    for (size_t i = 0; i < delta->tool_call_deltas_count; i++) {
+        llm_tool_call_delta_t* td = &delta->tool_call_deltas[i];
+        if (td->index >= ch->accums_count) {
+            size_t new_count = td->index + 1;
+            struct tool_call_accumulator* next =
+                mem_realloc(ctx->alloc, ch->accums, new_count * sizeof(struct tool_call_accumulator));
+            if (!next) {
+                stream_set_error(ctx, LLM_ERR_FAILED);
+                return false;
+            }
+            ch->accums = next;
+            for (size_t j = ch->accums_count; j < new_count; j++) {
+                accum_init(&ch->accums[j], ctx->alloc);
+            }
+            ch->accums_count = new_count;
+        }
+        if (cb->on_tool_call_delta) cb->on_tool_call_delta(cb->user_data, td);
+        bool accum_ok = accum_feed_delta(&ch->accums[td->index], td, ctx->max_tool_args);
+        if (td->arguments_fragment && cb->on_tool_args_fragment) {
+            cb->on_tool_args_fragment(cb->user_data, td->index, td->arguments_fragment, td->arguments_fragment_len);
+        }
+        if (!accum_ok) {
+            // Malformed arguments stop the stream here rather than after the model finishes.
+            stream_set_error(ctx, ch->accums[td->index].args_invalid ? LLM_ERR_INVALID_TOOL_ARGS : LLM_ERR_FAILED);
             return false;
         }
-        if (ctx->callbacks && ctx->callbacks->on_tool_args_complete) {
-            ctx->callbacks->on_tool_args_complete(ctx->callbacks->user_data, i, acc->args_buf.data, acc->args_buf.len);
+        // The streaming tool loop takes each call as soon as its arguments close, while later calls are still
+        // streaming; everyone else gets them at finish_reason.
+        struct tool_call_accumulator* acc = &ch->accums[td->index];
+        if (ctx->early_tool_args && !acc->completed && accum_args_complete(acc)) {
+            acc->completed = true;
+            if (!complete_tool_call(ctx, ch, td->index)) return false;
         }
     }
-
+    if (delta->finish_reason != LLM_FINISH_REASON_UNKNOWN) {
+        stream_content_flush(cb, &ch->stop, ch->stop_active);
+        if (delta->finish_reason == LLM_FINISH_REASON_TOOL_CALLS && !finalize_tool_calls(ctx, ch)) return false;
+        if (cb->on_finish_reason) cb->on_finish_reason(cb->user_data, delta->finish_reason);
+    }
     return true;
 }
 
+enum { STREAM_DEMUX_STACK_CHOICES = 8 };
+
 static bool on_sse_event(void* user_data, const sse_event_t* event) {
     struct stream_ctx* ctx = user_data;
     if (ctx->protocol_error) return true;
-    if (ctx->saw_done) return true;
+    if (ctx->saw_done || ctx->stopped) return true;
     if (event->data.len == 6 && memcmp(event->data.ptr, "[DONE]", 6) == 0) {
         ctx->saw_done = true;
+        for (size_t i = 0; i < ctx->choices_count; i++) {
+            struct stream_choice* ch = &ctx->choices[i];
+            stream_content_flush(ch->callbacks, &ch->stop, ch->stop_active);
+        }
         return true;
     }
     if (!event->data.ptr || event->data.len == 0) return true;
-    llm_chat_chunk_delta_t delta;
     llm_usage_t usage;
     bool usage_present = false;
-    if (parse_chat_chunk_choice(event->data.ptr, event->data.len, ctx->choice_index, &delta, &usage, &usage_present) ==
-        0) {
-        if (delta.content_delta && ctx->callbacks->on_content_delta) {
-            ctx->callbacks->on_content_delta(ctx->callbacks->user_data, delta.content_delta, delta.content_delta_len);
-        }
-        if (delta.reasoning_delta && ctx->callbacks->on_reasoning_delta) {
-            ctx->callbacks->on_reasoning_delta(ctx->callbacks->user_data, delta.reasoning_delta,
-                                               delta.reasoning_delta_len);
-        }
-        if (ctx->include_usage && usage_present && ctx->callbacks->on_usage) {
-            ctx->callbacks->on_usage(ctx->callbacks->user_data, &usage);
+    if (!ctx->demux) {
+        llm_chat_chunk_delta_t delta;
+        if (parse_chat_chunk_choice(event->data.ptr, event->data.len, ctx->choice_index, &delta, &usage, &usage_present,
+                                    ctx->alloc) == 0) {
+            const llm_usage_t* u = ctx->include_usage && usage_present ? &usage : NULL;
+            if (!stream_choice_apply(ctx, &ctx->choices[0], &delta, u)) ctx->protocol_error = true;
+            mem_free(ctx->alloc, delta.tool_call_deltas);
         }
-        if (delta.tool_call_deltas_count > 0) {
-            for (size_t i = 0; i < delta.tool_call_deltas_count; i++) {
-                llm_tool_call_delta_t* td = &delta.tool_call_deltas[i];
-                if (td->index >= ctx->accums_count) {
-                    size_t new_count = td->index + 1;
-                    struct tool_call_accumulator* next =
-                        realloc(ctx->accums, new_count * sizeof(struct tool_call_accumulator));
-                    if (!next) {
-                        ctx->protocol_error = true;
-                        stream_set_error(ctx, LLM_ERR_FAILED);
-                        free(delta.tool_call_deltas);
-                        return true;
-                    }
-                    ctx->accums = next;
-                    for (size_t j = ctx->accums_count; j < new_count; j++) {
-                        accum_init(&ctx->accums[j]);
-                    }
-                    ctx->accums_count = new_count;
-                }
-                if (ctx->callbacks->on_tool_call_delta) {
-                    ctx->callbacks->on_tool_call_delta(ctx->callbacks->user_data, td);
-                }
-                bool accum_ok = accum_feed_delta(&ctx->accums[td->index], td, ctx->max_tool_args);
-                if (td->arguments_fragment && ctx->callbacks->on_tool_args_fragment) {
-                    ctx->callbacks->on_tool_args_fragment(ctx->callbacks->user_data, td->index, td->arguments_fragment,
-                                                          td->arguments_fragment_len);
-                }
-                if (!accum_ok) {
-                    ctx->protocol_error = true;
-                    stream_set_error(ctx, LLM_ERR_FAILED);
-                    free(delta.tool_call_deltas);
-                    return true;
-                }
-            }
+        return true;
+    }
+
+    // One parse per chunk for all choices; usage goes to choice 0.
+    llm_chat_chunk_delta_t stack_deltas[STREAM_DEMUX_STACK_CHOICES];
+    llm_chat_chunk_delta_t* deltas = stack_deltas;
+    if (ctx->choices_count > STREAM_DEMUX_STACK_CHOICES) {
+        deltas = mem_alloc(ctx->alloc, ctx->choices_count * sizeof(*deltas));
+        if (!deltas) {
+            ctx->protocol_error = true;
+            stream_set_error(ctx, LLM_ERR_FAILED);
+            return true;
         }
-        if (delta.finish_reason != LLM_FINISH_REASON_UNKNOWN) {
-            if (delta.finish_reason == LLM_FINISH_REASON_TOOL_CALLS) {
-                if (!finalize_tool_calls(ctx)) {
-                    ctx->protocol_error = true;
-                    free(delta.tool_call_deltas);
-                    return true;
-                }
-            }
-            if (ctx->callbacks->on_finish_reason) {
-                ctx->callbacks->on_finish_reason(ctx->callbacks->user_data, delta.finish_reason);
+    }
+    if (parse_chat_chunk_choices(event->data.ptr, event->data.len, deltas, ctx->choices_count, &usage, &usage_present,
+                                 ctx->alloc) == 0) {
+        for (size_t i = 0; i < ctx->choices_count; i++) {
+            struct stream_choice* ch = &ctx->choices[i];
+            const llm_usage_t* u = i == 0 && ctx->include_usage && usage_present ? &usage : NULL;
+            if (!ch->stopped && !ctx->protocol_error && !stream_choice_apply(ctx, ch, &deltas[i], u)) {
+                ctx->protocol_error = true;
             }
+            mem_free(ctx->alloc, deltas[i].tool_call_deltas);
         }
-        free(delta.tool_call_deltas);
     }
+    if (deltas != stack_deltas) mem_free(ctx->alloc, deltas);
     return true;
 }
 
@@ -1751,6 +2663,12 @@ typedef struct {
 
 static bool curl_stream_cb(const char* chunk, size_t len, void* user_data) {
     curl_stream_ctx* cs = user_data;
+    if (!cs->ctx->saw_first_byte) {
+        cs->ctx->saw_first_byte = true;
+        for (size_t c = 0; c < cs->ctx->choices_count; c++) {
+            stream_stats_first_byte(cs->ctx->choices[c].callbacks->stats);
+        }
+    }
     if (cs->ctx->abort_cb && cs->ctx->abort_cb(cs->ctx->abort_user_data)) {
         stream_set_error(cs->ctx, LLM_ERR_CANCELLED);
         return false;
@@ -1766,6 +2684,7 @@ static bool curl_stream_cb(const char* chunk, size_t len, void* user_data) {
         }
         return false;
     }
+    if (cs->ctx->stopped) return false;
     if (cs->ctx->abort_cb && cs->ctx->abort_cb(cs->ctx->abort_user_data)) {
         stream_set_error(cs->ctx, LLM_ERR_CANCELLED);
         return false;
@@ -1777,43 +2696,89 @@ static bool curl_stream_cb(const char* chunk, size_t len, void* user_data) {
     return true;
 }
 
-static llm_error_t llm_chat_stream_with_headers_choice_ex(llm_client_t* client, const llm_message_t* messages,
-                                                          size_t messages_count, const char* params_json,
-                                                          const char* tooling_json, const char* response_format_json,
-                                                          size_t choice_index, const llm_stream_callbacks_t* callbacks,
-                                                          llm_abort_cb abort_cb, void* abort_user_data,
-                                                          const char* const* headers, size_t headers_count,
-                                                          llm_error_detail_t* detail) {
+static void stream_choices_free(struct stream_ctx* ctx) {
+    for (size_t c = 0; c < ctx->choices_count; c++) {
+        struct stream_choice* ch = &ctx->choices[c];
+        if (ch->stop_active) stop_matcher_free(&ch->stop);
+        for (size_t i = 0; i < ch->accums_count; i++) {
+            accum_free(&ch->accums[i]);
+        }
+        mem_free(ctx->alloc, ch->accums);
+    }
+    mem_free(ctx->alloc, ctx->choices);
+    ctx->choices = NULL;
+    ctx->choices_count = 0;
+}
+
+static bool stream_choices_init(struct stream_ctx* ctx, const llm_stream_callbacks_t* callbacks, size_t count) {
+    ctx->choices = mem_calloc(ctx->alloc, count, sizeof(*ctx->choices));
+    if (!ctx->choices) return false;
+    for (size_t c = 0; c < count; c++) {
+        ctx->choices[c].callbacks = &callbacks[c];
+        ctx->choices_count = c + 1;
+        if (!stream_stop_init(&ctx->choices[c].stop, &ctx->choices[c].stop_active, &callbacks[c], ctx->alloc)) {
+            stream_choices_free(ctx);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Streams a chat completion. Without demux, callbacks[0] follows choice_index; with demux, callbacks[i]
+// receives choice i for every i below callbacks_count. early_tool_args moves on_tool_args_complete from
+// finish_reason to the moment each call's arguments close.
+static llm_error_t chat_stream_request(llm_client_t* client, const llm_message_t* messages, size_t messages_count,
+                                       const char* params_json, const char* tooling_json,
+                                       const char* response_format_json, size_t choice_index, bool demux,
+                                       bool early_tool_args, const llm_stream_callbacks_t* callbacks,
+                                       size_t callbacks_count, llm_abort_cb abort_cb, void* abort_user_data,
+                                       const char* const* headers, size_t headers_count, llm_error_detail_t* detail) {
     if (detail) llm_error_detail_free(detail);
     last_error_reset(client);
+    if (!callbacks || callbacks_count == 0) {
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
+        return LLM_ERR_FAILED;
+    }
+    uint64_t start_ns = mono_ns();
+    for (size_t c = 0; c < callbacks_count; c++) stream_stats_start(callbacks[c].stats, start_ns);
     char url[1024];
     snprintf(url, sizeof(url), "%s/v1/chat/completions", client->base_url);
 
-    const bool include_usage = callbacks && callbacks->include_usage;
+    const bool include_usage = callbacks[0].include_usage;
     char* request_json =
         build_chat_request(client->model.name, messages, messages_count, true, include_usage, params_json, tooling_json,
-                           response_format_json, client->limits.max_content_parts, client->limits.max_content_bytes);
+                           response_format_json, client->limits.max_content_parts, client->limits.max_content_bytes,
+                           &client->allocator);
     if (!request_json) {
+        stream_stats_finish_all(callbacks, callbacks_count);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
 
-    struct stream_ctx ctx = {.callbacks = callbacks,
-                             .choice_index = choice_index,
-                             .accums = NULL,
-                             .accums_count = 0,
+    struct stream_ctx ctx = {.choice_index = choice_index,
+                             .demux = demux,
+                             .early_tool_args = early_tool_args,
                              .max_tool_args = client->limits.max_tool_args_bytes_per_call,
-                             .tool_calls_finalized = false,
                              .saw_done = false,
                              .include_usage = include_usage,
                              .protocol_error = false,
                              .abort_cb = abort_cb,
                              .abort_user_data = abort_user_data,
-                             .error = LLM_ERR_NONE};
-    sse_parser_t* sse = sse_create(client->limits.max_line_bytes, client->limits.max_frame_bytes,
-                                   client->limits.max_sse_buffer_bytes, client->limits.max_response_bytes);
+                             .error = LLM_ERR_NONE,
+                             .alloc = &client->allocator};
+    if (!stream_choices_init(&ctx, callbacks, callbacks_count)) {
+        mem_free(&client->allocator, request_json);
+        stream_stats_finish_all(callbacks, callbacks_count);
+        error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
+        return LLM_ERR_FAILED;
+    }
+    sse_parser_t* sse = sse_create_with_allocator(client->limits.max_line_bytes, client->limits.max_frame_bytes,
+                                                  client->limits.max_sse_buffer_bytes,
+                                                  client->limits.max_response_bytes, &client->allocator);
     if (!sse) {
-        free(request_json);
+        stream_choices_free(&ctx);
+        mem_free(&client->allocator, request_json);
+        stream_stats_finish_all(callbacks, callbacks_count);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
@@ -1823,24 +2788,33 @@ static llm_error_t llm_chat_stream_with_headers_choice_ex(llm_client_t* client,
     curl_stream_ctx cs = {sse, &ctx, SSE_OK};
     struct header_set header_set;
     if (!llm_header_set_init(&header_set, client, headers, headers_count)) {
+        stream_choices_free(&ctx);
         sse_destroy(sse);
-        free(request_json);
+        mem_free(&client->allocator, request_json);
+        stream_stats_finish_all(callbacks, callbacks_count);
         error_detail_capture(client, detail, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL, 0, NULL, 0, false);
         return LLM_ERR_FAILED;
     }
     llm_tls_config_t tls;
     const llm_tls_config_t* tls_ptr = llm_client_tls_config(client, &tls);
     struct stream_capture_ctx capture;
-    stream_capture_init(&capture, curl_stream_cb, &cs, client->limits.max_response_bytes, detail != NULL);
+    stream_capture_init(&capture, curl_stream_cb, &cs, client->limits.max_response_bytes, detail != NULL,
+                        &client->allocator);
     stream_cb cb = detail ? stream_capture_cb : curl_stream_cb;
     void* cb_user_data = detail ? (void*)&capture : (void*)&cs;
     llm_transport_status_t status;
     bool ok = http_post_stream(url, request_json, client->timeout.overall_timeout_ms,
                                client->timeout.read_idle_timeout_ms, header_set.headers, header_set.count, tls_ptr,
-                               client->proxy_url, client->no_proxy, cb, cb_user_data, &status);
+                               client->proxy_url, client->no_proxy, cb, cb_user_data,
+                               abort_wake_fd(abort_cb, abort_user_data), &status);
+    stream_stats_finish_all(callbacks, callbacks_count);
     header_set_free(&header_set);
-    if (ok && !ctx.tool_calls_finalized && ctx.saw_done) {
-        if (!finalize_tool_calls(&ctx)) {
+    if (!ok && abort_cb && abort_cb(abort_user_data)) stream_set_error(&ctx, LLM_ERR_CANCELLED);
+    if (ctx.stopped) ok = true;  // aborted on purpose after a stop string
+    for (size_t c = 0; ok && c < ctx.choices_count; c++) {
+        struct stream_choice* ch = &ctx.choices[c];
+        stream_content_flush(ch->callbacks, &ch->stop, ch->stop_active);
+        if (!ch->tool_calls_finalized && ctx.saw_done && !finalize_tool_calls(&ctx, ch)) {
             ctx.protocol_error = true;
             stream_set_error(&ctx, LLM_ERR_FAILED);
             ok = false;
@@ -1850,12 +2824,9 @@ static llm_error_t llm_chat_stream_with_headers_choice_ex(llm_client_t* client,
         ok = false;
     }
 
-    for (size_t i = 0; i < ctx.accums_count; i++) {
-        accum_free(&ctx.accums[i]);
-    }
-    free(ctx.accums);
+    stream_choices_free(&ctx);
     sse_destroy(sse);
-    free(request_json);
+    mem_free(&client->allocator, request_json);
 
     if (!ok) {
         llm_error_t err = (ctx.error != LLM_ERR_NONE) ? ctx.error : LLM_ERR_FAILED;
@@ -1902,6 +2873,33 @@ static llm_error_t llm_chat_stream_with_headers_choice_ex(llm_client_t* client,
     return LLM_ERR_NONE;
 }
 
+static llm_error_t llm_chat_stream_with_headers_choice_ex(llm_client_t* client, const llm_message_t* messages,
+                                                          size_t messages_count, const char* params_json,
+                                                          const char* tooling_json, const char* response_format_json,
+                                                          size_t choice_index, const llm_stream_callbacks_t* callbacks,
+                                                          llm_abort_cb abort_cb, void* abort_user_data,
+                                                          const char* const* headers, size_t headers_count,
+                                                          llm_error_detail_t* detail) {
+    llm_stream_callbacks_t none;
+    if (!callbacks) {
+        memset(&none, 0, sizeof(none));
+        callbacks = &none;
+    }
+    return chat_stream_request(client, messages, messages_count, params_json, tooling_json, response_format_json,
+                               choice_index, false, false, callbacks, 1, abort_cb, abort_user_data, headers,
+                               headers_count, detail);
+}
+
+llm_error_t llm_chat_stream_choices_ex(llm_client_t* client, const llm_message_t* messages, size_t messages_count,
+                                       const char* params_json, const char* tooling_json,
+                                       const char* response_format_json, const llm_stream_callbacks_t* choice_callbacks,
+                                       size_t choices_count, llm_abort_cb abort_cb, void* abort_user_data,
+                                       const char* const* headers, size_t headers_count, llm_error_detail_t* detail) {
+    return chat_stream_request(client, messages, messages_count, params_json, tooling_json, response_format_json, 0,
+                               true, false, choice_callbacks, choices_count, abort_cb, abort_user_data, headers,
+                               headers_count, detail);
+}
+
 bool llm_chat_stream_with_headers(llm_client_t* client, const llm_message_t* messages, size_t messages_count,
                                   const char* params_json, const char* tooling_json, const char* response_format_json,
                                   const llm_stream_callbacks_t* callbacks, const char* const* headers,
@@ -2017,100 +3015,162 @@ llm_error_t llm_chat_stream_choice_with_headers_detail_ex(llm_client_t* client,
                                                   abort_user_data, headers, headers_count, detail);
 }
 
+// Appends the assistant turn (its tool_calls array plus content and reasoning combined) to the run arena;
+// history has room.
+static bool tool_loop_push_assistant(struct tool_history* history, const char* tool_calls_json,
+                                     size_t tool_calls_json_len, const char* content, size_t content_len,
+                                     const char* reasoning, size_t reasoning_len) {
+    llm_message_t* assistant_msg = &history->msgs[history->count];
+    memset(assistant_msg, 0, sizeof(*assistant_msg));
+    assistant_msg->role = LLM_ROLE_ASSISTANT;
+    char* calls = mem_alloc(&history->alloc, tool_calls_json_len);
+    if (!calls) return false;
+    memcpy(calls, tool_calls_json, tool_calls_json_len);
+    assistant_msg->tool_calls_json = calls;
+    assistant_msg->tool_calls_json_len = tool_calls_json_len;
+
+    // Combine content and reasoning_content if available
+    if (content || reasoning) {
+        size_t total_len = 0;
+        if (content) total_len += content_len;
+        if (reasoning) total_len += reasoning_len;
+
+        char* combined_content = mem_alloc(&history->alloc, total_len + 1);  // +1 for null terminator
+        if (!combined_content) return false;
+
+        size_t current_offset = 0;
+        if (content) {
+            memcpy(combined_content, content, content_len);
+            current_offset += content_len;
+        }
+        if (reasoning) {
+            memcpy(combined_content + current_offset, reasoning, reasoning_len);
+            current_offset += reasoning_len;
+        }
+        combined_content[total_len] = '\0';
+
+        assistant_msg->content = combined_content;
+        assistant_msg->content_len = total_len;
+    }
+    history->count++;
+    return true;
+}
+
+// Appends one dispatch result as a tool message; res_json (from the caller's malloc) is copied into the run
+// arena and freed either way.
+static bool tool_loop_push_result(llm_client_t* client, struct tool_history* history, char* res_json,
+                                  size_t res_len, const char* tool_call_id, size_t tool_call_id_len,
+                                  size_t* tool_output_total) {
+    // If dispatch succeeded but returned no res_json, treat as failure for loop purposes
+    if (!res_json) return false;
+
+    const size_t max_tool_output_total = client->limits.max_tool_output_bytes_total;
+    if (res_len > SIZE_MAX - *tool_output_total) {
+        free(res_json);
+        return false;
+    }
+    size_t next_output_total = *tool_output_total + res_len;
+    if (max_tool_output_total && next_output_total > max_tool_output_total) {
+        free(res_json);
+        return false;
+    }
+    *tool_output_total = next_output_total;
+
+    char* content = mem_strndup(&history->alloc, res_json, res_len);
+    free(res_json);
+    if (!content) return false;
+
+    llm_message_t* tool_msg = &history->msgs[history->count];
+    memset(tool_msg, 0, sizeof(*tool_msg));
+    tool_msg->role = LLM_ROLE_TOOL;
+    tool_msg->content = content;
+    tool_msg->content_len = res_len;
+
+    if (tool_call_id) {
+        tool_msg->tool_call_id = mem_strndup(&history->alloc, tool_call_id, tool_call_id_len);
+        if (!tool_msg->tool_call_id) return false;
+        tool_msg->tool_call_id_len = tool_call_id_len;
+    }
+    history->count++;
+    return true;
+}
+
+static bool tool_loop_pool_init(llm_client_t* client, struct tool_pool* pool, const llm_tool_loop_opts_t* opts,
+                                llm_tool_dispatch_cb dispatch, void* dispatch_user_data, bool* active) {
+    *active = false;
+    if (!opts || opts->max_parallel_dispatch <= 1) return true;
+    if (!tool_pool_init(pool, opts->max_parallel_dispatch, dispatch, dispatch_user_data, &client->allocator)) {
+        return false;
+    }
+    *active = true;
+    return true;
+}
+
+static bool tool_loop_cache_init(llm_client_t* client, struct tool_cache* cache, const llm_tool_loop_opts_t* opts,
+                                 bool* active) {
+    *active = false;
+    if (!opts || opts->cache_max_entries == 0 || opts->cacheable_tools_count == 0) return true;
+    if (!tool_cache_init(cache, &client->allocator, opts->cache_max_entries, opts->cacheable_tools,
+                         opts->cacheable_tools_count)) {
+        return false;
+    }
+    *active = true;
+    return true;
+}
+
+static void tool_loop_report_stats(const llm_tool_loop_opts_t* opts, size_t dispatches, const struct tool_cache* cache,
+                                   bool cache_active) {
+    if (!opts || !opts->stats) return;
+    opts->stats->dispatches = dispatches;
+    opts->stats->cache_hits = cache_active ? cache->hits : 0;
+    opts->stats->cache_misses = cache_active ? cache->misses : 0;
+}
+
+// Non-streaming arguments are the escaped body of a JSON string; the result cache keys on the plain JSON.
+static bool tool_loop_plain_args(struct growbuf* b, const llm_tool_call_t* tc) {
+    b->len = 0;
+    if (tc->arguments_len == 0) return true;
+    if (!growbuf_append(b, tc->arguments, tc->arguments_len, 0)) return false;
+    size_t len = 0;
+    if (!unescape_json_string_inplace(b->data, b->len, &len)) return false;
+    b->len = len;
+    return true;
+}
+
+// Outcome of one call of a non-streaming turn.
+struct tool_loop_slot {
+    char* result;  // caller's malloc, from dispatch or the cache
+    size_t result_len;
+    struct tool_job* job;  // when dispatched on the pool
+    bool cached;
+};
+
 // Tool loop implementation is usually complex, let's put a simplified version here
-llm_error_t llm_tool_loop_run_with_headers_ex(llm_client_t* client, const llm_message_t* initial_messages,
-                                              size_t initial_count, const char* params_json, const char* tooling_json,
-                                              const char* response_format_json, llm_tool_dispatch_cb dispatch,
-                                              void* dispatch_user_data, llm_abort_cb abort_cb, void* abort_user_data,
-                                              size_t max_turns, const char* const* headers, size_t headers_count) {
+llm_error_t llm_tool_loop_run_opts(llm_client_t* client, const llm_message_t* initial_messages, size_t initial_count,
+                                   const char* params_json, const char* tooling_json, const char* response_format_json,
+                                   llm_tool_dispatch_cb dispatch, void* dispatch_user_data, llm_abort_cb abort_cb,
+                                   void* abort_user_data, size_t max_turns, const char* const* headers,
+                                   size_t headers_count, const llm_tool_loop_opts_t* opts) {
     last_error_reset(client);
-    size_t history_count = initial_count;
-    llm_message_t* history = calloc(history_count, sizeof(llm_message_t));
-    if (!history) {
+    struct tool_history history;
+    if (!tool_history_init(&history, &client->allocator, initial_messages, initial_count)) {
+        tool_history_free(&history);
         last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
         return LLM_ERR_FAILED;
     }
 
-    for (size_t i = 0; i < initial_count; i++) {
-        history[i].role = initial_messages[i].role;
-        if (initial_messages[i].content_json_len && !initial_messages[i].content_json) {
-            tool_loop_free_history(&history, &history_count);
-            last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
-            return LLM_ERR_FAILED;
-        }
-        if (initial_messages[i].content && initial_messages[i].content_json) {
-            tool_loop_free_history(&history, &history_count);
-            last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
-            return LLM_ERR_FAILED;
-        }
-        if (initial_messages[i].content) {
-            history[i].content = strdup(initial_messages[i].content);
-            if (!history[i].content) {
-                // Free already duplicated content and history itself
-                for (size_t j = 0; j < i; j++) {
-                    llm_message_free_content(&history[j]);
-                }
-                free(history);
-                last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
-                return LLM_ERR_FAILED;
-            }
-            history[i].content_len = initial_messages[i].content_len;
-        }
-        if (initial_messages[i].content_json) {
-            if (initial_messages[i].content_json_len == 0) {
-                tool_loop_free_history(&history, &history_count);
-                last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
-                return LLM_ERR_FAILED;
-            }
-            history[i].content_json = malloc(initial_messages[i].content_json_len);
-            if (!history[i].content_json) {
-                llm_message_free_content(&history[i]);
-                for (size_t j = 0; j < i; j++) {
-                    llm_message_free_content(&history[j]);
-                }
-                free(history);
-                last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
-                return LLM_ERR_FAILED;
-            }
-            memcpy((char*)history[i].content_json, initial_messages[i].content_json,
-                   initial_messages[i].content_json_len);
-            history[i].content_json_len = initial_messages[i].content_json_len;
-        }
-        if (initial_messages[i].tool_call_id) {
-            history[i].tool_call_id = strdup(initial_messages[i].tool_call_id);
-            if (!history[i].tool_call_id) {
-                llm_message_free_content(&history[i]);  // Free current content
-                for (size_t j = 0; j < i; j++) {
-                    llm_message_free_content(&history[j]);
-                }
-                free(history);
-                last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
-                return LLM_ERR_FAILED;
-            }
-            history[i].tool_call_id_len = initial_messages[i].tool_call_id_len;
-        }
-        history[i].name =
-            initial_messages[i].name;  // name is not duplicated as it's typically static or managed elsewhere
-        history[i].name_len = initial_messages[i].name_len;
-        if (initial_messages[i].tool_calls_json && initial_messages[i].tool_calls_json_len > 0) {
-            history[i].tool_calls_json = malloc(initial_messages[i].tool_calls_json_len);
-            if (!history[i].tool_calls_json) {
-                llm_message_free_content(&history[i]);
-                for (size_t j = 0; j < i; j++) {
-                    llm_message_free_content(&history[j]);
-                }
-                free(history);
-                last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
-                return LLM_ERR_FAILED;
-            }
-            memcpy((char*)history[i].tool_calls_json, initial_messages[i].tool_calls_json,
-                   initial_messages[i].tool_calls_json_len);
-            history[i].tool_calls_json_len = initial_messages[i].tool_calls_json_len;
-        }
+    struct tool_pool pool;
+    bool pool_active = false;
+    if (max_turns == 0 || !tool_loop_pool_init(client, &pool, opts, dispatch, dispatch_user_data, &pool_active)) {
+        tool_history_free(&history);
+        last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
+        return LLM_ERR_FAILED;
     }
-
-    if (max_turns == 0) {
-        tool_loop_free_history(&history, &history_count);
+    struct tool_cache cache;
+    bool cache_active = false;
+    if (!tool_loop_cache_init(client, &cache, opts, &cache_active)) {
+        if (pool_active) tool_pool_destroy(&pool);
+        tool_history_free(&history);
         last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
         return LLM_ERR_FAILED;
     }
@@ -2118,8 +3178,10 @@ llm_error_t llm_tool_loop_run_with_headers_ex(llm_client_t* client, const llm_me
     struct tool_loop_guard guard;
     tool_loop_guard_init(&guard);
     size_t tool_output_total = 0;
+    size_t dispatches = 0;
     const size_t max_tool_args_per_turn = client->limits.max_tool_args_bytes_per_turn;
-    const size_t max_tool_output_total = client->limits.max_tool_output_bytes_total;
+    struct growbuf plain_args;
+    growbuf_init(&plain_args, 0, &client->allocator);
 
     llm_error_t err = LLM_ERR_NONE;
     for (size_t turn = 0; turn < max_turns; turn++) {
@@ -2128,7 +3190,7 @@ llm_error_t llm_tool_loop_run_with_headers_ex(llm_client_t* client, const llm_me
             break;
         }
         llm_chat_result_t result;
-        if (!llm_chat_with_headers(client, history, history_count, params_json, tooling_json, response_format_json,
+        if (!llm_chat_with_headers(client, history.msgs, history.count, params_json, tooling_json, response_format_json,
                                    &result, headers, headers_count)) {
             err = LLM_ERR_FAILED;
             break;
@@ -2190,117 +3252,68 @@ llm_error_t llm_tool_loop_run_with_headers_ex(llm_client_t* client, const llm_me
         }
 
         // Prepare for new messages (assistant + tool results)
-        size_t next_history_idx = history_count;
-        size_t new_total_count = history_count + 1 + result.tool_calls_count;
-        llm_message_t* new_history = realloc(history, new_total_count * sizeof(llm_message_t));
-        if (!new_history) {
+        if (!tool_history_reserve(&history, 1 + result.tool_calls_count)) {
             llm_chat_result_free(&result);
             err = LLM_ERR_FAILED;
             break;
         }
-        history = new_history;
 
-        // Assistant message
-        llm_message_t* assistant_msg = &history[next_history_idx++];
-        memset(assistant_msg, 0, sizeof(*assistant_msg));
-        assistant_msg->role = LLM_ROLE_ASSISTANT;
-        assistant_msg->tool_calls_json = malloc(result.tool_calls_json_len);
-        if (!assistant_msg->tool_calls_json) {
+        if (!tool_loop_push_assistant(&history, result.tool_calls_json, result.tool_calls_json_len, result.content,
+                                      result.content_len, result.reasoning_content, result.reasoning_content_len)) {
             llm_chat_result_free(&result);
             err = LLM_ERR_FAILED;
             break;
         }
-        memcpy((char*)assistant_msg->tool_calls_json, result.tool_calls_json, result.tool_calls_json_len);
-        assistant_msg->tool_calls_json_len = result.tool_calls_json_len;
-
-        // Combine content and reasoning_content if available
-        if (result.content || result.reasoning_content) {
-            size_t total_len = 0;
-            if (result.content) total_len += result.content_len;
-            if (result.reasoning_content) total_len += result.reasoning_content_len;
-
-            char* combined_content = malloc(total_len + 1);  // +1 for null terminator
-            if (!combined_content) {
-                // Handle allocation failure, clean up
-                llm_message_free_content(assistant_msg);
-                llm_chat_result_free(&result);
-                err = LLM_ERR_FAILED;
-                break;
-            }
-
-            size_t current_offset = 0;
-            if (result.content) {
-                memcpy(combined_content, result.content, result.content_len);
-                current_offset += result.content_len;
-            }
-            if (result.reasoning_content) {
-                memcpy(combined_content + current_offset, result.reasoning_content, result.reasoning_content_len);
-                current_offset += result.reasoning_content_len;
-            }
-            combined_content[total_len] = '\0';
-
-            assistant_msg->content = combined_content;
-            assistant_msg->content_len = total_len;
-        }
-        history_count++;  // Increment history count for the assistant message
 
-        // Handle tool call messages
-        bool loop_error = false;
-        for (size_t i = 0; i < result.tool_calls_count; i++) {
-            char* res_json = NULL;
-            size_t res_len = 0;
-
-            // Call dispatch function
-            if (!dispatch(dispatch_user_data, result.tool_calls[i].name, result.tool_calls[i].name_len,
-                          result.tool_calls[i].arguments, result.tool_calls[i].arguments_len, &res_json, &res_len)) {
-                // Dispatch failed. Clean up this tool result.
-                if (res_json) free(res_json);
-                err = LLM_ERR_FAILED;
-                loop_error = true;
-                break;
+        // Handle tool call messages: answer what the cache can, start the rest, then take results in call order.
+        struct tool_loop_slot* slots = mem_calloc(&client->allocator, result.tool_calls_count, sizeof(*slots));
+        bool loop_error = slots == NULL;
+        for (size_t i = 0; i < result.tool_calls_count && !loop_error; i++) {
+            const llm_tool_call_t* tc = &result.tool_calls[i];
+            if (cache_active && tool_loop_plain_args(&plain_args, tc)) {
+                slots[i].cached = tool_cache_get(&cache, tc->name, tc->name_len, plain_args.data, plain_args.len,
+                                                 &slots[i].result, &slots[i].result_len);
             }
-
-            // If dispatch succeeded but returned no res_json, treat as failure for loop purposes
-            if (!res_json) {
-                err = LLM_ERR_FAILED;
+            if (slots[i].cached || !pool_active) continue;
+            slots[i].job = tool_pool_submit(&pool, tc->name, tc->name_len, tc->arguments, tc->arguments_len);
+            if (!slots[i].job) {
                 loop_error = true;
-                break;
+            } else {
+                dispatches++;
             }
-
-            if (res_len > SIZE_MAX - tool_output_total) {
-                free(res_json);
-                err = LLM_ERR_FAILED;
-                loop_error = true;
-                break;
+        }
+        if (pool_active) tool_pool_wait(&pool);
+        for (size_t i = 0; i < result.tool_calls_count && !loop_error; i++) {
+            const llm_tool_call_t* tc = &result.tool_calls[i];
+            char* res_json = slots[i].result;
+            size_t res_len = slots[i].result_len;
+            slots[i].result = NULL;
+            bool ok = true;
+            if (slots[i].job) {
+                res_json = slots[i].job->result;
+                res_len = slots[i].job->result_len;
+                slots[i].job->result = NULL;
+                ok = slots[i].job->ok;
+            } else if (!slots[i].cached) {
+                dispatches++;
+                ok = dispatch(dispatch_user_data, tc->name, tc->name_len, tc->arguments, tc->arguments_len, &res_json,
+                              &res_len);
             }
-            size_t next_output_total = tool_output_total + res_len;
-            if (max_tool_output_total && next_output_total > max_tool_output_total) {
+            if (!ok) {
                 free(res_json);
-                err = LLM_ERR_FAILED;
                 loop_error = true;
                 break;
             }
-            tool_output_total = next_output_total;
-
-            llm_message_t* tool_msg = &history[next_history_idx++];
-            memset(tool_msg, 0, sizeof(*tool_msg));
-            tool_msg->role = LLM_ROLE_TOOL;
-            tool_msg->content = res_json;  // Takes ownership of res_json
-            tool_msg->content_len = res_len;
-
-            if (result.tool_calls[i].id) {
-                tool_msg->tool_call_id = strdup(result.tool_calls[i].id);
-                if (!tool_msg->tool_call_id) {
-                    // Allocation failure, clean up
-                    llm_message_free_content(tool_msg);  // Free content (res_json)
-                    err = LLM_ERR_FAILED;
-                    loop_error = true;
-                    break;
-                }
-                tool_msg->tool_call_id_len = result.tool_calls[i].id_len;
+            if (cache_active && !slots[i].cached && res_json && tool_loop_plain_args(&plain_args, tc)) {
+                tool_cache_put(&cache, tc->name, tc->name_len, plain_args.data, plain_args.len, res_json, res_len);
             }
-            history_count++;  // Increment history count for each tool message
+            loop_error = !tool_loop_push_result(client, &history, res_json, res_len, tc->id, tc->id_len,
+                                                &tool_output_total);
         }
+        for (size_t i = 0; slots && i < result.tool_calls_count; i++) free(slots[i].result);
+        mem_free(&client->allocator, slots);
+        if (pool_active) tool_pool_reset(&pool);
+        if (loop_error) err = LLM_ERR_FAILED;
 
         llm_chat_result_free(&result);
         if (loop_error) {
@@ -2308,15 +3321,528 @@ llm_error_t llm_tool_loop_run_with_headers_ex(llm_client_t* client, const llm_me
         }
     }
 
-    // Free history copies if we made them
+    if (pool_active) tool_pool_destroy(&pool);
+    tool_loop_report_stats(opts, dispatches, &cache, cache_active);
+    if (cache_active) tool_cache_destroy(&cache);
+    growbuf_free(&plain_args);
     if (err != LLM_ERR_NONE) {
         llm_error_stage_t stage = (err == LLM_ERR_CANCELLED) ? LLM_ERROR_STAGE_NONE : LLM_ERROR_STAGE_PROTOCOL;
         last_error_set_simple_if_empty(client, err, stage);
     }
-    tool_loop_free_history(&history, &history_count);
+    tool_history_free(&history);
     return err;
 }
 
+llm_error_t llm_tool_loop_run_with_headers_ex(llm_client_t* client, const llm_message_t* initial_messages,
+                                              size_t initial_count, const char* params_json, const char* tooling_json,
+                                              const char* response_format_json, llm_tool_dispatch_cb dispatch,
+                                              void* dispatch_user_data, llm_abort_cb abort_cb, void* abort_user_data,
+                                              size_t max_turns, const char* const* headers, size_t headers_count) {
+    return llm_tool_loop_run_opts(client, initial_messages, initial_count, params_json, tooling_json,
+                                  response_format_json, dispatch, dispatch_user_data, abort_cb, abort_user_data,
+                                  max_turns, headers, headers_count, NULL);
+}
+
+// One tool call of a streamed turn, dispatched as soon as its arguments complete unless the turn may yet be
+// refused.
+struct tool_stream_call {
+    char* id;
+    size_t id_len;
+    char* name;
+    size_t name_len;
+    char* args;
+    size_t args_len;
+    char* result;  // from dispatch, caller's malloc
+    size_t result_len;
+    struct tool_job* job;  // until its outcome is collected
+    uint64_t key;          // hash of name and canonical arguments
+    bool keyed;
+    bool dispatched;
+    bool cached;  // result came from the cache
+};
+
+// Call keys of the turns the loop guard remembers, so a turn that may be repeating one of them holds its calls
+// back until the guard has seen it whole.
+struct tool_stream_recent {
+    uint64_t* keys[TOOL_LOOP_HASH_WINDOW];
+    size_t counts[TOOL_LOOP_HASH_WINDOW];
+    size_t pos;
+};
+
+struct tool_stream_turn {
+    llm_client_t* client;
+    const llm_stream_callbacks_t* user;
+    llm_abort_cb abort_cb;
+    void* abort_user_data;
+    struct tool_pool* pool;
+    struct tool_cache* cache;  // optional
+    struct tool_stream_recent recent;
+    struct growbuf key;  // scratch for call keys
+    bool early;          // calls may run while the turn streams; false on the last allowed turn
+    size_t dispatches;
+    struct tool_stream_call* calls;
+    size_t calls_count;
+    struct growbuf content;  // escaped, as streamed
+    struct growbuf reasoning;
+    bool saw_content;
+    bool saw_reasoning;
+    size_t args_bytes;
+    llm_finish_reason_t finish_reason;
+    llm_error_t error;
+};
+
+static void tool_stream_turn_reset(struct tool_stream_turn* t) {
+    const llm_allocator_t* alloc = &t->client->allocator;
+    // Jobs borrow the call names and arguments freed below.
+    tool_pool_wait(t->pool);
+    tool_pool_reset(t->pool);
+    for (size_t i = 0; i < t->calls_count; i++) {
+        mem_free(alloc, t->calls[i].id);
+        mem_free(alloc, t->calls[i].name);
+        mem_free(alloc, t->calls[i].args);
+        free(t->calls[i].result);
+    }
+    mem_free(alloc, t->calls);
+    t->calls = NULL;
+    t->calls_count = 0;
+    growbuf_free(&t->content);
+    growbuf_free(&t->reasoning);
+    t->saw_content = false;
+    t->saw_reasoning = false;
+    t->args_bytes = 0;
+    t->finish_reason = LLM_FINISH_REASON_UNKNOWN;
+}
+
+static void tool_stream_fail(struct tool_stream_turn* t, llm_error_t err) {
+    if (t->error == LLM_ERR_NONE) t->error = err;
+}
+
+static struct tool_stream_call* tool_stream_call_at(struct tool_stream_turn* t, size_t index) {
+    if (index >= t->calls_count) {
+        if (index >= SIZE_MAX / sizeof(*t->calls) - 1) return NULL;
+        struct tool_stream_call* next =
+            mem_realloc(&t->client->allocator, t->calls, (index + 1) * sizeof(*t->calls));
+        if (!next) return NULL;
+        memset(next + t->calls_count, 0, (index + 1 - t->calls_count) * sizeof(*next));
+        t->calls = next;
+        t->calls_count = index + 1;
+    }
+    return &t->calls[index];
+}
+
+static void tool_stream_on_content(void* user_data, const char* delta, size_t len) {
+    struct tool_stream_turn* t = user_data;
+    t->saw_content = true;
+    if (!growbuf_append(&t->content, delta, len, t->client->limits.max_response_bytes)) {
+        tool_stream_fail(t, LLM_ERR_FAILED);
+    }
+    if (t->user && t->user->on_content_delta) t->user->on_content_delta(t->user->user_data, delta, len);
+}
+
+static void tool_stream_on_reasoning(void* user_data, const char* delta, size_t len) {
+    struct tool_stream_turn* t = user_data;
+    t->saw_reasoning = true;
+    if (!growbuf_append(&t->reasoning, delta, len, t->client->limits.max_response_bytes)) {
+        tool_stream_fail(t, LLM_ERR_FAILED);
+    }
+    if (t->user && t->user->on_reasoning_delta) t->user->on_reasoning_delta(t->user->user_data, delta, len);
+}
+
+static void tool_stream_on_args_fragment(void* user_data, size_t tool_index, const char* fragment, size_t len) {
+    struct tool_stream_turn* t = user_data;
+    if (t->user && t->user->on_tool_args_fragment) {
+        t->user->on_tool_args_fragment(t->user->user_data, tool_index, fragment, len);
+    }
+}
+
+static void tool_stream_on_call_delta(void* user_data, const llm_tool_call_delta_t* delta) {
+    struct tool_stream_turn* t = user_data;
+    struct tool_stream_call* call = tool_stream_call_at(t, delta->index);
+    if (!call) {
+        tool_stream_fail(t, LLM_ERR_FAILED);
+        return;
+    }
+    if (!call->id && delta->id) {
+        call->id = mem_strndup(&t->client->allocator, delta->id, delta->id_len);
+        call->id_len = delta->id_len;
+        if (!call->id) tool_stream_fail(t, LLM_ERR_FAILED);
+    }
+    if (!call->name && delta->name) {
+        call->name = mem_strndup(&t->client->allocator, delta->name, delta->name_len);
+        call->name_len = delta->name_len;
+        if (!call->name) tool_stream_fail(t, LLM_ERR_FAILED);
+    }
+    if (t->user && t->user->on_tool_call_delta) t->user->on_tool_call_delta(t->user->user_data, delta);
+}
+
+// Answers the call from the cache or hands it to the pool; dispatch never runs on the transfer's thread.
+static void tool_stream_dispatch(struct tool_stream_turn* t, struct tool_stream_call* call) {
+    call->dispatched = true;
+    if (t->cache && tool_cache_get(t->cache, call->name, call->name_len, call->args, call->args_len, &call->result,
+                                   &call->result_len)) {
+        call->cached = true;
+        return;
+    }
+    t->dispatches++;
+    call->job = tool_pool_submit(t->pool, call->name, call->name_len, call->args, call->args_len);
+    if (!call->job) tool_stream_fail(t, LLM_ERR_FAILED);
+}
+
+// True when a remembered turn has at least n calls and agrees with every call of the first n whose arguments
+// have closed, so this turn may still turn out a repeat the guard will refuse.
+static bool tool_stream_may_repeat(const struct tool_stream_turn* t, size_t n) {
+    for (size_t r = 0; r < TOOL_LOOP_HASH_WINDOW; r++) {
+        if (t->recent.counts[r] < n) continue;
+        size_t i = 0;
+        while (i < n && (!t->calls[i].keyed || t->recent.keys[r][i] == t->calls[i].key)) i++;
+        if (i == n) return true;
+    }
+    return false;
+}
+
+// Runs the calls whose arguments have closed, once they rule out a repeat of a recent turn.
+static void tool_stream_release(struct tool_stream_turn* t) {
+    if (!t->early) return;
+    size_t n = t->calls_count;
+    while (n > 0 && !t->calls[n - 1].keyed) n--;
+    if (n == 0 || tool_stream_may_repeat(t, n)) return;
+    for (size_t i = 0; i < n && t->error == LLM_ERR_NONE; i++) {
+        if (t->calls[i].keyed && !t->calls[i].dispatched) tool_stream_dispatch(t, &t->calls[i]);
+    }
+}
+
+// Keeps the call and runs it while the model keeps generating the next one, unless the turn may yet be refused.
+static void tool_stream_on_args_complete(void* user_data, size_t tool_index, const char* args_json, size_t len) {
+    struct tool_stream_turn* t = user_data;
+    if (t->user && t->user->on_tool_args_complete) {
+        t->user->on_tool_args_complete(t->user->user_data, tool_index, args_json, len);
+    }
+    if (t->error != LLM_ERR_NONE) return;
+    struct tool_stream_call* call = tool_stream_call_at(t, tool_index);
+    if (!call || !call->name || call->name_len == 0) {
+        tool_stream_fail(t, LLM_ERR_FAILED);
+        return;
+    }
+    const size_t max_args_per_turn = t->client->limits.max_tool_args_bytes_per_turn;
+    if (len > SIZE_MAX - t->args_bytes || (max_args_per_turn && t->args_bytes + len > max_args_per_turn)) {
+        tool_stream_fail(t, LLM_ERR_FAILED);
+        return;
+    }
+    t->args_bytes += len;
+    call->args = mem_strndup(&t->client->allocator, args_json, len);
+    if (!call->args) {
+        tool_stream_fail(t, LLM_ERR_FAILED);
+        return;
+    }
+    call->args_len = len;
+    if (!tool_call_key(&t->key, &t->client->allocator, call->name, call->name_len, call->args, call->args_len)) {
+        tool_stream_fail(t, LLM_ERR_FAILED);
+        return;
+    }
+    call->key = tool_loop_hash_bytes(1469598103934665603ULL, t->key.data, t->key.len);
+    call->keyed = true;
+    tool_stream_release(t);
+}
+
+static void tool_stream_on_usage(void* user_data, const llm_usage_t* usage) {
+    struct tool_stream_turn* t = user_data;
+    if (t->user && t->user->on_usage) t->user->on_usage(t->user->user_data, usage);
+}
+
+static void tool_stream_on_finish(void* user_data, llm_finish_reason_t reason) {
+    struct tool_stream_turn* t = user_data;
+    t->finish_reason = reason;
+    if (t->user && t->user->on_finish_reason) t->user->on_finish_reason(t->user->user_data, reason);
+}
+
+// Waits for the pool and moves each job's outcome onto its call.
+static void tool_stream_collect(struct tool_stream_turn* t) {
+    tool_pool_wait(t->pool);
+    for (size_t i = 0; i < t->calls_count; i++) {
+        struct tool_job* job = t->calls[i].job;
+        if (!job) continue;
+        t->calls[i].result = job->result;
+        t->calls[i].result_len = job->result_len;
+        t->calls[i].job = NULL;
+        job->result = NULL;
+        if (!job->ok) tool_stream_fail(t, LLM_ERR_FAILED);
+    }
+}
+
+// Remembers the calls of an accepted turn, dropping the oldest once the guard's window is full.
+static bool tool_stream_remember(struct tool_stream_turn* t) {
+    uint64_t* keys = mem_alloc(&t->client->allocator, t->calls_count * sizeof(*keys));
+    if (!keys) return false;
+    for (size_t i = 0; i < t->calls_count; i++) keys[i] = t->calls[i].key;
+    struct tool_stream_recent* recent = &t->recent;
+    mem_free(&t->client->allocator, recent->keys[recent->pos]);
+    recent->keys[recent->pos] = keys;
+    recent->counts[recent->pos] = t->calls_count;
+    recent->pos = (recent->pos + 1) % TOOL_LOOP_HASH_WINDOW;
+    return true;
+}
+
+static bool tool_stream_abort(void* user_data) {
+    struct tool_stream_turn* t = user_data;
+    if (t->error != LLM_ERR_NONE || tool_pool_failed(t->pool)) return true;
+    return t->abort_cb && t->abort_cb(t->abort_user_data);
+}
+
+static int tool_stream_wake_fd(void* user_data) {
+    const struct tool_stream_turn* t = user_data;
+    return abort_wake_fd(t->abort_cb, t->abort_user_data);
+}
+
+// Turns the streamed content (escaped JSON spans) into plain text, as the non-streaming result holds it.
+static bool tool_stream_unescape(struct growbuf* b) {
+    if (b->len == 0) return true;
+    size_t len = 0;
+    if (!unescape_json_string_inplace(b->data, b->len, &len)) return false;
+    b->len = len;
+    return true;
+}
+
+// Builds the assistant tool_calls array for history from the streamed calls.
+static char* tool_stream_calls_json(struct tool_stream_turn* t, size_t* out_len) {
+    const llm_allocator_t* alloc = &t->client->allocator;
+    llm_tool_call_build_t* build = mem_calloc(alloc, t->calls_count, sizeof(*build));
+    if (!build) return NULL;
+    size_t cap = 2;
+    for (size_t i = 0; i < t->calls_count; i++) {
+        const struct tool_stream_call* call = &t->calls[i];
+        build[i].id = call->id;
+        build[i].id_len = call->id_len;
+        build[i].name = call->name;
+        build[i].name_len = call->name_len;
+        build[i].arguments_json = call->args;
+        build[i].arguments_json_len = call->args_len;
+        // Each byte escapes to at most six (\u00XX), plus the fixed keys of one entry.
+        size_t bytes = call->id_len + call->name_len + call->args_len;
+        if (bytes > (SIZE_MAX - cap - 64) / 6) {
+            mem_free(alloc, build);
+            return NULL;
+        }
+        cap += bytes * 6 + 64;
+    }
+    char* json = mem_alloc(alloc, cap);
+    if (json && !llm_tool_calls_json_write(build, t->calls_count, json, cap, 0, out_len)) {
+        mem_free(alloc, json);
+        json = NULL;
+    }
+    mem_free(alloc, build);
+    return json;
+}
+
+// Hashes the streamed turn through the same guard as the non-streaming loop.
+static bool tool_stream_hash_turn(struct tool_stream_turn* t, uint64_t* out_hash) {
+    llm_tool_call_t* calls = mem_calloc(&t->client->allocator, t->calls_count, sizeof(*calls));
+    if (!calls) return false;
+    for (size_t i = 0; i < t->calls_count; i++) {
+        calls[i].name = t->calls[i].name;
+        calls[i].name_len = t->calls[i].name_len;
+        calls[i].arguments = t->calls[i].args;
+        calls[i].arguments_len = t->calls[i].args_len;
+    }
+    llm_chat_result_t view;
+    memset(&view, 0, sizeof(view));
+    view.tool_calls = calls;
+    view.tool_calls_count = t->calls_count;
+    view.content = t->saw_content ? t->content.data : NULL;
+    view.content_len = t->content.len;
+    view.reasoning_content = t->saw_reasoning ? t->reasoning.data : NULL;
+    view.reasoning_content_len = t->reasoning.len;
+    bool ok = tool_loop_hash_turn(&view, out_hash);
+    mem_free(&t->client->allocator, calls);
+    return ok;
+}
+
+llm_error_t llm_tool_loop_run_stream_opts(llm_client_t* client, const llm_message_t* initial_messages,
+                                          size_t initial_count, const char* params_json, const char* tooling_json,
+                                          const char* response_format_json, const llm_stream_callbacks_t* callbacks,
+                                          llm_tool_dispatch_cb dispatch, void* dispatch_user_data,
+                                          llm_abort_cb abort_cb, void* abort_user_data, size_t max_turns,
+                                          const char* const* headers, size_t headers_count,
+                                          const llm_tool_loop_opts_t* opts) {
+    last_error_reset(client);
+    struct tool_history history;
+    if (!tool_history_init(&history, &client->allocator, initial_messages, initial_count) || !dispatch ||
+        max_turns == 0) {
+        tool_history_free(&history);
+        last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
+        return LLM_ERR_FAILED;
+    }
+    // Tools never run on the transfer's thread, where a slow one would stall the stream into its idle timeout:
+    // one worker runs them in turn unless more are allowed.
+    struct tool_pool pool;
+    size_t workers = opts && opts->max_parallel_dispatch > 1 ? opts->max_parallel_dispatch : 1;
+    if (!tool_pool_init(&pool, workers, dispatch, dispatch_user_data, &client->allocator)) {
+        tool_history_free(&history);
+        last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
+        return LLM_ERR_FAILED;
+    }
+    struct tool_cache cache;
+    bool cache_active = false;
+    if (!tool_loop_cache_init(client, &cache, opts, &cache_active)) {
+        tool_pool_destroy(&pool);
+        tool_history_free(&history);
+        last_error_set_simple_if_empty(client, LLM_ERR_FAILED, LLM_ERROR_STAGE_PROTOCOL);
+        return LLM_ERR_FAILED;
+    }
+
+    struct tool_stream_turn t;
+    memset(&t, 0, sizeof(t));
+    t.client = client;
+    t.pool = &pool;
+    t.cache = cache_active ? &cache : NULL;
+    t.user = callbacks;
+    growbuf_init(&t.key, 0, &client->allocator);
+    t.abort_cb = abort_cb;
+    t.abort_user_data = abort_user_data;
+
+    llm_stream_callbacks_t cbs;
+    memset(&cbs, 0, sizeof(cbs));
+    if (callbacks) cbs = *callbacks;  // include_usage and stop strings carry over
+    cbs.user_data = &t;
+    cbs.on_content_delta = tool_stream_on_content;
+    cbs.on_reasoning_delta = tool_stream_on_reasoning;
+    cbs.on_tool_args_fragment = tool_stream_on_args_fragment;
+    cbs.on_tool_call_delta = tool_stream_on_call_delta;
+    cbs.on_tool_args_complete = tool_stream_on_args_complete;
+    cbs.on_usage = tool_stream_on_usage;
+    cbs.on_finish_reason = tool_stream_on_finish;
+
+    struct tool_loop_guard guard;
+    tool_loop_guard_init(&guard);
+    size_t tool_output_total = 0;
+
+    llm_error_t err = LLM_ERR_NONE;
+    for (size_t turn = 0; turn < max_turns; turn++) {
+        if (abort_cb && abort_cb(abort_user_data)) {
+            err = LLM_ERR_CANCELLED;
+            break;
+        }
+        tool_stream_turn_reset(&t);
+        growbuf_init(&t.content, 0, &client->allocator);
+        growbuf_init(&t.reasoning, 0, &client->allocator);
+        // The last allowed turn fails whatever it asks for, so its calls never run, as in the non-streaming loop.
+        t.early = turn + 1 < max_turns;
+
+        err = chat_stream_request(client, history.msgs, history.count, params_json, tooling_json,
+                                  response_format_json, 0, false, true, &cbs, 1, tool_stream_abort, &t, headers,
+                                  headers_count, NULL);
+        tool_stream_collect(&t);
+        if (t.error != LLM_ERR_NONE) {
+            // A failed dispatch aborts the stream; report the dispatch failure rather than the abort.
+            last_error_reset(client);
+            err = t.error;
+            break;
+        }
+        if (err != LLM_ERR_NONE) break;
+
+        if (t.finish_reason != LLM_FINISH_REASON_TOOL_CALLS) break;
+        if (t.calls_count == 0 || turn + 1 >= max_turns) {
+            err = LLM_ERR_FAILED;
+            break;
+        }
+        for (size_t i = 0; i < t.calls_count; i++) {
+            if (!t.calls[i].keyed) err = LLM_ERR_FAILED;
+        }
+        if (err != LLM_ERR_NONE) break;
+        if (!tool_stream_unescape(&t.content) || !tool_stream_unescape(&t.reasoning)) {
+            err = LLM_ERR_FAILED;
+            break;
+        }
+
+        uint64_t turn_hash = 0;
+        if (!tool_stream_hash_turn(&t, &turn_hash) || tool_loop_guard_seen(&guard, turn_hash) ||
+            !tool_stream_remember(&t)) {
+            err = LLM_ERR_FAILED;
+            break;
+        }
+        // The turn is accepted: the calls held back from the stream run now.
+        for (size_t i = 0; i < t.calls_count && t.error == LLM_ERR_NONE; i++) {
+            if (!t.calls[i].dispatched) tool_stream_dispatch(&t, &t.calls[i]);
+        }
+        tool_stream_collect(&t);
+        if (t.error != LLM_ERR_NONE) {
+            err = t.error;
+            break;
+        }
+
+        size_t calls_json_len = 0;
+        char* calls_json = tool_stream_calls_json(&t, &calls_json_len);
+        if (!calls_json) {
+            err = LLM_ERR_FAILED;
+            break;
+        }
+        if (!tool_history_reserve(&history, 1 + t.calls_count)) {
+            mem_free(&client->allocator, calls_json);
+            err = LLM_ERR_FAILED;
+            break;
+        }
+        bool pushed = tool_loop_push_assistant(&history, calls_json, calls_json_len,
+                                               t.saw_content ? t.content.data : NULL, t.content.len,
+                                               t.saw_reasoning ? t.reasoning.data : NULL, t.reasoning.len);
+        mem_free(&client->allocator, calls_json);
+        if (!pushed) {
+            err = LLM_ERR_FAILED;
+            break;
+        }
+
+        // Results go into history in call order, whatever order the calls completed in.
+        for (size_t i = 0; i < t.calls_count; i++) {
+            const struct tool_stream_call* call = &t.calls[i];
+            if (t.cache && !call->cached) {
+                tool_cache_put(t.cache, call->name, call->name_len, call->args, call->args_len, call->result,
+                               call->result_len);
+            }
+            char* res_json = t.calls[i].result;
+            t.calls[i].result = NULL;
+            if (!tool_loop_push_result(client, &history, res_json, t.calls[i].result_len, t.calls[i].id,
+                                       t.calls[i].id_len, &tool_output_total)) {
+                err = LLM_ERR_FAILED;
+                break;
+            }
+        }
+        if (err != LLM_ERR_NONE) break;
+    }
+    tool_stream_turn_reset(&t);
+    tool_pool_destroy(&pool);
+    growbuf_free(&t.key);
+    for (size_t r = 0; r < TOOL_LOOP_HASH_WINDOW; r++) mem_free(&client->allocator, t.recent.keys[r]);
+    tool_loop_report_stats(opts, t.dispatches, &cache, cache_active);
+    if (cache_active) tool_cache_destroy(&cache);
+
+    if (err != LLM_ERR_NONE) {
+        llm_error_stage_t stage = (err == LLM_ERR_CANCELLED) ? LLM_ERROR_STAGE_NONE : LLM_ERROR_STAGE_PROTOCOL;
+        last_error_set_simple_if_empty(client, err, stage);
+    }
+    tool_history_free(&history);
+    return err;
+}
+
+llm_error_t llm_tool_loop_run_stream_ex(llm_client_t* client, const llm_message_t* initial_messages,
+                                        size_t initial_count, const char* params_json, const char* tooling_json,
+                                        const char* response_format_json, const llm_stream_callbacks_t* callbacks,
+                                        llm_tool_dispatch_cb dispatch, void* dispatch_user_data, llm_abort_cb abort_cb,
+                                        void* abort_user_data, size_t max_turns) {
+    return llm_tool_loop_run_stream_opts(client, initial_messages, initial_count, params_json, tooling_json,
+                                         response_format_json, callbacks, dispatch, dispatch_user_data, abort_cb,
+                                         abort_user_data, max_turns, NULL, 0, NULL);
+}
+
+llm_error_t llm_tool_loop_run_stream_with_headers_ex(llm_client_t* client, const llm_message_t* initial_messages,
+                                                     size_t initial_count, const char* params_json,
+                                                     const char* tooling_json, const char* response_format_json,
+                                                     const llm_stream_callbacks_t* callbacks,
+                                                     llm_tool_dispatch_cb dispatch, void* dispatch_user_data,
+                                                     llm_abort_cb abort_cb, void* abort_user_data, size_t max_turns,
+                                                     const char* const* headers, size_t headers_count) {
+    return llm_tool_loop_run_stream_opts(client, initial_messages, initial_count, params_json, tooling_json,
+                                         response_format_json, callbacks, dispatch, dispatch_user_data, abort_cb,
+                                         abort_user_data, max_turns, headers, headers_count, NULL);
+}
+
 bool llm_tool_loop_run(llm_client_t* client, const llm_message_t* initial_messages, size_t initial_count,
                        const char* params_json, const char* tooling_json, const char* response_format_json,
                        llm_tool_dispatch_cb dispatch, void* dispatch_user_data, size_t max_turns) {
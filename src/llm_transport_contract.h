@@ -7,8 +7,8 @@ Transport contract for llm transport backends.
 The transport layer is a byte pump. It must not parse JSON or interpret protocol state.
 
 Ownership and lifetime (http_get/http_post):
-- On success, the transport allocates a response body buffer with a malloc-compatible allocator,
-  sets *body and *len, and transfers ownership to the caller.
+- On success, the transport allocates a response body buffer with the supplied allocator
+  (libc malloc when alloc is NULL), sets *body and *len, and transfers ownership to the caller.
 - The response buffer remains valid until the caller frees it.
 - The transport must not retain or free the buffer after returning.
 - The buffer is not required to be NUL-terminated; if a terminator is added, it is not counted in *len.
@@ -30,6 +30,17 @@ Streaming (http_post_stream):
 - No callbacks occur after http_post_stream returns.
 - The chunk pointer is valid only for the duration of the callback; callers must copy to retain data.
 - stream_cb returns true to continue and false to abort the stream.
+- When cancel_fd >= 0 the transport waits on it together with the connection. Once it is readable the
+  transfer is aborted without waiting for more data, the connection is closed rather than reused, and
+  http_post_stream returns false. The transport never reads or writes cancel_fd.
+
+Batches (http_post_batch):
+- body_cb and done_cb are invoked synchronously on the caller thread, never concurrently.
+- body_cb is called at most once per item, when the item is about to be sent; its body must remain valid
+  until done_cb reports that item.
+- done_cb is called exactly once per item, in completion order, and owns any body it receives under the
+  same rules as http_post.
+- At most max_in_flight items are outstanding at any time.
 
 Failure propagation:
 - Any transport, TLS, or size-cap error returns false.
@@ -9,19 +9,20 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int tokenize(const char* json, size_t len, jstoktok_t** tokens_out, int* count_out) {
+static int tokenize(const char* json, size_t len, const llm_allocator_t* alloc, jstoktok_t** tokens_out,
+                    int* count_out) {
     jstok_parser parser;
     jstok_init(&parser);
     int needed = jstok_parse(&parser, json, (int)len, NULL, 0);
     if (needed < 0) return needed;
 
-    jstoktok_t* tokens = malloc(needed * sizeof(jstoktok_t));
+    jstoktok_t* tokens = mem_alloc(alloc, needed * sizeof(jstoktok_t));
     if (!tokens) return JSTOK_ERROR_NOMEM;
 
     jstok_init(&parser);
     int parsed = jstok_parse(&parser, json, (int)len, tokens, needed);
     if (parsed < 0) {
-        free(tokens);
+        mem_free(alloc, tokens);
         return parsed;
     }
     *tokens_out = tokens;
@@ -29,14 +30,14 @@ static int tokenize(const char* json, size_t len, jstoktok_t** tokens_out, int*
     return 0;
 }
 
-static void free_tokens(jstoktok_t* tokens) { free(tokens); }
+static void free_tokens(const llm_allocator_t* alloc, jstoktok_t* tokens) { mem_free(alloc, tokens); }
 
-static void free_chat_choices(llm_chat_choice_t* choices, size_t count) {
+static void free_chat_choices(const llm_allocator_t* alloc, llm_chat_choice_t* choices, size_t count) {
     if (!choices) return;
     for (size_t i = 0; i < count; i++) {
-        free(choices[i].tool_calls);
+        mem_free(alloc, choices[i].tool_calls);
     }
-    free(choices);
+    mem_free(alloc, choices);
 }
 
 static void usage_init(llm_usage_t* usage, bool* usage_present) {
@@ -94,14 +95,14 @@ static bool extract_reasoning_span(const char* json, const jstoktok_t* tokens, i
     return extract_optional_string_field(json, tokens, count, obj_idx, "thinking", out);
 }
 
-int parse_chat_response(const char* json, size_t len, llm_chat_result_t* result) {
+int parse_chat_response(const char* json, size_t len, llm_chat_result_t* result, const llm_allocator_t* alloc) {
     jstoktok_t* tokens = NULL;
     int count = 0;
-    int ret = tokenize(json, len, &tokens, &count);
+    int ret = tokenize(json, len, alloc, &tokens, &count);
     if (ret < 0) return ret;
 
     if (count == 0 || tokens[0].type != JSTOK_OBJECT) {
-        free_tokens(tokens);
+        free_tokens(alloc, tokens);
         return LLM_PARSE_ERR_PROTOCOL;
     }
 
@@ -109,14 +110,14 @@ int parse_chat_response(const char* json, size_t len, llm_chat_result_t* result)
 
     int choices_idx = obj_get_key(tokens, count, 0, json, "choices");
     if (choices_idx < 0 || tokens[choices_idx].type != JSTOK_ARRAY || tokens[choices_idx].size <= 0) {
-        free_tokens(tokens);
+        free_tokens(alloc, tokens);
         return LLM_PARSE_ERR_PROTOCOL;
     }
 
     size_t choices_count = (size_t)tokens[choices_idx].size;
-    result->choices = calloc(choices_count, sizeof(llm_chat_choice_t));
+    result->choices = mem_calloc(alloc, choices_count, sizeof(llm_chat_choice_t));
     if (!result->choices) {
-        free_tokens(tokens);
+        free_tokens(alloc, tokens);
         return JSTOK_ERROR_NOMEM;
     }
     result->choices_count = choices_count;
@@ -124,10 +125,10 @@ int parse_chat_response(const char* json, size_t len, llm_chat_result_t* result)
     for (size_t i = 0; i < choices_count; i++) {
         int choice_idx = arr_get(tokens, count, choices_idx, (int)i);
         if (choice_idx < 0 || tokens[choice_idx].type != JSTOK_OBJECT) {
-            free_chat_choices(result->choices, result->choices_count);
+            free_chat_choices(alloc, result->choices, result->choices_count);
             result->choices = NULL;
             result->choices_count = 0;
-            free_tokens(tokens);
+            free_tokens(alloc, tokens);
             return LLM_PARSE_ERR_PROTOCOL;
         }
 
@@ -142,10 +143,10 @@ int parse_chat_response(const char* json, size_t len, llm_chat_result_t* result)
 
         int message_idx = obj_get_key(tokens, count, choice_idx, json, "message");
         if (message_idx < 0 || tokens[message_idx].type != JSTOK_OBJECT) {
-            free_chat_choices(result->choices, result->choices_count);
+            free_chat_choices(alloc, result->choices, result->choices_count);
             result->choices = NULL;
             result->choices_count = 0;
-            free_tokens(tokens);
+            free_tokens(alloc, tokens);
             return LLM_PARSE_ERR_PROTOCOL;
         }
 
@@ -167,22 +168,22 @@ int parse_chat_response(const char* json, size_t len, llm_chat_result_t* result)
             choice->tool_calls_json_len = sp.len;
             if (tokens[tool_calls_idx].size > 0) {
                 size_t tool_count = (size_t)tokens[tool_calls_idx].size;
-                choice->tool_calls = calloc(tool_count, sizeof(llm_tool_call_t));
+                choice->tool_calls = mem_calloc(alloc, tool_count, sizeof(llm_tool_call_t));
                 if (!choice->tool_calls) {
-                    free_chat_choices(result->choices, result->choices_count);
+                    free_chat_choices(alloc, result->choices, result->choices_count);
                     result->choices = NULL;
                     result->choices_count = 0;
-                    free_tokens(tokens);
+                    free_tokens(alloc, tokens);
                     return JSTOK_ERROR_NOMEM;
                 }
                 choice->tool_calls_count = tool_count;
                 for (size_t j = 0; j < tool_count; j++) {
                     int tool_idx = arr_get(tokens, count, tool_calls_idx, (int)j);
                     if (tool_idx < 0 || tokens[tool_idx].type != JSTOK_OBJECT) {
-                        free_chat_choices(result->choices, result->choices_count);
+                        free_chat_choices(alloc, result->choices, result->choices_count);
                         result->choices = NULL;
                         result->choices_count = 0;
-                        free_tokens(tokens);
+                        free_tokens(alloc, tokens);
                         return LLM_PARSE_ERR_PROTOCOL;
                     }
                     llm_tool_call_t* tc = &choice->tool_calls[j];
@@ -226,7 +227,7 @@ int parse_chat_response(const char* json, size_t len, llm_chat_result_t* result)
         result->tool_calls_json_len = choice0->tool_calls_json_len;
     }
 
-    free_tokens(tokens);
+    free_tokens(alloc, tokens);
     return 0;
 }
 
@@ -263,15 +264,87 @@ static int find_choice_token(const char* json, const jstoktok_t* tokens, int cou
     return -1;
 }
 
+// Fills delta from one choice object of a chunk; spans point into json.
+static int parse_choice_delta(const char* json, const jstoktok_t* tokens, int count, int choice_idx,
+                              llm_chat_chunk_delta_t* delta, const llm_allocator_t* alloc) {
+    int finish_idx = obj_get_key(tokens, count, choice_idx, json, "finish_reason");
+    if (finish_idx >= 0 && tokens[finish_idx].type == JSTOK_STRING) {
+        span_t sp = tok_span(json, &tokens[finish_idx]);
+        delta->finish_reason = llm_finish_reason_from_string(sp.ptr, sp.len);
+    }
+    int delta_obj_idx = obj_get_key(tokens, count, choice_idx, json, "delta");
+    if (delta_obj_idx >= 0 && tokens[delta_obj_idx].type == JSTOK_OBJECT) {
+        int content_idx = obj_get_key(tokens, count, delta_obj_idx, json, "content");
+        if (content_idx >= 0 && tokens[content_idx].type == JSTOK_STRING) {
+            span_t sp = tok_span(json, &tokens[content_idx]);
+            delta->content_delta = sp.ptr;
+            delta->content_delta_len = sp.len;
+        }
+        span_t reasoning = {0};
+        if (extract_reasoning_span(json, tokens, count, delta_obj_idx, &reasoning)) {
+            delta->reasoning_delta = reasoning.ptr;
+            delta->reasoning_delta_len = reasoning.len;
+        }
+        int tool_calls_idx = obj_get_key(tokens, count, delta_obj_idx, json, "tool_calls");
+        if (tool_calls_idx >= 0 && tokens[tool_calls_idx].type == JSTOK_ARRAY && tokens[tool_calls_idx].size > 0) {
+            int tool_count = tokens[tool_calls_idx].size;
+            delta->tool_call_deltas = mem_calloc(alloc, (size_t)tool_count, sizeof(llm_tool_call_delta_t));
+            if (!delta->tool_call_deltas) {
+                return JSTOK_ERROR_NOMEM;
+            }
+            delta->tool_call_deltas_count = (size_t)tool_count;
+            for (int i = 0; i < tool_count; i++) {
+                int tool_idx = arr_get(tokens, count, tool_calls_idx, i);
+                if (tool_idx < 0 || tokens[tool_idx].type != JSTOK_OBJECT) {
+                    mem_free(alloc, delta->tool_call_deltas);
+                    delta->tool_call_deltas = NULL;
+                    delta->tool_call_deltas_count = 0;
+                    return LLM_PARSE_ERR_PROTOCOL;
+                }
+                llm_tool_call_delta_t* td = &delta->tool_call_deltas[i];
+                int index_idx = obj_get_key(tokens, count, tool_idx, json, "index");
+                if (index_idx >= 0) {
+                    size_t idx_val = 0;
+                    if (parse_choice_index(json, &tokens[index_idx], &idx_val)) {
+                        td->index = idx_val;
+                    }
+                }
+                int id_idx = obj_get_key(tokens, count, tool_idx, json, "id");
+                if (id_idx >= 0 && tokens[id_idx].type == JSTOK_STRING) {
+                    span_t sp = tok_span(json, &tokens[id_idx]);
+                    td->id = sp.ptr;
+                    td->id_len = sp.len;
+                }
+                int func_idx = obj_get_key(tokens, count, tool_idx, json, "function");
+                if (func_idx >= 0 && tokens[func_idx].type == JSTOK_OBJECT) {
+                    int name_idx = obj_get_key(tokens, count, func_idx, json, "name");
+                    if (name_idx >= 0 && tokens[name_idx].type == JSTOK_STRING) {
+                        span_t sp = tok_span(json, &tokens[name_idx]);
+                        td->name = sp.ptr;
+                        td->name_len = sp.len;
+                    }
+                    int args_idx = obj_get_key(tokens, count, func_idx, json, "arguments");
+                    if (args_idx >= 0 && tokens[args_idx].type == JSTOK_STRING) {
+                        span_t sp = tok_span(json, &tokens[args_idx]);
+                        td->arguments_fragment = sp.ptr;
+                        td->arguments_fragment_len = sp.len;
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
 int parse_chat_chunk_choice(const char* json, size_t len, size_t choice_index, llm_chat_chunk_delta_t* delta,
-                            llm_usage_t* usage, bool* usage_present) {
+                            llm_usage_t* usage, bool* usage_present, const llm_allocator_t* alloc) {
     jstoktok_t* tokens = NULL;
     int count = 0;
-    int ret = tokenize(json, len, &tokens, &count);
+    int ret = tokenize(json, len, alloc, &tokens, &count);
     if (ret < 0) return ret;
 
     if (count == 0 || tokens[0].type != JSTOK_OBJECT) {
-        free_tokens(tokens);
+        free_tokens(alloc, tokens);
         return LLM_PARSE_ERR_PROTOCOL;
     }
 
@@ -282,85 +355,60 @@ int parse_chat_chunk_choice(const char* json, size_t len, size_t choice_index, l
     int choices_idx = obj_get_key(tokens, count, 0, json, "choices");
     if (choices_idx >= 0 && tokens[choices_idx].type == JSTOK_ARRAY && tokens[choices_idx].size > 0) {
         int choice_idx = find_choice_token(json, tokens, count, choices_idx, choice_index);
-        if (choice_idx < 0) {
-            free_tokens(tokens);
-            return 0;
-        }
-        int finish_idx = obj_get_key(tokens, count, choice_idx, json, "finish_reason");
-        if (finish_idx >= 0 && tokens[finish_idx].type == JSTOK_STRING) {
-            span_t sp = tok_span(json, &tokens[finish_idx]);
-            delta->finish_reason = llm_finish_reason_from_string(sp.ptr, sp.len);
-        }
-        int delta_obj_idx = obj_get_key(tokens, count, choice_idx, json, "delta");
-        if (delta_obj_idx >= 0 && tokens[delta_obj_idx].type == JSTOK_OBJECT) {
-            int content_idx = obj_get_key(tokens, count, delta_obj_idx, json, "content");
-            if (content_idx >= 0 && tokens[content_idx].type == JSTOK_STRING) {
-                span_t sp = tok_span(json, &tokens[content_idx]);
-                delta->content_delta = sp.ptr;
-                delta->content_delta_len = sp.len;
-            }
-            span_t reasoning = {0};
-            if (extract_reasoning_span(json, tokens, count, delta_obj_idx, &reasoning)) {
-                delta->reasoning_delta = reasoning.ptr;
-                delta->reasoning_delta_len = reasoning.len;
-            }
-            int tool_calls_idx = obj_get_key(tokens, count, delta_obj_idx, json, "tool_calls");
-            if (tool_calls_idx >= 0 && tokens[tool_calls_idx].type == JSTOK_ARRAY && tokens[tool_calls_idx].size > 0) {
-                int tool_count = tokens[tool_calls_idx].size;
-                delta->tool_call_deltas = calloc((size_t)tool_count, sizeof(llm_tool_call_delta_t));
-                if (!delta->tool_call_deltas) {
-                    free_tokens(tokens);
-                    return JSTOK_ERROR_NOMEM;
-                }
-                delta->tool_call_deltas_count = (size_t)tool_count;
-                for (int i = 0; i < tool_count; i++) {
-                    int tool_idx = arr_get(tokens, count, tool_calls_idx, i);
-                    if (tool_idx < 0 || tokens[tool_idx].type != JSTOK_OBJECT) {
-                        free(delta->tool_call_deltas);
-                        delta->tool_call_deltas = NULL;
-                        delta->tool_call_deltas_count = 0;
-                        free_tokens(tokens);
-                        return LLM_PARSE_ERR_PROTOCOL;
-                    }
-                    llm_tool_call_delta_t* td = &delta->tool_call_deltas[i];
-                    int index_idx = obj_get_key(tokens, count, tool_idx, json, "index");
-                    if (index_idx >= 0) {
-                        size_t idx_val = 0;
-                        if (parse_choice_index(json, &tokens[index_idx], &idx_val)) {
-                            td->index = idx_val;
-                        }
-                    }
-                    int id_idx = obj_get_key(tokens, count, tool_idx, json, "id");
-                    if (id_idx >= 0 && tokens[id_idx].type == JSTOK_STRING) {
-                        span_t sp = tok_span(json, &tokens[id_idx]);
-                        td->id = sp.ptr;
-                        td->id_len = sp.len;
-                    }
-                    int func_idx = obj_get_key(tokens, count, tool_idx, json, "function");
-                    if (func_idx >= 0 && tokens[func_idx].type == JSTOK_OBJECT) {
-                        int name_idx = obj_get_key(tokens, count, func_idx, json, "name");
-                        if (name_idx >= 0 && tokens[name_idx].type == JSTOK_STRING) {
-                            span_t sp = tok_span(json, &tokens[name_idx]);
-                            td->name = sp.ptr;
-                            td->name_len = sp.len;
-                        }
-                        int args_idx = obj_get_key(tokens, count, func_idx, json, "arguments");
-                        if (args_idx >= 0 && tokens[args_idx].type == JSTOK_STRING) {
-                            span_t sp = tok_span(json, &tokens[args_idx]);
-                            td->arguments_fragment = sp.ptr;
-                            td->arguments_fragment_len = sp.len;
-                        }
-                    }
-                }
-            }
-        }
+        if (choice_idx >= 0) ret = parse_choice_delta(json, tokens, count, choice_idx, delta, alloc);
     }
 
-    free_tokens(tokens);
-    return 0;
+    free_tokens(alloc, tokens);
+    return ret;
+}
+
+static void free_chunk_deltas(const llm_allocator_t* alloc, llm_chat_chunk_delta_t* deltas, size_t deltas_count) {
+    for (size_t i = 0; i < deltas_count; i++) {
+        mem_free(alloc, deltas[i].tool_call_deltas);
+        deltas[i].tool_call_deltas = NULL;
+        deltas[i].tool_call_deltas_count = 0;
+    }
+}
+
+int parse_chat_chunk_choices(const char* json, size_t len, llm_chat_chunk_delta_t* deltas, size_t deltas_count,
+                             llm_usage_t* usage, bool* usage_present, const llm_allocator_t* alloc) {
+    jstoktok_t* tokens = NULL;
+    int count = 0;
+    int ret = tokenize(json, len, alloc, &tokens, &count);
+    if (ret < 0) return ret;
+
+    if (count == 0 || tokens[0].type != JSTOK_OBJECT) {
+        free_tokens(alloc, tokens);
+        return LLM_PARSE_ERR_PROTOCOL;
+    }
+
+    memset(deltas, 0, deltas_count * sizeof(*deltas));
+    for (size_t i = 0; i < deltas_count; i++) deltas[i].finish_reason = LLM_FINISH_REASON_UNKNOWN;
+    usage_parse(json, tokens, count, usage, usage_present);
+
+    int choices_idx = obj_get_key(tokens, count, 0, json, "choices");
+    int size = choices_idx >= 0 && tokens[choices_idx].type == JSTOK_ARRAY ? tokens[choices_idx].size : 0;
+    for (int i = 0; i < size && ret == 0; i++) {
+        int choice_idx = arr_get(tokens, count, choices_idx, i);
+        if (choice_idx < 0 || tokens[choice_idx].type != JSTOK_OBJECT) continue;
+        // Choices without an index are numbered by position.
+        size_t idx_val = (size_t)i;
+        int index_idx = obj_get_key(tokens, count, choice_idx, json, "index");
+        if (index_idx >= 0 && !parse_choice_index(json, &tokens[index_idx], &idx_val)) continue;
+        if (idx_val >= deltas_count) continue;
+        llm_chat_chunk_delta_t* delta = &deltas[idx_val];
+        if (delta->tool_call_deltas) free_chunk_deltas(alloc, delta, 1);  // repeated index: the last one wins
+        memset(delta, 0, sizeof(*delta));
+        delta->finish_reason = LLM_FINISH_REASON_UNKNOWN;
+        ret = parse_choice_delta(json, tokens, count, choice_idx, delta, alloc);
+    }
+    if (ret != 0) free_chunk_deltas(alloc, deltas, deltas_count);
+
+    free_tokens(alloc, tokens);
+    return ret;
 }
 
 int parse_chat_chunk(const char* json, size_t len, llm_chat_chunk_delta_t* delta, llm_usage_t* usage,
-                     bool* usage_present) {
-    return parse_chat_chunk_choice(json, len, 0, delta, usage, usage_present);
+                     bool* usage_present, const llm_allocator_t* alloc) {
+    return parse_chat_chunk_choice(json, len, 0, delta, usage, usage_present, alloc);
 }
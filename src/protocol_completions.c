@@ -8,19 +8,20 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int tokenize(const char* json, size_t len, jstoktok_t** tokens_out, int* count_out) {
+static int tokenize(const char* json, size_t len, const llm_allocator_t* alloc, jstoktok_t** tokens_out,
+                    int* count_out) {
     jstok_parser parser;
     jstok_init(&parser);
     int needed = jstok_parse(&parser, json, (int)len, NULL, 0);
     if (needed < 0) return needed;
 
-    jstoktok_t* tokens = malloc(needed * sizeof(jstoktok_t));
+    jstoktok_t* tokens = mem_alloc(alloc, needed * sizeof(jstoktok_t));
     if (!tokens) return JSTOK_ERROR_NOMEM;
 
     jstok_init(&parser);
     int parsed = jstok_parse(&parser, json, (int)len, tokens, needed);
     if (parsed < 0) {
-        free(tokens);
+        mem_free(alloc, tokens);
         return parsed;
     }
     *tokens_out = tokens;
@@ -28,7 +29,7 @@ static int tokenize(const char* json, size_t len, jstoktok_t** tokens_out, int*
     return 0;
 }
 
-static void free_tokens(jstoktok_t* tokens) { free(tokens); }
+static void free_tokens(const llm_allocator_t* alloc, jstoktok_t* tokens) { mem_free(alloc, tokens); }
 
 static void usage_init(llm_usage_t* usage, bool* usage_present) {
     if (usage) {
@@ -72,14 +73,15 @@ static void usage_parse(const char* json, const jstoktok_t* tokens, int count, l
     }
 }
 
-int parse_completions_response(const char* json, size_t len, llm_completions_result_t* result) {
+int parse_completions_response(const char* json, size_t len, llm_completions_result_t* result,
+                               const llm_allocator_t* alloc) {
     jstoktok_t* tokens = NULL;
     int count = 0;
-    int ret = tokenize(json, len, &tokens, &count);
+    int ret = tokenize(json, len, alloc, &tokens, &count);
     if (ret < 0) return ret;
 
     if (count == 0 || tokens[0].type != JSTOK_OBJECT) {
-        free_tokens(tokens);
+        free_tokens(alloc, tokens);
         return LLM_PARSE_ERR_PROTOCOL;
     }
 
@@ -87,14 +89,14 @@ int parse_completions_response(const char* json, size_t len, llm_completions_res
 
     int choices_idx = obj_get_key(tokens, count, 0, json, "choices");
     if (choices_idx < 0 || tokens[choices_idx].type != JSTOK_ARRAY || tokens[choices_idx].size <= 0) {
-        free_tokens(tokens);
+        free_tokens(alloc, tokens);
         return LLM_PARSE_ERR_PROTOCOL;
     }
 
     size_t choices_count = (size_t)tokens[choices_idx].size;
-    result->choices = calloc(choices_count, sizeof(llm_completion_choice_t));
+    result->choices = mem_calloc(alloc, choices_count, sizeof(llm_completion_choice_t));
     if (!result->choices) {
-        free_tokens(tokens);
+        free_tokens(alloc, tokens);
         return JSTOK_ERROR_NOMEM;
     }
     result->choices_count = choices_count;
@@ -102,18 +104,18 @@ int parse_completions_response(const char* json, size_t len, llm_completions_res
     for (size_t i = 0; i < choices_count; i++) {
         int choice_idx = arr_get(tokens, count, choices_idx, (int)i);
         if (choice_idx < 0 || tokens[choice_idx].type != JSTOK_OBJECT) {
-            free(result->choices);
+            mem_free(alloc, result->choices);
             result->choices = NULL;
             result->choices_count = 0;
-            free_tokens(tokens);
+            free_tokens(alloc, tokens);
             return LLM_PARSE_ERR_PROTOCOL;
         }
         int text_idx = obj_get_key(tokens, count, choice_idx, json, "text");
         if (text_idx < 0 || tokens[text_idx].type != JSTOK_STRING) {
-            free(result->choices);
+            mem_free(alloc, result->choices);
             result->choices = NULL;
             result->choices_count = 0;
-            free_tokens(tokens);
+            free_tokens(alloc, tokens);
             return LLM_PARSE_ERR_PROTOCOL;
         }
         span_t sp = tok_span(json, &tokens[text_idx]);
@@ -121,7 +123,7 @@ int parse_completions_response(const char* json, size_t len, llm_completions_res
         result->choices[i].text_len = sp.len;
     }
 
-    free_tokens(tokens);
+    free_tokens(alloc, tokens);
     return 0;
 }
 
@@ -159,10 +161,11 @@ static int find_choice_token(const char* json, const jstoktok_t* tokens, int cou
 }
 
 int parse_completions_chunk_choice(const char* json, size_t len, size_t choice_index, span_t* text_delta,
-                                   llm_finish_reason_t* finish_reason, llm_usage_t* usage, bool* usage_present) {
+                                   llm_finish_reason_t* finish_reason, llm_usage_t* usage, bool* usage_present,
+                                   const llm_allocator_t* alloc) {
     jstoktok_t* tokens = NULL;
     int count = 0;
-    int ret = tokenize(json, len, &tokens, &count);
+    int ret = tokenize(json, len, alloc, &tokens, &count);
     if (ret < 0) return ret;
 
     if (text_delta) {
@@ -174,7 +177,7 @@ int parse_completions_chunk_choice(const char* json, size_t len, size_t choice_i
     }
 
     if (count == 0 || tokens[0].type != JSTOK_OBJECT) {
-        free_tokens(tokens);
+        free_tokens(alloc, tokens);
         return LLM_PARSE_ERR_PROTOCOL;
     }
 
@@ -203,11 +206,11 @@ int parse_completions_chunk_choice(const char* json, size_t len, size_t choice_i
         }
     }
 
-    free_tokens(tokens);
+    free_tokens(alloc, tokens);
     return 0;
 }
 
 int parse_completions_chunk(const char* json, size_t len, span_t* text_delta, llm_finish_reason_t* finish_reason,
-                            llm_usage_t* usage, bool* usage_present) {
-    return parse_completions_chunk_choice(json, len, 0, text_delta, finish_reason, usage, usage_present);
+                            llm_usage_t* usage, bool* usage_present, const llm_allocator_t* alloc) {
+    return parse_completions_chunk_choice(json, len, 0, text_delta, finish_reason, usage, usage_present, alloc);
 }
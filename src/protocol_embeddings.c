@@ -1,24 +1,27 @@
 #include "llm/internal.h"
 #include "llm/json_core.h"
 #include "llm/llm.h"
+#include "protocol_embeddings.h"
 #define JSTOK_HEADER
 #include <jstok.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-static int tokenize(const char* json, size_t len, jstoktok_t** tokens_out, int* count_out) {
+static int tokenize(const char* json, size_t len, const llm_allocator_t* alloc, jstoktok_t** tokens_out,
+                    int* count_out) {
     jstok_parser parser;
     jstok_init(&parser);
     int needed = jstok_parse(&parser, json, (int)len, NULL, 0);
     if (needed < 0) return needed;
 
-    jstoktok_t* tokens = malloc(needed * sizeof(jstoktok_t));
+    jstoktok_t* tokens = mem_alloc(alloc, needed * sizeof(jstoktok_t));
     if (!tokens) return JSTOK_ERROR_NOMEM;
 
     jstok_init(&parser);
     int parsed = jstok_parse(&parser, json, (int)len, tokens, needed);
     if (parsed < 0) {
-        free(tokens);
+        mem_free(alloc, tokens);
         return parsed;
     }
     *tokens_out = tokens;
@@ -26,16 +29,33 @@ static int tokenize(const char* json, size_t len, jstoktok_t** tokens_out, int*
     return 0;
 }
 
-static void free_tokens(jstoktok_t* tokens) { free(tokens); }
+static void free_tokens(const llm_allocator_t* alloc, jstoktok_t* tokens) { mem_free(alloc, tokens); }
 
-int parse_embeddings_response(const char* json, size_t len, llm_embeddings_result_t* result) {
+static bool parse_item_index(const char* json, const jstoktok_t* tok, size_t* out) {
+    if (tok->type != JSTOK_PRIMITIVE) return false;
+    span_t sp = tok_span(json, tok);
+    if (sp.len == 0 || sp.len > 18) return false;
+    size_t val = 0;
+    for (size_t i = 0; i < sp.len; i++) {
+        char c = sp.ptr[i];
+        if (c < '0' || c > '9') return false;
+        val = (val * 10) + (size_t)(c - '0');
+    }
+    *out = val;
+    return true;
+}
+
+// Item i lands in data[i], or in data[index] when it carries one: servers may answer out of order. An index out
+// of range or claimed twice is a protocol error.
+int parse_embeddings_response(const char* json, size_t len, llm_embeddings_result_t* result,
+                              const llm_allocator_t* alloc) {
     jstoktok_t* tokens = NULL;
     int count = 0;
-    int ret = tokenize(json, len, &tokens, &count);
+    int ret = tokenize(json, len, alloc, &tokens, &count);
     if (ret < 0) return ret;
 
     if (count == 0 || tokens[0].type != JSTOK_OBJECT) {
-        free_tokens(tokens);
+        free_tokens(alloc, tokens);
         return LLM_PARSE_ERR_PROTOCOL;
     }
 
@@ -43,14 +63,14 @@ int parse_embeddings_response(const char* json, size_t len, llm_embeddings_resul
 
     int data_idx = obj_get_key(tokens, count, 0, json, "data");
     if (data_idx < 0 || tokens[data_idx].type != JSTOK_ARRAY || tokens[data_idx].size <= 0) {
-        free_tokens(tokens);
+        free_tokens(alloc, tokens);
         return LLM_PARSE_ERR_PROTOCOL;
     }
 
     size_t data_count = (size_t)tokens[data_idx].size;
-    result->data = calloc(data_count, sizeof(llm_embedding_item_t));
+    result->data = mem_calloc(alloc, data_count, sizeof(llm_embedding_item_t));
     if (!result->data) {
-        free_tokens(tokens);
+        free_tokens(alloc, tokens);
         return JSTOK_ERROR_NOMEM;
     }
     result->data_count = data_count;
@@ -58,25 +78,530 @@ int parse_embeddings_response(const char* json, size_t len, llm_embeddings_resul
     for (size_t i = 0; i < data_count; i++) {
         int item_idx = arr_get(tokens, count, data_idx, (int)i);
         if (item_idx < 0 || tokens[item_idx].type != JSTOK_OBJECT) {
-            free(result->data);
+            mem_free(alloc, result->data);
             result->data = NULL;
             result->data_count = 0;
-            free_tokens(tokens);
+            free_tokens(alloc, tokens);
             return LLM_PARSE_ERR_PROTOCOL;
         }
         int embedding_idx = obj_get_key(tokens, count, item_idx, json, "embedding");
-        if (embedding_idx < 0 || tokens[embedding_idx].type != JSTOK_ARRAY) {
-            free(result->data);
+        // encoding_format "base64" returns the vector as a string of little-endian float32 bytes.
+        if (embedding_idx < 0 ||
+            (tokens[embedding_idx].type != JSTOK_ARRAY && tokens[embedding_idx].type != JSTOK_STRING)) {
+            mem_free(alloc, result->data);
+            result->data = NULL;
+            result->data_count = 0;
+            free_tokens(alloc, tokens);
+            return LLM_PARSE_ERR_PROTOCOL;
+        }
+        size_t slot = i;
+        int index_idx = obj_get_key(tokens, count, item_idx, json, "index");
+        if ((index_idx >= 0 && !parse_item_index(json, &tokens[index_idx], &slot)) || slot >= data_count ||
+            result->data[slot].embedding) {
+            mem_free(alloc, result->data);
             result->data = NULL;
             result->data_count = 0;
-            free_tokens(tokens);
+            free_tokens(alloc, tokens);
             return LLM_PARSE_ERR_PROTOCOL;
         }
         span_t sp = tok_span(json, &tokens[embedding_idx]);
-        result->data[i].embedding = sp.ptr;
-        result->data[i].embedding_len = sp.len;
+        result->data[slot].embedding = sp.ptr;
+        result->data[slot].embedding_len = sp.len;
     }
 
-    free_tokens(tokens);
+    free_tokens(alloc, tokens);
     return 0;
 }
+
+// Exact powers of ten representable as doubles (Clinger fast path).
+static const double k_pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static bool is_ws(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+// Parses one JSON number at [p, end). Up to 19 significant digits with a small decimal exponent are
+// converted exactly without strtod; anything else falls back to strtod on the validated span.
+static const char* parse_number_f32(const char* p, const char* end, float* out) {
+    const char* start = p;
+    bool neg = false;
+    if (p < end && *p == '-') {
+        neg = true;
+        p++;
+    }
+    if (p >= end || !is_digit(*p)) return NULL;
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exp10 = 0;
+    bool exact = true;
+    if (*p == '0') {
+        p++;
+    } else {
+        while (p < end && is_digit(*p)) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits++;
+            } else {
+                exp10++;
+                if (*p != '0') exact = false;
+            }
+            p++;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (p >= end || !is_digit(*p)) return NULL;
+        while (p < end && is_digit(*p)) {
+            if (digits < 19) {
+                if (mantissa != 0 || *p != '0') digits++;
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                exp10--;
+            } else if (*p != '0') {
+                exact = false;
+            }
+            p++;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool exp_neg = false;
+        if (p < end && (*p == '+' || *p == '-')) {
+            exp_neg = (*p == '-');
+            p++;
+        }
+        if (p >= end || !is_digit(*p)) return NULL;
+        int e = 0;
+        while (p < end && is_digit(*p)) {
+            if (e < 10000) e = e * 10 + (*p - '0');
+            p++;
+        }
+        exp10 += exp_neg ? -e : e;
+    }
+
+    double value;
+    if (exact && mantissa <= ((uint64_t)1 << 53) && exp10 >= -22 && exp10 <= 22) {
+        value = (double)mantissa;
+        value = exp10 < 0 ? value / k_pow10[-exp10] : value * k_pow10[exp10];
+        if (neg) value = -value;
+    } else {
+        char* parsed_end = NULL;
+        value = strtod(start, &parsed_end);
+        if (parsed_end != p) return NULL;
+    }
+    *out = (float)value;
+    return p;
+}
+
+static bool decode_f32_array(const char* p, const char* end, float* out, size_t out_cap, size_t* out_dims) {
+    size_t n = 0;
+    if (p >= end || *p != '[') return false;
+    p++;
+    while (p < end && is_ws(*p)) p++;
+    if (p < end && *p == ']') {
+        *out_dims = 0;
+        return p + 1 == end;
+    }
+    for (;;) {
+        float v;
+        p = parse_number_f32(p, end, &v);
+        if (!p) return false;
+        if (out) {
+            if (n >= out_cap) return false;
+            out[n] = v;
+        }
+        n++;
+        while (p < end && is_ws(*p)) p++;
+        if (p >= end) return false;
+        if (*p == ']') break;
+        if (*p != ',') return false;
+        p++;
+        while (p < end && is_ws(*p)) p++;
+    }
+    *out_dims = n;
+    return p + 1 == end;
+}
+
+static int base64_value(unsigned char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+static void emit_f32_byte(unsigned char byte, size_t index, float* out, uint32_t* word) {
+    *word |= (uint32_t)byte << (8 * (index & 3));
+    if ((index & 3) == 3) {
+        memcpy(&out[index >> 2], word, sizeof(*word));
+        *word = 0;
+    }
+}
+
+// Decodes base64 (optionally with JSON-escaped '/') of little-endian float32 values.
+static bool decode_f32_base64(const char* p, const char* end, float* out, size_t out_cap, size_t* out_dims) {
+    size_t bytes = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+    int padding = 0;
+    uint32_t word = 0;
+    for (; p < end; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '\\' && p + 1 < end && p[1] == '/') continue;
+        if (c == '=') {
+            padding++;
+            continue;
+        }
+        int v = base64_value(c);
+        if (v < 0 || padding > 0) return false;
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (out) {
+                if ((bytes >> 2) >= out_cap) return false;
+                emit_f32_byte((unsigned char)(acc >> bits), bytes, out, &word);
+            }
+            bytes++;
+            acc &= (1u << bits) - 1u;
+        }
+    }
+    if (padding > 2 || bytes % 4 != 0) return false;
+    *out_dims = bytes / 4;
+    return true;
+}
+
+bool llm_embedding_decode_f32(const char* span, size_t span_len, float* out, size_t out_cap, size_t* out_dims) {
+    if (!span || !out_dims) return false;
+    const char* p = span;
+    const char* end = span + span_len;
+    while (p < end && is_ws(*p)) p++;
+    while (end > p && is_ws(end[-1])) end--;
+    if (p < end && *p == '[') return decode_f32_array(p, end, out, out_cap, out_dims);
+    return decode_f32_base64(p, end, out, out_cap, out_dims);
+}
+
+enum { EMB_ROLE_NONE = 0, EMB_ROLE_DATA, EMB_ROLE_VECTOR, EMB_ROLE_INDEX, EMB_ROLE_ELEMENT };
+
+// Embedding array states: value or ']', value, ',' or ']'.
+enum { EMB_VEC_VALUE_OR_END = 0, EMB_VEC_VALUE, EMB_VEC_COMMA_OR_END };
+
+void emb_stream_init(emb_stream_t* s, float* row, size_t row_cap, llm_embedding_vector_cb on_vector, void* user_data) {
+    memset(s, 0, sizeof(*s));
+    s->row = row;
+    s->row_cap = row ? row_cap : 0;
+    s->on_vector = on_vector;
+    s->user_data = user_data;
+}
+
+static int emb_fail(emb_stream_t* s, int err) {
+    s->error = err;
+    return err;
+}
+
+static char emb_top(const emb_stream_t* s) { return s->depth > 0 ? s->stack[s->depth - 1] : 0; }
+
+static bool emb_key_is(const emb_stream_t* s, const char* lit) {
+    size_t n = strlen(lit);
+    return !s->key_overflow && s->key_len == n && memcmp(s->key, lit, n) == 0;
+}
+
+// Shared checks for any value start; hands back the role set by the preceding key.
+static int emb_value_start(emb_stream_t* s, int* role) {
+    if (s->after_key) return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+    if (s->depth == 0 && s->root_done) return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+    if (emb_top(s) == '{' && s->expect_key) return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+    if (s->vector_depth && s->depth == s->vector_depth) {
+        if (s->vector_state == EMB_VEC_COMMA_OR_END) return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+        s->vector_state = EMB_VEC_COMMA_OR_END;
+        *role = EMB_ROLE_ELEMENT;
+        return EMB_STREAM_OK;
+    }
+    *role = s->role;
+    s->role = EMB_ROLE_NONE;
+    return EMB_STREAM_OK;
+}
+
+static int emb_emit_item(emb_stream_t* s) {
+    if (!s->item_has_vector) return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+    size_t index = s->item_has_index ? s->item_index : s->items;
+    s->items++;
+    if (s->on_vector && !s->on_vector(s->user_data, index, s->row, s->dims)) {
+        return emb_fail(s, EMB_STREAM_ERR_ABORT);
+    }
+    return EMB_STREAM_OK;
+}
+
+static int emb_finish_primitive(emb_stream_t* s) {
+    s->in_primitive = false;
+    if (s->depth == 0) return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+    if (s->primitive_role == EMB_ROLE_ELEMENT) {
+        float v;
+        const char* end = parse_number_f32(s->num, s->num + s->num_len, &v);
+        if (!end || end != s->num + s->num_len) return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+        if (s->dims >= s->row_cap) return emb_fail(s, EMB_STREAM_ERR_OVERFLOW);
+        s->row[s->dims++] = v;
+    } else if (s->primitive_role == EMB_ROLE_INDEX) {
+        size_t index = 0;
+        if (s->num_len == 0) return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+        for (size_t i = 0; i < s->num_len; i++) {
+            char c = s->num[i];
+            if (!is_digit(c) || index > (SIZE_MAX - 9) / 10) return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+            index = index * 10 + (size_t)(c - '0');
+        }
+        s->item_index = index;
+        s->item_has_index = true;
+    } else if (s->primitive_role != EMB_ROLE_NONE) {
+        return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+    }
+    return EMB_STREAM_OK;
+}
+
+static int emb_b64_char(emb_stream_t* s, unsigned char c) {
+    if (c == '=') {
+        s->b64_pad++;
+        return s->b64_pad > 2 ? emb_fail(s, EMB_STREAM_ERR_PROTOCOL) : EMB_STREAM_OK;
+    }
+    int v = base64_value(c);
+    if (v < 0 || s->b64_pad > 0) return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+    s->b64_acc = (s->b64_acc << 6) | (uint32_t)v;
+    s->b64_bits += 6;
+    if (s->b64_bits >= 8) {
+        s->b64_bits -= 8;
+        if ((s->b64_bytes >> 2) >= s->row_cap) return emb_fail(s, EMB_STREAM_ERR_OVERFLOW);
+        emit_f32_byte((unsigned char)(s->b64_acc >> s->b64_bits), s->b64_bytes, s->row, &s->b64_word);
+        s->b64_bytes++;
+        s->b64_acc &= (1u << s->b64_bits) - 1u;
+    }
+    return EMB_STREAM_OK;
+}
+
+static bool is_hex(char c) { return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); }
+
+static int emb_string_end(emb_stream_t* s) {
+    s->in_string = false;
+    if (s->string_is_key) {
+        s->after_key = true;
+        s->expect_key = false;
+        return EMB_STREAM_OK;
+    }
+    if (s->in_vector) {
+        if (s->b64_bytes % 4 != 0) return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+        s->dims = s->b64_bytes / 4;
+        s->in_vector = false;
+        s->item_has_vector = true;
+    }
+    return EMB_STREAM_OK;
+}
+
+static int emb_string_char(emb_stream_t* s, char c) {
+    if ((unsigned char)c < 0x20) return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+    if (s->unicode_left > 0) {
+        s->unicode_left--;
+        return is_hex(c) ? EMB_STREAM_OK : emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+    }
+    if (s->escape) {
+        s->escape = false;
+        if (c == 'u') {
+            s->unicode_left = 4;
+        } else if (!strchr("\"\\/bfnrt", c)) {
+            return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+        }
+        // Escaped keys never match; base64 only tolerates the "\/" escape.
+        if (s->string_is_key) {
+            s->key_overflow = true;
+        } else if (s->in_vector) {
+            return c == '/' ? emb_b64_char(s, '/') : emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+        }
+        return EMB_STREAM_OK;
+    }
+    if (c == '\\') {
+        s->escape = true;
+        return EMB_STREAM_OK;
+    }
+    if (c == '"') return emb_string_end(s);
+    if (s->string_is_key) {
+        if (s->key_len < EMB_STREAM_KEY_MAX) {
+            s->key[s->key_len++] = c;
+        } else {
+            s->key_overflow = true;
+        }
+        return EMB_STREAM_OK;
+    }
+    if (s->in_vector) return emb_b64_char(s, (unsigned char)c);
+    return EMB_STREAM_OK;
+}
+
+static int emb_string_start(emb_stream_t* s) {
+    s->in_string = true;
+    s->escape = false;
+    s->unicode_left = 0;
+    if (emb_top(s) == '{' && s->expect_key && !s->after_key) {
+        s->string_is_key = true;
+        s->key_len = 0;
+        s->key_overflow = false;
+        return EMB_STREAM_OK;
+    }
+    s->string_is_key = false;
+    int role;
+    int rc = emb_value_start(s, &role);
+    if (rc < 0) return rc;
+    if (role == EMB_ROLE_VECTOR) {
+        s->in_vector = true;
+        s->vector_b64 = true;
+        s->b64_acc = 0;
+        s->b64_bits = 0;
+        s->b64_pad = 0;
+        s->b64_bytes = 0;
+        s->b64_word = 0;
+        s->dims = 0;
+    } else if (role != EMB_ROLE_NONE) {
+        return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+    }
+    if (s->depth == 0) return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+    return EMB_STREAM_OK;
+}
+
+static int emb_open(emb_stream_t* s, char c) {
+    int role;
+    int rc = emb_value_start(s, &role);
+    if (rc < 0) return rc;
+    if (s->depth == 0 && c != '{') return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+    if (s->depth >= EMB_STREAM_MAX_DEPTH) return emb_fail(s, EMB_STREAM_ERR_OVERFLOW);
+    if (role == EMB_ROLE_ELEMENT || role == EMB_ROLE_INDEX) return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+    if ((role == EMB_ROLE_DATA || role == EMB_ROLE_VECTOR) && c != '[') return emb_fail(s, EMB_STREAM_ERR_PROTOCOL);
+    s->stack[s->depth++] = c;
+    s->expect_key = (c == '{');
+    if (role == EMB_ROLE_DATA) {
+        s->data_depth = s->depth;
+    } else if (role == EMB_ROLE_VECTOR) {
+        s->vector_depth = s->depth;
+        s->vector_state = EMB_VEC_VALUE_OR_END;
+        s->in_vector = true;
+        s->vector_b64 = false;
+        s->dims = 0;
+    } else if (c == '{' && s->data_depth && s->depth == s->data_depth + 1) {
+        s->item_has_vector = false;
+        s->item_has_index = false;
+        s->item_index = 0;
+        s->dims = 0;
+    }
+    return EMB_STREAM_OK;
+}
+
+static int emb_close(emb_stream_t* s, char c) {
+    char open = (c == '}') ? '{' : '[';
+    if (s->after_key || emb_top(s) != open) return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+    int closing = s->depth;
+    if (closing == s->vector_depth) {
+        if (s->vector_state == EMB_VEC_VALUE) return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+        s->vector_depth = 0;
+        s->in_vector = false;
+        s->item_has_vector = true;
+    }
+    s->depth--;
+    s->expect_key = false;
+    s->role = EMB_ROLE_NONE;
+    if (c == '}' && s->data_depth && closing == s->data_depth + 1) {
+        int rc = emb_emit_item(s);
+        if (rc < 0) return rc;
+    }
+    if (closing == s->data_depth) s->data_depth = 0;
+    if (s->depth == 0) s->root_done = true;
+    return EMB_STREAM_OK;
+}
+
+static int emb_colon(emb_stream_t* s) {
+    if (!s->after_key) return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+    s->after_key = false;
+    s->role = EMB_ROLE_NONE;
+    if (s->depth == 1 && emb_key_is(s, "data")) {
+        s->role = EMB_ROLE_DATA;
+    } else if (s->data_depth && s->depth == s->data_depth + 1) {
+        if (emb_key_is(s, "embedding")) {
+            s->role = EMB_ROLE_VECTOR;
+        } else if (emb_key_is(s, "index")) {
+            s->role = EMB_ROLE_INDEX;
+        }
+    }
+    return EMB_STREAM_OK;
+}
+
+static int emb_comma(emb_stream_t* s) {
+    if (s->after_key || s->depth == 0) return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+    if (s->vector_depth && s->depth == s->vector_depth) {
+        if (s->vector_state != EMB_VEC_COMMA_OR_END) return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+        s->vector_state = EMB_VEC_VALUE;
+        return EMB_STREAM_OK;
+    }
+    if (emb_top(s) == '{') s->expect_key = true;
+    return EMB_STREAM_OK;
+}
+
+static int emb_primitive_char(emb_stream_t* s, char c) {
+    if (!s->in_primitive) {
+        int role;
+        int rc = emb_value_start(s, &role);
+        if (rc < 0) return rc;
+        s->in_primitive = true;
+        s->primitive_role = role;
+        s->num_len = 0;
+    }
+    if (s->primitive_role == EMB_ROLE_ELEMENT || s->primitive_role == EMB_ROLE_INDEX) {
+        if (s->num_len + 1 >= EMB_STREAM_NUM_MAX) return emb_fail(s, EMB_STREAM_ERR_OVERFLOW);
+        s->num[s->num_len++] = c;
+        s->num[s->num_len] = '\0';
+    }
+    return EMB_STREAM_OK;
+}
+
+int emb_stream_feed(emb_stream_t* s, const char* chunk, size_t len) {
+    if (s->error) return s->error;
+    int rc = EMB_STREAM_OK;
+    for (size_t i = 0; i < len && rc == EMB_STREAM_OK; i++) {
+        char c = chunk[i];
+        if (s->in_string) {
+            rc = emb_string_char(s, c);
+            continue;
+        }
+        bool structural = (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',' || c == '"');
+        if (s->in_primitive && (structural || is_ws(c))) {
+            rc = emb_finish_primitive(s);
+            if (rc < 0) break;
+        }
+        if (is_ws(c)) continue;
+        switch (c) {
+            case '{':
+            case '[':
+                rc = emb_open(s, c);
+                break;
+            case '}':
+            case ']':
+                rc = emb_close(s, c);
+                break;
+            case ':':
+                rc = emb_colon(s);
+                break;
+            case ',':
+                rc = emb_comma(s);
+                break;
+            case '"':
+                rc = emb_string_start(s);
+                break;
+            default:
+                rc = emb_primitive_char(s, c);
+                break;
+        }
+    }
+    return rc;
+}
+
+int emb_stream_finish(emb_stream_t* s) {
+    if (s->error) return s->error;
+    if (s->in_string || s->in_primitive || s->depth != 0 || !s->root_done) {
+        return emb_fail(s, EMB_STREAM_ERR_SYNTAX);
+    }
+    return EMB_STREAM_OK;
+}
@@ -0,0 +1,76 @@
+#ifndef PROTOCOL_EMBEDDINGS_H
+#define PROTOCOL_EMBEDDINGS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "llm/llm.h"
+
+enum { EMB_STREAM_MAX_DEPTH = 32, EMB_STREAM_KEY_MAX = 16, EMB_STREAM_NUM_MAX = 64 };
+
+typedef enum {
+    EMB_STREAM_OK = 0,
+    EMB_STREAM_ERR_SYNTAX = -1,
+    EMB_STREAM_ERR_PROTOCOL = -2,
+    EMB_STREAM_ERR_OVERFLOW = -3,
+    EMB_STREAM_ERR_ABORT = -4,
+} emb_stream_err_t;
+
+// Push scanner for an embeddings response fed in arbitrary chunks. It tracks only the structure needed
+// to find data[i].embedding / data[i].index and decodes each vector (number array or base64 float32)
+// straight into row, so memory is bounded by one vector regardless of body size. Everything else in the
+// document is skipped structurally. No allocation.
+typedef struct {
+    llm_embedding_vector_cb on_vector;
+    void* user_data;
+    float* row;
+    size_t row_cap;
+    size_t dims;
+
+    char stack[EMB_STREAM_MAX_DEPTH];
+    int depth;
+    bool expect_key;
+    bool after_key;  // key read, ':' must follow
+    bool root_done;
+    int role;  // role of the next value, from the key just read
+
+    bool in_string;
+    bool string_is_key;
+    bool escape;
+    int unicode_left;
+    char key[EMB_STREAM_KEY_MAX];
+    size_t key_len;
+    bool key_overflow;
+
+    bool in_primitive;
+    int primitive_role;
+    char num[EMB_STREAM_NUM_MAX];
+    size_t num_len;
+
+    int data_depth;    // depth of the data array, 0 when outside
+    int vector_depth;  // depth of the embedding array, 0 when outside
+    int vector_state;
+    bool in_vector;  // inside data[i].embedding (array or base64 string)
+    bool vector_b64;
+    bool item_has_vector;
+    bool item_has_index;
+    size_t item_index;
+    size_t items;
+
+    uint32_t b64_acc;
+    int b64_bits;
+    int b64_pad;
+    size_t b64_bytes;
+    uint32_t b64_word;
+
+    int error;
+} emb_stream_t;
+
+void emb_stream_init(emb_stream_t* s, float* row, size_t row_cap, llm_embedding_vector_cb on_vector, void* user_data);
+// Returns EMB_STREAM_OK or a negative emb_stream_err_t; the error is sticky.
+int emb_stream_feed(emb_stream_t* s, const char* chunk, size_t len);
+// Checks that a complete document was seen.
+int emb_stream_finish(emb_stream_t* s);
+
+#endif  // PROTOCOL_EMBEDDINGS_H
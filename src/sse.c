@@ -47,6 +47,7 @@ struct sse_parser {
     void* frame_user_data;
 
     int last_error;
+    llm_allocator_t alloc;
 };
 
 static bool sse_size_add(size_t a, size_t b, size_t* out) {
@@ -55,8 +56,8 @@ static bool sse_size_add(size_t a, size_t b, size_t* out) {
     return true;
 }
 
-static void sse_buf_free(struct sse_buf* buf) {
-    free(buf->data);
+static void sse_buf_free(sse_parser_t* parser, struct sse_buf* buf) {
+    mem_free(&parser->alloc, buf->data);
     buf->data = NULL;
     buf->len = 0;
     buf->cap = 0;
@@ -85,7 +86,7 @@ static int sse_buf_reserve(sse_parser_t* parser, struct sse_buf* buf, size_t nee
         if (new_cap > max_cap) new_cap = max_cap;
     }
 
-    char* next = realloc(buf->data, new_cap);
+    char* next = mem_realloc(&parser->alloc, buf->data, new_cap);
     if (!next) return SSE_ERR_NOMEM;
     parser->mem_used = parser->mem_used - buf->cap + new_cap;
     buf->data = next;
@@ -409,9 +410,15 @@ static int sse_process_byte(sse_parser_t* parser, unsigned char b) {
 
 sse_parser_t* sse_create(size_t max_line_bytes, size_t max_frame_bytes, size_t max_sse_buffer_bytes,
                          size_t max_total_bytes) {
-    sse_parser_t* parser = malloc(sizeof(*parser));
+    return sse_create_with_allocator(max_line_bytes, max_frame_bytes, max_sse_buffer_bytes, max_total_bytes, NULL);
+}
+
+sse_parser_t* sse_create_with_allocator(size_t max_line_bytes, size_t max_frame_bytes, size_t max_sse_buffer_bytes,
+                                        size_t max_total_bytes, const llm_allocator_t* alloc) {
+    sse_parser_t* parser = mem_alloc(alloc, sizeof(*parser));
     if (!parser) return NULL;
     memset(parser, 0, sizeof(*parser));
+    if (alloc) parser->alloc = *alloc;
     parser->max_line_bytes = max_line_bytes;
     parser->max_frame_bytes = max_frame_bytes;
     parser->max_sse_buffer_bytes = max_sse_buffer_bytes;
@@ -422,11 +429,12 @@ sse_parser_t* sse_create(size_t max_line_bytes, size_t max_frame_bytes, size_t m
 
 void sse_destroy(sse_parser_t* parser) {
     if (!parser) return;
-    sse_buf_free(&parser->line);
-    sse_buf_free(&parser->data);
-    sse_buf_free(&parser->event_type);
-    sse_buf_free(&parser->last_event_id);
-    free(parser);
+    sse_buf_free(parser, &parser->line);
+    sse_buf_free(parser, &parser->data);
+    sse_buf_free(parser, &parser->event_type);
+    sse_buf_free(parser, &parser->last_event_id);
+    llm_allocator_t alloc = parser->alloc;
+    mem_free(&alloc, parser);
 }
 
 void sse_set_callback(sse_parser_t* parser, sse_event_cb cb, void* user_data) {
@@ -36,6 +36,8 @@ typedef struct {
 
 sse_parser_t* sse_create(size_t max_line_bytes, size_t max_frame_bytes, size_t max_sse_buffer_bytes,
                          size_t max_total_bytes);
+sse_parser_t* sse_create_with_allocator(size_t max_line_bytes, size_t max_frame_bytes, size_t max_sse_buffer_bytes,
+                                        size_t max_total_bytes, const llm_allocator_t* alloc);
 void sse_destroy(sse_parser_t* parser);
 void sse_set_callback(sse_parser_t* parser, sse_event_cb cb, void* user_data);
 void sse_set_frame_callback(sse_parser_t* parser, sse_frame_cb cb, void* user_data);
@@ -0,0 +1,286 @@
+#include "stop_match.h"
+
+#include <string.h>
+
+enum {
+    STOP_ESC_NONE = 0,
+    STOP_ESC_BACKSLASH,
+    STOP_ESC_HEX,      // 4 states: digits of \uXXXX
+    STOP_ESC_LOW = 6,  // after a high surrogate, expecting '\'
+    STOP_ESC_LOW_U,    // expecting 'u'
+    STOP_ESC_LOW_HEX,  // 4 states: digits of the low surrogate
+    STOP_MAX_NODES = 65535,
+    STOP_HOLD_PER_BYTE = 6,  // \u00XX is the longest escape per decoded byte
+    STOP_HOLD_SLACK = 24,    // partial escape plus the rest of a surrogate pair
+};
+
+bool stop_matcher_init(stop_matcher_t* m, const char* const* stops, const size_t* lens, size_t count,
+                       const llm_allocator_t* alloc) {
+    memset(m, 0, sizeof(*m));
+    m->alloc = alloc;
+    if (count > 0 && (!stops || !lens)) return false;
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (lens[i] > 0 && !stops[i]) return false;
+        if (lens[i] > STOP_MAX_NODES - 1 - total) return false;
+        total += lens[i];
+        if (lens[i] > m->max_len) m->max_len = lens[i];
+        for (size_t j = 0; j < lens[i]; j++) {
+            unsigned char c = (unsigned char)stops[i][j];
+            if (m->class_of[c] == 0) m->class_of[c] = (uint8_t)++m->classes;
+        }
+    }
+    if (m->max_len == 0) return true;  // nothing to match
+    if (m->classes > 255) return false;
+    m->classes++;  // class 0: bytes in no stop string
+
+    size_t max_nodes = total + 1;
+    m->next = mem_calloc(alloc, max_nodes * m->classes, sizeof(*m->next));
+    m->out_len = mem_calloc(alloc, max_nodes, sizeof(*m->out_len));
+    m->depth = mem_calloc(alloc, max_nodes, sizeof(*m->depth));
+    m->starts = mem_calloc(alloc, m->max_len, sizeof(*m->starts));
+    m->hold_cap = m->max_len * STOP_HOLD_PER_BYTE + STOP_HOLD_SLACK;
+    m->hold = mem_alloc(alloc, m->hold_cap);
+    uint16_t* fail = mem_calloc(alloc, max_nodes, sizeof(*fail));
+    uint16_t* queue = mem_calloc(alloc, max_nodes, sizeof(*queue));
+    if (!m->next || !m->out_len || !m->depth || !m->starts || !m->hold || !fail || !queue) {
+        mem_free(alloc, fail);
+        mem_free(alloc, queue);
+        stop_matcher_free(m);
+        return false;
+    }
+
+    // Trie; 0 means no edge yet (the root is never a child).
+    m->nodes = 1;
+    for (size_t i = 0; i < count; i++) {
+        size_t node = 0;
+        for (size_t j = 0; j < lens[i]; j++) {
+            uint16_t* edge = &m->next[node * m->classes + m->class_of[(unsigned char)stops[i][j]]];
+            if (*edge == 0) {
+                m->depth[m->nodes] = (uint16_t)(j + 1);
+                *edge = (uint16_t)m->nodes++;
+            }
+            node = *edge;
+        }
+        if (lens[i] > 0) m->out_len[node] = (uint16_t)lens[i];
+    }
+
+    // Breadth-first failure links, folded into the transition table. A child is one level deeper
+    // than its parent; any other entry is a filled-in failure transition.
+    size_t head = 0;
+    size_t tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        size_t u = queue[head++];
+        for (size_t c = 0; c < m->classes; c++) {
+            uint16_t* edge = &m->next[u * m->classes + c];
+            size_t v = *edge;
+            if (v != 0 && m->depth[v] == m->depth[u] + 1) {
+                fail[v] = (u == 0) ? 0 : m->next[fail[u] * m->classes + c];
+                if (m->out_len[v] == 0) m->out_len[v] = m->out_len[fail[v]];
+                queue[tail++] = (uint16_t)v;
+            } else {
+                *edge = (u == 0) ? 0 : m->next[fail[u] * m->classes + c];
+            }
+        }
+    }
+    mem_free(alloc, fail);
+    mem_free(alloc, queue);
+    return true;
+}
+
+void stop_matcher_free(stop_matcher_t* m) {
+    if (!m) return;
+    mem_free(m->alloc, m->next);
+    mem_free(m->alloc, m->out_len);
+    mem_free(m->alloc, m->depth);
+    mem_free(m->alloc, m->starts);
+    mem_free(m->alloc, m->hold);
+    memset(m, 0, sizeof(*m));
+}
+
+// Emits escaped bytes [emitted, upto) from hold followed by delta.
+static void stop_emit_until(stop_matcher_t* m, const char* delta, size_t upto, stop_emit_cb emit, void* user_data) {
+    if (upto < m->emitted) upto = m->emitted;
+    size_t n = upto - m->emitted;
+    size_t from_hold = (n < m->hold_len) ? n : m->hold_len;
+    if (emit && from_hold) emit(user_data, m->hold, from_hold);
+    if (emit && n > from_hold) emit(user_data, delta, n - from_hold);
+    memmove(m->hold, m->hold + from_hold, m->hold_len - from_hold);
+    m->hold_len -= from_hold;
+    m->emitted = upto;
+}
+
+// Advances the automaton by one decoded byte; returns true on a match.
+static bool stop_step(stop_matcher_t* m, unsigned char byte, size_t start, size_t* cut) {
+    m->state = m->next[m->state * m->classes + m->class_of[byte]];
+    m->starts[m->decoded % m->max_len] = start;
+    m->decoded++;
+    size_t len = m->out_len[m->state];
+    if (len == 0) return false;
+    *cut = m->starts[(m->decoded - len) % m->max_len];
+    return true;
+}
+
+static bool stop_step_code(stop_matcher_t* m, uint32_t cp, size_t start, size_t* cut) {
+    unsigned char buf[4];
+    size_t n;
+    if (cp <= 0x7F) {
+        buf[0] = (unsigned char)cp;
+        n = 1;
+    } else if (cp <= 0x7FF) {
+        buf[0] = (unsigned char)(0xC0 | (cp >> 6));
+        buf[1] = (unsigned char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp <= 0xFFFF) {
+        buf[0] = (unsigned char)(0xE0 | (cp >> 12));
+        buf[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[2] = (unsigned char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        buf[0] = (unsigned char)(0xF0 | (cp >> 18));
+        buf[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+        buf[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[3] = (unsigned char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (stop_step(m, buf[i], start, cut)) return true;
+    }
+    return false;
+}
+
+static int stop_hexval(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Unescapes one input byte at escaped offset pos and steps the automaton over what it completes.
+static bool stop_scan_byte(stop_matcher_t* m, char c, size_t pos, size_t* cut) {
+    int v;
+    switch (m->esc) {
+        case STOP_ESC_NONE:
+            if (c == '\\') {
+                m->esc = STOP_ESC_BACKSLASH;
+                m->esc_start = pos;
+                return false;
+            }
+            return stop_step(m, (unsigned char)c, pos, cut);
+        case STOP_ESC_BACKSLASH:
+            m->esc = STOP_ESC_NONE;
+            switch (c) {
+                case 'b':
+                    return stop_step(m, '\b', m->esc_start, cut);
+                case 'f':
+                    return stop_step(m, '\f', m->esc_start, cut);
+                case 'n':
+                    return stop_step(m, '\n', m->esc_start, cut);
+                case 'r':
+                    return stop_step(m, '\r', m->esc_start, cut);
+                case 't':
+                    return stop_step(m, '\t', m->esc_start, cut);
+                case 'u':
+                    m->esc = STOP_ESC_HEX;
+                    m->code = 0;
+                    return false;
+                default:
+                    return stop_step(m, (unsigned char)c, m->esc_start, cut);
+            }
+        case STOP_ESC_LOW:
+            if (c == '\\') {
+                m->esc = STOP_ESC_LOW_U;
+                return false;
+            }
+            // Lone high surrogate, then c on its own.
+            m->esc = STOP_ESC_NONE;
+            if (stop_step_code(m, m->high, m->esc_start, cut)) return true;
+            return stop_scan_byte(m, c, pos, cut);
+        case STOP_ESC_LOW_U:
+            if (c == 'u') {
+                m->esc = STOP_ESC_LOW_HEX;
+                m->code = 0;
+                return false;
+            }
+            // Lone high surrogate, then an ordinary escape starting at the previous byte.
+            if (stop_step_code(m, m->high, m->esc_start, cut)) return true;
+            m->esc = STOP_ESC_BACKSLASH;
+            m->esc_start = pos - 1;
+            return stop_scan_byte(m, c, pos, cut);
+        default:
+            break;
+    }
+
+    // Hex digits of \uXXXX or of the low surrogate that follows a high one.
+    v = stop_hexval(c);
+    m->code = (m->code << 4) | (uint32_t)(v < 0 ? 0 : v);
+    if (m->esc != STOP_ESC_HEX + 3 && m->esc != STOP_ESC_LOW_HEX + 3) {
+        m->esc++;
+        return false;
+    }
+    if (m->esc == STOP_ESC_HEX + 3) {
+        if (m->code >= 0xD800 && m->code < 0xDC00) {
+            m->high = m->code;
+            m->esc = STOP_ESC_LOW;
+            return false;
+        }
+        m->esc = STOP_ESC_NONE;
+        return stop_step_code(m, m->code, m->esc_start, cut);
+    }
+    m->esc = STOP_ESC_NONE;
+    if (m->code >= 0xDC00 && m->code < 0xE000) {
+        uint32_t cp = 0x10000 + ((m->high - 0xD800) << 10) + (m->code - 0xDC00);
+        return stop_step_code(m, cp, m->esc_start, cut);
+    }
+    if (stop_step_code(m, m->high, m->esc_start, cut)) return true;
+    return stop_step_code(m, m->code, pos - 5, cut);
+}
+
+bool stop_matcher_feed(stop_matcher_t* m, const char* delta, size_t len, stop_emit_cb emit, void* user_data) {
+    if (m->matched) return true;
+    if (!delta || len == 0) return false;
+    if (m->max_len == 0) {
+        if (emit) emit(user_data, delta, len);
+        m->offset += len;
+        m->emitted = m->offset;
+        return false;
+    }
+
+    size_t base = m->offset;
+    for (size_t i = 0; i < len; i++) {
+        size_t cut = 0;
+        if (stop_scan_byte(m, delta[i], base + i, &cut)) {
+            stop_emit_until(m, delta, cut, emit, user_data);
+            m->hold_len = 0;
+            m->offset = base + len;
+            m->matched = true;
+            return true;
+        }
+    }
+    m->offset = base + len;
+
+    // Everything before the oldest byte that may still start a match (or a pending escape) is final.
+    size_t depth = m->depth[m->state];
+    size_t safe = m->offset;
+    if (m->esc != STOP_ESC_NONE) safe = m->esc_start;
+    if (depth > 0) safe = m->starts[(m->decoded - depth) % m->max_len];
+    if (m->offset - safe > m->hold_cap) safe = m->offset - m->hold_cap;  // unreachable for valid escapes
+    if (safe < m->emitted) safe = m->emitted;
+
+    stop_emit_until(m, delta, safe, emit, user_data);
+    // The hold keeps [safe, offset): its own tail plus the unemitted part of delta.
+    size_t delta_from = (safe > base) ? safe - base : 0;
+    memcpy(m->hold + m->hold_len, delta + delta_from, len - delta_from);
+    m->hold_len += len - delta_from;
+    return false;
+}
+
+void stop_matcher_flush(stop_matcher_t* m, stop_emit_cb emit, void* user_data) {
+    if (m->matched || m->hold_len == 0) return;
+    if (emit) emit(user_data, m->hold, m->hold_len);
+    m->emitted += m->hold_len;
+    m->hold_len = 0;
+    m->state = 0;
+}
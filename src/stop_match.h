@@ -0,0 +1,53 @@
+#ifndef STOP_MATCH_H
+#define STOP_MATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "llm/internal.h"
+
+typedef void (*stop_emit_cb)(void* user_data, const char* delta, size_t len);
+
+// Client-side stop sequences over a stream of JSON-escaped content deltas. Stop strings are plain
+// (unescaped) bytes. Matching runs on the unescaped text through an Aho-Corasick automaton compiled to a
+// dense DFA over byte classes, so a match split across deltas or hidden behind escapes is still found.
+// Bytes that could still begin a stop string are held back; everything before them is emitted as
+// escaped slices, so output is cut exactly before the first (earliest-ending) match.
+typedef struct {
+    const llm_allocator_t* alloc;
+    uint16_t* next;     // nodes * classes transitions
+    uint16_t* out_len;  // longest stop string ending at this node, 0 if none
+    uint16_t* depth;
+    uint8_t class_of[256];
+    size_t classes;
+    size_t nodes;
+    size_t max_len;
+    size_t state;
+
+    int esc;  // unescape state for an escape split across input bytes
+    uint32_t code;
+    uint32_t high;  // pending high surrogate
+    size_t esc_start;
+
+    size_t* starts;   // ring of the escaped offset that produced each of the last max_len decoded bytes
+    size_t decoded;   // decoded bytes so far
+    size_t offset;    // escaped offset of the next input byte
+    size_t emitted;   // escaped bytes emitted so far
+    char* hold;       // escaped bytes in [emitted, offset)
+    size_t hold_len;
+    size_t hold_cap;
+    bool matched;
+} stop_matcher_t;
+
+// Empty stop strings are ignored. Returns false on allocation failure or too many pattern bytes.
+bool stop_matcher_init(stop_matcher_t* m, const char* const* stops, const size_t* lens, size_t count,
+                       const llm_allocator_t* alloc);
+void stop_matcher_free(stop_matcher_t* m);
+// Scans one escaped delta and emits what can no longer be part of a match (at most two emit calls).
+// Returns true once a stop string matched: the text before it has been emitted and the rest must be dropped.
+bool stop_matcher_feed(stop_matcher_t* m, const char* delta, size_t len, stop_emit_cb emit, void* user_data);
+// Emits held-back bytes at the end of the stream.
+void stop_matcher_flush(stop_matcher_t* m, stop_emit_cb emit, void* user_data);
+
+#endif  // STOP_MATCH_H
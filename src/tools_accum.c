@@ -3,46 +3,144 @@
 #include <stdlib.h>
 #include <string.h>
 
-void accum_init(struct tool_call_accumulator* acc) {
+enum { ACCUM_ESC_NONE = 0, ACCUM_ESC_BACKSLASH = 1, ACCUM_ESC_HEX = 2, ACCUM_VALIDATE_CHUNK = 256 };
+
+void accum_init(struct tool_call_accumulator* acc, const llm_allocator_t* alloc) {
     acc->id = NULL;
     acc->name = NULL;
-    growbuf_init(&acc->args_buf, 1024);
+    acc->alloc = alloc;
+    growbuf_init(&acc->args_buf, 1024, alloc);
     acc->active = false;
     acc->saw_args = false;
     acc->frozen = false;
+    jstok_init_chunked(&acc->args_parser);
+    acc->args_result = JSTOK_ERROR_PART;
+    acc->esc_state = ACCUM_ESC_NONE;
+    acc->esc_code = 0;
+    acc->args_invalid = false;
+    acc->completed = false;
 }
 
 void accum_free(struct tool_call_accumulator* acc) {
-    free(acc->id);
-    free(acc->name);
+    mem_free(acc->alloc, acc->id);
+    mem_free(acc->alloc, acc->name);
     growbuf_free(&acc->args_buf);
 }
 
-static char* strdup_span(const char* ptr, size_t len) {
-    if (!ptr) return NULL;
-    char* s = malloc(len + 1);
-    if (s) {
-        memcpy(s, ptr, len);
-        s[len] = '\0';
+static bool accum_validate_flush(struct tool_call_accumulator* acc, const char* buf, size_t len) {
+    acc->args_result = jstok_parse(&acc->args_parser, buf, (int)len, NULL, 0);
+    return acc->args_result >= 0 || acc->args_result == JSTOK_ERROR_PART;
+}
+
+static int accum_hexval(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Unescapes one fragment of the arguments string and feeds the result to the validator. Only ASCII can
+// be JSON structure, so any \u escape above 0x7f is passed on as a single non-ASCII placeholder byte.
+static bool accum_validate(struct tool_call_accumulator* acc, const char* frag, size_t len) {
+    char buf[ACCUM_VALIDATE_CHUNK];
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = frag[i];
+        if (acc->esc_state == ACCUM_ESC_NONE) {
+            if (c == '\\') {
+                acc->esc_state = ACCUM_ESC_BACKSLASH;
+                continue;
+            }
+        } else if (acc->esc_state == ACCUM_ESC_BACKSLASH) {
+            switch (c) {
+                case '"':
+                case '\\':
+                case '/':
+                    break;
+                case 'b':
+                    c = '\b';
+                    break;
+                case 'f':
+                    c = '\f';
+                    break;
+                case 'n':
+                    c = '\n';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'u':
+                    acc->esc_state = ACCUM_ESC_HEX;
+                    acc->esc_code = 0;
+                    continue;
+                default:
+                    return false;
+            }
+            acc->esc_state = ACCUM_ESC_NONE;
+        } else {
+            int v = accum_hexval(c);
+            if (v < 0) return false;
+            acc->esc_code = (acc->esc_code << 4) | (uint32_t)v;
+            if (++acc->esc_state < ACCUM_ESC_HEX + 4) continue;
+            c = (acc->esc_code < 0x80) ? (char)acc->esc_code : '\x80';
+            acc->esc_state = ACCUM_ESC_NONE;
+        }
+        buf[n++] = c;
+        if (n == sizeof(buf)) {
+            if (!accum_validate_flush(acc, buf, n)) return false;
+            n = 0;
+        }
+    }
+    return accum_validate_flush(acc, buf, n);
+}
+
+bool accum_args_complete(const struct tool_call_accumulator* acc) {
+    return !acc->args_invalid && acc->esc_state == ACCUM_ESC_NONE && acc->args_result > 0;
+}
+
+// A call handed out early may still receive fragments; only (escaped) whitespace is harmless there.
+static bool accum_trailing_ws(const char* frag, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (frag[i] == ' ') continue;
+        if (frag[i] == '\\' && i + 1 < len && (frag[i + 1] == 'n' || frag[i + 1] == 'r' || frag[i + 1] == 't')) {
+            i++;
+            continue;
+        }
+        return false;
     }
-    return s;
+    return true;
 }
 
 bool accum_feed_delta(struct tool_call_accumulator* acc, const llm_tool_call_delta_t* delta, size_t max_args_bytes) {
+    if (acc->args_invalid) return false;
+    if (acc->completed) {
+        if (!delta->arguments_fragment || accum_trailing_ws(delta->arguments_fragment, delta->arguments_fragment_len)) {
+            return true;
+        }
+        acc->args_invalid = true;
+        return false;
+    }
     if (acc->frozen) return false;
     acc->active = true;
 
     if (!acc->id && delta->id) {
-        acc->id = strdup_span(delta->id, delta->id_len);
+        acc->id = mem_strndup(acc->alloc, delta->id, delta->id_len);
     }
     if (!acc->name && delta->name) {
-        acc->name = strdup_span(delta->name, delta->name_len);
+        acc->name = mem_strndup(acc->alloc, delta->name, delta->name_len);
     }
     if (delta->arguments_fragment) {
         acc->saw_args = true;
         if (!growbuf_append(&acc->args_buf, delta->arguments_fragment, delta->arguments_fragment_len, max_args_bytes)) {
             return false;
         }
+        if (!accum_validate(acc, delta->arguments_fragment, delta->arguments_fragment_len)) {
+            acc->args_invalid = true;
+            return false;
+        }
     }
     return true;
 }
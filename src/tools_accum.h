@@ -2,22 +2,37 @@
 #define TOOLS_ACCUM_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "llm/internal.h"
 #include "llm/llm.h"
+#define JSTOK_HEADER
+#include <jstok.h>
 
 struct tool_call_accumulator {
     char* id;
     char* name;
     struct growbuf args_buf;
+    const llm_allocator_t* alloc;
     bool active;
     bool saw_args;
     bool frozen;
+
+    // Arguments arrive as fragments of a JSON-escaped string. Each fragment is unescaped on the fly
+    // (esc_state/esc_code carry a split escape) and pushed through a chunked, count-only jstok parser.
+    jstok_parser args_parser;
+    int args_result;  // last jstok_parse result
+    int esc_state;
+    uint32_t esc_code;
+    bool args_invalid;  // hard syntax error seen, accum_feed_delta fails from then on
+    bool completed;     // handed out before finish_reason (early completion); only whitespace may follow
 };
 
-void accum_init(struct tool_call_accumulator* acc);
+void accum_init(struct tool_call_accumulator* acc, const llm_allocator_t* alloc);
 void accum_free(struct tool_call_accumulator* acc);
 bool accum_feed_delta(struct tool_call_accumulator* acc, const llm_tool_call_delta_t* delta, size_t max_args_bytes);
 void accum_freeze(struct tool_call_accumulator* acc);
+// True once the arguments seen so far form one complete JSON value.
+bool accum_args_complete(const struct tool_call_accumulator* acc);
 
 #endif  // TOOLS_ACCUM_H
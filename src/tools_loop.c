@@ -1,4 +1,544 @@
-#include "llm/internal.h"
-#include "llm/llm.h"
+#include "tools_loop.h"
 
-// TODO: implement tool loop runner
\ No newline at end of file
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+
+#define JSTOK_HEADER
+#include <jstok.h>
+
+enum { TOOL_POOL_MAX_THREADS = 64, TOOL_ARENA_FIRST_BLOCK = 4096 };
+
+#define TOOL_ARENA_ALIGN _Alignof(max_align_t)
+#define TOOL_ARENA_ROUND(n) (((n) + TOOL_ARENA_ALIGN - 1) & ~(size_t)(TOOL_ARENA_ALIGN - 1))
+// Every allocation is preceded by its size so realloc can copy it.
+#define TOOL_ARENA_HDR TOOL_ARENA_ROUND(sizeof(size_t))
+
+static void tool_job_run(struct tool_pool* pool, struct tool_job* job) {
+    job->ok = pool->dispatch(pool->dispatch_user_data, job->name, job->name_len, job->args, job->args_len,
+                             &job->result, &job->result_len) &&
+              job->result != NULL;
+    if (!job->ok) atomic_store(&pool->failed, true);
+}
+
+static void* tool_pool_worker(void* arg) {
+    struct tool_pool* pool = arg;
+    pthread_mutex_lock(&pool->mu);
+    for (;;) {
+        while (!pool->head && !pool->stopping) {
+            pool->idle++;
+            pthread_cond_wait(&pool->work_cv, &pool->mu);
+            pool->idle--;
+        }
+        if (!pool->head) break;  // stopping with nothing queued
+        struct tool_job* job = pool->head;
+        pool->head = job->next;
+        if (!pool->head) pool->tail = NULL;
+        pthread_mutex_unlock(&pool->mu);
+
+        tool_job_run(pool, job);
+
+        pthread_mutex_lock(&pool->mu);
+        if (--pool->running == 0) pthread_cond_broadcast(&pool->done_cv);
+    }
+    pthread_mutex_unlock(&pool->mu);
+    return NULL;
+}
+
+bool tool_pool_init(struct tool_pool* pool, size_t max_threads, llm_tool_dispatch_cb dispatch, void* user_data,
+                    const llm_allocator_t* alloc) {
+    memset(pool, 0, sizeof(*pool));
+    atomic_init(&pool->failed, false);
+    if (!dispatch || max_threads == 0) return false;
+    if (max_threads > TOOL_POOL_MAX_THREADS) max_threads = TOOL_POOL_MAX_THREADS;
+    pool->dispatch = dispatch;
+    pool->dispatch_user_data = user_data;
+    pool->alloc = alloc;
+    pool->max_threads = max_threads;
+    pool->threads = mem_calloc(alloc, max_threads, sizeof(*pool->threads));
+    if (!pool->threads) return false;
+    if (pthread_mutex_init(&pool->mu, NULL) != 0) {
+        mem_free(alloc, pool->threads);
+        return false;
+    }
+    if (pthread_cond_init(&pool->work_cv, NULL) != 0) {
+        pthread_mutex_destroy(&pool->mu);
+        mem_free(alloc, pool->threads);
+        return false;
+    }
+    if (pthread_cond_init(&pool->done_cv, NULL) != 0) {
+        pthread_cond_destroy(&pool->work_cv);
+        pthread_mutex_destroy(&pool->mu);
+        mem_free(alloc, pool->threads);
+        return false;
+    }
+    return true;
+}
+
+struct tool_job* tool_pool_submit(struct tool_pool* pool, const char* name, size_t name_len, const char* args,
+                                  size_t args_len) {
+    if (pool->jobs_count == pool->jobs_cap) {
+        size_t cap = pool->jobs_cap ? pool->jobs_cap * 2 : 8;
+        struct tool_job** next = mem_realloc(pool->alloc, pool->jobs, cap * sizeof(*next));
+        if (!next) return NULL;
+        pool->jobs = next;
+        pool->jobs_cap = cap;
+    }
+    struct tool_job* job = mem_calloc(pool->alloc, 1, sizeof(*job));
+    if (!job) return NULL;
+    job->name = name;
+    job->name_len = name_len;
+    job->args = args;
+    job->args_len = args_len;
+    pool->jobs[pool->jobs_count++] = job;
+
+    pthread_mutex_lock(&pool->mu);
+    size_t queued = 1;
+    for (const struct tool_job* q = pool->head; q; q = q->next) queued++;
+    if (queued > pool->idle && pool->threads_count < pool->max_threads &&
+        pthread_create(&pool->threads[pool->threads_count], NULL, tool_pool_worker, pool) == 0) {
+        pool->threads_count++;
+    }
+    if (pool->threads_count == 0) {
+        // No worker could be started: dispatch here, as the sequential loop would.
+        pthread_mutex_unlock(&pool->mu);
+        tool_job_run(pool, job);
+        return job;
+    }
+    if (pool->tail) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    pool->running++;
+    pthread_cond_signal(&pool->work_cv);
+    pthread_mutex_unlock(&pool->mu);
+    return job;
+}
+
+bool tool_pool_failed(struct tool_pool* pool) { return atomic_load(&pool->failed); }
+
+void tool_pool_wait(struct tool_pool* pool) {
+    pthread_mutex_lock(&pool->mu);
+    while (pool->running > 0) pthread_cond_wait(&pool->done_cv, &pool->mu);
+    pthread_mutex_unlock(&pool->mu);
+}
+
+void tool_pool_reset(struct tool_pool* pool) {
+    for (size_t i = 0; i < pool->jobs_count; i++) {
+        free(pool->jobs[i]->result);
+        mem_free(pool->alloc, pool->jobs[i]);
+    }
+    pool->jobs_count = 0;
+    atomic_store(&pool->failed, false);
+}
+
+void tool_pool_destroy(struct tool_pool* pool) {
+    if (!pool->threads) return;
+    tool_pool_wait(pool);
+    pthread_mutex_lock(&pool->mu);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->mu);
+    for (size_t i = 0; i < pool->threads_count; i++) pthread_join(pool->threads[i], NULL);
+    tool_pool_reset(pool);
+    mem_free(pool->alloc, pool->jobs);
+    mem_free(pool->alloc, pool->threads);
+    pthread_cond_destroy(&pool->done_cv);
+    pthread_cond_destroy(&pool->work_cv);
+    pthread_mutex_destroy(&pool->mu);
+    memset(pool, 0, sizeof(*pool));
+}
+
+struct tool_arena_block {
+    struct tool_arena_block* next;
+    size_t cap;
+    size_t used;
+    size_t last;  // offset of the newest allocation's header, for in-place growth
+};
+
+#define TOOL_ARENA_BLOCK_HDR TOOL_ARENA_ROUND(sizeof(struct tool_arena_block))
+
+static unsigned char* tool_arena_data(struct tool_arena_block* b) { return (unsigned char*)b + TOOL_ARENA_BLOCK_HDR; }
+
+static void* tool_arena_alloc(void* user_data, size_t size) {
+    struct tool_arena* arena = user_data;
+    if (size > SIZE_MAX / 2 - TOOL_ARENA_BLOCK_HDR - TOOL_ARENA_HDR - TOOL_ARENA_ALIGN) return NULL;
+    size_t need = TOOL_ARENA_HDR + TOOL_ARENA_ROUND(size);
+    struct tool_arena_block* b = arena->head;
+    if (!b || b->cap - b->used < need) {
+        size_t cap = b ? b->cap * 2 : TOOL_ARENA_FIRST_BLOCK;
+        if (cap < need) cap = need;
+        struct tool_arena_block* next = mem_alloc(arena->backing, TOOL_ARENA_BLOCK_HDR + cap);
+        if (!next) return NULL;
+        next->next = b;
+        next->cap = cap;
+        next->used = 0;
+        next->last = 0;
+        arena->head = next;
+        b = next;
+    }
+    unsigned char* hdr = tool_arena_data(b) + b->used;
+    memcpy(hdr, &size, sizeof(size));
+    b->last = b->used;
+    b->used += need;
+    return hdr + TOOL_ARENA_HDR;
+}
+
+static void* tool_arena_realloc(void* user_data, void* ptr, size_t size) {
+    struct tool_arena* arena = user_data;
+    if (!ptr) return tool_arena_alloc(user_data, size);
+    unsigned char* hdr = (unsigned char*)ptr - TOOL_ARENA_HDR;
+    size_t old_size;
+    memcpy(&old_size, hdr, sizeof(old_size));
+    struct tool_arena_block* b = arena->head;
+    if (hdr == tool_arena_data(b) + b->last && size <= b->cap - b->last - TOOL_ARENA_HDR) {
+        // Newest allocation: grow or shrink in place.
+        memcpy(hdr, &size, sizeof(size));
+        b->used = b->last + TOOL_ARENA_HDR + TOOL_ARENA_ROUND(size);
+        return ptr;
+    }
+    if (size <= old_size) return ptr;
+    void* next = tool_arena_alloc(user_data, size);
+    if (next) memcpy(next, ptr, old_size);
+    return next;
+}
+
+static void tool_arena_free(void* user_data, void* ptr) {
+    (void)user_data;
+    (void)ptr;
+}
+
+void tool_arena_init(struct tool_arena* arena, const llm_allocator_t* backing) {
+    arena->backing = backing;
+    arena->head = NULL;
+}
+
+llm_allocator_t tool_arena_allocator(struct tool_arena* arena) {
+    llm_allocator_t a = {tool_arena_alloc, tool_arena_realloc, tool_arena_free, arena};
+    return a;
+}
+
+void tool_arena_destroy(struct tool_arena* arena) {
+    while (arena->head) {
+        struct tool_arena_block* next = arena->head->next;
+        mem_free(arena->backing, arena->head);
+        arena->head = next;
+    }
+}
+
+bool tool_history_init(struct tool_history* h, const llm_allocator_t* backing, const llm_message_t* initial,
+                       size_t initial_count) {
+    memset(h, 0, sizeof(*h));
+    h->backing = backing;
+    tool_arena_init(&h->arena, backing);
+    h->alloc = tool_arena_allocator(&h->arena);
+    for (size_t i = 0; i < initial_count; i++) {
+        const llm_message_t* m = &initial[i];
+        if (m->content_json_len && !m->content_json) return false;
+        if (m->content && m->content_json) return false;
+        if (m->content_json && m->content_json_len == 0) return false;
+    }
+    if (!tool_history_reserve(h, initial_count)) return false;
+    if (initial_count) memcpy(h->msgs, initial, initial_count * sizeof(*initial));
+    h->count = initial_count;
+    return true;
+}
+
+bool tool_history_reserve(struct tool_history* h, size_t extra) {
+    if (extra > SIZE_MAX / sizeof(llm_message_t) / 2 - h->count) return false;
+    size_t need = h->count + extra;
+    if (need <= h->cap && h->msgs) return true;
+    size_t cap = h->cap ? h->cap : 8;
+    while (cap < need) cap *= 2;
+    llm_message_t* next = mem_realloc(h->backing, h->msgs, cap * sizeof(*next));
+    if (!next) return false;
+    h->msgs = next;
+    h->cap = cap;
+    return true;
+}
+
+void tool_history_free(struct tool_history* h) {
+    mem_free(h->backing, h->msgs);
+    tool_arena_destroy(&h->arena);
+    h->msgs = NULL;
+    h->count = 0;
+    h->cap = 0;
+}
+
+// Fresh key for one cache, so chain lengths cannot be planned ahead of the run. Falls back to /dev/urandom and,
+// failing that, to the clock and the cache's address.
+static void tool_cache_seed(struct tool_cache* cache) {
+    unsigned char* key = (unsigned char*)cache->seed;
+    if (getrandom(key, sizeof(cache->seed), GRND_NONBLOCK) == (ssize_t)sizeof(cache->seed)) return;
+    FILE* f = fopen("/dev/urandom", "rb");
+    size_t got = f ? fread(key, 1, sizeof(cache->seed), f) : 0;
+    if (f) fclose(f);
+    if (got == sizeof(cache->seed)) return;
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    cache->seed[0] ^= (uint64_t)ts.tv_sec * 1000000007ULL ^ (uint64_t)ts.tv_nsec;
+    cache->seed[1] ^= (uint64_t)(uintptr_t)cache ^ ((uint64_t)clock() << 32);
+}
+
+bool tool_cache_init(struct tool_cache* cache, const llm_allocator_t* alloc, size_t max_entries,
+                     const char* const* cacheable, size_t cacheable_count) {
+    memset(cache, 0, sizeof(*cache));
+    if (max_entries == 0 || !cacheable || cacheable_count == 0) return false;
+    if (max_entries > SIZE_MAX / 4) return false;
+    size_t buckets = 16;
+    while (buckets < max_entries * 2) buckets *= 2;
+    cache->entries = mem_calloc(alloc, max_entries, sizeof(*cache->entries));
+    cache->buckets = mem_calloc(alloc, buckets, sizeof(*cache->buckets));
+    if (!cache->entries || !cache->buckets) {
+        mem_free(alloc, cache->entries);
+        mem_free(alloc, cache->buckets);
+        cache->entries = NULL;
+        cache->buckets = NULL;
+        return false;
+    }
+    cache->bucket_mask = buckets - 1;
+    cache->alloc = alloc;
+    cache->cacheable = cacheable;
+    cache->cacheable_count = cacheable_count;
+    cache->cap = max_entries;
+    growbuf_init(&cache->scratch, 0, alloc);
+    tool_cache_seed(cache);
+    return true;
+}
+
+static bool tool_cache_qualifies(const struct tool_cache* cache, const char* name, size_t name_len) {
+    for (size_t i = 0; i < cache->cacheable_count; i++) {
+        const char* c = cache->cacheable[i];
+        if (c && strlen(c) == name_len && memcmp(c, name, name_len) == 0) return true;
+    }
+    return false;
+}
+
+struct canon_member {
+    const char* key;
+    size_t key_len;
+    int idx;
+};
+
+static int canon_member_cmp(const void* a, const void* b) {
+    const struct canon_member* x = a;
+    const struct canon_member* y = b;
+    size_t n = x->key_len < y->key_len ? x->key_len : y->key_len;
+    int c = memcmp(x->key, y->key, n);
+    if (c) return c;
+    if (x->key_len != y->key_len) return (x->key_len > y->key_len) - (x->key_len < y->key_len);
+    // Duplicate keys keep their source order; qsort is not stable.
+    return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+// Writes the value at toks[idx] without whitespace and with object members sorted by key; returns the index
+// after its subtree, or -1.
+static int canon_emit(const char* json, const jstoktok_t* toks, int count, int idx, struct growbuf* out,
+                      const llm_allocator_t* alloc) {
+    const jstoktok_t* tok = &toks[idx];
+    if (tok->type == JSTOK_STRING) {
+        bool ok = growbuf_append(out, "\"", 1, 0) && growbuf_append(out, json + tok->start, tok->end - tok->start, 0) &&
+                  growbuf_append(out, "\"", 1, 0);
+        return ok ? idx + 1 : -1;
+    }
+    if (tok->type == JSTOK_PRIMITIVE) {
+        return growbuf_append(out, json + tok->start, tok->end - tok->start, 0) ? idx + 1 : -1;
+    }
+    int next = idx + 1;
+    if (tok->type == JSTOK_ARRAY) {
+        if (!growbuf_append(out, "[", 1, 0)) return -1;
+        for (int i = 0; i < tok->size && next >= 0; i++) {
+            if (i && !growbuf_append(out, ",", 1, 0)) return -1;
+            next = canon_emit(json, toks, count, next, out, alloc);
+        }
+        return next >= 0 && growbuf_append(out, "]", 1, 0) ? next : -1;
+    }
+    if (tok->type != JSTOK_OBJECT) return -1;
+    struct canon_member* members = NULL;
+    if (tok->size > 0) {
+        members = mem_alloc(alloc, (size_t)tok->size * sizeof(*members));
+        if (!members) return -1;
+    }
+    for (int i = 0; i < tok->size; i++) {
+        if (next < 0 || next >= count || toks[next].type != JSTOK_STRING) {
+            mem_free(alloc, members);
+            return -1;
+        }
+        members[i].key = json + toks[next].start;
+        members[i].key_len = (size_t)(toks[next].end - toks[next].start);
+        members[i].idx = next;
+        next = jstok_skip(toks, count, next + 1);
+    }
+    if (tok->size > 1) qsort(members, (size_t)tok->size, sizeof(*members), canon_member_cmp);
+    bool ok = growbuf_append(out, "{", 1, 0);
+    for (int i = 0; ok && i < tok->size; i++) {
+        ok = (i == 0 || growbuf_append(out, ",", 1, 0)) &&
+             canon_emit(json, toks, count, members[i].idx, out, alloc) >= 0 && growbuf_append(out, ":", 1, 0) &&
+             canon_emit(json, toks, count, members[i].idx + 1, out, alloc) >= 0;
+    }
+    mem_free(alloc, members);
+    return ok && growbuf_append(out, "}", 1, 0) ? next : -1;
+}
+
+bool tool_call_key(struct growbuf* key, const llm_allocator_t* alloc, const char* name, size_t name_len,
+                   const char* args, size_t args_len) {
+    key->len = 0;
+    key->nomem = false;
+    if (!growbuf_append(key, name, name_len, 0) || !growbuf_append(key, "", 1, 0)) return false;
+    size_t prefix = key->len;
+    bool canonical = false;
+    if (args_len && args_len <= (size_t)INT_MAX) {
+        jstok_parser parser;
+        jstok_init(&parser);
+        int needed = jstok_parse(&parser, args, (int)args_len, NULL, 0);
+        jstoktok_t* toks = needed > 0 ? mem_alloc(alloc, (size_t)needed * sizeof(*toks)) : NULL;
+        if (toks) {
+            jstok_init(&parser);
+            int parsed = jstok_parse(&parser, args, (int)args_len, toks, needed);
+            // A single value must account for every token; anything else is keyed as is.
+            canonical = parsed > 0 && jstok_skip(toks, parsed, 0) == parsed &&
+                        canon_emit(args, toks, parsed, 0, key, alloc) >= 0;
+            mem_free(alloc, toks);
+        }
+    }
+    if (!canonical) {
+        key->len = prefix;
+        key->nomem = false;
+        if (!growbuf_append(key, args, args_len, 0)) return false;
+    }
+    return true;
+}
+
+#define SIP_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIP_ROUND(v0, v1, v2, v3) \
+    do {                          \
+        v0 += v1;                 \
+        v1 = SIP_ROTL(v1, 13);    \
+        v1 ^= v0;                 \
+        v0 = SIP_ROTL(v0, 32);    \
+        v2 += v3;                 \
+        v3 = SIP_ROTL(v3, 16);    \
+        v3 ^= v2;                 \
+        v0 += v3;                 \
+        v3 = SIP_ROTL(v3, 21);    \
+        v3 ^= v0;                 \
+        v2 += v1;                 \
+        v1 = SIP_ROTL(v1, 17);    \
+        v1 ^= v2;                 \
+        v2 = SIP_ROTL(v2, 32);    \
+    } while (0)
+
+static uint64_t sip_load_le(const unsigned char* p, size_t n) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+// SipHash-2-4: a keyed hash, so model-chosen arguments cannot be made to collide into one long chain.
+static uint64_t siphash24(const uint64_t key[2], const unsigned char* data, size_t len) {
+    uint64_t v0 = key[0] ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = key[1] ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = key[0] ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = key[1] ^ 0x7465646279746573ULL;
+    size_t whole = len - len % 8;
+    for (size_t i = 0; i < whole; i += 8) {
+        uint64_t m = sip_load_le(data + i, 8);
+        v3 ^= m;
+        SIP_ROUND(v0, v1, v2, v3);
+        SIP_ROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    uint64_t last = ((uint64_t)len << 56) | sip_load_le(data + whole, len % 8);
+    v3 ^= last;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= last;
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; i++) SIP_ROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// Builds the call's key into scratch.
+static bool tool_cache_key(struct tool_cache* cache, const char* name, size_t name_len, const char* args,
+                           size_t args_len, uint64_t* hash) {
+    struct growbuf* key = &cache->scratch;
+    if (!tool_call_key(key, cache->alloc, name, name_len, args, args_len)) return false;
+    *hash = siphash24(cache->seed, (const unsigned char*)key->data, key->len);
+    return true;
+}
+
+bool tool_cache_get(struct tool_cache* cache, const char* name, size_t name_len, const char* args, size_t args_len,
+                    char** result, size_t* result_len) {
+    if (!tool_cache_qualifies(cache, name, name_len)) return false;
+    uint64_t hash;
+    if (!tool_cache_key(cache, name, name_len, args, args_len, &hash)) return false;
+    for (size_t i = cache->buckets[hash & cache->bucket_mask]; i; i = cache->entries[i - 1].next) {
+        const struct tool_cache_entry* e = &cache->entries[i - 1];
+        if (e->hash != hash || e->key_len != cache->scratch.len || memcmp(e->key, cache->scratch.data, e->key_len)) {
+            continue;
+        }
+        // Results go back through the dispatch contract, which hands over malloc'd memory.
+        char* copy = malloc(e->result_len + 1);
+        if (!copy) return false;
+        memcpy(copy, e->result, e->result_len);
+        copy[e->result_len] = '\0';
+        *result = copy;
+        *result_len = e->result_len;
+        cache->hits++;
+        return true;
+    }
+    cache->misses++;
+    return false;
+}
+
+void tool_cache_put(struct tool_cache* cache, const char* name, size_t name_len, const char* args, size_t args_len,
+                    const char* result, size_t result_len) {
+    if (!tool_cache_qualifies(cache, name, name_len)) return;
+    uint64_t hash;
+    if (!tool_cache_key(cache, name, name_len, args, args_len, &hash)) return;
+    char* key = mem_strndup(cache->alloc, cache->scratch.data, cache->scratch.len);
+    char* res = mem_strndup(cache->alloc, result, result_len);
+    if (!key || !res) {
+        mem_free(cache->alloc, key);
+        mem_free(cache->alloc, res);
+        return;
+    }
+    size_t slot;
+    if (cache->count < cache->cap) {
+        slot = cache->count++;
+    } else {
+        slot = cache->next_evict;
+        cache->next_evict = (cache->next_evict + 1) % cache->cap;
+        struct tool_cache_entry* old = &cache->entries[slot];
+        size_t* link = &cache->buckets[old->hash & cache->bucket_mask];
+        while (*link != slot + 1) link = &cache->entries[*link - 1].next;
+        *link = old->next;
+        mem_free(cache->alloc, old->key);
+        mem_free(cache->alloc, old->result);
+    }
+    struct tool_cache_entry* e = &cache->entries[slot];
+    size_t* bucket = &cache->buckets[hash & cache->bucket_mask];
+    e->next = *bucket;
+    *bucket = slot + 1;
+    e->hash = hash;
+    e->key = key;
+    e->key_len = cache->scratch.len;
+    e->result = res;
+    e->result_len = result_len;
+}
+
+void tool_cache_destroy(struct tool_cache* cache) {
+    for (size_t i = 0; i < cache->count; i++) {
+        mem_free(cache->alloc, cache->entries[i].key);
+        mem_free(cache->alloc, cache->entries[i].result);
+    }
+    mem_free(cache->alloc, cache->entries);
+    mem_free(cache->alloc, cache->buckets);
+    growbuf_free(&cache->scratch);
+    memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,141 @@
+#ifndef TOOLS_LOOP_H
+#define TOOLS_LOOP_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "llm/internal.h"
+#include "llm/llm.h"
+
+// One dispatch handed to the pool. name and args are borrowed and must outlive tool_pool_wait.
+struct tool_job {
+    const char* name;
+    size_t name_len;
+    const char* args;
+    size_t args_len;
+    char* result;  // from dispatch, caller's malloc
+    size_t result_len;
+    bool ok;
+    struct tool_job* next;  // queue link
+};
+
+// Bounded worker pool running llm_tool_dispatch_cb concurrently. Threads start lazily, one per submitted
+// job up to max_threads, and are reused across turns. All pool state is touched under mu; jobs and
+// their bookkeeping are allocated on the submitting thread only, so the client allocator need not be
+// thread-safe.
+struct tool_pool {
+    llm_tool_dispatch_cb dispatch;
+    void* dispatch_user_data;
+    const llm_allocator_t* alloc;
+    pthread_mutex_t mu;
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    pthread_t* threads;
+    size_t threads_count;
+    size_t max_threads;
+    size_t idle;
+    struct tool_job* head;  // queued, not yet started
+    struct tool_job* tail;
+    struct tool_job** jobs;  // every job since the last reset, in submission order
+    size_t jobs_count;
+    size_t jobs_cap;
+    size_t running;  // queued or in dispatch
+    bool stopping;
+    atomic_bool failed;  // some dispatch since the last reset returned false; readable without mu
+};
+
+bool tool_pool_init(struct tool_pool* pool, size_t max_threads, llm_tool_dispatch_cb dispatch, void* user_data,
+                    const llm_allocator_t* alloc);
+// Queues a dispatch. Falls back to running it on the calling thread when no worker can be started.
+struct tool_job* tool_pool_submit(struct tool_pool* pool, const char* name, size_t name_len, const char* args,
+                                  size_t args_len);
+// True once a dispatch of the current batch has failed, so a caller can give up before tool_pool_wait.
+bool tool_pool_failed(struct tool_pool* pool);
+// Blocks until every submitted job has finished.
+void tool_pool_wait(struct tool_pool* pool);
+// Frees the jobs of the last batch along with any result nobody took; call after tool_pool_wait.
+void tool_pool_reset(struct tool_pool* pool);
+void tool_pool_destroy(struct tool_pool* pool);
+
+// Per-run arena for the messages a tool loop generates. Blocks come from the backing allocator and grow
+// geometrically; free is a no-op and everything is released together by tool_arena_destroy.
+struct tool_arena_block;
+struct tool_arena {
+    const llm_allocator_t* backing;
+    struct tool_arena_block* head;
+};
+
+void tool_arena_init(struct tool_arena* arena, const llm_allocator_t* backing);
+// Hooks bound to arena; arena must not move while they are in use.
+llm_allocator_t tool_arena_allocator(struct tool_arena* arena);
+void tool_arena_destroy(struct tool_arena* arena);
+
+// Tool loop history. The first initial_count entries borrow the caller's messages: they are shallow copies
+// whose strings still point into caller memory. Messages appended by the loop are allocated from arena, so a
+// run costs memory in proportion to what it generates, not to the size of the seed conversation.
+struct tool_history {
+    const llm_allocator_t* backing;
+    llm_message_t* msgs;
+    size_t count;
+    size_t cap;
+    struct tool_arena arena;
+    llm_allocator_t alloc;  // arena hooks for appended messages
+};
+
+// Validates and borrows initial; h must not move afterwards.
+bool tool_history_init(struct tool_history* h, const llm_allocator_t* backing, const llm_message_t* initial,
+                       size_t initial_count);
+// Makes room for extra more messages.
+bool tool_history_reserve(struct tool_history* h, size_t extra);
+void tool_history_free(struct tool_history* h);
+
+// Bounded memo of tool results for one run. Only tools named in cacheable qualify; a call hits when its name
+// and canonical arguments (whitespace dropped, object keys sorted, duplicate keys left in source order) match a
+// stored call byte for byte. The 64-bit hash picks the bucket and only narrows the search; it is keyed per cache
+// (SipHash-2-4 under a random seed), so arguments cannot be picked to pile up in one chain. When full, the oldest
+// entry is evicted.
+struct tool_cache_entry {
+    uint64_t hash;
+    char* key;  // name, NUL, canonical arguments
+    size_t key_len;
+    char* result;
+    size_t result_len;
+    size_t next;  // next entry in the same bucket, plus one; 0 ends the chain
+};
+
+struct tool_cache {
+    const llm_allocator_t* alloc;
+    const char* const* cacheable;
+    size_t cacheable_count;
+    struct tool_cache_entry* entries;
+    size_t* buckets;  // first entry of each chain, plus one; a power of two at least twice cap
+    size_t bucket_mask;
+    size_t count;
+    size_t cap;
+    size_t next_evict;
+    uint64_t seed[2];        // hash key, drawn at init
+    struct growbuf scratch;  // key of the current lookup
+    size_t hits;
+    size_t misses;
+};
+
+bool tool_cache_init(struct tool_cache* cache, const llm_allocator_t* alloc, size_t max_entries,
+                     const char* const* cacheable, size_t cacheable_count);
+// args must be plain (unescaped) JSON. On a hit, *result is a malloc'd copy for the caller. Returns false on a
+// miss, for tools that do not qualify, and when out of memory.
+bool tool_cache_get(struct tool_cache* cache, const char* name, size_t name_len, const char* args, size_t args_len,
+                    char** result, size_t* result_len);
+// Stores a copy of result for a call that missed. Best effort: a failed store leaves the cache unchanged.
+void tool_cache_put(struct tool_cache* cache, const char* name, size_t name_len, const char* args, size_t args_len,
+                    const char* result, size_t result_len);
+void tool_cache_destroy(struct tool_cache* cache);
+
+// Builds a call's cache key into key: name, NUL, canonical arguments. Arguments that do not parse are kept
+// verbatim. Returns false when out of memory.
+bool tool_call_key(struct growbuf* key, const llm_allocator_t* alloc, const char* name, size_t name_len,
+                   const char* args, size_t args_len);
+
+#endif  // TOOLS_LOOP_H
@@ -1,6 +1,7 @@
 #include "transport_curl.h"
 
 #include <curl/curl.h>
+#include <poll.h>
 
 #include "llm/internal.h"
 #include "llm/llm.h"
@@ -157,13 +158,13 @@ static size_t write_cb(void* ptr, size_t size, size_t nmemb, void* userdata) {
 
 bool http_get(const char* url, long timeout_ms, size_t max_response_bytes, const char* const* headers,
               size_t headers_count, const llm_tls_config_t* tls, const char* proxy_url, const char* no_proxy,
-              char** body, size_t* len, llm_transport_status_t* status) {
+              const llm_allocator_t* alloc, char** body, size_t* len, llm_transport_status_t* status) {
     CURL* curl = curl_easy_init();
     if (!curl) return false;
     transport_status_init(status);
 
     struct growbuf buf;
-    growbuf_init(&buf, 4096);
+    growbuf_init(&buf, 4096, alloc);
     struct write_ctx ctx = {&buf, max_response_bytes};
 
     struct curl_slist* header_list = NULL;
@@ -224,13 +225,14 @@ bool http_get(const char* url, long timeout_ms, size_t max_response_bytes, const
 
 bool http_post(const char* url, const char* json_body, long timeout_ms, size_t max_response_bytes,
                const char* const* headers, size_t headers_count, const llm_tls_config_t* tls, const char* proxy_url,
-               const char* no_proxy, char** body, size_t* len, llm_transport_status_t* status) {
+               const char* no_proxy, const llm_allocator_t* alloc, char** body, size_t* len,
+               llm_transport_status_t* status) {
     CURL* curl = curl_easy_init();
     if (!curl) return false;
     transport_status_init(status);
 
     struct growbuf buf;
-    growbuf_init(&buf, 4096);
+    growbuf_init(&buf, 4096, alloc);
     struct write_ctx ctx = {&buf, max_response_bytes};
 
     struct curl_slist* header_list = NULL;
@@ -297,9 +299,57 @@ static size_t stream_write_cb(void* ptr, size_t size, size_t nmemb, void* userda
     return realsize;
 }
 
+static bool fd_readable(int fd) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+// curl_easy_perform that also returns as soon as cancel_fd turns readable. Removing an unfinished transfer
+// from its multi handle closes the connection, which is how the server learns the client is gone.
+static CURLcode perform_cancellable(CURL* curl, int cancel_fd) {
+    if (cancel_fd < 0) return curl_easy_perform(curl);
+    if (fd_readable(cancel_fd)) return CURLE_ABORTED_BY_CALLBACK;
+    CURLM* multi = curl_multi_init();
+    if (!multi) return CURLE_OUT_OF_MEMORY;
+    if (curl_multi_add_handle(multi, curl) != CURLM_OK) {
+        curl_multi_cleanup(multi);
+        return CURLE_FAILED_INIT;
+    }
+    CURLcode res = CURLE_OK;
+    for (;;) {
+        int running = 0;
+        if (curl_multi_perform(multi, &running) != CURLM_OK) {
+            res = CURLE_FAILED_INIT;
+            break;
+        }
+        CURLMsg* msg;
+        int left = 0;
+        bool done = false;
+        while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+            if (msg->msg == CURLMSG_DONE) {
+                res = msg->data.result;
+                done = true;
+            }
+        }
+        if (done || running == 0) break;
+        struct curl_waitfd wait_fd = {cancel_fd, CURL_WAIT_POLLIN, 0};
+        if (curl_multi_poll(multi, &wait_fd, 1, 1000, NULL) != CURLM_OK) {
+            res = CURLE_FAILED_INIT;
+            break;
+        }
+        if (wait_fd.revents & CURL_WAIT_POLLIN) {
+            res = CURLE_ABORTED_BY_CALLBACK;
+            break;
+        }
+    }
+    curl_multi_remove_handle(multi, curl);
+    curl_multi_cleanup(multi);
+    return res;
+}
+
 bool http_post_stream(const char* url, const char* json_body, long timeout_ms, long read_idle_timeout_ms,
                       const char* const* headers, size_t headers_count, const llm_tls_config_t* tls,
-                      const char* proxy_url, const char* no_proxy, stream_cb cb, void* user_data,
+                      const char* proxy_url, const char* no_proxy, stream_cb cb, void* user_data, int cancel_fd,
                       llm_transport_status_t* status) {
     CURL* curl = curl_easy_init();
     if (!curl) return false;
@@ -342,7 +392,7 @@ bool http_post_stream(const char* url, const char* json_body, long timeout_ms, l
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, stream_write_cb);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ctx);
 
-    CURLcode res = curl_easy_perform(curl);
+    CURLcode res = perform_cancellable(curl, cancel_fd);
     bool success = (res == CURLE_OK);
     if (status) {
         status->curl_code = res;
@@ -358,3 +408,167 @@ bool http_post_stream(const char* url, const char* json_body, long timeout_ms, l
     memset(key_pass_buf, 0, sizeof(key_pass_buf));
     return success;
 }
+
+struct batch_slot {
+    CURL* curl;
+    size_t index;
+    struct growbuf buf;
+    struct write_ctx ctx;
+    char key_pass_buf[1024];
+};
+
+static void batch_slot_release(CURLM* multi, struct batch_slot* slot) {
+    curl_multi_remove_handle(multi, slot->curl);
+    curl_easy_cleanup(slot->curl);
+    slot->curl = NULL;
+    memset(slot->key_pass_buf, 0, sizeof(slot->key_pass_buf));
+}
+
+// Starts item index in slot. On failure the item has been reported to done_cb and the slot stays free.
+static void batch_slot_start(CURLM* multi, struct batch_slot* slot, size_t index, const char* url, long timeout_ms,
+                             size_t max_response_bytes, struct curl_slist* header_list, const llm_tls_config_t* tls,
+                             const char* proxy_url, const char* no_proxy, const llm_allocator_t* alloc,
+                             batch_body_cb body_cb, batch_done_cb done_cb, void* user_data) {
+    llm_transport_status_t status;
+    transport_status_init(&status);
+    const char* json_body = body_cb(index, user_data);
+    CURL* curl = json_body ? curl_easy_init() : NULL;
+    if (!curl) {
+        done_cb(index, false, NULL, 0, &status, user_data);
+        return;
+    }
+    slot->curl = curl;
+    slot->index = index;
+    growbuf_init(&slot->buf, 4096, alloc);
+    slot->ctx.buf = &slot->buf;
+    slot->ctx.max_bytes = max_response_bytes;
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    if (!apply_tls_config(curl, tls, slot->key_pass_buf, sizeof(slot->key_pass_buf))) {
+        status.tls_error = true;
+        status.curl_code = CURLE_SSL_CONNECT_ERROR;
+        curl_easy_cleanup(curl);
+        slot->curl = NULL;
+        memset(slot->key_pass_buf, 0, sizeof(slot->key_pass_buf));
+        growbuf_free(&slot->buf);
+        done_cb(index, false, NULL, 0, &status, user_data);
+        return;
+    }
+    apply_proxy_config(curl, proxy_url, no_proxy);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_body);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, timeout_ms > 10000 ? 10000 : timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &slot->ctx);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, slot);
+    // Wait for an in-flight connection to the same host rather than opening another one for every slot.
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    if (curl_multi_add_handle(multi, curl) != CURLM_OK) {
+        curl_easy_cleanup(curl);
+        slot->curl = NULL;
+        memset(slot->key_pass_buf, 0, sizeof(slot->key_pass_buf));
+        growbuf_free(&slot->buf);
+        done_cb(index, false, NULL, 0, &status, user_data);
+    }
+}
+
+static void batch_slot_finish(CURLM* multi, struct batch_slot* slot, CURLcode res, size_t max_response_bytes,
+                              batch_done_cb done_cb, void* user_data) {
+    llm_transport_status_t status;
+    transport_status_init(&status);
+    status.curl_code = res;
+    bool success = (res == CURLE_OK);
+    char* body = NULL;
+    size_t len = 0;
+    if (success) {
+        curl_easy_getinfo(slot->curl, CURLINFO_RESPONSE_CODE, &status.http_status);
+        if (growbuf_append(&slot->buf, "", 1, max_response_bytes + 1)) {
+            slot->buf.len--;
+        }
+        body = slot->buf.data;
+        len = slot->buf.len;
+    } else {
+        status.tls_error = curl_is_tls_error(res);
+        growbuf_free(&slot->buf);
+    }
+    batch_slot_release(multi, slot);
+    done_cb(slot->index, success, body, len, &status, user_data);
+}
+
+bool http_post_batch(const char* url, size_t count, size_t max_in_flight, long timeout_ms, size_t max_response_bytes,
+                     const char* const* headers, size_t headers_count, const llm_tls_config_t* tls,
+                     const char* proxy_url, const char* no_proxy, const llm_allocator_t* alloc, batch_body_cb body_cb,
+                     batch_done_cb done_cb, void* user_data) {
+    if (!done_cb) return false;
+    if (count == 0) return true;
+    if (max_in_flight == 0) max_in_flight = 1;
+    if (max_in_flight > count) max_in_flight = count;
+
+    llm_transport_status_t failed;
+    transport_status_init(&failed);
+    CURLM* multi = body_cb ? curl_multi_init() : NULL;
+    struct batch_slot* slots = multi ? mem_calloc(alloc, max_in_flight, sizeof(*slots)) : NULL;
+    if (!slots) {
+        if (multi) curl_multi_cleanup(multi);
+        for (size_t i = 0; i < count; i++) done_cb(i, false, NULL, 0, &failed, user_data);
+        return false;
+    }
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)max_in_flight);
+
+    struct curl_slist* header_list = NULL;
+    header_list = curl_slist_append(header_list, "Content-Type: application/json");
+    header_list = append_headers(header_list, headers, headers_count);
+
+    size_t next = 0;
+    size_t active = 0;
+    bool ok = true;
+    for (;;) {
+        for (size_t s = 0; s < max_in_flight && next < count; s++) {
+            if (slots[s].curl) continue;
+            batch_slot_start(multi, &slots[s], next++, url, timeout_ms, max_response_bytes, header_list, tls,
+                             proxy_url, no_proxy, alloc, body_cb, done_cb, user_data);
+            if (slots[s].curl) active++;
+        }
+        if (active == 0) {
+            if (next < count) continue;
+            break;
+        }
+
+        int running = 0;
+        if (curl_multi_perform(multi, &running) != CURLM_OK) {
+            ok = false;
+            break;
+        }
+        CURLMsg* msg;
+        int left = 0;
+        bool freed = false;
+        while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            struct batch_slot* slot = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&slot);
+            if (!slot) continue;
+            batch_slot_finish(multi, slot, msg->data.result, max_response_bytes, done_cb, user_data);
+            active--;
+            freed = true;
+        }
+        if (!freed && running > 0 && curl_multi_poll(multi, NULL, 0, 1000, NULL) != CURLM_OK) {
+            ok = false;
+            break;
+        }
+    }
+
+    // Only reached early when the multi interface fails: whatever is left fails too.
+    for (size_t s = 0; s < max_in_flight; s++) {
+        if (!slots[s].curl) continue;
+        growbuf_free(&slots[s].buf);
+        batch_slot_release(multi, &slots[s]);
+        done_cb(slots[s].index, false, NULL, 0, &failed, user_data);
+    }
+    for (; next < count; next++) done_cb(next, false, NULL, 0, &failed, user_data);
+    mem_free(alloc, slots);
+    curl_slist_free_all(header_list);
+    curl_multi_cleanup(multi);
+    return ok;
+}
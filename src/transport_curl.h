@@ -4,7 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 
-typedef struct llm_tls_config llm_tls_config_t;
+#include "llm/llm.h"
 
 typedef bool (*stream_cb)(const char* chunk, size_t len, void* user_data);
 
@@ -16,15 +16,35 @@ typedef struct {
 
 bool http_get(const char* url, long timeout_ms, size_t max_response_bytes, const char* const* headers,
               size_t headers_count, const llm_tls_config_t* tls, const char* proxy_url, const char* no_proxy,
-              char** body, size_t* len, llm_transport_status_t* status);
+              const llm_allocator_t* alloc, char** body, size_t* len, llm_transport_status_t* status);
 
 bool http_post(const char* url, const char* json_body, long timeout_ms, size_t max_response_bytes,
                const char* const* headers, size_t headers_count, const llm_tls_config_t* tls, const char* proxy_url,
-               const char* no_proxy, char** body, size_t* len, llm_transport_status_t* status);
+               const char* no_proxy, const llm_allocator_t* alloc, char** body, size_t* len,
+               llm_transport_status_t* status);
 
+// cancel_fd, when >= 0, is polled alongside the transfer: once it is readable the transfer stops at once, even
+// while the server sends nothing, and its connection is closed.
 bool http_post_stream(const char* url, const char* json_body, long timeout_ms, long read_idle_timeout_ms,
                       const char* const* headers, size_t headers_count, const llm_tls_config_t* tls,
-                      const char* proxy_url, const char* no_proxy, stream_cb cb, void* user_data,
+                      const char* proxy_url, const char* no_proxy, stream_cb cb, void* user_data, int cancel_fd,
                       llm_transport_status_t* status);
 
+// Supplies the request body for batch item index, or NULL to fail that item without sending it. The body must
+// stay valid until batch_done_cb has been called for the same index.
+typedef const char* (*batch_body_cb)(size_t index, void* user_data);
+// Receives the outcome of batch item index. On success body was allocated with the batch allocator and is owned
+// by the callee; on failure body is NULL.
+typedef void (*batch_done_cb)(size_t index, bool ok, char* body, size_t len, const llm_transport_status_t* status,
+                              void* user_data);
+
+// Posts count independent requests to url with at most max_in_flight outstanding, reusing connections (and
+// multiplexing over HTTP/2 where available) across items. Bodies are requested lazily as slots free up; both
+// callbacks run on the caller thread and items may complete in any order. Every item is reported to done_cb
+// exactly once, even when the batch machinery itself fails, which is what a false return means.
+bool http_post_batch(const char* url, size_t count, size_t max_in_flight, long timeout_ms, size_t max_response_bytes,
+                     const char* const* headers, size_t headers_count, const llm_tls_config_t* tls,
+                     const char* proxy_url, const char* no_proxy, const llm_allocator_t* alloc, batch_body_cb body_cb,
+                     batch_done_cb done_cb, void* user_data);
+
 #endif  // TRANSPORT_CURL_H
@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+
+// Every header the server includes comes first, so the counting macros below touch only its calls.
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
+#ifdef DESI_HTTP_IO_URING
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// SSE fan-out: one worker holds 1000 event streams and every round writes one event to each from another thread,
+// the way a broadcast reaches its subscribers. Reported per backend: the system calls the worker makes per round
+// and per delivered event, and its CPU time per round per 1k subscribers.
+
+static atomic_long g_syscalls;
+static _Thread_local bool g_counted;  // set on the worker thread
+
+#define DESI_COUNTED(call) ((g_counted ? (void)atomic_fetch_add(&g_syscalls, 1) : (void)0), call)
+#define read(...) DESI_COUNTED(read(__VA_ARGS__))
+#define write(...) DESI_COUNTED(write(__VA_ARGS__))
+#define recv(...) DESI_COUNTED(recv(__VA_ARGS__))
+#define recvmsg(...) DESI_COUNTED(recvmsg(__VA_ARGS__))
+#define sendmsg(...) DESI_COUNTED(sendmsg(__VA_ARGS__))
+#define setsockopt(...) DESI_COUNTED(setsockopt(__VA_ARGS__))
+#define accept4(...) DESI_COUNTED(accept4(__VA_ARGS__))
+#define shutdown(...) DESI_COUNTED(shutdown(__VA_ARGS__))
+#define close(...) DESI_COUNTED(close(__VA_ARGS__))
+#define epoll_wait(...) DESI_COUNTED(epoll_wait(__VA_ARGS__))
+#define epoll_ctl(...) DESI_COUNTED(epoll_ctl(__VA_ARGS__))
+#define syscall(...) DESI_COUNTED(syscall(__VA_ARGS__))
+
+#include "../src/internal/http1_server.c"
+
+#undef read
+#undef write
+#undef recv
+#undef recvmsg
+#undef sendmsg
+#undef setsockopt
+#undef accept4
+#undef shutdown
+#undef close
+#undef epoll_wait
+#undef epoll_ctl
+#undef syscall
+
+enum { SUBSCRIBERS = 1000, ROUNDS = 200, WAIT_MS = 10000 };
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static desi_http_stream_t* g_streams[SUBSCRIBERS];
+static size_t g_stream_count;
+static atomic_long g_received;  // events seen by the clients
+static atomic_bool g_reading;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static int events_handler(void* user_data, const desi_http_req_t* req, desi_http_resp_t* resp) {
+    (void)user_data;
+    desi_http_stream_t* s = desi_http_resp_stream(req, resp);
+    if (!s) return -1;
+    resp->status = 200;
+    resp->content_type = "text/event-stream";
+    pthread_mutex_lock(&g_mu);
+    if (g_stream_count < SUBSCRIBERS) {
+        g_streams[g_stream_count++] = s;
+        s = NULL;
+    }
+    pthread_mutex_unlock(&g_mu);
+    if (s) desi_http_stream_finish(s);
+    return 0;
+}
+
+static void* server_main(void* arg) {
+    g_counted = true;
+    desi_server_run(arg, events_handler, NULL);
+    return NULL;
+}
+
+static uint16_t free_port(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    uint16_t port = 0;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) port = desi_bound_port(fd);
+    close(fd);
+    return port;
+}
+
+static int subscribe(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    static const char req[] = "GET /events HTTP/1.1\r\nHost: bench\r\n\r\n";
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        send(fd, req, sizeof(req) - 1, MSG_NOSIGNAL) != (ssize_t)(sizeof(req) - 1)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Drains every subscriber socket and counts the events in it: each carries a single '*', which nothing else in
+// a response does.
+static void* reader_main(void* arg) {
+    int ep = *(int*)arg;
+    struct epoll_event events[256];
+    char buf[16384];
+    while (atomic_load(&g_reading)) {
+        int n = epoll_wait(ep, events, 256, 50);
+        for (int i = 0; i < n; i++) {
+            ssize_t got;
+            while ((got = recv(events[i].data.fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+                long stars = 0;
+                for (ssize_t j = 0; j < got; j++) stars += buf[j] == '*';
+                if (stars) atomic_fetch_add(&g_received, stars);
+            }
+        }
+    }
+    return NULL;
+}
+
+static long long thread_cpu_ns(pthread_t thread) {
+    clockid_t clock;
+    struct timespec ts;
+    if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &ts) != 0) return 0;
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct fanout_result {
+    double syscalls_per_round;
+    double syscalls_per_event;
+    double cpu_us_per_round_1k;
+};
+
+static bool wait_for(bool (*done)(long), long arg) {
+    long long deadline = now_ms() + WAIT_MS;
+    while (!done(arg)) {
+        if (now_ms() > deadline) return false;
+        struct timespec ts = {0, 100 * 1000L};
+        nanosleep(&ts, NULL);
+    }
+    return true;
+}
+
+static bool all_subscribed(long want) {
+    pthread_mutex_lock(&g_mu);
+    bool done = (long)g_stream_count >= want;
+    pthread_mutex_unlock(&g_mu);
+    return done;
+}
+
+static bool all_received(long want) { return atomic_load(&g_received) >= want; }
+
+static int fanout_run(bool epoll_only, size_t subscribers, struct fanout_result* out) {
+    static desi_server_config_t confs[2];
+    static int next_conf;
+    desi_server_config_t* conf = &confs[next_conf++];
+    *conf = (desi_server_config_t){.bind_host = "127.0.0.1", .port = free_port(), .backlog = 4096, .workers = 1};
+    conf->epoll_only = epoll_only;
+    g_stream_count = 0;
+    atomic_store(&g_received, 0);
+    pthread_t server;
+    if (conf->port == 0 || pthread_create(&server, NULL, server_main, conf) != 0) return 1;
+
+    static int fds[SUBSCRIBERS];
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) return 1;
+    size_t held = 0;
+    for (int i = 0; i < 200 && held == 0; i++) {
+        fds[0] = subscribe(conf->port);
+        if (fds[0] >= 0) {
+            held = 1;
+        } else {
+            struct timespec ts = {0, 10 * 1000000L};
+            nanosleep(&ts, NULL);
+        }
+    }
+    for (; held > 0 && held < subscribers; held++) {
+        fds[held] = subscribe(conf->port);
+        if (fds[held] < 0) break;
+    }
+    for (size_t i = 0; i < held; i++) {
+        struct epoll_event ev = {.events = EPOLLIN, .data.fd = fds[i]};
+        epoll_ctl(ep, EPOLL_CTL_ADD, fds[i], &ev);
+    }
+    if (held < subscribers || !wait_for(all_subscribed, (long)subscribers)) {
+        fprintf(stderr, "only %zu of %zu subscribers connected\n", held, subscribers);
+        return 1;
+    }
+    atomic_store(&g_reading, true);
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, reader_main, &ep) != 0) return 1;
+
+    // Each round is delivered in full before the next starts, so every round wakes the worker afresh.
+    long sent = 0;
+    long long cpu0 = thread_cpu_ns(server);
+    long calls0 = atomic_load(&g_syscalls);
+    for (int round = 0; round < ROUNDS; round++) {
+        for (size_t i = 0; i < subscribers; i++) {
+            if (desi_http_stream_sse_event(g_streams[i], "tick", 4, "*", 1) == DESI_STREAM_OK) sent++;
+        }
+        if (!wait_for(all_received, sent)) {
+            fprintf(stderr, "round %d: %ld of %ld events arrived\n", round, atomic_load(&g_received), sent);
+            return 1;
+        }
+    }
+    long calls = atomic_load(&g_syscalls) - calls0;
+    long long cpu = thread_cpu_ns(server) - cpu0;
+
+    for (size_t i = 0; i < subscribers; i++) desi_http_stream_finish(g_streams[i]);
+    atomic_store(&g_reading, false);
+    pthread_join(reader, NULL);
+    for (size_t i = 0; i < held; i++) close(fds[i]);
+    close(ep);
+    out->syscalls_per_round = (double)calls / ROUNDS;
+    out->syscalls_per_event = (double)calls / (double)sent;
+    out->cpu_us_per_round_1k = (double)cpu / 1000.0 / ROUNDS / ((double)subscribers / 1000.0);
+    return 0;
+}
+
+static bool uring_available(void) {
+#ifdef DESI_HAVE_URING
+    struct desi_uring r;
+    if (desi_uring_init(&r) != 0) return false;
+    desi_uring_free(&r);
+    return true;
+#else
+    return false;
+#endif
+}
+
+int main(void) {
+    signal(SIGPIPE, SIG_IGN);
+    // Both ends of every subscriber live in this process.
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    size_t subscribers = SUBSCRIBERS;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY &&
+        (lim.rlim_cur - 256) / 2 < subscribers) {
+        subscribers = (size_t)(lim.rlim_cur - 256) / 2;
+    }
+
+    printf("http1 server, SSE fan-out to %zu subscribers on 1 worker, %d rounds\n", subscribers, ROUNDS);
+    struct fanout_result epoll_res;
+    if (fanout_run(true, subscribers, &epoll_res) != 0) return 1;
+    printf("  epoll:    %8.1f syscalls per round (%.3f per event), %8.1f us CPU per round per 1k subscribers\n",
+           epoll_res.syscalls_per_round, epoll_res.syscalls_per_event, epoll_res.cpu_us_per_round_1k);
+    if (!uring_available()) {
+        printf("  io_uring: not available here\n");
+        return 0;
+    }
+    struct fanout_result uring_res;
+    if (fanout_run(false, subscribers, &uring_res) != 0) return 1;
+    printf("  io_uring: %8.1f syscalls per round (%.3f per event), %8.1f us CPU per round per 1k subscribers\n",
+           uring_res.syscalls_per_round, uring_res.syscalls_per_event, uring_res.cpu_us_per_round_1k);
+    return 0;
+}
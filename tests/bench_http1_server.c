@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/internal/http1_server.c"
+
+// Requests per second against GET /health with one worker versus one per usable CPU. Every request uses a
+// fresh connection, which the client asks the server to close, and clients outnumber workers so the server is
+// the bottleneck. Then one worker holds up to 10k idle connections (the shape of SSE subscribers) while
+// /health latency is measured. Last, a 7 KB request head is fed to one connection a byte per read, which
+// costs as much per byte as a head that arrives whole only if each read scans just the new bytes.
+
+enum { DURATION_MS = 2000, CLIENTS_PER_WORKER = 2, MAX_IDLE = 10000, LATENCY_SAMPLES = 200, DRIBBLE_ROUNDS = 20 };
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static int health_handler(void* user_data, const desi_http_req_t* req, desi_http_resp_t* resp) {
+    (void)user_data;
+    if (req->path_len != 7 || memcmp(req->path, "/health", 7) != 0) {
+        resp->status = 404;
+        return 0;
+    }
+    resp->status = 200;
+    resp->body = "ok\n";
+    resp->body_len = 3;
+    return 0;
+}
+
+static void* server_main(void* arg) {
+    desi_server_run(arg, health_handler, NULL);
+    return NULL;
+}
+
+static uint16_t free_port(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    uint16_t port = 0;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) port = desi_bound_port(fd);
+    close(fd);
+    return port;
+}
+
+static bool health_request(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    static const char req[] = "GET /health HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n\r\n";
+    bool ok = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 && send(fd, req, sizeof(req) - 1, 0) > 0;
+    char buf[256];
+    size_t len = 0;
+    ssize_t got = 0;
+    while (ok && len < sizeof(buf) && (got = recv(fd, buf + len, sizeof(buf) - len, 0)) > 0) len += (size_t)got;
+    close(fd);
+    return ok && len > 12 && memcmp(buf + 9, "200", 3) == 0;
+}
+
+struct client {
+    uint16_t port;
+    long long deadline_ms;
+    long requests;
+    bool failed;
+};
+
+static void* client_main(void* arg) {
+    struct client* c = arg;
+    while (now_ms() < c->deadline_ms) {
+        if (!health_request(c->port)) {
+            c->failed = true;
+            return NULL;
+        }
+        c->requests++;
+    }
+    return NULL;
+}
+
+static double run(unsigned workers) {
+    static desi_server_config_t confs[2];
+    static int next_conf;
+    desi_server_config_t* conf = &confs[next_conf++];
+    *conf = (desi_server_config_t){.bind_host = "127.0.0.1", .port = free_port(), .backlog = 1024};
+    conf->workers = workers;
+    conf->pin_cpus = true;
+    pthread_t server;
+    if (conf->port == 0 || pthread_create(&server, NULL, server_main, conf) != 0) return -1.0;
+    pthread_detach(server);
+    for (int i = 0; i < 200 && !health_request(conf->port); i++) {
+        struct timespec ts = {0, 10 * 1000000L};
+        nanosleep(&ts, NULL);
+    }
+
+    enum { MAX_CLIENTS = 256 };
+    struct client clients[MAX_CLIENTS];
+    pthread_t threads[MAX_CLIENTS];
+    size_t count = (size_t)workers * CLIENTS_PER_WORKER;
+    if (count > MAX_CLIENTS) count = MAX_CLIENTS;
+    long long start = now_ms();
+    for (size_t i = 0; i < count; i++) {
+        clients[i] = (struct client){conf->port, start + DURATION_MS, 0, false};
+        if (pthread_create(&threads[i], NULL, client_main, &clients[i]) != 0) return -1.0;
+    }
+    long total = 0;
+    bool failed = false;
+    for (size_t i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+        total += clients[i].requests;
+        failed = failed || clients[i].failed;
+    }
+    double elapsed_s = (double)(now_ms() - start) / 1000.0;
+    return failed ? -1.0 : (double)total / elapsed_s;
+}
+
+static int cmp_ll(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+static int idle_run(void) {
+    // Both ends of every idle connection live in this process.
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    size_t idle_count = MAX_IDLE;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY && (lim.rlim_cur - 256) / 2 < idle_count) {
+        idle_count = (size_t)(lim.rlim_cur - 256) / 2;
+    }
+
+    static desi_server_config_t conf;
+    conf = (desi_server_config_t){.bind_host = "127.0.0.1", .port = free_port(), .backlog = 4096, .workers = 1};
+    pthread_t server;
+    if (conf.port == 0 || pthread_create(&server, NULL, server_main, &conf) != 0) return 1;
+    pthread_detach(server);
+    for (int i = 0; i < 200 && !health_request(conf.port); i++) {
+        struct timespec ts = {0, 10 * 1000000L};
+        nanosleep(&ts, NULL);
+    }
+
+    static int idle[MAX_IDLE];
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(conf.port);
+    long long start = now_ms();
+    size_t held = 0;
+    for (; held < idle_count; held++) {
+        idle[held] = socket(AF_INET, SOCK_STREAM, 0);
+        if (idle[held] < 0 || connect(idle[held], (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            if (idle[held] >= 0) close(idle[held]);
+            break;
+        }
+    }
+    long long connect_ms = now_ms() - start;
+
+    long long samples[LATENCY_SAMPLES];
+    for (int i = 0; i < LATENCY_SAMPLES; i++) {
+        long long t0 = now_ms();
+        if (!health_request(conf.port)) {
+            fprintf(stderr, "health request failed behind %zu idle connections\n", held);
+            return 1;
+        }
+        samples[i] = now_ms() - t0;
+    }
+    qsort(samples, LATENCY_SAMPLES, sizeof(samples[0]), cmp_ll);
+    printf("  1 worker holding %zu idle connections (opened in %lld ms): /health p50 %lld ms, max %lld ms\n", held,
+           connect_ms, samples[LATENCY_SAMPLES / 2], samples[LATENCY_SAMPLES - 1]);
+    for (size_t i = 0; i < held; i++) close(idle[i]);
+    return 0;
+}
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Server-side nanoseconds to read and answer one request delivered in pieces of piece bytes, the client's
+// sends excluded. Returns -1 on failure.
+static long long dribble_request(const char* head, size_t len, size_t piece) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0) return -1;
+    struct desi_conn_config conf = {.handler = health_handler,
+                                    .max_requests = DESI_HTTP_DEFAULT_MAX_REQUESTS,
+                                    .max_body_bytes = DESI_HTTP_DEFAULT_MAX_BODY_BYTES};
+    struct desi_conn c;
+    desi_conn_init(&c, fds[1], &conf);
+    long long spent = 0;
+    int rc = 0;
+    for (size_t off = 0; rc == 0 && off < len && c.state == DESI_CONN_READING; off += piece) {
+        size_t n = len - off < piece ? len - off : piece;
+        if (send(fds[0], head + off, n, 0) != (ssize_t)n) rc = -1;
+        long long t0 = now_ns();
+        if (rc == 0) rc = desi_conn_read(&c);
+        spent += now_ns() - t0;
+    }
+    bool answered = rc == 0 && c.state == DESI_CONN_WRITING;
+    desi_conn_release(&c);
+    close(fds[0]);
+    close(fds[1]);
+    return answered ? spent : -1;
+}
+
+static int dribble_run(void) {
+    static char head[7200];
+    size_t len = (size_t)snprintf(head, sizeof(head), "GET /health HTTP/1.1\r\nHost: bench\r\n");
+    for (int i = 0; i < 60; i++) {
+        len += (size_t)snprintf(head + len, sizeof(head) - len, "X-Pad-%02d: %0100d\r\n", i, i);
+    }
+    len += (size_t)snprintf(head + len, sizeof(head) - len, "\r\n");
+    long long whole = 0;
+    long long dribbled = 0;
+    for (int i = 0; i < DRIBBLE_ROUNDS; i++) {
+        long long a = dribble_request(head, len, len);
+        long long b = dribble_request(head, len, 1);
+        if (a < 0 || b < 0) {
+            fprintf(stderr, "dribbled request failed\n");
+            return 1;
+        }
+        whole += a;
+        dribbled += b;
+    }
+    printf("  %zu-byte head, server read time: whole %.1f us, 1-byte writes %.1f us (%.0f ns per byte)\n", len,
+           (double)whole / DRIBBLE_ROUNDS / 1000.0, (double)dribbled / DRIBBLE_ROUNDS / 1000.0,
+           (double)dribbled / DRIBBLE_ROUNDS / (double)len);
+    return 0;
+}
+
+int main(void) {
+    signal(SIGPIPE, SIG_IGN);
+    int cpus[DESI_MAX_CPUS];
+    unsigned cores = (unsigned)desi_usable_cpus(cpus, DESI_MAX_CPUS);
+    double one = run(1);
+    double all = run(cores);
+    if (one < 0 || all < 0) {
+        fprintf(stderr, "load run failed\n");
+        return 1;
+    }
+    printf("http1 server, GET /health, %d ms per run\n", DURATION_MS);
+    printf("  1 worker:   %10.0f req/s\n", one);
+    printf("  %u workers: %10.0f req/s (%.2fx, ideal %ux)\n", cores, all, all / one, cores);
+    if (idle_run() != 0) return 1;
+    return dribble_run();
+}
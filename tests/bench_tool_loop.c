@@ -0,0 +1,138 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+// Wall clock of one tool turn plus the final answer, with the tool calls dispatched after the response
+// (llm_tool_loop_run_with_headers_ex) versus from the stream (llm_tool_loop_run_stream_ex). The fake server
+// paces both kinds of response like a model generating tokens, and every tool takes TOOL_US, like an HTTP
+// tool call.
+
+enum { TOOLS = 3, FRAMES_PER_TOOL = 6, CHUNK_US = 15000, TOOL_US = 60000, CHUNK_SIZE = 48, RUNS = 5 };
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static bool dispatch(void* user_data, const char* tool_name, size_t name_len, const char* args_json, size_t args_len,
+                     char** result_json, size_t* result_len) {
+    (void)user_data;
+    (void)tool_name;
+    (void)name_len;
+    (void)args_json;
+    (void)args_len;
+    struct timespec ts = {0, TOOL_US * 1000L};
+    nanosleep(&ts, NULL);
+    *result_json = malloc(8);
+    if (!*result_json) return false;
+    memcpy(*result_json, "{\"ok\":1}", 8);
+    *result_len = 8;
+    return true;
+}
+
+static char g_stream_turn[8192];
+static char g_post_turn[4096];
+
+static void build_payloads(void) {
+    size_t off = 0;
+    for (int t = 0; t < TOOLS; t++) {
+        off += (size_t)snprintf(g_stream_turn + off, sizeof(g_stream_turn) - off,
+                                "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":%d,\"id\":\"call_%d\","
+                                "\"function\":{\"name\":\"lookup\",\"arguments\":\"{\\\"q\\\":[\"}}]}}]}\n\n",
+                                t, t);
+        for (int f = 0; f < FRAMES_PER_TOOL; f++) {
+            off += (size_t)snprintf(g_stream_turn + off, sizeof(g_stream_turn) - off,
+                                    "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":%d,"
+                                    "\"function\":{\"arguments\":\"%s%d\"}}]}}]}\n\n",
+                                    t, f ? "," : "", f);
+        }
+        off += (size_t)snprintf(g_stream_turn + off, sizeof(g_stream_turn) - off,
+                                "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":%d,"
+                                "\"function\":{\"arguments\":\"]}\"}}]}}]}\n\n",
+                                t);
+    }
+    snprintf(g_stream_turn + off, sizeof(g_stream_turn) - off,
+             "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"tool_calls\"}]}\n\ndata: [DONE]\n\n");
+
+    off = (size_t)snprintf(g_post_turn, sizeof(g_post_turn),
+                           "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"tool_calls\":[");
+    for (int t = 0; t < TOOLS; t++) {
+        off += (size_t)snprintf(g_post_turn + off, sizeof(g_post_turn) - off,
+                                "%s{\"id\":\"call_%d\",\"type\":\"function\",\"function\":{\"name\":\"lookup\","
+                                "\"arguments\":\"{\\\"q\\\":[0,1,2,3,4,5]}\"}}",
+                                t ? "," : "", t);
+    }
+    snprintf(g_post_turn + off, sizeof(g_post_turn) - off, "]},\"finish_reason\":\"tool_calls\"}]}");
+}
+
+static const char k_stream_final[] =
+    "data: {\"choices\":[{\"delta\":{\"content\":\"done\"}}]}\n\n"
+    "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"stop\"}]}\n\n"
+    "data: [DONE]\n\n";
+static const char k_post_final[] =
+    "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"done\"},\"finish_reason\":\"stop\"}]}";
+
+int main(void) {
+    build_payloads();
+    size_t chunks = (strlen(g_stream_turn) + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    long generation_us = (long)(chunks - 1) * CHUNK_US;
+    llm_model_t model = {"bench-model"};
+    llm_message_t msg = {LLM_ROLE_USER, "look things up", 14, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+
+    long long total_post = 0;
+    long long total_stream = 0;
+    for (int run = 0; run < RUNS; run++) {
+        fake_transport_reset();
+        fake_transport_state_t* fake = fake_transport_state();
+        fake->post_responses[0] = g_post_turn;
+        fake->post_responses[1] = k_post_final;
+        // Same number of paced chunks, so the buffered response takes as long to generate as the stream.
+        fake->stream_chunk_size = (strlen(g_post_turn) + chunks - 1) / chunks;
+        fake->stream_chunk_interval_us = CHUNK_US;
+        llm_client_t* client = llm_client_create("http://fake", &model, NULL, NULL);
+        if (!client) return 1;
+        long long start = now_us();
+        llm_error_t err =
+            llm_tool_loop_run_with_headers_ex(client, &msg, 1, NULL, NULL, NULL, dispatch, NULL, NULL, NULL, 4, NULL,
+                                              0);
+        total_post += now_us() - start;
+        llm_client_destroy(client);
+        if (err != LLM_ERR_NONE) {
+            fprintf(stderr, "non-streaming loop failed: %s\n", llm_errstr(err));
+            return 1;
+        }
+
+        fake_transport_reset();
+        fake = fake_transport_state();
+        fake->stream_payloads[0] = g_stream_turn;
+        fake->stream_payloads[1] = k_stream_final;
+        fake->stream_payloads_count = 2;
+        fake->stream_chunk_size = CHUNK_SIZE;
+        fake->stream_chunk_interval_us = CHUNK_US;
+        client = llm_client_create("http://fake", &model, NULL, NULL);
+        if (!client) return 1;
+        start = now_us();
+        err = llm_tool_loop_run_stream_ex(client, &msg, 1, NULL, NULL, NULL, NULL, dispatch, NULL, NULL, NULL, 4);
+        total_stream += now_us() - start;
+        llm_client_destroy(client);
+        if (err != LLM_ERR_NONE) {
+            fprintf(stderr, "streaming loop failed: %s\n", llm_errstr(err));
+            return 1;
+        }
+    }
+
+    double post_ms = (double)total_post / RUNS / 1000.0;
+    double stream_ms = (double)total_stream / RUNS / 1000.0;
+    printf("tool loop, %d tools x %d ms, %.0f ms generation per turn\n", TOOLS, TOOL_US / 1000,
+           (double)generation_us / 1000.0);
+    printf("  dispatch after response: %8.1f ms/run\n", post_ms);
+    printf("  dispatch from stream:    %8.1f ms/run (%.2fx)\n", stream_ms, post_ms / stream_ms);
+    return 0;
+}
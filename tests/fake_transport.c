@@ -1,7 +1,11 @@
+#define _POSIX_C_SOURCE 200809L
 #include "fake_transport.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include "llm/internal.h"
 
 static fake_transport_state_t g_state;
 static char* g_stream_scratch;
@@ -63,6 +67,20 @@ static bool ensure_stream_scratch(size_t len) {
     return true;
 }
 
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void sleep_until_us(long long deadline) {
+    long long now = now_us();
+    if (deadline <= now) return;
+    long long wait = deadline - now;
+    struct timespec ts = {(time_t)(wait / 1000000LL), (long)(wait % 1000000LL) * 1000L};
+    nanosleep(&ts, NULL);
+}
+
 static bool capture_request(fake_transport_state_t* state, const char* json_body) {
     state->last_request_body = NULL;
     state->last_request_len = 0;
@@ -110,6 +128,7 @@ void fake_transport_reset(void) {
     g_state.proxy_ok = true;
     g_state.stream_use_scratch = true;
     g_state.stream_scratch_fill = 'x';
+    g_state.stream_cancel_fd = -1;
 
     free(g_stream_scratch);
     g_stream_scratch = NULL;
@@ -118,7 +137,7 @@ void fake_transport_reset(void) {
 
 bool http_get(const char* url, long timeout_ms, size_t max_response_bytes, const char* const* headers,
               size_t headers_count, const llm_tls_config_t* tls, const char* proxy_url, const char* no_proxy,
-              char** body, size_t* len, llm_transport_status_t* status) {
+              const llm_allocator_t* alloc, char** body, size_t* len, llm_transport_status_t* status) {
     (void)timeout_ms;
     (void)tls;
 
@@ -146,7 +165,7 @@ bool http_get(const char* url, long timeout_ms, size_t max_response_bytes, const
         return false;
     }
 
-    char* resp = malloc(resp_len + 1);
+    char* resp = mem_alloc(alloc, resp_len + 1);
     if (!resp) return false;
     if (resp_len > 0) {
         memcpy(resp, g_state.response_get, resp_len);
@@ -162,7 +181,8 @@ bool http_get(const char* url, long timeout_ms, size_t max_response_bytes, const
 
 bool http_post(const char* url, const char* json_body, long timeout_ms, size_t max_response_bytes,
                const char* const* headers, size_t headers_count, const llm_tls_config_t* tls, const char* proxy_url,
-               const char* no_proxy, char** body, size_t* len, llm_transport_status_t* status) {
+               const char* no_proxy, const llm_allocator_t* alloc, char** body, size_t* len,
+               llm_transport_status_t* status) {
     (void)timeout_ms;
     (void)tls;
 
@@ -206,6 +226,11 @@ bool http_post(const char* url, const char* json_body, long timeout_ms, size_t m
     }
 
     size_t resp_len = resolve_len(response, response_len);
+    if (g_state.stream_chunk_interval_us > 0) {
+        size_t chunk_size = g_state.stream_chunk_size ? g_state.stream_chunk_size : resp_len;
+        size_t chunks = chunk_size ? (resp_len + chunk_size - 1) / chunk_size : 0;
+        if (chunks > 1) sleep_until_us(now_us() + (long long)(chunks - 1) * g_state.stream_chunk_interval_us);
+    }
     if (max_response_bytes > 0 && resp_len > max_response_bytes) {
         if (body) *body = NULL;
         if (len) *len = 0;
@@ -213,7 +238,7 @@ bool http_post(const char* url, const char* json_body, long timeout_ms, size_t m
         return false;
     }
 
-    char* resp = malloc(resp_len + 1);
+    char* resp = mem_alloc(alloc, resp_len + 1);
     if (!resp) return false;
     if (resp_len > 0) {
         memcpy(resp, response, resp_len);
@@ -249,11 +274,12 @@ static bool stream_emit_chunk(const char* data, size_t len, stream_cb cb, void*
 
 bool http_post_stream(const char* url, const char* json_body, long timeout_ms, long read_idle_timeout_ms,
                       const char* const* headers, size_t headers_count, const llm_tls_config_t* tls,
-                      const char* proxy_url, const char* no_proxy, stream_cb cb, void* user_data,
+                      const char* proxy_url, const char* no_proxy, stream_cb cb, void* user_data, int cancel_fd,
                       llm_transport_status_t* status) {
     (void)timeout_ms;
     (void)read_idle_timeout_ms;
     (void)tls;
+    g_state.stream_cancel_fd = cancel_fd;
 
     transport_status_init(status, g_state.status_stream);
     g_state.called_stream = true;
@@ -289,21 +315,115 @@ bool http_post_stream(const char* url, const char* json_body, long timeout_ms, l
         return true;
     }
 
-    if (!g_state.stream_payload || g_state.stream_payload_len == 0) {
+    const char* payload = g_state.stream_payload;
+    size_t payload_len = g_state.stream_payload_len;
+    if (g_state.stream_payloads_count > 0) {
+        if (g_state.stream_calls > g_state.stream_payloads_count) {
+            transport_status_init(status, 0);
+            return false;
+        }
+        payload = g_state.stream_payloads[g_state.stream_calls - 1];
+        payload_len = payload ? strlen(payload) : 0;
+    }
+    if (!payload || payload_len == 0) {
         transport_status_init(status, 0);
         return false;
     }
 
-    size_t chunk_size = g_state.stream_chunk_size ? g_state.stream_chunk_size : g_state.stream_payload_len;
+    size_t chunk_size = g_state.stream_chunk_size ? g_state.stream_chunk_size : payload_len;
     size_t offset = 0;
-    while (offset < g_state.stream_payload_len) {
-        size_t remaining = g_state.stream_payload_len - offset;
+    long long start = now_us();
+    for (size_t chunk = 0; offset < payload_len; chunk++) {
+        size_t remaining = payload_len - offset;
         size_t take = remaining < chunk_size ? remaining : chunk_size;
+        if (g_state.stream_chunk_interval_us > 0) {
+            sleep_until_us(start + (long long)chunk * g_state.stream_chunk_interval_us);
+        }
         g_state.headers_ok = g_state.headers_ok && check_headers(&g_state, headers, headers_count);
-        bool keep = stream_emit_chunk(g_state.stream_payload + offset, take, cb, user_data);
+        bool keep = stream_emit_chunk(payload + offset, take, cb, user_data);
         g_state.headers_ok = g_state.headers_ok && check_headers(&g_state, headers, headers_count);
         if (!keep) return false;
         offset += take;
     }
     return true;
 }
+
+bool http_post_batch(const char* url, size_t count, size_t max_in_flight, long timeout_ms, size_t max_response_bytes,
+                     const char* const* headers, size_t headers_count, const llm_tls_config_t* tls,
+                     const char* proxy_url, const char* no_proxy, const llm_allocator_t* alloc, batch_body_cb body_cb,
+                     batch_done_cb done_cb, void* user_data) {
+    (void)timeout_ms;
+    (void)tls;
+
+    g_state.called_post = true;
+    g_state.batch_calls++;
+    g_state.batch_max_in_flight = max_in_flight;
+    g_state.headers_ok = g_state.headers_ok && check_headers(&g_state, headers, headers_count);
+    g_state.proxy_ok = g_state.proxy_ok && check_proxy(&g_state, proxy_url, no_proxy);
+    if (g_state.expected_url && (!url || strcmp(url, g_state.expected_url) != 0)) {
+        g_state.headers_ok = false;
+    }
+    if (count == 0) return true;
+    if (max_in_flight == 0) max_in_flight = 1;
+    if (max_in_flight > count) max_in_flight = count;
+
+    llm_transport_status_t status;
+    size_t* window = malloc(max_in_flight * sizeof(*window));
+    if (!window) {
+        transport_status_init(&status, 0);
+        for (size_t i = 0; i < count; i++) done_cb(i, false, NULL, 0, &status, user_data);
+        return false;
+    }
+    size_t active = 0;
+    size_t next = 0;
+    while (next < count || active > 0) {
+        while (active < max_in_flight && next < count) {
+            size_t index = next++;
+            const char* json_body = body_cb(index, user_data);
+            if (!json_body) {
+                transport_status_init(&status, 0);
+                done_cb(index, false, NULL, 0, &status, user_data);
+                continue;
+            }
+            capture_request(&g_state, json_body);
+            window[active++] = index;
+        }
+        if (active > g_state.batch_peak_in_flight) g_state.batch_peak_in_flight = active;
+        if (active == 0) continue;
+
+        size_t index;
+        if (g_state.batch_newest_first) {
+            index = window[--active];
+        } else {
+            index = window[0];
+            memmove(window, window + 1, --active * sizeof(*window));
+        }
+        const char* response = g_state.response_post;
+        size_t response_len = g_state.response_post_len;
+        long http_status = g_state.status_post;
+        if (index < FAKE_TRANSPORT_MAX_POST_RESPONSES) {
+            if (g_state.post_responses[index]) {
+                response = g_state.post_responses[index];
+                response_len = g_state.post_response_lens[index];
+            }
+            if (g_state.batch_statuses[index]) http_status = g_state.batch_statuses[index];
+        }
+        size_t resp_len = resolve_len(response, response_len);
+        char* resp = NULL;
+        if (!g_state.fail_post && response && (max_response_bytes == 0 || resp_len <= max_response_bytes)) {
+            resp = mem_alloc(alloc, resp_len + 1);
+        }
+        if (!resp) {
+            transport_status_init(&status, 0);
+            done_cb(index, false, NULL, 0, &status, user_data);
+            continue;
+        }
+        memcpy(resp, response, resp_len);
+        resp[resp_len] = '\0';
+        g_state.post_calls++;
+        transport_status_init(&status, http_status);
+        done_cb(index, true, resp, resp_len, &status, user_data);
+    }
+    free(window);
+    return true;
+}
@@ -39,6 +39,17 @@ typedef struct {
     size_t stream_chunks_count;
     bool stream_use_scratch;
     char stream_scratch_fill;
+    // One payload per stream call, in order (overrides stream_payload when set).
+    const char* stream_payloads[FAKE_TRANSPORT_MAX_POST_RESPONSES];
+    size_t stream_payloads_count;
+    // Pacing: chunk i is not delivered before i * interval after the call starts, like a server that keeps
+    // generating while the client is busy. A paced http_post returns when its last chunk would have.
+    long stream_chunk_interval_us;
+
+    // http_post_batch answers item i with post_responses[i] (response_post when unset) and status
+    // batch_statuses[i] (status_post when 0). Items complete oldest first unless batch_newest_first.
+    long batch_statuses[FAKE_TRANSPORT_MAX_POST_RESPONSES];
+    bool batch_newest_first;
 
     bool fail_get;
     bool fail_post;
@@ -54,6 +65,10 @@ typedef struct {
     size_t post_calls;
     size_t stream_calls;
     size_t stream_cb_calls;
+    size_t batch_calls;
+    int stream_cancel_fd;  // as passed to the last http_post_stream
+    size_t batch_max_in_flight;   // as passed by the caller
+    size_t batch_peak_in_flight;  // most items started and not yet completed
 
     char* last_body;
     size_t last_body_len;
@@ -0,0 +1,61 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "llm/json_core.h"
+
+enum { FUZZ_MAX_INPUT = 1024, FUZZ_MAX_TOKENS = 256 };
+
+// Feeds json as json[0:split] followed by pieces of step bytes (step 0: the rest in one piece).
+static int parse_chunked(const char* json, int len, int split, int step, jstoktok_t* tokens) {
+    jstok_parser parser;
+    jstok_init_chunked(&parser);
+    int r = jstok_parse(&parser, json, split, tokens, FUZZ_MAX_TOKENS);
+    int off = split;
+    while (off < len && (r >= 0 || r == JSTOK_ERROR_PART)) {
+        int n = (step && step < len - off) ? step : len - off;
+        r = jstok_parse(&parser, json + off, n, tokens, FUZZ_MAX_TOKENS);
+        off += n;
+    }
+    return r;
+}
+
+static void check_same(int expect, const jstoktok_t* want, int got, const jstoktok_t* have) {
+    // Success must match exactly; any error must stay an error.
+    if ((expect >= 0) != (got >= 0)) abort();
+    if (expect < 0) return;
+    if (expect != got) abort();
+    if (memcmp(want, have, (size_t)expect * sizeof(*want)) != 0) abort();
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (!data) return 0;
+    if (size > FUZZ_MAX_INPUT) size = FUZZ_MAX_INPUT;
+    if (size == 0) return 0;
+
+    const char* json = (const char*)data;
+    int len = (int)size;
+    jstoktok_t* want = calloc(FUZZ_MAX_TOKENS, sizeof(*want));
+    jstoktok_t* have = calloc(FUZZ_MAX_TOKENS, sizeof(*have));
+    if (!want || !have) {
+        free(want);
+        free(have);
+        return 0;
+    }
+
+    jstok_parser parser;
+    jstok_init(&parser);
+    int expect = jstok_parse(&parser, json, len, want, FUZZ_MAX_TOKENS);
+
+    for (int split = 0; split <= len; split++) {
+        memset(have, 0, FUZZ_MAX_TOKENS * sizeof(*have));
+        check_same(expect, want, parse_chunked(json, len, split, 0, have), have);
+    }
+    memset(have, 0, FUZZ_MAX_TOKENS * sizeof(*have));
+    check_same(expect, want, parse_chunked(json, len, 0, 1, have), have);
+
+    free(want);
+    free(have);
+    return 0;
+}
@@ -52,7 +52,7 @@ int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
 
     struct tool_call_accumulator accums[FUZZ_MAX_ACCUMS];
     for (size_t i = 0; i < acc_count; i++) {
-        accum_init(&accums[i]);
+        accum_init(&accums[i], NULL);
     }
 
     for (size_t i = 0; i < delta_count && cur.pos < cur.len; i++) {
@@ -91,7 +91,7 @@ int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
         }
         if (flags & 0x10) {
             accum_free(acc);
-            accum_init(acc);
+            accum_init(acc, NULL);
         }
     }
 
@@ -0,0 +1,253 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static llm_client_t* make_client(const llm_allocator_t* alloc, bool enable_last_error) {
+    llm_model_t model = {"test-model"};
+    llm_timeout_t timeout = {0};
+    timeout.connect_timeout_ms = 1000;
+    timeout.overall_timeout_ms = 2000;
+    timeout.read_idle_timeout_ms = 2000;
+    llm_client_init_opts_t opts = {0};
+    opts.enable_last_error = enable_last_error;
+    opts.allocator = alloc;
+    const char* headers[] = {"X-Test: 1"};
+    return llm_client_create_with_headers_opts("http://fake", &model, &timeout, NULL, headers, 1, &opts);
+}
+
+static const char k_chat_tool_response[] =
+    "{\"choices\":[{\"finish_reason\":\"tool_calls\",\"message\":{\"content\":\"hi\",\"tool_calls\":[{\"id\":\"call_"
+    "1\",\"type\":\"function\",\"function\":{\"name\":\"add\",\"arguments\":\"{\\\"a\\\":1}\"}}]}}]}";
+
+static const char k_stream_payload[] =
+    "data: {\"choices\":[{\"index\":0,\"delta\":{\"content\":\"he\"}}]}\n\n"
+    "data: {\"choices\":[{\"index\":0,\"delta\":{\"tool_calls\":[{\"index\":0,\"id\":\"call_1\",\"function\":{"
+    "\"name\":\"add\",\"arguments\":\"{\\\"a\\\":\"}}]}}]}\n\n"
+    "data: {\"choices\":[{\"index\":0,\"delta\":{\"tool_calls\":[{\"index\":0,\"function\":{\"arguments\":\"1}\"}}]}"
+    ",\"finish_reason\":\"tool_calls\"}]}\n\n"
+    "data: [DONE]\n\n";
+
+static void on_args_complete(void* user_data, size_t tool_index, const char* args_json, size_t len) {
+    (void)tool_index;
+    size_t* calls = user_data;
+    if (len == 7 && memcmp(args_json, "{\"a\":1}", 7) == 0) {
+        (*calls)++;
+    }
+}
+
+static bool dispatch_echo(void* user_data, const char* tool_name, size_t name_len, const char* args_json,
+                          size_t args_len, char** result_json, size_t* result_len) {
+    (void)user_data;
+    (void)tool_name;
+    (void)name_len;
+    (void)args_json;
+    (void)args_len;
+    *result_json = malloc(3);
+    if (!*result_json) return false;
+    memcpy(*result_json, "42", 3);
+    *result_len = 2;
+    return true;
+}
+
+static bool test_partial_allocator_rejected(void) {
+    llm_counting_allocator_t counter;
+    llm_counting_allocator_init(&counter, NULL, 0);
+    llm_allocator_t partial = llm_counting_allocator(&counter);
+    partial.free = NULL;
+    llm_client_t* client = make_client(&partial, false);
+    if (!require(client == NULL, "partial allocator rejected")) return false;
+    if (!require(counter.alloc_calls == 0, "no allocation through partial allocator")) return false;
+    return true;
+}
+
+static bool test_all_allocations_routed(void) {
+    fake_reset();
+    llm_counting_allocator_t counter;
+    llm_counting_allocator_init(&counter, NULL, 0);
+    llm_allocator_t alloc = llm_counting_allocator(&counter);
+
+    llm_client_t* client = make_client(&alloc, true);
+    if (!require(client != NULL, "client create")) return false;
+    if (!require(counter.live_allocs > 0, "client uses allocator")) return false;
+    if (!require(llm_client_set_api_key(client, "secret"), "api key")) return false;
+
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    g_fake->response_post = k_chat_tool_response;
+    llm_chat_result_t result;
+    if (!require(llm_chat(client, &msg, 1, NULL, NULL, NULL, &result), "chat")) return false;
+    if (!require(result.tool_calls_count == 1, "tool call parsed")) return false;
+    size_t live_with_result = counter.live_allocs;
+    llm_chat_result_free(&result);
+    if (!require(counter.live_allocs < live_with_result, "result freed through allocator")) return false;
+
+    g_fake->response_post = "{\"choices\":[{\"text\":\"ok\"}]}";
+    llm_completions_result_t comp;
+    if (!require(llm_completions(client, "p", 1, NULL, &comp), "completions")) return false;
+    llm_completions_free(&comp);
+
+    g_fake->response_post = "{\"data\":[{\"embedding\":[0.5,1.0]}]}";
+    llm_embedding_input_t input = {"x", 1};
+    llm_embeddings_result_t emb;
+    if (!require(llm_embeddings(client, &input, 1, NULL, &emb), "embeddings")) return false;
+    llm_embeddings_free(&emb);
+
+    g_fake->stream_payload = k_stream_payload;
+    g_fake->stream_payload_len = sizeof(k_stream_payload) - 1;
+    g_fake->stream_chunk_size = 7;
+    size_t complete_calls = 0;
+    llm_stream_callbacks_t callbacks = {0};
+    callbacks.user_data = &complete_calls;
+    callbacks.on_tool_args_complete = on_args_complete;
+    if (!require(llm_chat_stream(client, &msg, 1, NULL, NULL, NULL, &callbacks), "chat stream")) return false;
+    if (!require(complete_calls == 1, "stream tool args")) return false;
+
+    g_fake->status_post = 400;
+    g_fake->response_post = "{\"error\":{\"message\":\"bad\",\"type\":\"invalid_request_error\"}}";
+    llm_error_detail_t detail = {0};
+    if (!require(llm_chat_ex(client, &msg, 1, NULL, NULL, NULL, &result, &detail) == LLM_ERR_FAILED, "chat error")) {
+        return false;
+    }
+    if (!require(detail.raw_body != NULL, "error body captured")) return false;
+    llm_error_detail_free(&detail);
+
+    g_fake->status_post = 200;
+    g_fake->post_responses[0] = k_chat_tool_response;
+    g_fake->post_responses[1] = "{\"choices\":[{\"finish_reason\":\"stop\",\"message\":{\"content\":\"done\"}}]}";
+    g_fake->post_responses_count = 2;
+    if (!require(llm_tool_loop_run(client, &msg, 1, NULL, NULL, NULL, dispatch_echo, NULL, 4), "tool loop")) {
+        return false;
+    }
+
+    size_t calls_before_destroy = counter.alloc_calls + counter.realloc_calls;
+    llm_client_destroy(client);
+    if (!require(calls_before_destroy > 10, "allocations counted")) return false;
+    if (!require(counter.live_allocs == 0 && counter.live_bytes == 0, "no leaked allocations")) return false;
+    if (!require(counter.peak_bytes >= counter.live_bytes && counter.total_bytes >= counter.peak_bytes,
+                 "byte accounting")) {
+        return false;
+    }
+    return true;
+}
+
+static bool test_result_outlives_client(void) {
+    fake_reset();
+    llm_counting_allocator_t counter;
+    llm_counting_allocator_init(&counter, NULL, 0);
+    llm_allocator_t alloc = llm_counting_allocator(&counter);
+
+    llm_client_t* client = make_client(&alloc, false);
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    g_fake->response_post = k_chat_tool_response;
+    llm_chat_result_t result;
+    if (!require(llm_chat(client, &msg, 1, NULL, NULL, NULL, &result), "chat")) return false;
+    llm_client_destroy(client);
+    if (!require(counter.live_allocs > 0, "result still owns memory")) return false;
+    llm_chat_result_free(&result);
+    if (!require(counter.live_allocs == 0, "result freed after client")) return false;
+    return true;
+}
+
+static bool test_allocation_budget(void) {
+    fake_reset();
+    llm_counting_allocator_t counter;
+    llm_counting_allocator_init(&counter, NULL, 0);
+    llm_allocator_t alloc = llm_counting_allocator(&counter);
+
+    llm_client_t* client = make_client(&alloc, false);
+    if (!require(client != NULL, "client create")) return false;
+
+    // Allow the client itself plus a little headroom, but not a 4 KiB request buffer.
+    counter.max_live_bytes = counter.live_bytes + 1024;
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    g_fake->response_post = k_chat_tool_response;
+    llm_chat_result_t result;
+    size_t live_before = counter.live_allocs;
+    if (!require(!llm_chat(client, &msg, 1, NULL, NULL, NULL, &result), "chat over budget fails")) return false;
+    if (!require(!g_fake->called_post, "no request sent over budget")) return false;
+    if (!require(counter.failed_calls > 0, "budget failure counted")) return false;
+    if (!require(counter.live_allocs == live_before, "no leak on budget failure")) return false;
+
+    counter.max_live_bytes = 0;
+    if (!require(llm_chat(client, &msg, 1, NULL, NULL, NULL, &result), "chat after budget lifted")) return false;
+    llm_chat_result_free(&result);
+
+    llm_client_destroy(client);
+    if (!require(counter.live_allocs == 0, "no leaked allocations")) return false;
+    return true;
+}
+
+struct live_probe {
+    llm_counting_allocator_t* counter;
+    size_t live_at_dispatch;
+};
+
+static bool dispatch_probe(void* user_data, const char* tool_name, size_t name_len, const char* args_json,
+                           size_t args_len, char** result_json, size_t* result_len) {
+    struct live_probe* probe = user_data;
+    if (probe->counter->live_bytes > probe->live_at_dispatch) probe->live_at_dispatch = probe->counter->live_bytes;
+    return dispatch_echo(NULL, tool_name, name_len, args_json, args_len, result_json, result_len);
+}
+
+static bool test_tool_loop_borrows_initial_messages(void) {
+    fake_reset();
+    llm_counting_allocator_t counter;
+    llm_counting_allocator_init(&counter, NULL, 0);
+    llm_allocator_t alloc = llm_counting_allocator(&counter);
+    llm_client_t* client = make_client(&alloc, false);
+    if (!require(client != NULL, "client create")) return false;
+
+    enum { DOC_LEN = 256 * 1024 };
+    char* doc = malloc(DOC_LEN + 1);
+    if (!require(doc != NULL, "doc alloc")) return false;
+    memset(doc, 'd', DOC_LEN);
+    doc[DOC_LEN] = '\0';
+    llm_message_t msgs[2] = {{LLM_ROLE_SYSTEM, doc, DOC_LEN, NULL, 0, NULL, 0, NULL, 0, NULL, 0},
+                             {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0}};
+    g_fake->post_responses[0] = k_chat_tool_response;
+    g_fake->post_responses[1] =
+        "{\"choices\":[{\"finish_reason\":\"tool_calls\",\"message\":{\"tool_calls\":[{\"id\":\"call_2\","
+        "\"type\":\"function\",\"function\":{\"name\":\"add\",\"arguments\":\"{\\\"a\\\":2}\"}}]}}]}";
+    g_fake->post_responses[2] = "{\"choices\":[{\"finish_reason\":\"stop\",\"message\":{\"content\":\"done\"}}]}";
+    g_fake->post_responses_count = 3;
+    size_t live_before = counter.live_bytes;
+    struct live_probe probe = {&counter, 0};
+    bool ok = llm_tool_loop_run(client, msgs, 2, NULL, NULL, NULL, dispatch_probe, &probe, 4);
+    llm_client_destroy(client);
+    free(doc);
+    if (!require(ok && g_fake->request_count == 3, "tool loop")) return false;
+    // The seed document stays in caller memory; the loop only holds what it generated between requests.
+    if (!require(probe.live_at_dispatch - live_before < DOC_LEN / 4, "initial messages borrowed")) return false;
+    if (!require(counter.live_allocs == 0, "no leaked allocations")) return false;
+    return true;
+}
+
+int main(void) {
+    if (!test_partial_allocator_rejected()) return 1;
+    if (!test_all_allocations_routed()) return 1;
+    if (!test_result_outlives_client()) return 1;
+    if (!test_allocation_budget()) return 1;
+    if (!test_tool_loop_borrows_initial_messages()) return 1;
+    printf("Allocator tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static llm_client_t* make_client(const llm_allocator_t* alloc) {
+    llm_model_t model = {"test-model"};
+    llm_timeout_t timeout = {0};
+    timeout.connect_timeout_ms = 1000;
+    timeout.overall_timeout_ms = 2000;
+    timeout.read_idle_timeout_ms = 2000;
+    llm_client_init_opts_t opts = {0};
+    opts.enable_last_error = true;
+    opts.allocator = alloc;
+    return llm_client_create_opts("http://fake", &model, &timeout, NULL, &opts);
+}
+
+static bool span_eq(const char* p, size_t n, const char* lit) {
+    return p && n == strlen(lit) && memcmp(p, lit, n) == 0;
+}
+
+static const char k_chat_response[] =
+    "{\"choices\":[{\"finish_reason\":\"tool_calls\",\"message\":{\"content\":\"hi\",\"tool_calls\":[{\"id\":\"call_"
+    "1\",\"type\":\"function\",\"function\":{\"name\":\"add\",\"arguments\":\"{}\"}}]}},{\"finish_reason\":\"stop\","
+    "\"message\":{\"content\":\"second\"}}]}";
+
+static bool test_arena_basics(void) {
+    unsigned char buf[512];
+    llm_arena_t arena;
+    llm_arena_init(&arena, buf + 1, sizeof(buf) - 1);
+    llm_allocator_t a = llm_arena_allocator(&arena);
+
+    unsigned char* p1 = a.alloc(a.user_data, 10);
+    if (!require(p1 != NULL, "arena alloc")) return false;
+    if (!require(((uintptr_t)p1 % _Alignof(max_align_t)) == 0, "arena alignment")) return false;
+    memset(p1, 'a', 10);
+
+    unsigned char* grown = a.realloc(a.user_data, p1, 40);
+    if (!require(grown == p1, "top block grows in place")) return false;
+    if (!require(grown[9] == 'a', "grow keeps data")) return false;
+
+    unsigned char* p2 = a.alloc(a.user_data, 8);
+    if (!require(p2 != NULL && p2 > p1, "second alloc")) return false;
+    size_t used = arena.used;
+    unsigned char* moved = a.realloc(a.user_data, p1, 48);
+    if (!require(moved != NULL && moved != p1 && moved[0] == 'a', "non-top realloc copies")) return false;
+    if (!require(arena.used > used, "copy consumes arena")) return false;
+
+    used = arena.used;
+    void* top = a.alloc(a.user_data, 16);
+    a.free(a.user_data, top);
+    if (!require(arena.used <= used + 16, "top free rolls back")) return false;
+
+    if (!require(a.alloc(a.user_data, sizeof(buf)) == NULL, "exhausted arena fails")) return false;
+    if (!require(arena.failed_calls == 1, "failure counted")) return false;
+
+    size_t peak = arena.peak;
+    llm_arena_reset(&arena);
+    if (!require(arena.used == 0 && arena.peak == peak, "reset keeps peak")) return false;
+    if (!require(a.alloc(a.user_data, 100) != NULL, "alloc after reset")) return false;
+    return true;
+}
+
+static bool test_chat_arena(void) {
+    fake_reset();
+    llm_counting_allocator_t counter;
+    llm_counting_allocator_init(&counter, NULL, 0);
+    llm_allocator_t hooks = llm_counting_allocator(&counter);
+    llm_client_t* client = make_client(&hooks);
+    if (!require(client != NULL, "client create")) return false;
+
+    static unsigned char buf[16384];
+    llm_arena_t arena;
+    llm_arena_init(&arena, buf, sizeof(buf));
+
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    g_fake->response_post = k_chat_response;
+    size_t live_before = counter.live_allocs;
+    llm_chat_result_t result;
+    if (!require(llm_chat_arena_ex(client, &msg, 1, NULL, NULL, NULL, &arena, &result, NULL, 0, NULL) ==
+                     LLM_ERR_NONE,
+                 "chat arena")) {
+        return false;
+    }
+    if (!require(counter.live_allocs == live_before, "result holds no client memory")) return false;
+    if (!require(arena.used > sizeof(k_chat_response), "arena holds body")) return false;
+    if (!require(result.choices_count == 2 && result.tool_calls_count == 1, "choices parsed")) return false;
+    if (!require((unsigned char*)result.choices >= buf && (unsigned char*)result.choices < buf + sizeof(buf),
+                 "choices in arena")) {
+        return false;
+    }
+    if (!require(span_eq(result.tool_calls[0].name, result.tool_calls[0].name_len, "add"), "tool name")) return false;
+    if (!require(span_eq(result.choices[1].content, result.choices[1].content_len, "second"), "second choice")) {
+        return false;
+    }
+    llm_chat_result_free(&result);
+    llm_arena_reset(&arena);
+
+    g_fake->response_post = "{\"choices\":[{\"text\":\"ok\"}]}";
+    llm_completions_result_t comp;
+    if (!require(llm_completions_arena_ex(client, "p", 1, NULL, &arena, &comp, NULL, 0, NULL) == LLM_ERR_NONE,
+                 "completions arena")) {
+        return false;
+    }
+    if (!require(comp.choices_count == 1 && span_eq(comp.choices[0].text, comp.choices[0].text_len, "ok"),
+                 "completions text")) {
+        return false;
+    }
+    llm_arena_reset(&arena);
+
+    g_fake->response_post = "{\"data\":[{\"embedding\":[0.5,1.0]}]}";
+    llm_embedding_input_t input = {"x", 1};
+    llm_embeddings_result_t emb;
+    if (!require(llm_embeddings_arena_ex(client, &input, 1, NULL, &arena, &emb, NULL, 0, NULL) == LLM_ERR_NONE,
+                 "embeddings arena")) {
+        return false;
+    }
+    if (!require(emb.data_count == 1 && span_eq(emb.data[0].embedding, emb.data[0].embedding_len, "[0.5,1.0]"),
+                 "embedding span")) {
+        return false;
+    }
+    llm_arena_reset(&arena);
+    if (!require(counter.live_allocs == live_before, "no client memory retained")) return false;
+
+    llm_client_destroy(client);
+    if (!require(counter.live_allocs == 0, "no leaked allocations")) return false;
+    return true;
+}
+
+static bool test_chat_arena_errors(void) {
+    fake_reset();
+    llm_client_t* client = make_client(NULL);
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    llm_chat_result_t result;
+
+    if (!require(llm_chat_arena_ex(client, &msg, 1, NULL, NULL, NULL, NULL, &result, NULL, 0, NULL) ==
+                     LLM_ERR_FAILED,
+                 "NULL arena rejected")) {
+        return false;
+    }
+
+    unsigned char small[64];
+    llm_arena_t arena;
+    llm_arena_init(&arena, small, sizeof(small));
+    g_fake->response_post = k_chat_response;
+    if (!require(llm_chat_arena_ex(client, &msg, 1, NULL, NULL, NULL, &arena, &result, NULL, 0, NULL) ==
+                     LLM_ERR_FAILED,
+                 "exhausted arena fails")) {
+        return false;
+    }
+    if (!require(arena.failed_calls > 0, "arena failure counted")) return false;
+
+    static unsigned char buf[4096];
+    llm_arena_init(&arena, buf, sizeof(buf));
+    g_fake->status_post = 400;
+    g_fake->response_post = "{\"error\":{\"message\":\"bad\",\"type\":\"invalid_request_error\"}}";
+    llm_error_detail_t detail = {0};
+    if (!require(llm_chat_arena_ex(client, &msg, 1, NULL, NULL, NULL, &arena, &result, NULL, 0, &detail) ==
+                     LLM_ERR_FAILED,
+                 "http error")) {
+        return false;
+    }
+    memset(buf, 0, sizeof(buf));
+    llm_arena_reset(&arena);
+    if (!require(span_eq(detail.message, detail.message_len, "bad"), "detail survives arena reset")) return false;
+    llm_error_detail_free(&detail);
+
+    llm_client_destroy(client);
+    return true;
+}
+
+int main(void) {
+    if (!test_arena_basics()) return 1;
+    if (!test_chat_arena()) return 1;
+    if (!test_chat_arena_errors()) return 1;
+    printf("Arena tests passed.\n");
+    return 0;
+}
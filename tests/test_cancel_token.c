@@ -0,0 +1,206 @@
+#define _POSIX_C_SOURCE 200809L
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+static int create_listener(uint16_t* port_out) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0 ||
+        getsockname(fd, (struct sockaddr*)&addr, &len) != 0) {
+        close(fd);
+        return -1;
+    }
+    *port_out = ntohs(addr.sin_port);
+    return fd;
+}
+
+// Accepts one request and never answers, so the client can only leave by cancelling.
+struct silent_server {
+    int listen_fd;
+    bool got_request;
+    long long closed_at_ms;
+};
+
+static void* silent_server_main(void* arg) {
+    struct silent_server* srv = arg;
+    int fd = accept(srv->listen_fd, NULL, NULL);
+    if (fd < 0) return NULL;
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        srv->got_request = true;
+    }
+    srv->closed_at_ms = now_ms();
+    close(fd);
+    return NULL;
+}
+
+struct trigger {
+    llm_cancel_t* cancel;
+    long delay_ms;
+    long long fired_at_ms;
+};
+
+static void* trigger_main(void* arg) {
+    struct trigger* t = arg;
+    sleep_ms(t->delay_ms);
+    t->fired_at_ms = now_ms();
+    llm_cancel_trigger(t->cancel);
+    return NULL;
+}
+
+static void on_content_delta(void* user_data, const char* delta, size_t len) {
+    (void)user_data;
+    (void)delta;
+    (void)len;
+}
+
+static bool test_cancel_wakes_silent_stream(void) {
+    uint16_t port = 0;
+    struct silent_server srv = {create_listener(&port), false, 0};
+    if (!require(srv.listen_fd >= 0, "listener")) return false;
+    pthread_t server_thread;
+    if (!require(pthread_create(&server_thread, NULL, silent_server_main, &srv) == 0, "server thread")) return false;
+
+    char base_url[64];
+    snprintf(base_url, sizeof(base_url), "http://127.0.0.1:%u", (unsigned)port);
+    llm_model_t model = {"test-model"};
+    // The timeouts are far past the cancel point; only the token can end the call in time.
+    llm_timeout_t timeout = {0};
+    timeout.connect_timeout_ms = 10000;
+    timeout.overall_timeout_ms = 10000;
+    llm_client_t* client = llm_client_create(base_url, &model, &timeout, NULL);
+    llm_cancel_t* cancel = llm_cancel_create();
+    if (!require(client != NULL && cancel != NULL, "client and token")) return false;
+
+    struct trigger t = {cancel, 200, 0};
+    pthread_t trigger_thread;
+    if (!require(pthread_create(&trigger_thread, NULL, trigger_main, &t) == 0, "trigger thread")) return false;
+
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    llm_stream_callbacks_t callbacks = {0};
+    callbacks.on_content_delta = on_content_delta;
+    llm_error_detail_t detail = {0};
+    llm_error_t err = llm_chat_stream_detail_ex(client, &msg, 1, NULL, NULL, NULL, &callbacks, llm_cancel_abort_cb,
+                                                cancel, &detail);
+    long long returned_at = now_ms();
+    pthread_join(trigger_thread, NULL);
+    pthread_join(server_thread, NULL);
+    close(srv.listen_fd);
+
+    if (!require(err == LLM_ERR_CANCELLED && detail.code == LLM_ERR_CANCELLED, "cancelled")) return false;
+    if (!require(detail.stage == LLM_ERROR_STAGE_NONE, "cancel is not a transport error")) return false;
+    if (!require(srv.got_request, "request reached the server")) return false;
+    long long latency = returned_at - t.fired_at_ms;
+    printf("cancel-to-return latency: %lld ms\n", latency);
+    if (!require(latency < 100, "returned promptly after cancel")) return false;
+    if (!require(srv.closed_at_ms > 0 && srv.closed_at_ms - t.fired_at_ms < 1000, "connection closed")) return false;
+
+    // Reset rearms the token; a triggered token fails the next call before it connects.
+    if (!require(llm_cancel_triggered(cancel), "token stays triggered")) return false;
+    llm_cancel_reset(cancel);
+    if (!require(!llm_cancel_triggered(cancel), "reset")) return false;
+    llm_cancel_trigger(cancel);
+    llm_cancel_trigger(cancel);
+    err = llm_chat_stream_ex(client, &msg, 1, NULL, NULL, NULL, &callbacks, llm_cancel_abort_cb, cancel);
+    if (!require(err == LLM_ERR_CANCELLED, "pre-triggered token")) return false;
+
+    llm_error_detail_free(&detail);
+    llm_cancel_destroy(cancel);
+    llm_client_destroy(client);
+    return true;
+}
+
+static bool never_dispatch(void* user_data, const char* tool_name, size_t name_len, const char* args_json,
+                           size_t args_len, char** result_json, size_t* result_len) {
+    (void)user_data;
+    (void)tool_name;
+    (void)name_len;
+    (void)args_json;
+    (void)args_len;
+    (void)result_json;
+    (void)result_len;
+    return false;
+}
+
+// The streaming tool loop hands the transport its own abort callback; the token behind it must still wake it.
+static bool test_cancel_wakes_tool_loop_stream(void) {
+    uint16_t port = 0;
+    struct silent_server srv = {create_listener(&port), false, 0};
+    if (!require(srv.listen_fd >= 0, "listener")) return false;
+    pthread_t server_thread;
+    if (!require(pthread_create(&server_thread, NULL, silent_server_main, &srv) == 0, "server thread")) return false;
+
+    char base_url[64];
+    snprintf(base_url, sizeof(base_url), "http://127.0.0.1:%u", (unsigned)port);
+    llm_model_t model = {"test-model"};
+    llm_timeout_t timeout = {0};
+    timeout.connect_timeout_ms = 10000;
+    timeout.overall_timeout_ms = 10000;
+    llm_client_t* client = llm_client_create(base_url, &model, &timeout, NULL);
+    llm_cancel_t* cancel = llm_cancel_create();
+    if (!require(client != NULL && cancel != NULL, "client and token")) return false;
+
+    struct trigger t = {cancel, 200, 0};
+    pthread_t trigger_thread;
+    if (!require(pthread_create(&trigger_thread, NULL, trigger_main, &t) == 0, "trigger thread")) return false;
+
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    static const char tooling[] = "[{\"type\":\"function\",\"function\":{\"name\":\"noop\"}}]";
+    llm_error_t err = llm_tool_loop_run_stream_ex(client, &msg, 1, NULL, tooling, NULL, NULL, never_dispatch, NULL,
+                                                  llm_cancel_abort_cb, cancel, 4);
+    long long returned_at = now_ms();
+    pthread_join(trigger_thread, NULL);
+    pthread_join(server_thread, NULL);
+    close(srv.listen_fd);
+
+    if (!require(err == LLM_ERR_CANCELLED, "tool loop cancelled")) return false;
+    if (!require(srv.got_request, "request reached the server")) return false;
+    long long latency = returned_at - t.fired_at_ms;
+    printf("tool loop cancel-to-return latency: %lld ms\n", latency);
+    if (!require(latency < 100, "tool loop returned promptly after cancel")) return false;
+
+    llm_cancel_destroy(cancel);
+    llm_client_destroy(client);
+    return true;
+}
+
+int main(void) {
+    if (!test_cancel_wakes_silent_stream()) return 1;
+    if (!test_cancel_wakes_tool_loop_stream()) return 1;
+    printf("Cancel token tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static llm_client_t* make_client(void) {
+    llm_model_t model = {"test-model"};
+    return llm_client_create("http://fake", &model, NULL, NULL);
+}
+
+enum { ITEMS = 5 };
+
+static const char* const k_prompts[ITEMS] = {"q0", "q1", "q2", "q3", "q4"};
+static const char* const k_answers[ITEMS] = {
+    "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"a0\"},\"finish_reason\":\"stop\"}]}",
+    "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"a1\"},\"finish_reason\":\"stop\"}]}",
+    "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"a2\"},\"finish_reason\":\"stop\"}]}",
+    "{\"error\":{\"message\":\"slow down\",\"type\":\"rate_limit\",\"code\":\"rate_limited\"}}",
+    "{\"choices\":[",
+};
+
+static bool request_sent(const char* prompt) {
+    char needle[32];
+    snprintf(needle, sizeof(needle), "\"content\":\"%s\"", prompt);
+    for (size_t i = 0; i < g_fake->request_count; i++) {
+        if (strstr(g_fake->request_bodies[i], needle)) return true;
+    }
+    return false;
+}
+
+static bool test_per_item_results(void) {
+    fake_reset();
+    for (size_t i = 0; i < ITEMS; i++) g_fake->post_responses[i] = k_answers[i];
+    g_fake->batch_statuses[3] = 429;
+    // Responses arrive out of order; results must still line up with requests.
+    g_fake->batch_newest_first = true;
+
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msgs[ITEMS];
+    llm_chat_batch_request_t reqs[ITEMS];
+    for (size_t i = 0; i < ITEMS; i++) {
+        llm_message_t msg = {LLM_ROLE_USER, k_prompts[i], 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+        msgs[i] = msg;
+        memset(&reqs[i], 0, sizeof(reqs[i]));
+        reqs[i].messages = &msgs[i];
+        reqs[i].messages_count = 1;
+    }
+    llm_chat_batch_result_t results[ITEMS];
+    llm_error_t err = llm_chat_batch_ex(client, reqs, ITEMS, 2, results);
+    llm_client_destroy(client);
+
+    if (!require(err == LLM_ERR_FAILED, "batch reports failure")) return false;
+    if (!require(g_fake->batch_calls == 1 && g_fake->batch_max_in_flight == 2, "one batch, concurrency 2")) {
+        return false;
+    }
+    if (!require(g_fake->batch_peak_in_flight == 2 && g_fake->request_count == ITEMS, "bounded in-flight")) {
+        return false;
+    }
+    for (size_t i = 0; i < ITEMS; i++) {
+        if (!require(request_sent(k_prompts[i]), "every request sent")) return false;
+    }
+    for (size_t i = 0; i < 3; i++) {
+        char want[3] = {'a', (char)('0' + i), '\0'};
+        if (!require(results[i].error == LLM_ERR_NONE && results[i].result.content_len == 2 &&
+                         memcmp(results[i].result.content, want, 2) == 0,
+                     "result matches its request")) {
+            return false;
+        }
+    }
+    const llm_error_detail_t* d3 = &results[3].detail;
+    if (!require(results[3].error == LLM_ERR_FAILED && d3->stage == LLM_ERROR_STAGE_PROTOCOL &&
+                     d3->http_status == 429 && d3->message_len == 9 && memcmp(d3->message, "slow down", 9) == 0,
+                 "http error detail per item")) {
+        return false;
+    }
+    if (!require(results[4].error == LLM_ERR_FAILED && results[4].detail.stage == LLM_ERROR_STAGE_JSON,
+                 "parse error detail per item")) {
+        return false;
+    }
+    llm_chat_batch_results_free(results, ITEMS);
+    return true;
+}
+
+static bool test_all_succeed(void) {
+    fake_reset();
+    g_fake->response_post = k_answers[0];
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "q", 1, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    llm_chat_batch_request_t reqs[3] = {{&msg, 1, NULL, NULL, NULL}, {&msg, 1, NULL, NULL, NULL},
+                                        {&msg, 1, NULL, NULL, NULL}};
+    llm_chat_batch_result_t results[3];
+    llm_error_t err = llm_chat_batch_ex(client, reqs, 3, 0, results);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE && g_fake->batch_peak_in_flight == 1, "sequential batch succeeds")) {
+        return false;
+    }
+    for (size_t i = 0; i < 3; i++) {
+        if (!require(results[i].error == LLM_ERR_NONE && results[i].result.content_len == 2, "each result")) {
+            return false;
+        }
+    }
+    llm_chat_batch_results_free(results, 3);
+    return true;
+}
+
+static bool test_build_failure_is_per_item(void) {
+    fake_reset();
+    g_fake->response_post = k_answers[0];
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "q", 1, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    // content and content_json together cannot be encoded.
+    llm_message_t bad = {LLM_ROLE_USER, "q", 1, NULL, 0, NULL, 0, NULL, 0, "[]", 2};
+    llm_chat_batch_request_t reqs[2] = {{&bad, 1, NULL, NULL, NULL}, {&msg, 1, NULL, NULL, NULL}};
+    llm_chat_batch_result_t results[2];
+    llm_error_t err = llm_chat_batch_ex(client, reqs, 2, 2, results);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_FAILED && g_fake->request_count == 1, "bad item not sent")) return false;
+    if (!require(results[0].error == LLM_ERR_FAILED && results[0].detail.stage == LLM_ERROR_STAGE_PROTOCOL,
+                 "build failure detail")) {
+        return false;
+    }
+    if (!require(results[1].error == LLM_ERR_NONE, "other items unaffected")) return false;
+    llm_chat_batch_results_free(results, 2);
+    return true;
+}
+
+int main(void) {
+    if (!test_per_item_results()) return 1;
+    if (!test_all_succeed()) return 1;
+    if (!test_build_failure_is_per_item()) return 1;
+    printf("Chat batch tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,166 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static const char k_answer[] =
+    "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"hi\"},\"finish_reason\":\"stop\"}]}";
+
+static llm_client_t* make_client(void) {
+    llm_model_t model = {"base-model"};
+    const char* headers[] = {"X-Team: evals"};
+    llm_client_init_opts_t opts = {0};
+    opts.enable_last_error = true;
+    llm_client_t* client = llm_client_create_with_headers_opts("http://fake", &model, NULL, NULL, headers, 1, &opts);
+    if (client && !llm_client_set_api_key(client, "k1")) {
+        llm_client_destroy(client);
+        return NULL;
+    }
+    return client;
+}
+
+static llm_error_t chat(llm_client_t* client, const llm_message_t* msg) {
+    llm_chat_result_t result;
+    llm_error_t err = llm_chat_ex(client, msg, 1, NULL, NULL, NULL, &result, NULL);
+    if (err == LLM_ERR_NONE) llm_chat_result_free(&result);
+    return err;
+}
+
+static bool test_context_shares_config(void) {
+    fake_reset();
+    g_fake->response_post = k_answer;
+    static const char* const expected[] = {"X-Team: evals", "Authorization: Bearer k1"};
+    g_fake->expected_headers = expected;
+    g_fake->expected_headers_count = 2;
+
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_client_t* ctx = llm_client_context_create(client);
+    if (!require(ctx != NULL, "context create")) return false;
+
+    llm_message_t ok_msg = {LLM_ROLE_USER, "q", 1, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    llm_message_t bad_msg = {LLM_ROLE_USER, "q", 1, NULL, 0, NULL, 0, NULL, 0, "[]", 2};
+    if (!require(chat(client, &ok_msg) == LLM_ERR_NONE, "parent request")) return false;
+    if (!require(chat(ctx, &bad_msg) == LLM_ERR_FAILED, "context request fails")) return false;
+    if (!require(g_fake->headers_ok && strstr(g_fake->last_request_body, "\"model\":\"base-model\"") != NULL,
+                 "context uses the client configuration")) {
+        return false;
+    }
+    const llm_error_detail_t* parent_err = llm_client_last_error(client);
+    const llm_error_detail_t* ctx_err = llm_client_last_error(ctx);
+    if (!require(parent_err && parent_err->code == LLM_ERR_NONE, "parent last_error untouched")) return false;
+    if (!require(ctx_err && ctx_err->code == LLM_ERR_FAILED, "context has its own last_error")) return false;
+
+    // The configuration outlives the handle that created it.
+    llm_client_destroy(client);
+    if (!require(chat(ctx, &ok_msg) == LLM_ERR_NONE && g_fake->headers_ok, "context after parent destroy")) {
+        return false;
+    }
+    llm_client_destroy(ctx);
+    return true;
+}
+
+static bool test_setters_copy_on_write(void) {
+    fake_reset();
+    g_fake->response_post = k_answer;
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_client_t* ctx = llm_client_context_create(client);
+    if (!require(ctx != NULL, "context create")) return false;
+
+    llm_model_t other = {"ctx-model"};
+    if (!require(llm_client_set_model(ctx, &other) && llm_client_set_api_key(client, "k2"), "setters")) {
+        return false;
+    }
+    llm_message_t msg = {LLM_ROLE_USER, "q", 1, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+
+    static const char* const ctx_headers[] = {"X-Team: evals", "Authorization: Bearer k1"};
+    g_fake->expected_headers = ctx_headers;
+    g_fake->expected_headers_count = 2;
+    if (!require(chat(ctx, &msg) == LLM_ERR_NONE && g_fake->headers_ok, "context keeps its api key")) return false;
+    if (!require(strstr(g_fake->last_request_body, "\"model\":\"ctx-model\"") != NULL, "context model")) {
+        return false;
+    }
+
+    static const char* const parent_headers[] = {"X-Team: evals", "Authorization: Bearer k2"};
+    g_fake->expected_headers = parent_headers;
+    if (!require(chat(client, &msg) == LLM_ERR_NONE && g_fake->headers_ok, "parent sees its new api key")) {
+        return false;
+    }
+    if (!require(strstr(g_fake->last_request_body, "\"model\":\"base-model\"") != NULL, "parent model kept")) {
+        return false;
+    }
+    llm_client_destroy(ctx);
+    llm_client_destroy(client);
+    return true;
+}
+
+enum { THREADS = 4, ROUNDS = 200 };
+
+struct worker {
+    llm_client_t* ctx;
+    bool ok;
+};
+
+// Requests that fail before reaching the transport still write last_error, which is what threads must not share.
+static void* worker_main(void* arg) {
+    struct worker* w = arg;
+    llm_message_t bad_msg = {LLM_ROLE_USER, "q", 1, NULL, 0, NULL, 0, NULL, 0, "[]", 2};
+    w->ok = true;
+    for (int i = 0; i < ROUNDS && w->ok; i++) {
+        llm_error_t err = chat(w->ctx, &bad_msg);
+        const llm_error_detail_t* detail = llm_client_last_error(w->ctx);
+        w->ok = err == LLM_ERR_FAILED && detail && detail->code == LLM_ERR_FAILED &&
+                detail->stage == LLM_ERROR_STAGE_PROTOCOL;
+    }
+    return NULL;
+}
+
+static bool test_threads_share_one_client(void) {
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    struct worker workers[THREADS];
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        workers[i].ctx = llm_client_context_create(client);
+        if (!require(workers[i].ctx != NULL, "context create")) return false;
+    }
+    for (int i = 0; i < THREADS; i++) {
+        if (!require(pthread_create(&threads[i], NULL, worker_main, &workers[i]) == 0, "thread start")) return false;
+    }
+    bool ok = true;
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        ok = ok && workers[i].ok;
+        llm_client_destroy(workers[i].ctx);
+    }
+    llm_client_destroy(client);
+    return require(ok, "every thread saw its own errors");
+}
+
+int main(void) {
+    if (!test_context_shares_config()) return 1;
+    if (!test_setters_copy_on_write()) return 1;
+    if (!test_threads_share_one_client()) return 1;
+    printf("Client context tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,197 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static llm_client_t* make_client(void) {
+    llm_model_t model = {"test-model"};
+    llm_timeout_t timeout = {0};
+    timeout.connect_timeout_ms = 1000;
+    timeout.overall_timeout_ms = 2000;
+    timeout.read_idle_timeout_ms = 2000;
+    return llm_client_create("http://fake", &model, &timeout, NULL);
+}
+
+static size_t base64_encode_f32(const float* values, size_t count, char* out) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned char bytes[64];
+    size_t n = count * 4;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t w;
+        memcpy(&w, &values[i], sizeof(w));
+        for (size_t b = 0; b < 4; b++) bytes[i * 4 + b] = (unsigned char)(w >> (8 * b));
+    }
+    size_t o = 0;
+    for (size_t i = 0; i < n; i += 3) {
+        uint32_t chunk = (uint32_t)bytes[i] << 16;
+        if (i + 1 < n) chunk |= (uint32_t)bytes[i + 1] << 8;
+        if (i + 2 < n) chunk |= bytes[i + 2];
+        out[o++] = table[(chunk >> 18) & 63];
+        out[o++] = table[(chunk >> 12) & 63];
+        out[o++] = (i + 1 < n) ? table[(chunk >> 6) & 63] : '=';
+        out[o++] = (i + 2 < n) ? table[chunk & 63] : '=';
+    }
+    out[o] = '\0';
+    return o;
+}
+
+static bool test_decode_numbers(void) {
+    static const char* const numbers[] = {
+        "0",
+        "-0",
+        "1",
+        "-1.5",
+        "0.0001234",
+        "3.14159265358979323846264",
+        "1e10",
+        "-2.5E-3",
+        "1e-45",
+        "3.4028235e38",
+        "12345678901234567890",
+        "0.000000000000000000000001",
+        "123.456e5",
+        "9007199254740993",
+        "-0.017",
+        "0.99999994",
+    };
+    size_t count = sizeof(numbers) / sizeof(numbers[0]);
+    char json[1024];
+    size_t off = 0;
+    json[off++] = '[';
+    for (size_t i = 0; i < count; i++) {
+        off += (size_t)snprintf(json + off, sizeof(json) - off, "%s%s", i ? ", " : "", numbers[i]);
+    }
+    json[off++] = ']';
+
+    float out[32];
+    size_t dims = 0;
+    if (!require(llm_embedding_decode_f32(json, off, NULL, 0, &dims) && dims == count, "size pass")) return false;
+    if (!require(llm_embedding_decode_f32(json, off, out, 32, &dims) && dims == count, "decode")) return false;
+    for (size_t i = 0; i < count; i++) {
+        float expect = (float)strtod(numbers[i], NULL);
+        if (!require(memcmp(&out[i], &expect, sizeof(float)) == 0, numbers[i])) return false;
+    }
+
+    if (!require(!llm_embedding_decode_f32(json, off, out, count - 1, &dims), "cap enforced")) return false;
+    if (!require(llm_embedding_decode_f32("[]", 2, out, 1, &dims) && dims == 0, "empty array")) return false;
+    if (!require(!llm_embedding_decode_f32("[1,]", 4, out, 4, &dims), "trailing comma")) return false;
+    if (!require(!llm_embedding_decode_f32("[01]", 4, out, 4, &dims), "leading zero")) return false;
+    if (!require(!llm_embedding_decode_f32("[1.]", 4, out, 4, &dims), "bare dot")) return false;
+    if (!require(!llm_embedding_decode_f32("[1 2]", 5, out, 4, &dims), "missing comma")) return false;
+    return true;
+}
+
+static bool test_decode_base64(void) {
+    float values[5] = {0.5f, -1.25f, 3.0e-7f, 12345.678f, 0.0f};
+    char b64[64];
+    size_t len = base64_encode_f32(values, 5, b64);
+    float out[5];
+    size_t dims = 0;
+    if (!require(llm_embedding_decode_f32(b64, len, out, 5, &dims) && dims == 5, "base64 decode")) return false;
+    if (!require(memcmp(out, values, sizeof(values)) == 0, "base64 values")) return false;
+    if (!require(!llm_embedding_decode_f32(b64, len, out, 4, &dims), "base64 cap")) return false;
+    if (!require(!llm_embedding_decode_f32("AAA", 3, out, 4, &dims), "partial float")) return false;
+    if (!require(!llm_embedding_decode_f32("AA*A", 4, out, 4, &dims), "bad alphabet")) return false;
+    return true;
+}
+
+static bool test_embeddings_matrix(void) {
+    fake_reset();
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_embedding_input_t inputs[2] = {{"a", 1}, {"b", 1}};
+    float out[8];
+    size_t dims = 0;
+
+    g_fake->response_post =
+        "{\"data\":[{\"index\":0,\"embedding\":[0.5,1,-2]},{\"index\":1,\"embedding\":[3,4e-1,5]}]}";
+    if (!require(llm_embeddings_f32_ex(client, inputs, 2, NULL, LLM_EMBEDDING_ENCODING_FLOAT, out, 8, &dims, NULL, 0,
+                                       NULL) == LLM_ERR_NONE,
+                 "float matrix")) {
+        return false;
+    }
+    if (!require(dims == 3 && out[0] == 0.5f && out[2] == -2.0f && out[4] == 0.4f, "matrix rows")) return false;
+    if (!require(strstr(g_fake->last_request_body, "encoding_format") == NULL, "float leaves encoding default")) {
+        return false;
+    }
+
+    float v0[2] = {1.0f, 2.0f};
+    float v1[2] = {-3.0f, 0.25f};
+    char b0[32];
+    char b1[32];
+    base64_encode_f32(v0, 2, b0);
+    base64_encode_f32(v1, 2, b1);
+    char response[256];
+    snprintf(response, sizeof(response), "{\"data\":[{\"embedding\":\"%s\"},{\"embedding\":\"%s\"}]}", b0, b1);
+    g_fake->response_post = response;
+    if (!require(llm_embeddings_f32_ex(client, inputs, 2, NULL, LLM_EMBEDDING_ENCODING_BASE64, out, 8, &dims, NULL, 0,
+                                       NULL) == LLM_ERR_NONE,
+                 "base64 matrix")) {
+        return false;
+    }
+    if (!require(dims == 2 && out[0] == 1.0f && out[1] == 2.0f && out[2] == -3.0f && out[3] == 0.25f,
+                 "base64 rows")) {
+        return false;
+    }
+    if (!require(strstr(g_fake->last_request_body, "\"encoding_format\":\"base64\"") != NULL, "base64 requested")) {
+        return false;
+    }
+
+    llm_error_detail_t detail = {0};
+    g_fake->response_post = "{\"data\":[{\"embedding\":[1,2]},{\"embedding\":[1,2,3]}]}";
+    if (!require(llm_embeddings_f32_ex(client, inputs, 2, NULL, LLM_EMBEDDING_ENCODING_FLOAT, out, 8, &dims, NULL, 0,
+                                       &detail) == LLM_ERR_FAILED,
+                 "ragged rows rejected")) {
+        return false;
+    }
+    if (!require(detail.stage == LLM_ERROR_STAGE_PROTOCOL && detail.raw_body != NULL &&
+                     detail.raw_body_len == strlen(g_fake->response_post),
+                 "ragged detail")) {
+        return false;
+    }
+    llm_error_detail_free(&detail);
+
+    g_fake->response_post = "{\"data\":[{\"embedding\":[1,2,3]},{\"embedding\":[1,2,3]}]}";
+    if (!require(llm_embeddings_f32_ex(client, inputs, 2, NULL, LLM_EMBEDDING_ENCODING_FLOAT, out, 5, &dims, NULL, 0,
+                                       NULL) == LLM_ERR_FAILED,
+                 "matrix cap enforced")) {
+        return false;
+    }
+    g_fake->response_post = "{\"data\":[{\"embedding\":[1,2,3]}]}";
+    if (!require(llm_embeddings_f32_ex(client, inputs, 2, NULL, LLM_EMBEDDING_ENCODING_FLOAT, out, 8, &dims, NULL, 0,
+                                       NULL) == LLM_ERR_FAILED,
+                 "row count enforced")) {
+        return false;
+    }
+
+    llm_client_destroy(client);
+    return true;
+}
+
+int main(void) {
+    if (!test_decode_numbers()) return 1;
+    if (!test_decode_base64()) return 1;
+    if (!test_embeddings_matrix()) return 1;
+    printf("Embeddings f32 tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static llm_client_t* make_client(size_t max_inputs, size_t max_input_bytes) {
+    llm_model_t model = {"embed-model"};
+    llm_limits_t limits = {0};
+    limits.max_embedding_inputs = max_inputs;
+    limits.max_embedding_input_bytes = max_input_bytes;
+    return llm_client_create("http://fake", &model, NULL, &limits);
+}
+
+static bool embedding_is(const llm_embeddings_result_t* result, size_t i, const char* want) {
+    size_t len = strlen(want);
+    return result->data[i].embedding_len == len && memcmp(result->data[i].embedding, want, len) == 0;
+}
+
+enum { INPUTS = 7 };
+
+static const char* const k_texts[INPUTS] = {"t0", "t1", "t2", "t3", "t4", "t5", "t6"};
+
+static bool test_shards_merge_in_input_order(void) {
+    fake_reset();
+    g_fake->post_responses[0] = "{\"data\":[{\"embedding\":[0]},{\"embedding\":[1]},{\"embedding\":[2]}]}";
+    g_fake->post_responses[1] = "{\"error\":{\"message\":\"overloaded\"}}";
+    g_fake->post_responses[2] = "{\"data\":[{\"embedding\":[6]}]}";
+    g_fake->batch_statuses[1] = 500;
+    g_fake->batch_newest_first = true;
+
+    llm_client_t* client = make_client(3, 0);
+    if (!require(client != NULL, "client create")) return false;
+    llm_embedding_input_t inputs[INPUTS];
+    for (size_t i = 0; i < INPUTS; i++) {
+        inputs[i].text = k_texts[i];
+        inputs[i].text_len = 2;
+    }
+    llm_error_t input_errors[INPUTS];
+    llm_embeddings_opts_t opts = {0};
+    opts.max_parallel_requests = 2;
+    opts.input_errors = input_errors;
+    llm_embeddings_result_t result;
+    llm_error_detail_t detail = {0};
+    llm_error_t err = llm_embeddings_opts_ex(client, inputs, INPUTS, NULL, &result, NULL, 0, &opts, &detail);
+    llm_client_destroy(client);
+
+    if (!require(err == LLM_ERR_FAILED && detail.http_status == 500, "failed shard reported")) return false;
+    if (!require(g_fake->batch_calls == 1 && g_fake->request_count == 3 && g_fake->batch_peak_in_flight == 2,
+                 "three shards, two in flight")) {
+        return false;
+    }
+    if (!require(strstr(g_fake->request_bodies[0], "\"input\":[\"t0\",\"t1\",\"t2\"]") != NULL &&
+                     strstr(g_fake->request_bodies[2], "\"input\":[\"t6\"]") != NULL,
+                 "shards respect max_embedding_inputs")) {
+        return false;
+    }
+    for (size_t i = 0; i < INPUTS; i++) {
+        llm_error_t want = (i >= 3 && i <= 5) ? LLM_ERR_FAILED : LLM_ERR_NONE;
+        if (!require(input_errors[i] == want, "per-input errors")) return false;
+    }
+    if (!require(result.data_count == INPUTS && embedding_is(&result, 0, "[0]") && embedding_is(&result, 2, "[2]") &&
+                     embedding_is(&result, 6, "[6]"),
+                 "embeddings in input order")) {
+        return false;
+    }
+    if (!require(result.data[4].embedding == NULL && result.data[4].embedding_len == 0, "failed inputs empty")) {
+        return false;
+    }
+    llm_embeddings_free(&result);
+    llm_error_detail_free(&detail);
+    return true;
+}
+
+static bool test_oversized_input_fails_alone(void) {
+    fake_reset();
+    g_fake->post_responses[0] = "{\"data\":[{\"embedding\":[0]}]}";
+    g_fake->post_responses[2] = "{\"data\":[{\"embedding\":[2]}]}";  // shard 1 is never sent
+
+    llm_client_t* client = make_client(0, 4);
+    if (!require(client != NULL, "client create")) return false;
+    llm_embedding_input_t inputs[3] = {{"aa", 2}, {"bbbbbbb", 7}, {"cc", 2}};
+    llm_error_t input_errors[3];
+    llm_embeddings_opts_t opts = {0};
+    opts.input_errors = input_errors;
+    llm_embeddings_result_t result;
+    llm_error_t err = llm_embeddings_opts_ex(client, inputs, 3, NULL, &result, NULL, 0, &opts, NULL);
+    llm_client_destroy(client);
+
+    if (!require(err == LLM_ERR_FAILED && g_fake->request_count == 2, "oversized input not sent")) return false;
+    if (!require(input_errors[0] == LLM_ERR_NONE && input_errors[1] == LLM_ERR_FAILED &&
+                     input_errors[2] == LLM_ERR_NONE,
+                 "only the oversized input fails")) {
+        return false;
+    }
+    if (!require(embedding_is(&result, 0, "[0]") && embedding_is(&result, 2, "[2]"), "neighbours embedded")) {
+        return false;
+    }
+    llm_embeddings_free(&result);
+    return true;
+}
+
+static bool test_max_inputs_per_request(void) {
+    fake_reset();
+    g_fake->response_post = "{\"data\":[{\"embedding\":[1]},{\"embedding\":[2]}]}";
+
+    llm_client_t* client = make_client(0, 0);
+    if (!require(client != NULL, "client create")) return false;
+    llm_embedding_input_t inputs[4] = {{"a", 1}, {"b", 1}, {"c", 1}, {"d", 1}};
+    llm_embeddings_opts_t opts = {0};
+    opts.max_inputs_per_request = 2;
+    opts.max_parallel_requests = 4;
+    llm_embeddings_result_t result;
+    llm_error_t err = llm_embeddings_opts_ex(client, inputs, 4, NULL, &result, NULL, 0, &opts, NULL);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE && g_fake->request_count == 2 && g_fake->batch_max_in_flight == 4,
+                 "two shards of two")) {
+        return false;
+    }
+    if (!require(result.data_count == 4 && embedding_is(&result, 1, "[2]") && embedding_is(&result, 2, "[1]"),
+                 "merged result")) {
+        return false;
+    }
+    llm_embeddings_free(&result);
+    return true;
+}
+
+static bool test_rows_mapped_by_index(void) {
+    fake_reset();
+    g_fake->post_responses[0] = "{\"data\":[{\"index\":1,\"embedding\":[1]},{\"index\":0,\"embedding\":[0]}]}";
+    g_fake->post_responses[1] = "{\"data\":[{\"index\":1,\"embedding\":[3]},{\"index\":0,\"embedding\":[2]}]}";
+
+    llm_client_t* client = make_client(2, 0);
+    if (!require(client != NULL, "client create")) return false;
+    llm_embedding_input_t inputs[4] = {{"a", 1}, {"b", 1}, {"c", 1}, {"d", 1}};
+    llm_embeddings_opts_t opts = {0};
+    llm_embeddings_result_t result;
+    llm_error_t err = llm_embeddings_opts_ex(client, inputs, 4, NULL, &result, NULL, 0, &opts, NULL);
+    if (!require(err == LLM_ERR_NONE && result.data_count == 4, "shuffled shards merge")) return false;
+    for (size_t i = 0; i < 4; i++) {
+        char want[4] = {'[', (char)('0' + i), ']', '\0'};
+        if (!require(embedding_is(&result, i, want), "row placed by index")) return false;
+    }
+    llm_embeddings_free(&result);
+
+    fake_reset();
+    g_fake->response_post = "{\"data\":[{\"index\":0,\"embedding\":[0]},{\"index\":0,\"embedding\":[1]}]}";
+    err = llm_embeddings_opts_ex(client, inputs, 2, NULL, &result, NULL, 0, &opts, NULL);
+    llm_client_destroy(client);
+    return require(err != LLM_ERR_NONE, "duplicate index rejected");
+}
+
+int main(void) {
+    if (!test_shards_merge_in_input_order()) return 1;
+    if (!test_oversized_input_fails_alone()) return 1;
+    if (!test_max_inputs_per_request()) return 1;
+    if (!test_rows_mapped_by_index()) return 1;
+    printf("Embeddings sharding tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,200 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+#include "protocol_embeddings.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static llm_client_t* make_client(void) {
+    llm_model_t model = {"test-model"};
+    llm_timeout_t timeout = {0};
+    timeout.connect_timeout_ms = 1000;
+    timeout.overall_timeout_ms = 2000;
+    timeout.read_idle_timeout_ms = 2000;
+    return llm_client_create("http://fake", &model, &timeout, NULL);
+}
+
+typedef struct {
+    float rows[4][4];
+    size_t dims[4];
+    size_t order[4];
+    size_t calls;
+    size_t stop_after;
+} collect_t;
+
+static bool collect(void* user_data, size_t index, const float* vector, size_t dims) {
+    collect_t* c = user_data;
+    if (index >= 4 || dims > 4 || c->calls >= 4) return false;
+    memcpy(c->rows[index], vector, dims * sizeof(float));
+    c->dims[index] = dims;
+    c->order[c->calls++] = index;
+    return c->stop_after == 0 || c->calls < c->stop_after;
+}
+
+static const char k_response[] =
+    "{\"object\":\"list\",\"data\":[{\"object\":\"embedding\",\"embedding\":[0.5, -1.25e0,3],\"index\":1},"
+    "{\"index\":0,\"meta\":{\"data\":[9],\"embedding\":\"x\"},\"embedding\":[1e-1,2,0]}],"
+    "\"model\":\"m\",\"usage\":{\"prompt_tokens\":2,\"total_tokens\":2},\"note\":\"esc\\\"aped [\"}";
+
+static bool check_collected(const collect_t* c) {
+    if (!require(c->calls == 2, "two vectors")) return false;
+    if (!require(c->order[0] == 1 && c->order[1] == 0, "response order with index")) return false;
+    if (!require(c->dims[0] == 3 && c->dims[1] == 3, "dims")) return false;
+    if (!require(c->rows[1][0] == 0.5f && c->rows[1][1] == -1.25f && c->rows[1][2] == 3.0f, "row 1")) return false;
+    if (!require(c->rows[0][0] == 0.1f && c->rows[0][1] == 2.0f, "row 0")) return false;
+    return true;
+}
+
+static bool test_every_split(void) {
+    size_t len = sizeof(k_response) - 1;
+    for (size_t split = 0; split <= len; split++) {
+        collect_t c = {0};
+        float row[4];
+        emb_stream_t s;
+        emb_stream_init(&s, row, 4, collect, &c);
+        if (!require(emb_stream_feed(&s, k_response, split) == EMB_STREAM_OK, "feed head")) return false;
+        if (!require(emb_stream_feed(&s, k_response + split, len - split) == EMB_STREAM_OK, "feed tail")) {
+            return false;
+        }
+        if (!require(emb_stream_finish(&s) == EMB_STREAM_OK, "finish")) return false;
+        if (!check_collected(&c)) return false;
+    }
+    return true;
+}
+
+static int scan_all(const char* json, size_t row_cap) {
+    collect_t c = {0};
+    float row[4];
+    emb_stream_t s;
+    emb_stream_init(&s, row, row_cap, collect, &c);
+    int rc = emb_stream_feed(&s, json, strlen(json));
+    if (rc != EMB_STREAM_OK) return rc;
+    return emb_stream_finish(&s);
+}
+
+static bool test_rejects(void) {
+    if (!require(scan_all("{\"data\":[{\"embedding\":[1,2]}]}", 4) == EMB_STREAM_OK, "baseline")) return false;
+    if (!require(scan_all("{\"data\":[{\"embedding\":[1,2,3]}]}", 2) == EMB_STREAM_ERR_OVERFLOW, "row cap")) {
+        return false;
+    }
+    if (!require(scan_all("{\"data\":[{\"embedding\":[1,]}]}", 4) == EMB_STREAM_ERR_SYNTAX, "trailing comma")) {
+        return false;
+    }
+    if (!require(scan_all("{\"data\":[{\"embedding\":[1 2]}]}", 4) == EMB_STREAM_ERR_SYNTAX, "missing comma")) {
+        return false;
+    }
+    if (!require(scan_all("{\"data\":[{\"embedding\":[\"1\"]}]}", 4) == EMB_STREAM_ERR_PROTOCOL, "string elem")) {
+        return false;
+    }
+    if (!require(scan_all("{\"data\":[{\"index\":0}]}", 4) == EMB_STREAM_ERR_PROTOCOL, "missing vector")) {
+        return false;
+    }
+    if (!require(scan_all("{\"data\":[{\"embedding\":[1]}]", 4) == EMB_STREAM_ERR_SYNTAX, "truncated")) return false;
+    if (!require(scan_all("{\"data\":[{\"embedding\":[1]}]]", 4) == EMB_STREAM_ERR_SYNTAX, "mismatch")) return false;
+    if (!require(scan_all("{\"data\":[{\"embedding\":\"AAA\"}]}", 4) == EMB_STREAM_ERR_PROTOCOL, "partial b64")) {
+        return false;
+    }
+    return true;
+}
+
+static bool test_stream_request(void) {
+    fake_reset();
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_embedding_input_t inputs[2] = {{"a", 1}, {"b", 1}};
+    float row[4];
+
+    g_fake->stream_payload = k_response;
+    g_fake->stream_payload_len = sizeof(k_response) - 1;
+    g_fake->stream_chunk_size = 5;
+    collect_t c = {0};
+    if (!require(llm_embeddings_stream_ex(client, inputs, 2, NULL, LLM_EMBEDDING_ENCODING_FLOAT, row, 4, collect, &c,
+                                          NULL, 0, NULL) == LLM_ERR_NONE,
+                 "stream embeddings")) {
+        return false;
+    }
+    if (!check_collected(&c)) return false;
+    if (!require(g_fake->called_stream && !g_fake->called_post, "uses streaming transport")) return false;
+
+    // "AACAPwAAAEA=" is {1.0f, 2.0f} as little-endian float32.
+    static const char b64_response[] = "{\"data\":[{\"embedding\":\"AACAPwAAAEA=\"}]}";
+    g_fake->stream_payload = b64_response;
+    g_fake->stream_payload_len = sizeof(b64_response) - 1;
+    g_fake->stream_chunk_size = 3;
+    memset(&c, 0, sizeof(c));
+    if (!require(llm_embeddings_stream_ex(client, inputs, 1, NULL, LLM_EMBEDDING_ENCODING_BASE64, row, 4, collect, &c,
+                                          NULL, 0, NULL) == LLM_ERR_NONE,
+                 "stream base64")) {
+        return false;
+    }
+    if (!require(c.calls == 1 && c.dims[0] == 2 && c.rows[0][0] == 1.0f && c.rows[0][1] == 2.0f, "b64 row")) {
+        return false;
+    }
+    if (!require(strstr(g_fake->last_request_body, "\"encoding_format\":\"base64\"") != NULL, "base64 requested")) {
+        return false;
+    }
+
+    g_fake->stream_payload = k_response;
+    g_fake->stream_payload_len = sizeof(k_response) - 1;
+    memset(&c, 0, sizeof(c));
+    c.stop_after = 1;
+    if (!require(llm_embeddings_stream_ex(client, inputs, 2, NULL, LLM_EMBEDDING_ENCODING_FLOAT, row, 4, collect, &c,
+                                          NULL, 0, NULL) == LLM_ERR_CANCELLED,
+                 "callback cancels")) {
+        return false;
+    }
+    if (!require(c.calls == 1, "no vectors after cancel")) return false;
+
+    memset(&c, 0, sizeof(c));
+    llm_error_detail_t detail = {0};
+    if (!require(llm_embeddings_stream_ex(client, inputs, 2, NULL, LLM_EMBEDDING_ENCODING_FLOAT, row, 2, collect, &c,
+                                          NULL, 0, &detail) == LLM_ERR_FAILED,
+                 "row overflow fails")) {
+        return false;
+    }
+    if (!require(detail.stage == LLM_ERROR_STAGE_PROTOCOL, "overflow stage")) return false;
+    llm_error_detail_free(&detail);
+
+    static const char err_response[] = "{\"error\":{\"message\":\"too many inputs\",\"type\":\"invalid_request\"}}";
+    g_fake->status_stream = 400;
+    g_fake->stream_payload = err_response;
+    g_fake->stream_payload_len = sizeof(err_response) - 1;
+    memset(&c, 0, sizeof(c));
+    if (!require(llm_embeddings_stream_ex(client, inputs, 2, NULL, LLM_EMBEDDING_ENCODING_FLOAT, row, 4, collect, &c,
+                                          NULL, 0, &detail) == LLM_ERR_FAILED,
+                 "http error")) {
+        return false;
+    }
+    if (!require(detail.http_status == 400 && detail.message_len == 15, "error detail parsed")) return false;
+    if (!require(c.calls == 0, "no vectors on error")) return false;
+    llm_error_detail_free(&detail);
+
+    llm_client_destroy(client);
+    return true;
+}
+
+int main(void) {
+    if (!test_every_split()) return 1;
+    if (!test_rejects()) return 1;
+    if (!test_stream_request()) return 1;
+    printf("Embeddings stream tests passed.\n");
+    return 0;
+}
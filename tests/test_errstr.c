@@ -23,6 +23,9 @@ static bool test_errstr_values(void) {
     const char* failed = llm_errstr(LLM_ERR_FAILED);
     if (!require(failed && strcmp(failed, "failed") == 0, "errstr failed")) return false;
 
+    const char* tool_args = llm_errstr(LLM_ERR_INVALID_TOOL_ARGS);
+    if (!require(tool_args && strcmp(tool_args, "invalid tool arguments") == 0, "errstr tool args")) return false;
+
     const char* unknown = llm_errstr((llm_error_t)99);
     if (!require(unknown && strcmp(unknown, "unknown") == 0, "errstr unknown")) return false;
 
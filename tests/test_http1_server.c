@@ -1,7 +1,15 @@
+#define _GNU_SOURCE
+#include <netinet/in.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../src/internal/http1_server.c"
@@ -110,6 +118,21 @@ static int parse_response(const char* buf, size_t len, struct http_response* out
     return -1;
 }
 
+// Drives one connection through the server's state machine on a blocking socket.
+static int serve_one(int fd, desi_request_handler_t handler, void* user_data) {
+    struct desi_conn_config conf = {.handler = handler,
+                                    .user_data = user_data,
+                                    .max_requests = DESI_HTTP_DEFAULT_MAX_REQUESTS,
+                                    .max_body_bytes = DESI_HTTP_DEFAULT_MAX_BODY_BYTES};
+    struct desi_conn c;
+    desi_conn_init(&c, fd, &conf);
+    int rc = 0;
+    while (rc == 0 && (c.state == DESI_CONN_READING || c.state == DESI_CONN_BODY)) rc = desi_conn_read(&c);
+    while (rc == 0 && c.state == DESI_CONN_WRITING) rc = desi_conn_write(&c);
+    desi_conn_release(&c);
+    return rc;
+}
+
 static int run_health_test(void) {
     int fds[2];
     if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
@@ -126,7 +149,7 @@ static int run_health_test(void) {
     }
 
     struct handler_state state = {0};
-    if (desi_handle_client(fds[1], health_handler, &state) != 0) {
+    if (serve_one(fds[1], health_handler, &state) != 0) {
         fprintf(stderr, "health handler failed\n");
         close(fds[0]);
         close(fds[1]);
@@ -190,7 +213,7 @@ static int run_bad_request_test(void) {
     }
 
     struct handler_state state = {0};
-    if (desi_handle_client(fds[1], health_handler, &state) != 0) {
+    if (serve_one(fds[1], health_handler, &state) != 0) {
         fprintf(stderr, "bad request handling failed\n");
         close(fds[0]);
         close(fds[1]);
@@ -238,9 +261,1012 @@ static int run_bad_request_test(void) {
     return 0;
 }
 
+// A head fed one byte per read is tokenized as it arrives; nothing is answered before its blank line, and a bad
+// line is answered only then.
+static int run_dribbled_head_test(void) {
+    static const struct {
+        const char* head;
+        int status;
+    } cases[] = {
+        {"GET /health HTTP/1.1\r\nHost: example\r\nAccept:  */*  \r\n\r\n", 200},
+        {"GET /health HTTP/1.1\nHost: example\n\n", 200},
+        {"GET /health HTTP/1.1\r\nno colon\r\nHost: example\r\n\r\n", 400},
+    };
+    struct desi_conn_config conf = {.handler = health_handler,
+                                    .max_requests = DESI_HTTP_DEFAULT_MAX_REQUESTS,
+                                    .max_body_bytes = DESI_HTTP_DEFAULT_MAX_BODY_BYTES};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0) {
+            perror("socketpair");
+            return 1;
+        }
+        struct desi_conn c;
+        desi_conn_init(&c, fds[1], &conf);
+        size_t len = strlen(cases[i].head);
+        int rc = 0;
+        for (size_t b = 0; rc == 0 && b < len; b++) {
+            bool early = c.state != DESI_CONN_READING;
+            if (early || send(fds[0], cases[i].head + b, 1, 0) != 1) {
+                fprintf(stderr, "dribbled head %zu: %s at byte %zu\n", i, early ? "answered" : "send failed", b);
+                rc = -1;
+                break;
+            }
+            rc = desi_conn_read(&c);
+        }
+        while (rc == 0 && c.state == DESI_CONN_WRITING) rc = desi_conn_write(&c);
+        desi_conn_release(&c);
+        char buf[256];
+        ssize_t got = rc == 0 ? recv(fds[0], buf, sizeof(buf), 0) : -1;
+        close(fds[0]);
+        close(fds[1]);
+        struct http_response resp = {0};
+        if (got <= 0 || parse_response(buf, (size_t)got, &resp) != 0 || resp.status != cases[i].status) {
+            fprintf(stderr, "dribbled head %zu: status %d\n", i, resp.status);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+enum { WORKERS = 4, WORKER_REQUESTS = 64 };
+
+struct thread_seen {
+    pthread_mutex_t mu;
+    pthread_t threads[WORKERS + 1];
+    int distinct;
+    int calls;
+};
+
+static int worker_handler(void* user_data, const desi_http_req_t* req, desi_http_resp_t* resp) {
+    struct thread_seen* seen = user_data;
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&seen->mu);
+    seen->calls++;
+    bool known = false;
+    for (int i = 0; i < seen->distinct; i++) known = known || pthread_equal(seen->threads[i], self);
+    if (!known && seen->distinct < WORKERS + 1) seen->threads[seen->distinct++] = self;
+    pthread_mutex_unlock(&seen->mu);
+    return health_handler(NULL, req, resp);
+}
+
+struct server_args {
+    desi_server_config_t conf;
+    desi_request_handler_t handler;
+    void* user_data;
+};
+
+static void* server_main(void* arg) {
+    struct server_args* args = arg;
+    desi_server_run(&args->conf, args->handler, args->user_data);
+    return NULL;
+}
+
+static uint16_t free_port(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    uint16_t port = 0;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) port = desi_bound_port(fd);
+    close(fd);
+    return port;
+}
+
+static int connect_port(uint16_t port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    for (int attempt = 0; attempt < 200; attempt++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) return fd;
+        close(fd);
+        struct timespec ts = {0, 10 * 1000000L};
+        nanosleep(&ts, NULL);
+    }
+    return -1;
+}
+
+// The server runs detached for the rest of the process; the port is picked up front.
+static uint16_t start_server(struct server_args* args) {
+    args->conf.bind_host = "127.0.0.1";
+    args->conf.port = free_port();
+    if (args->conf.port == 0) {
+        fprintf(stderr, "no free port\n");
+        return 0;
+    }
+    pthread_t server;
+    if (pthread_create(&server, NULL, server_main, args) != 0) {
+        fprintf(stderr, "server thread failed\n");
+        return 0;
+    }
+    pthread_detach(server);
+    return args->conf.port;
+}
+
+static size_t read_all(int fd, char* buf, size_t cap) {
+    size_t len = 0;
+    ssize_t got = 0;
+    while (len < cap - 1 && (got = recv(fd, buf + len, cap - 1 - len, 0)) > 0) {
+        len += (size_t)got;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static int get_status(uint16_t port, const char* path) {
+    int fd = connect_port(port);
+    if (fd < 0) {
+        perror("connect");
+        return -1;
+    }
+    char req[128];
+    int req_len = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: example\r\nConnection: close\r\n\r\n", path);
+    if (send(fd, req, (size_t)req_len, 0) < 0) {
+        perror("send");
+        close(fd);
+        return -1;
+    }
+    char buf[256];
+    size_t len = read_all(fd, buf, sizeof(buf));
+    close(fd);
+    struct http_response resp = {0};
+    if (parse_response(buf, len, &resp) != 0) return -1;
+    return resp.status;
+}
+
+static int run_workers_test(void) {
+    struct thread_seen seen = {.mu = PTHREAD_MUTEX_INITIALIZER};
+    static struct server_args args;
+    args.conf.workers = WORKERS;
+    args.conf.pin_cpus = true;
+    args.handler = worker_handler;
+    args.user_data = &seen;
+    uint16_t port = start_server(&args);
+    if (port == 0) return 1;
+
+    // Each connection has a new source port, so the kernel hashes them across the workers' sockets.
+    for (int i = 0; i < WORKER_REQUESTS; i++) {
+        if (get_status(port, "/health") != 200) {
+            fprintf(stderr, "worker request %d failed\n", i);
+            return 1;
+        }
+    }
+
+    pthread_mutex_lock(&seen.mu);
+    int calls = seen.calls;
+    int distinct = seen.distinct;
+    pthread_mutex_unlock(&seen.mu);
+    if (calls != WORKER_REQUESTS) {
+        fprintf(stderr, "handler called %d times\n", calls);
+        return 1;
+    }
+    if (distinct < 2 || distinct > WORKERS) {
+        fprintf(stderr, "requests served by %d threads\n", distinct);
+        return 1;
+    }
+    return 0;
+}
+
+enum { IDLE_CONNECTIONS = 1000, BIG_BODY = 4 * 1024 * 1024 };
+
+static char g_big_body[BIG_BODY];
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+static int loop_handler(void* user_data, const desi_http_req_t* req, desi_http_resp_t* resp) {
+    (void)user_data;
+    if (req->path_len == 4 && memcmp(req->path, "/big", 4) == 0) {
+        resp->status = 200;
+        resp->body = g_big_body;
+        resp->body_len = BIG_BODY;
+        return 0;
+    }
+    return health_handler(NULL, req, resp);
+}
+
+// Closed by the server: EOF, or a reset once our writes hit the closed socket.
+static bool peer_closed(int fd) {
+    char c;
+    ssize_t got = recv(fd, &c, 1, MSG_DONTWAIT);
+    return got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+// One worker holds many idle connections, with no thread for any of them, and keeps serving requests.
+static int run_idle_connections_test(void) {
+    static struct server_args args;
+    args.conf.workers = 1;
+    args.conf.backlog = IDLE_CONNECTIONS;
+    args.handler = loop_handler;
+    uint16_t port = start_server(&args);
+    if (port == 0) return 1;
+
+    static int idle[IDLE_CONNECTIONS];
+    for (int i = 0; i < IDLE_CONNECTIONS; i++) {
+        idle[i] = connect_port(port);
+        if (idle[i] < 0) {
+            perror("connect");
+            return 1;
+        }
+    }
+    long long start = now_ms();
+    int status = get_status(port, "/health");
+    long long elapsed = now_ms() - start;
+    int open = 0;
+    for (int i = 0; i < IDLE_CONNECTIONS; i++) {
+        open += !peer_closed(idle[i]);
+        close(idle[i]);
+    }
+    if (status != 200 || elapsed > 1000) {
+        fprintf(stderr, "request behind idle connections: status %d after %lld ms\n", status, elapsed);
+        return 1;
+    }
+    if (open != IDLE_CONNECTIONS) {
+        fprintf(stderr, "only %d idle connections kept\n", open);
+        return 1;
+    }
+    return 0;
+}
+
+static int run_timeouts_test(void) {
+    static struct server_args args;
+    args.conf.workers = 1;
+    args.conf.idle_timeout_ms = 200;
+    args.conf.header_timeout_ms = 600;
+    args.handler = loop_handler;
+    uint16_t port = start_server(&args);
+    if (port == 0) return 1;
+
+    // One client sends nothing and hits the idle timeout; the other trickles a request head fast enough to stay
+    // active and hits the header deadline instead.
+    int silent = connect_port(port);
+    int trickle = connect_port(port);
+    if (silent < 0 || trickle < 0) {
+        perror("connect");
+        return 1;
+    }
+    const char head[] = "GET /health HTTP/1.1\r\nX-Slow: ";
+    if (send(trickle, head, sizeof(head) - 1, MSG_NOSIGNAL) < 0) {
+        perror("send");
+        return 1;
+    }
+    long long start = now_ms();
+    long long silent_closed = 0;
+    long long trickle_closed = 0;
+    while (now_ms() - start < 2000 && (!silent_closed || !trickle_closed)) {
+        sleep_ms(25);
+        long long at = now_ms() - start;
+        if (!silent_closed && peer_closed(silent)) silent_closed = at;
+        if (!trickle_closed && peer_closed(trickle)) trickle_closed = at;
+        if (!trickle_closed && (at / 25) % 4 == 0) (void)send(trickle, "x", 1, MSG_NOSIGNAL);
+    }
+    close(silent);
+    close(trickle);
+    if (silent_closed < 150 || silent_closed > 500) {
+        fprintf(stderr, "idle connection closed after %lld ms\n", silent_closed);
+        return 1;
+    }
+    if (trickle_closed < 550 || trickle_closed > 1000) {
+        fprintf(stderr, "slow request head closed after %lld ms\n", trickle_closed);
+        return 1;
+    }
+    return 0;
+}
+
+static int run_partial_io_test(void) {
+    static struct server_args args;
+    args.conf.workers = 1;
+    args.handler = loop_handler;
+    uint16_t port = start_server(&args);
+    if (port == 0) return 1;
+    for (size_t i = 0; i < BIG_BODY; i++) g_big_body[i] = (char)('a' + i % 26);
+
+    int fd = connect_port(port);
+    if (fd < 0) {
+        perror("connect");
+        return 1;
+    }
+    const char part1[] = "GET /big HTTP/1.1\r\nHo";
+    const char part2[] = "st: example\r\nConnection: close\r\n\r\n";
+    if (send(fd, part1, sizeof(part1) - 1, 0) < 0) return 1;
+    sleep_ms(50);
+    if (send(fd, part2, sizeof(part2) - 1, 0) < 0) return 1;
+
+    // The response is far larger than the socket buffers, so the worker is now parked on EPOLLOUT.
+    sleep_ms(100);
+    if (get_status(port, "/health") != 200) {
+        fprintf(stderr, "worker blocked behind a pending write\n");
+        return 1;
+    }
+
+    size_t cap = BIG_BODY + 4096;
+    char* buf = malloc(cap);
+    if (!buf) return 1;
+    size_t len = read_all(fd, buf, cap);
+    close(fd);
+    struct http_response resp = {0};
+    int rc = 0;
+    if (parse_response(buf, len, &resp) != 0 || resp.status != 200 || resp.content_length != BIG_BODY ||
+        resp.body_len != BIG_BODY || memcmp(resp.body, g_big_body, BIG_BODY) != 0) {
+        fprintf(stderr, "large response damaged (%zu bytes)\n", len);
+        rc = 1;
+    }
+    free(buf);
+    return rc;
+}
+
+// Responses read one at a time off a persistent connection; bytes past the current one stay buffered.
+struct response_reader {
+    int fd;
+    char buf[4096];
+    size_t len;
+    char body[256];  // of the last response, NUL-terminated and cut to fit
+};
+
+static int next_response(struct response_reader* r, int* status, bool* closes) {
+    for (;;) {
+        char* head_end = memmem(r->buf, r->len, "\r\n\r\n", 4);
+        struct http_response resp = {0};
+        if (head_end && parse_response(r->buf, r->len, &resp) == 0 && resp.body_len >= resp.content_length) {
+            size_t total = (size_t)(resp.body - r->buf) + resp.content_length;
+            *status = resp.status;
+            *closes = memmem(r->buf, (size_t)(head_end - r->buf), "Connection: close", 17) != NULL;
+            size_t body_len = resp.content_length < sizeof(r->body) ? resp.content_length : sizeof(r->body) - 1;
+            memcpy(r->body, resp.body, body_len);
+            r->body[body_len] = '\0';
+            memmove(r->buf, r->buf + total, r->len - total);
+            r->len -= total;
+            return 0;
+        }
+        if (r->len == sizeof(r->buf)) return -1;
+        ssize_t got = recv(r->fd, r->buf + r->len, sizeof(r->buf) - r->len, 0);
+        if (got <= 0) return -1;
+        r->len += (size_t)got;
+    }
+}
+
+static bool expect_response(struct response_reader* r, int want_status, bool want_close, const char* what) {
+    int status = 0;
+    bool closes = false;
+    if (next_response(r, &status, &closes) != 0 || status != want_status || closes != want_close) {
+        fprintf(stderr, "%s: status %d, closes %d\n", what, status, closes);
+        return false;
+    }
+    return true;
+}
+
+static bool expect_eof(struct response_reader* r, const char* what) {
+    char c;
+    if (r->len != 0 || recv(r->fd, &c, 1, 0) != 0) {
+        fprintf(stderr, "%s: connection left open\n", what);
+        return false;
+    }
+    return true;
+}
+
+static bool send_all(int fd, const char* data) {
+    return send(fd, data, strlen(data), MSG_NOSIGNAL) == (ssize_t)strlen(data);
+}
+
+static int run_keep_alive_test(void) {
+    static struct thread_seen seen = {.mu = PTHREAD_MUTEX_INITIALIZER};
+    static struct server_args args;
+    args.conf.workers = 1;
+    args.conf.max_requests_per_conn = 4;
+    args.handler = worker_handler;
+    args.user_data = &seen;
+    uint16_t port = start_server(&args);
+    if (port == 0) return 1;
+
+    struct response_reader r = {.fd = connect_port(port)};
+    if (r.fd < 0) {
+        perror("connect");
+        return 1;
+    }
+    // Sequential requests reuse the connection.
+    for (int i = 0; i < 2; i++) {
+        if (!send_all(r.fd, "GET /health HTTP/1.1\r\nHost: example\r\n\r\n")) return 1;
+        if (!expect_response(&r, 200, false, "sequential request")) return 1;
+    }
+    // Three pipelined requests in one segment are answered in order; the cap closes after the fourth.
+    if (!send_all(r.fd, "GET /missing HTTP/1.1\r\n\r\nGET /health HTTP/1.1\r\n\r\nGET /health HTTP/1.1\r\n\r\n")) {
+        return 1;
+    }
+    if (!expect_response(&r, 500, false, "pipelined request 1") ||
+        !expect_response(&r, 200, true, "pipelined request 2") || !expect_eof(&r, "request cap")) {
+        return 1;
+    }
+    close(r.fd);
+
+    // HTTP/1.0 closes by default, keeps the connection when asked, and an explicit close wins.
+    struct {
+        const char* request;
+        bool keeps;
+    } cases[] = {
+        {"GET /health HTTP/1.0\r\n\r\n", false},
+        {"GET /health HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n", true},
+        {"GET /health HTTP/1.1\r\nconnection: TE, close\r\n\r\n", false},
+        {"GET /health HTTP/1.1\r\nContent-Length: 0\r\n\r\n", true},
+        {"GET /health HTTP/1.1\r\nContent-Length: 2\r\n\r\nhi", true},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        r = (struct response_reader){.fd = connect_port(port)};
+        if (r.fd < 0 || !send_all(r.fd, cases[i].request)) return 1;
+        if (!expect_response(&r, 200, !cases[i].keeps, cases[i].request)) return 1;
+        if (!cases[i].keeps && !expect_eof(&r, cases[i].request)) return 1;
+        close(r.fd);
+    }
+
+    // A pipelined head split across segments resumes where the previous request ended.
+    r = (struct response_reader){.fd = connect_port(port)};
+    if (r.fd < 0 || !send_all(r.fd, "GET /health HTTP/1.1\r\n\r\nGET /hea")) return 1;
+    if (!expect_response(&r, 200, false, "first of split pair")) return 1;
+    sleep_ms(20);
+    if (!send_all(r.fd, "lth HTTP/1.1\r\nConnection: close\r\n\r\n")) return 1;
+    if (!expect_response(&r, 200, true, "second of split pair") || !expect_eof(&r, "split pair")) return 1;
+    close(r.fd);
+    return 0;
+}
+
+static bool send_bytes(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        data += sent;
+        len -= (size_t)sent;
+    }
+    return true;
+}
+
+static bool pattern_ok(const char* data, size_t len, size_t offset) {
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != (char)('a' + (offset + i) % 26)) return false;
+    }
+    return true;
+}
+
+static int body_handler(void* user_data, const desi_http_req_t* req, desi_http_resp_t* resp) {
+    (void)user_data;
+    resp->status = 200;
+    if (req->path_len == 5 && memcmp(req->path, "/echo", 5) == 0) {
+        resp->body = req->body;
+        resp->body_len = req->body_len;
+    } else if (req->path_len == 7 && memcmp(req->path, "/header", 7) == 0) {
+        const desi_http_header_t* h = desi_http_req_header(req, "x-echo");
+        if (!h) return -1;
+        resp->body = h->value;
+        resp->body_len = h->value_len;
+    } else if (req->path_len == 8 && memcmp(req->path, "/pattern", 8) == 0) {
+        if (!req->body || !pattern_ok(req->body, req->body_len, 0)) return -1;
+        resp->body = "ok\n";
+        resp->body_len = 3;
+    } else {
+        return health_handler(NULL, req, resp);
+    }
+    return 0;
+}
+
+static char* make_pattern(size_t len) {
+    char* buf = malloc(len);
+    if (buf) {
+        for (size_t i = 0; i < len; i++) buf[i] = (char)('a' + i % 26);
+    }
+    return buf;
+}
+
+static bool exchange(uint16_t port, const char* request, int want_status, bool want_close, const char* what) {
+    struct response_reader r = {.fd = connect_port(port)};
+    bool ok = r.fd >= 0 && send_all(r.fd, request) && expect_response(&r, want_status, want_close, what);
+    if (ok && want_close) ok = expect_eof(&r, what);
+    if (r.fd >= 0) close(r.fd);
+    return ok;
+}
+
+static int run_request_body_test(void) {
+    static struct server_args args;
+    args.conf.workers = 1;
+    args.conf.max_body_bytes = 256 * 1024;
+    args.handler = body_handler;
+    uint16_t port = start_server(&args);
+    if (port == 0) return 1;
+
+    struct response_reader r = {.fd = connect_port(port)};
+    if (r.fd < 0) return 1;
+    if (!send_all(r.fd, "POST /echo HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello") ||
+        !expect_response(&r, 200, false, "content-length body") || strcmp(r.body, "hello") != 0) {
+        return 1;
+    }
+    // Chunk extensions and trailers are skipped; the request pipelined behind the body is served next.
+    if (!send_all(r.fd, "POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n4\r\nwiki\r\n5;ext=1\r\npedia\r\n"
+                        "0\r\nX-Trailer: t\r\n\r\nGET /health HTTP/1.1\r\n\r\n") ||
+        !expect_response(&r, 200, false, "chunked body") || strcmp(r.body, "wikipedia") != 0 ||
+        !expect_response(&r, 200, false, "request after chunked body") || strcmp(r.body, "ok\n") != 0) {
+        return 1;
+    }
+    // Framing split anywhere, even between a chunk line's CR and LF.
+    const char* pieces[] = {"POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r", "\nab", "c\r\n0\r\n",
+                            "\r\n"};
+    for (size_t i = 0; i < 4; i++) {
+        if (!send_all(r.fd, pieces[i])) return 1;
+        sleep_ms(10);
+    }
+    if (!expect_response(&r, 200, false, "split chunked body") || strcmp(r.body, "abc") != 0) return 1;
+    if (!send_all(r.fd, "GET /header HTTP/1.1\r\nX-Echo: \t spaced value \r\n\r\n") ||
+        !expect_response(&r, 200, false, "header lookup") || strcmp(r.body, "spaced value") != 0) {
+        return 1;
+    }
+    // A client waiting for 100 Continue gets it before sending the body.
+    if (!send_all(r.fd, "POST /echo HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 2\r\n\r\n") ||
+        !expect_response(&r, 100, false, "interim response") || !send_all(r.fd, "ok") ||
+        !expect_response(&r, 200, false, "body after 100 Continue") || strcmp(r.body, "ok") != 0) {
+        return 1;
+    }
+
+    // Large bodies, with Content-Length and as uneven chunks, arrive intact.
+    enum { LARGE = 200000 };
+    char* large = make_pattern(LARGE);
+    if (!large) return 1;
+    char head[128];
+    snprintf(head, sizeof(head), "POST /pattern HTTP/1.1\r\nContent-Length: %d\r\n\r\n", LARGE);
+    bool ok = send_all(r.fd, head) && send_bytes(r.fd, large, LARGE) && expect_response(&r, 200, false, "large body");
+    const size_t chunk_sizes[] = {1, 70000, 9, LARGE - 70010};
+    ok = ok && send_all(r.fd, "POST /pattern HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n");
+    for (size_t i = 0, off = 0; ok && i < 4; off += chunk_sizes[i++]) {
+        char line[32];
+        snprintf(line, sizeof(line), "%zx\r\n", chunk_sizes[i]);
+        ok = send_all(r.fd, line) && send_bytes(r.fd, large + off, chunk_sizes[i]) && send_all(r.fd, "\r\n");
+    }
+    ok = ok && send_all(r.fd, "0\r\n\r\n") && expect_response(&r, 200, false, "large chunked body");
+    free(large);
+    close(r.fd);
+    if (!ok) return 1;
+
+    // Oversized bodies and framing the server cannot trust close the connection.
+    if (!exchange(port, "POST /echo HTTP/1.1\r\nContent-Length: 300000\r\n\r\n", 413, true, "length too large") ||
+        !exchange(port, "POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n50000\r\n", 413, true,
+                  "chunk too large") ||
+        !exchange(port, "POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 3\r\n\r\n", 400, true,
+                  "both framings") ||
+        !exchange(port, "POST /echo HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", 400, true, "unknown coding") ||
+        !exchange(port, "POST /echo HTTP/1.1\r\nContent-Length: 2\r\nContent-Length: 3\r\n\r\n", 400, true,
+                  "conflicting lengths") ||
+        !exchange(port, "POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", 400, true,
+                  "bad chunk size") ||
+        !exchange(port, "GET /health HTTP/1.1\r\nX-A: 1\r\n folded\r\n\r\n", 400, true, "folded header")) {
+        return 1;
+    }
+    char many[2048];
+    size_t len = (size_t)snprintf(many, sizeof(many), "GET /health HTTP/1.1\r\n");
+    for (int i = 0; i <= DESI_HTTP_MAX_HEADERS; i++) {
+        len += (size_t)snprintf(many + len, sizeof(many) - len, "X-%d: v\r\n", i);
+    }
+    snprintf(many + len, sizeof(many) - len, "\r\n");
+    return exchange(port, many, 431, true, "too many headers") ? 0 : 1;
+}
+
+// Streaming body mode: validates the pattern piece by piece and counts what it saw.
+struct stream_state {
+    size_t bytes;
+    size_t pieces;
+    char reply[64];
+};
+
+static atomic_int g_stream_states;
+
+static int pattern_chunk(void* user_data, const desi_http_req_t* req, void** state, const char* data, size_t len) {
+    (void)user_data;
+    (void)req;
+    struct stream_state* st = *state;
+    if (!data) {
+        if (st) atomic_fetch_sub(&g_stream_states, 1);
+        free(st);
+        return 0;
+    }
+    if (!st) {
+        st = calloc(1, sizeof(*st));
+        if (!st) return -1;
+        atomic_fetch_add(&g_stream_states, 1);
+        *state = st;
+    }
+    if (!pattern_ok(data, len, st->bytes)) return -1;
+    st->bytes += len;
+    st->pieces++;
+    return 0;
+}
+
+static int streamed_handler(void* user_data, const desi_http_req_t* req, desi_http_resp_t* resp) {
+    (void)user_data;
+    struct stream_state* st = req->body_state;
+    if (req->body != NULL || !st || st->bytes != req->body_len) return -1;
+    int n = snprintf(st->reply, sizeof(st->reply), "%zu %s", st->bytes, st->pieces > 1 ? "pieces" : "whole");
+    resp->status = 200;
+    resp->body = st->reply;
+    resp->body_len = (size_t)n;
+    return 0;
+}
+
+static int run_streaming_body_test(void) {
+    static struct server_args args;
+    args.conf.workers = 1;
+    args.conf.body_chunk = pattern_chunk;
+    args.handler = streamed_handler;
+    uint16_t port = start_server(&args);
+    if (port == 0) return 1;
+
+    enum { LARGE = 600000 };
+    char* large = make_pattern(LARGE);
+    if (!large) return 1;
+    struct response_reader r = {.fd = connect_port(port)};
+    char head[128];
+    snprintf(head, sizeof(head), "POST /upload HTTP/1.1\r\nContent-Length: %d\r\n\r\n", LARGE);
+    bool ok = r.fd >= 0 && send_all(r.fd, head) && send_bytes(r.fd, large, LARGE) &&
+              expect_response(&r, 200, false, "streamed body") && strcmp(r.body, "600000 pieces") == 0;
+    snprintf(head, sizeof(head), "%x\r\n", LARGE);
+    ok = ok && send_all(r.fd, "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n") && send_all(r.fd, head) &&
+         send_bytes(r.fd, large, LARGE) && send_all(r.fd, "\r\n0\r\n\r\n") &&
+         expect_response(&r, 200, false, "streamed chunked body") && strcmp(r.body, "600000 pieces") == 0;
+    free(large);
+    if (r.fd >= 0) close(r.fd);
+    if (!ok) return 1;
+
+    // A piece that fails validation rejects the request at once.
+    ok = exchange(port, "POST /upload HTTP/1.1\r\nContent-Length: 6\r\n\r\nabcXef", 400, true, "invalid piece");
+    if (!ok || atomic_load(&g_stream_states) != 0) {
+        fprintf(stderr, "streaming body: %d states left\n", atomic_load(&g_stream_states));
+        return 1;
+    }
+    return 0;
+}
+
+// Streamed responses: producers run on their own threads and write while the worker serves other events.
+enum { FLOOD_BYTES = 4 * 1024 * 1024, FLOOD_PIECE = 4096 };
+
+static atomic_int g_flood_busy;
+static atomic_int g_flood_result = -3;  // the last write's code once the producer is done
+static atomic_int g_hold_result = -3;
+
+static void* events_producer(void* arg) {
+    desi_http_stream_t* stream = arg;
+    static const char* const k_data[] = {"one", "two\nlines", "three"};
+    for (int i = 0; i < 3; i++) {
+        sleep_ms(10);
+        desi_http_stream_sse_event(stream, "delta", 5, k_data[i], strlen(k_data[i]));
+    }
+    desi_http_stream_sse_keepalive(stream);
+    desi_http_stream_finish(stream);
+    return NULL;
+}
+
+static void* flood_producer(void* arg) {
+    desi_http_stream_t* stream = arg;
+    char* pattern = make_pattern(FLOOD_BYTES);
+    int rc = pattern ? DESI_STREAM_OK : DESI_STREAM_ERROR;
+    for (size_t off = 0; rc == DESI_STREAM_OK && off < FLOOD_BYTES;) {
+        rc = desi_http_stream_write(stream, pattern + off, FLOOD_PIECE);
+        if (rc == DESI_STREAM_BUSY) {
+            atomic_fetch_add(&g_flood_busy, 1);
+            rc = desi_http_stream_wait(stream, 5000);
+            continue;
+        }
+        off += FLOOD_PIECE;
+    }
+    free(pattern);
+    atomic_store(&g_flood_result, rc);
+    desi_http_stream_finish(stream);
+    return NULL;
+}
+
+static void* hold_producer(void* arg) {
+    desi_http_stream_t* stream = arg;
+    int rc = DESI_STREAM_OK;
+    for (int i = 0; i < 500 && (rc == DESI_STREAM_OK || rc == DESI_STREAM_BUSY); i++) {
+        sleep_ms(10);
+        rc = desi_http_stream_sse_keepalive(stream);
+    }
+    atomic_store(&g_hold_result, rc);
+    desi_http_stream_finish(stream);
+    return NULL;
+}
+
+static int stream_handler(void* user_data, const desi_http_req_t* req, desi_http_resp_t* resp) {
+    (void)user_data;
+    void* (*producer)(void*) = NULL;
+    if (req->path_len == 7 && memcmp(req->path, "/events", 7) == 0) producer = events_producer;
+    if (req->path_len == 6 && memcmp(req->path, "/flood", 6) == 0) producer = flood_producer;
+    if (req->path_len == 5 && memcmp(req->path, "/hold", 5) == 0) producer = hold_producer;
+    desi_http_stream_t* stream = desi_http_resp_stream(req, resp);
+    if (!stream) return -1;
+    resp->status = 200;
+    resp->content_type = producer ? "text/event-stream" : NULL;
+    resp->headers = "Cache-Control: no-cache\r\n";
+    if (!producer) {
+        // Written and finished before the head is even queued.
+        desi_http_stream_write(stream, "hello", 5);
+        desi_http_stream_write(stream, " world", 6);
+        desi_http_stream_finish(stream);
+        return 0;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, producer, stream) != 0) {
+        desi_http_stream_finish(stream);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+// Buffered reads off a connection for a response of any framing: Content-Length, chunked or until close.
+struct stream_reader {
+    int fd;
+    char buf[8192];
+    size_t off;
+    size_t len;
+};
+
+static int stream_getc(struct stream_reader* r) {
+    if (r->off == r->len) {
+        ssize_t got = recv(r->fd, r->buf, sizeof(r->buf), 0);
+        if (got <= 0) return -1;
+        r->off = 0;
+        r->len = (size_t)got;
+    }
+    return (unsigned char)r->buf[r->off++];
+}
+
+// One CRLF-terminated line without its terminator.
+static bool stream_line(struct stream_reader* r, char* line, size_t cap) {
+    size_t len = 0;
+    for (;;) {
+        int ch = stream_getc(r);
+        if (ch < 0 || len + 1 == cap) return false;
+        if (ch == '\n' && len > 0 && line[len - 1] == '\r') {
+            line[len - 1] = '\0';
+            return true;
+        }
+        line[len++] = (char)ch;
+    }
+}
+
+// Reads the head into head (lines joined by "\n") and the whole body into body. Returns the body length, or -1.
+static long read_streamed(struct stream_reader* r, char* head, size_t head_cap, char* body, size_t cap) {
+    char line[256];
+    size_t head_len = 0;
+    head[0] = '\0';
+    while (stream_line(r, line, sizeof(line)) && line[0] != '\0') {
+        head_len += (size_t)snprintf(head + head_len, head_cap - head_len, "%s\n", line);
+        if (head_len >= head_cap) return -1;
+    }
+    if (head_len == 0) return -1;
+    size_t len = 0;
+    const char* length = strstr(head, "Content-Length: ");
+    if (length) {
+        size_t want = strtoul(length + 16, NULL, 10);
+        int ch = 0;
+        while (len < want && len < cap && (ch = stream_getc(r)) >= 0) body[len++] = (char)ch;
+        return len == want ? (long)len : -1;
+    }
+    if (!strstr(head, "Transfer-Encoding: chunked")) {
+        int ch;
+        while (len < cap && (ch = stream_getc(r)) >= 0) body[len++] = (char)ch;
+        return (long)len;
+    }
+    for (;;) {
+        if (!stream_line(r, line, sizeof(line))) return -1;
+        size_t size = strtoul(line, NULL, 16);
+        if (size == 0) return stream_line(r, line, sizeof(line)) && line[0] == '\0' ? (long)len : -1;
+        for (size_t i = 0; i < size; i++) {
+            int ch = stream_getc(r);
+            if (ch < 0 || len == cap) return -1;
+            body[len++] = (char)ch;
+        }
+        if (!stream_line(r, line, sizeof(line)) || line[0] != '\0') return -1;
+    }
+}
+
+static int run_response_stream_test(void) {
+    static struct server_args args;
+    args.conf.workers = 1;
+    args.handler = stream_handler;
+    uint16_t port = start_server(&args);
+    if (port == 0) return 1;
+
+    static const char k_events[] =
+        "event: delta\ndata: one\n\nevent: delta\ndata: two\ndata: lines\n\nevent: delta\ndata: three\n\n: ping\n\n";
+    char head[1024];
+    char body[512];
+    // SSE events from another thread, then the connection serves the next request.
+    struct stream_reader r = {.fd = connect_port(port)};
+    if (r.fd < 0 || !send_all(r.fd, "GET /events HTTP/1.1\r\n\r\n")) return 1;
+    long len = read_streamed(&r, head, sizeof(head), body, sizeof(body));
+    if (len != (long)sizeof(k_events) - 1 || memcmp(body, k_events, (size_t)len) != 0 ||
+        !strstr(head, "Content-Type: text/event-stream") || !strstr(head, "Cache-Control: no-cache") ||
+        !strstr(head, "Connection: keep-alive")) {
+        fprintf(stderr, "sse stream: %ld bytes after\n%s\n", len, head);
+        return 1;
+    }
+    if (!send_all(r.fd, "GET /inline HTTP/1.1\r\nConnection: close\r\n\r\n")) return 1;
+    len = read_streamed(&r, head, sizeof(head), body, sizeof(body));
+    if (len != 11 || memcmp(body, "hello world", 11) != 0 || stream_getc(&r) != -1) {
+        fprintf(stderr, "inline stream: %ld bytes\n", len);
+        return 1;
+    }
+    close(r.fd);
+
+    // HTTP/1.0 has no chunked encoding; the body ends when the connection does.
+    r = (struct stream_reader){.fd = connect_port(port)};
+    if (r.fd < 0 || !send_all(r.fd, "GET /events HTTP/1.0\r\n\r\n")) return 1;
+    len = read_streamed(&r, head, sizeof(head), body, sizeof(body));
+    if (len != (long)sizeof(k_events) - 1 || memcmp(body, k_events, (size_t)len) != 0 || strstr(head, "chunked") ||
+        !strstr(head, "Connection: close")) {
+        fprintf(stderr, "http/1.0 stream: %ld bytes after\n%s\n", len, head);
+        return 1;
+    }
+    close(r.fd);
+
+    // A client that stops reading pushes back on the producer, which waits and loses nothing.
+    r = (struct stream_reader){.fd = connect_port(port)};
+    if (r.fd < 0 || !send_all(r.fd, "GET /flood HTTP/1.1\r\nConnection: close\r\n\r\n")) return 1;
+    sleep_ms(300);
+    char* flood = malloc(FLOOD_BYTES + 1);
+    if (!flood) return 1;
+    len = read_streamed(&r, head, sizeof(head), flood, FLOOD_BYTES + 1);
+    bool ok = len == FLOOD_BYTES && pattern_ok(flood, FLOOD_BYTES, 0);
+    free(flood);
+    close(r.fd);
+    if (!ok || atomic_load(&g_flood_busy) == 0 || atomic_load(&g_flood_result) != DESI_STREAM_OK) {
+        fprintf(stderr, "flood: %ld bytes, %d busy, result %d\n", len, atomic_load(&g_flood_busy),
+                atomic_load(&g_flood_result));
+        return 1;
+    }
+
+    // A client that hangs up mid-stream closes it for the producer.
+    r = (struct stream_reader){.fd = connect_port(port)};
+    if (r.fd < 0 || !send_all(r.fd, "GET /hold HTTP/1.1\r\n\r\n")) return 1;
+    char line[256];
+    if (!stream_line(&r, line, sizeof(line)) || strncmp(line, "HTTP/1.1 200", 12) != 0) return 1;
+    close(r.fd);
+    long long start = now_ms();
+    while (atomic_load(&g_hold_result) == -3 && now_ms() - start < 2000) sleep_ms(10);
+    if (atomic_load(&g_hold_result) != DESI_STREAM_CLOSED) {
+        fprintf(stderr, "hang-up: producer saw %d\n", atomic_load(&g_hold_result));
+        return 1;
+    }
+    return 0;
+}
+
+// Static bodies are sent from place: gathered with the head, or with MSG_ZEROCOPY when large.
+enum { STATIC_BIG = 1024 * 1024 };
+
+static char* g_static_big;
+
+static int static_handler(void* user_data, const desi_http_req_t* req, desi_http_resp_t* resp) {
+    (void)user_data;
+    resp->status = 200;
+    resp->body_static = true;
+    if (req->path_len == 4 && memcmp(req->path, "/big", 4) == 0) {
+        resp->body = g_static_big;
+        resp->body_len = STATIC_BIG;
+    } else {
+        resp->body = "small static\n";
+        resp->body_len = 13;
+    }
+    return 0;
+}
+
+static int run_static_body_test(void) {
+    g_static_big = make_pattern(STATIC_BIG);
+    if (!g_static_big) return 1;
+    static struct server_args args;
+    args.conf.workers = 1;
+    args.conf.tcp_cork = true;
+    args.conf.zerocopy_min_bytes = 64 * 1024;
+    args.handler = static_handler;
+    uint16_t port = start_server(&args);
+    if (port == 0) return 1;
+
+    char* body = malloc(STATIC_BIG);
+    if (!body) return 1;
+    char head[1024];
+    struct stream_reader r = {.fd = connect_port(port)};
+    static const char* const k_paths[] = {"/big", "/small", "/big", "/small"};
+    bool ok = r.fd >= 0;
+    for (size_t i = 0; ok && i < sizeof(k_paths) / sizeof(k_paths[0]); i++) {
+        char req[64];
+        snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\n\r\n", k_paths[i]);
+        long len = send_all(r.fd, req) ? read_streamed(&r, head, sizeof(head), body, STATIC_BIG) : -1;
+        bool big = k_paths[i][1] == 'b';
+        ok = big ? len == STATIC_BIG && pattern_ok(body, STATIC_BIG, 0)
+                 : len == 13 && memcmp(body, "small static\n", 13) == 0;
+        if (!ok) fprintf(stderr, "static body %zu: %ld bytes\n", i, len);
+    }
+    free(body);
+    if (r.fd >= 0) close(r.fd);
+    return ok ? 0 : 1;
+}
+
+static long long process_cpu_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+enum { PAUSE_FILLERS = 4096, PAUSE_MS = 300 };
+
+// With every descriptor in use the worker cannot accept; it must wait out a tick between attempts instead of
+// spinning on the still-readable listening socket, and serve the connection once descriptors free up.
+static int run_accept_pause_test(void) {
+    static struct server_args args;
+    args.conf.workers = 1;
+    args.handler = health_handler;
+    uint16_t port = start_server(&args);
+    if (port == 0 || get_status(port, "/health") != 200) return 1;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct rlimit lim;
+    if (fd < 0 || getrlimit(RLIMIT_NOFILE, &lim) != 0) return 1;
+    struct rlimit low = lim;
+    low.rlim_cur = (rlim_t)fd + 1;
+    if (setrlimit(RLIMIT_NOFILE, &low) != 0) return 1;
+    static int fillers[PAUSE_FILLERS];
+    int filled = 0;
+    while (filled < PAUSE_FILLERS && (fillers[filled] = dup(fd)) >= 0) filled++;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    static const char req[] = "GET /health HTTP/1.1\r\nHost: example\r\nConnection: close\r\n\r\n";
+    bool sent = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 && send_all(fd, req);
+    long long cpu0 = process_cpu_ms();
+    sleep_ms(PAUSE_MS);
+    long long cpu = process_cpu_ms() - cpu0;
+
+    while (filled > 0) close(fillers[--filled]);
+    setrlimit(RLIMIT_NOFILE, &lim);
+    char buf[256];
+    size_t len = sent ? read_all(fd, buf, sizeof(buf)) : 0;
+    close(fd);
+    struct http_response resp = {0};
+    if (!sent || parse_response(buf, len, &resp) != 0 || resp.status != 200) {
+        fprintf(stderr, "request held back by the pause was not served\n");
+        return 1;
+    }
+    if (cpu > PAUSE_MS / 3) {
+        fprintf(stderr, "worker used %lld ms of CPU in %d ms without descriptors\n", cpu, PAUSE_MS);
+        return 1;
+    }
+    return 0;
+}
+
 int main(void) {
     if (run_health_test() != 0) return 1;
     if (run_bad_request_test() != 0) return 1;
+    if (run_dribbled_head_test() != 0) return 1;
+    if (run_workers_test() != 0) return 1;
+    if (run_idle_connections_test() != 0) return 1;
+    if (run_timeouts_test() != 0) return 1;
+    if (run_partial_io_test() != 0) return 1;
+    if (run_keep_alive_test() != 0) return 1;
+    if (run_request_body_test() != 0) return 1;
+    if (run_streaming_body_test() != 0) return 1;
+    if (run_response_stream_test() != 0) return 1;
+    if (run_static_body_test() != 0) return 1;
+    if (run_accept_pause_test() != 0) return 1;
     printf("http1 server tests passed\n");
     return 0;
 }
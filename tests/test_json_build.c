@@ -58,7 +58,8 @@ int main(void) {
                                  strlen("You are a helpful assistant."), NULL, 0, NULL, 0, NULL, 0, NULL, 0},
                                 {LLM_ROLE_USER, "Hello!", strlen("Hello!"), NULL, 0, NULL, 0, NULL, 0, NULL, 0}};
 
-    char* json = build_chat_request("gpt-4o", messages, 2, false, false, "{\"temperature\":0.7}", NULL, NULL, 0, 0);
+    char* json =
+        build_chat_request("gpt-4o", messages, 2, false, false, "{\"temperature\":0.7}", NULL, NULL, 0, 0, NULL);
     if (!json) {
         fprintf(stderr, "build_chat_request failed\n");
         return 1;
@@ -153,7 +154,7 @@ int main(void) {
 
     const char* esc_content = "Quotes: \" and Backslash: \\";
     llm_message_t msg_esc[] = {{LLM_ROLE_USER, esc_content, strlen(esc_content), NULL, 0, NULL, 0, NULL, 0, NULL, 0}};
-    json = build_chat_request("gpt-4o", msg_esc, 1, false, false, NULL, NULL, NULL, 0, 0);
+    json = build_chat_request("gpt-4o", msg_esc, 1, false, false, NULL, NULL, NULL, 0, 0, NULL);
     if (!json) {
         fprintf(stderr, "FAIL: escape build\n");
         return 1;
@@ -188,7 +189,7 @@ int main(void) {
                                .content_len = 0,
                                .content_json = parts_json,
                                .content_json_len = strlen(parts_json)};
-    json = build_chat_request("gpt-4o", &parts_msg, 1, false, false, NULL, NULL, NULL, 2, 1024);
+    json = build_chat_request("gpt-4o", &parts_msg, 1, false, false, NULL, NULL, NULL, 2, 1024, NULL);
     if (!json) {
         fprintf(stderr, "FAIL: parts build\n");
         return 1;
@@ -241,16 +242,16 @@ int main(void) {
     free(tokens);
     free(json);
 
-    json = build_chat_request("gpt-4o", &parts_msg, 1, false, false, NULL, NULL, NULL, 1, 1024);
+    json = build_chat_request("gpt-4o", &parts_msg, 1, false, false, NULL, NULL, NULL, 1, 1024, NULL);
     if (!require(json == NULL, "parts count limit")) return 1;
 
-    json = build_chat_request("gpt-4o", &parts_msg, 1, false, false, NULL, NULL, NULL, 2, 4);
+    json = build_chat_request("gpt-4o", &parts_msg, 1, false, false, NULL, NULL, NULL, 2, 4, NULL);
     if (!require(json == NULL, "parts byte limit")) return 1;
 
     const char* invalid_parts = "{\"type\":\"text\"}";
     llm_message_t invalid_msg = {
         .role = LLM_ROLE_USER, .content_json = invalid_parts, .content_json_len = strlen(invalid_parts)};
-    json = build_chat_request("gpt-4o", &invalid_msg, 1, false, false, NULL, NULL, NULL, 2, 1024);
+    json = build_chat_request("gpt-4o", &invalid_msg, 1, false, false, NULL, NULL, NULL, 2, 1024, NULL);
     if (!require(json == NULL, "invalid content json")) return 1;
 
     llm_message_t both_msg = {.role = LLM_ROLE_USER,
@@ -258,7 +259,7 @@ int main(void) {
                               .content_len = 2,
                               .content_json = parts_json,
                               .content_json_len = strlen(parts_json)};
-    json = build_chat_request("gpt-4o", &both_msg, 1, false, false, NULL, NULL, NULL, 2, 1024);
+    json = build_chat_request("gpt-4o", &both_msg, 1, false, false, NULL, NULL, NULL, 2, 1024, NULL);
     if (!require(json == NULL, "content and content_json exclusive")) return 1;
 
     printf("JSON build test passed!\n");
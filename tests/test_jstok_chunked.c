@@ -0,0 +1,125 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "llm/json_core.h"
+
+enum { MAX_TOKENS = 64 };
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static const char* const k_docs[] = {
+    "{\"a\":[1,-2.5e3,true,null,false,\"x\\u00e9\\\"y\"],\"b\":{},\"c\":[[],{\"d\":0.125E+2}]}",
+    "  [ \"\\\\\" , 0 , -0.0e-1 , \"\" ]  ",
+    "{\"arguments\":\"{\\\"city\\\":\\\"Paris\\\"}\",\"n\":12345678901234567890}",
+    "\"top-level string\"",
+    "[01]",
+    "[1.]",
+    "[-]",
+    "[truex]",
+    "[true1]",
+    "{\"a\" 1}",
+    "[\"bad\\q\"]",
+    "[\"\\u12g4\"]",
+    "[1,]",
+};
+
+// Parses doc as head + tail and requires the same outcome as one-shot parsing.
+static bool check_split(const char* doc, int len, int split, int step) {
+    jstoktok_t want[MAX_TOKENS];
+    jstoktok_t have[MAX_TOKENS];
+    memset(want, 0, sizeof(want));
+    memset(have, 0, sizeof(have));
+
+    jstok_parser parser;
+    jstok_init(&parser);
+    int expect = jstok_parse(&parser, doc, len, want, MAX_TOKENS);
+
+    jstok_init_chunked(&parser);
+    int got = jstok_parse(&parser, doc, split, have, MAX_TOKENS);
+    int off = split;
+    while (off < len && (got >= 0 || got == JSTOK_ERROR_PART)) {
+        int n = (step && step < len - off) ? step : len - off;
+        got = jstok_parse(&parser, doc + off, n, have, MAX_TOKENS);
+        off += n;
+    }
+
+    if (expect < 0) return got < 0;
+    return got == expect && memcmp(want, have, (size_t)expect * sizeof(want[0])) == 0;
+}
+
+static bool test_every_split(void) {
+    for (size_t d = 0; d < sizeof(k_docs) / sizeof(k_docs[0]); d++) {
+        int len = (int)strlen(k_docs[d]);
+        for (int split = 0; split <= len; split++) {
+            if (!require(check_split(k_docs[d], len, split, 0), k_docs[d])) return false;
+        }
+        if (!require(check_split(k_docs[d], len, 0, 1), k_docs[d])) return false;
+        if (!require(check_split(k_docs[d], len, 1, 3), k_docs[d])) return false;
+    }
+    return true;
+}
+
+static bool test_partial_state(void) {
+    static const char doc[] = "{\"key\":\"value\",\"n\":42}";
+    jstoktok_t toks[MAX_TOKENS];
+    jstok_parser parser;
+    jstok_init_chunked(&parser);
+
+    // Stop inside the value string: only the object and key tokens exist so far.
+    if (!require(jstok_parse(&parser, doc, 10, toks, MAX_TOKENS) == JSTOK_ERROR_PART, "part in string")) return false;
+    if (!require(parser.toknext == 2 && parser.part == JSTOK_PART_STRING, "string carried")) return false;
+    // Stop inside the number: it needs the closing brace to end.
+    if (!require(jstok_parse(&parser, doc + 10, 11, toks, MAX_TOKENS) == JSTOK_ERROR_PART, "part in number")) {
+        return false;
+    }
+    if (!require(parser.part == JSTOK_PART_NUMBER, "number carried")) return false;
+    if (!require(jstok_parse(&parser, doc + 21, 1, toks, MAX_TOKENS) == 5, "complete")) return false;
+    if (!require(toks[2].start == 8 && toks[2].end == 13, "stream offsets")) return false;
+    if (!require(toks[4].start == 19 && toks[4].end == 21 && toks[0].size == 2, "number token")) return false;
+    return true;
+}
+
+static bool test_nomem_resume(void) {
+    static const char doc[] = "[\"a\",\"b\",[true]]";
+    jstoktok_t toks[MAX_TOKENS];
+    jstok_parser parser;
+    jstok_init_chunked(&parser);
+
+    int r = jstok_parse(&parser, doc, (int)sizeof(doc) - 1, toks, 2);
+    if (!require(r == JSTOK_ERROR_NOMEM && parser.pos == 7, "nomem stops at closing quote")) return false;
+    // Feed again from parser.pos with room for the rest.
+    r = jstok_parse(&parser, doc + parser.pos, (int)sizeof(doc) - 1 - parser.pos, toks, MAX_TOKENS);
+    if (!require(r == 5 && toks[2].start == 6 && toks[3].type == JSTOK_ARRAY && toks[0].size == 3, "resumed")) {
+        return false;
+    }
+    return true;
+}
+
+static bool test_same_buffer_resume(void) {
+    static const char doc[] = "{\"a\":\"bc\",\"d\":[1,2]}";
+    jstoktok_t toks[MAX_TOKENS];
+    jstok_parser parser;
+    jstok_init(&parser);
+    for (int len = 1; len < (int)sizeof(doc) - 1; len++) {
+        if (!require(jstok_parse(&parser, doc, len, toks, MAX_TOKENS) == JSTOK_ERROR_PART, "growing prefix")) {
+            return false;
+        }
+    }
+    return require(jstok_parse(&parser, doc, (int)sizeof(doc) - 1, toks, MAX_TOKENS) == 7, "same buffer done");
+}
+
+int main(void) {
+    if (!test_every_split()) return 1;
+    if (!test_partial_state()) return 1;
+    if (!test_nomem_resume()) return 1;
+    if (!test_same_buffer_resume()) return 1;
+    printf("jstok chunked tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,186 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+#include "stop_match.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+typedef struct {
+    char text[512];
+    size_t len;
+    size_t deltas;
+    llm_finish_reason_t finish;
+    size_t finish_calls;
+} capture_t;
+
+static void on_content(void* user_data, const char* delta, size_t len) {
+    capture_t* c = user_data;
+    if (c->len + len > sizeof(c->text)) return;
+    memcpy(c->text + c->len, delta, len);
+    c->len += len;
+    c->deltas++;
+}
+
+static void on_finish(void* user_data, llm_finish_reason_t reason) {
+    capture_t* c = user_data;
+    c->finish = reason;
+    c->finish_calls++;
+}
+
+static bool text_is(const capture_t* c, const char* lit) {
+    return c->len == strlen(lit) && memcmp(c->text, lit, c->len) == 0;
+}
+
+// Feeds escaped text through the matcher in pieces of step bytes; returns whether it stopped.
+static bool match_in_steps(const char* const* stops, size_t count, const char* text, size_t step, capture_t* out) {
+    size_t lens[4];
+    for (size_t i = 0; i < count; i++) lens[i] = strlen(stops[i]);
+    stop_matcher_t m;
+    if (!stop_matcher_init(&m, stops, lens, count, NULL)) return false;
+    memset(out, 0, sizeof(*out));
+    size_t len = strlen(text);
+    bool hit = false;
+    for (size_t off = 0; off < len && !hit; off += step) {
+        size_t n = (len - off < step) ? len - off : step;
+        hit = stop_matcher_feed(&m, text + off, n, on_content, out);
+    }
+    if (!hit) stop_matcher_flush(&m, on_content, out);
+    stop_matcher_free(&m);
+    return hit;
+}
+
+static bool test_matcher(void) {
+    static const char* const stops[] = {"END", "\n\nUser:"};
+    static const char text[] = "hello wor\\nld\\n\\nUser: more";
+    capture_t c;
+    for (size_t step = 1; step <= sizeof(text); step++) {
+        if (!require(match_in_steps(stops, 2, text, step, &c), "newline stop across deltas")) return false;
+        if (!require(text_is(&c, "hello wor\\nld"), "cut before escaped stop")) return false;
+    }
+    for (size_t step = 1; step < 8; step++) {
+        if (!require(match_in_steps(stops, 2, "say \\u0045ND now", step, &c), "unicode escape stop")) return false;
+        if (!require(text_is(&c, "say "), "cut before \\u escape")) return false;
+        if (!require(!match_in_steps(stops, 2, "almost EN", step, &c), "prefix only")) return false;
+        if (!require(text_is(&c, "almost EN"), "held prefix flushed")) return false;
+    }
+
+    static const char* const overlap[] = {"abcd", "bc"};
+    if (!require(match_in_steps(overlap, 2, "zabcd", 1, &c) && text_is(&c, "za"), "earliest ending match")) {
+        return false;
+    }
+    static const char* const emoji[] = {"\xf0\x9f\x98\x80"};
+    if (!require(match_in_steps(emoji, 1, "hi \\ud83d\\ude00!", 2, &c) && text_is(&c, "hi "), "surrogate pair")) {
+        return false;
+    }
+    return true;
+}
+
+static llm_client_t* make_client(void) {
+    llm_model_t model = {"test-model"};
+    return llm_client_create("http://fake", &model, NULL, NULL);
+}
+
+static bool test_chat_stop(void) {
+    fake_reset();
+    static const char stream_sse[] =
+        "data: {\"choices\":[{\"delta\":{\"content\":\"Answer: 4\\n\\nUs\"}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{\"content\":\"er: and now\"}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{\"content\":\" the model keeps going\"}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{\"content\":\" and going\"}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"length\"}]}\n\n"
+        "data: [DONE]\n\n";
+    g_fake->stream_payload = stream_sse;
+    g_fake->stream_payload_len = strlen(stream_sse);
+    g_fake->stream_chunk_size = 16;
+
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    static const char* const stops[] = {"\n\nUser:"};
+    static const size_t stop_lens[] = {7};
+    capture_t c = {0};
+    llm_stream_callbacks_t cbs = {0};
+    cbs.user_data = &c;
+    cbs.on_content_delta = on_content;
+    cbs.on_finish_reason = on_finish;
+    cbs.stop_list = stops;
+    cbs.stop_lens = stop_lens;
+    cbs.stop_count = 1;
+
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    llm_error_t err = llm_chat_stream_ex(client, &msg, 1, NULL, NULL, NULL, &cbs, NULL, NULL);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE, "stop is not an error")) return false;
+    if (!require(text_is(&c, "Answer: 4"), "chat content cut")) return false;
+    if (!require(c.finish == LLM_FINISH_REASON_STOP && c.finish_calls == 1, "finish reason stop")) return false;
+    if (!require(g_fake->stream_cb_calls < (sizeof(stream_sse) + 15) / 16, "transport aborted early")) return false;
+    return true;
+}
+
+static bool test_completions_stop(void) {
+    fake_reset();
+    static const char stream_sse[] =
+        "data: {\"choices\":[{\"text\":\"1, 2, 3\"}]}\n\n"
+        "data: {\"choices\":[{\"text\":\", 4\"}]}\n\n"
+        "data: {\"choices\":[{\"text\":\", 5\",\"finish_reason\":\"length\"}]}\n\n"
+        "data: [DONE]\n\n";
+    g_fake->stream_payload = stream_sse;
+    g_fake->stream_payload_len = strlen(stream_sse);
+    g_fake->stream_chunk_size = 7;
+
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    static const char* const stops[] = {"3, 4", "zzz"};
+    static const size_t stop_lens[] = {4, 3};
+    capture_t c = {0};
+    llm_stream_callbacks_t cbs = {0};
+    cbs.user_data = &c;
+    cbs.on_content_delta = on_content;
+    cbs.on_finish_reason = on_finish;
+    cbs.stop_list = stops;
+    cbs.stop_lens = stop_lens;
+    cbs.stop_count = 2;
+    bool ok = llm_completions_stream(client, "count", 5, NULL, &cbs);
+    if (!require(ok && text_is(&c, "1, 2, ") && c.finish == LLM_FINISH_REASON_STOP, "completions cut")) {
+        llm_client_destroy(client);
+        return false;
+    }
+
+    // Without a match every byte is delivered, held-back bytes included.
+    static const char* const miss[] = {"5!"};
+    static const size_t miss_lens[] = {2};
+    memset(&c, 0, sizeof(c));
+    cbs.stop_list = miss;
+    cbs.stop_lens = miss_lens;
+    cbs.stop_count = 1;
+    ok = llm_completions_stream(client, "count", 5, NULL, &cbs);
+    llm_client_destroy(client);
+    if (!require(ok && text_is(&c, "1, 2, 3, 4, 5") && c.finish == LLM_FINISH_REASON_LENGTH, "no match")) {
+        return false;
+    }
+    return true;
+}
+
+int main(void) {
+    if (!test_matcher()) return 1;
+    if (!test_chat_stop()) return 1;
+    if (!test_completions_stop()) return 1;
+    printf("Stop sequence tests passed.\n");
+    return 0;
+}
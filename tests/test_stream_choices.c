@@ -0,0 +1,194 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static llm_client_t* make_client(void) {
+    llm_model_t model = {"test-model"};
+    return llm_client_create("http://fake", &model, NULL, NULL);
+}
+
+struct choice_capture {
+    char text[64];
+    size_t len;
+    llm_finish_reason_t finish;
+    size_t finishes;
+    char args[64];
+    size_t args_len;
+    size_t tool_index;
+    size_t usage_calls;
+    size_t total_tokens;
+};
+
+static void on_content(void* user_data, const char* delta, size_t len) {
+    struct choice_capture* c = user_data;
+    if (c->len + len > sizeof(c->text)) return;
+    memcpy(c->text + c->len, delta, len);
+    c->len += len;
+}
+
+static void on_finish(void* user_data, llm_finish_reason_t reason) {
+    struct choice_capture* c = user_data;
+    c->finish = reason;
+    c->finishes++;
+}
+
+static void on_args_complete(void* user_data, size_t tool_index, const char* args_json, size_t len) {
+    struct choice_capture* c = user_data;
+    if (len >= sizeof(c->args)) return;
+    memcpy(c->args, args_json, len);
+    c->args_len = len;
+    c->tool_index = tool_index;
+}
+
+static void on_usage(void* user_data, const llm_usage_t* usage) {
+    struct choice_capture* c = user_data;
+    c->usage_calls++;
+    c->total_tokens = usage->total_tokens;
+}
+
+static void bind(llm_stream_callbacks_t* cbs, struct choice_capture* caps, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        memset(&cbs[i], 0, sizeof(cbs[i]));
+        cbs[i].user_data = &caps[i];
+        cbs[i].on_content_delta = on_content;
+        cbs[i].on_finish_reason = on_finish;
+        cbs[i].on_tool_args_complete = on_args_complete;
+        cbs[i].on_usage = on_usage;
+    }
+}
+
+// Three choices interleaved across chunks, several per chunk and out of order; choice 3 is not subscribed.
+static const char k_payload[] =
+    "data: {\"choices\":[{\"index\":0,\"delta\":{\"content\":\"Hel\"}},{\"index\":1,\"delta\":{\"content\":\"Bon\"}},"
+    "{\"index\":3,\"delta\":{\"content\":\"ignored\"}}]}\n\n"
+    "data: {\"choices\":[{\"index\":2,\"delta\":{\"tool_calls\":[{\"index\":0,\"id\":\"c\",\"function\":"
+    "{\"name\":\"f\",\"arguments\":\"{\\\"x\\\":\"}}]}}]}\n\n"
+    "data: {\"choices\":[{\"index\":1,\"delta\":{\"content\":\"jour\"},\"finish_reason\":\"stop\"},"
+    "{\"index\":0,\"delta\":{\"content\":\"lo\"}}]}\n\n"
+    "data: {\"choices\":[{\"index\":2,\"delta\":{\"tool_calls\":[{\"index\":0,\"function\":{\"arguments\":\"1}\"}}]},"
+    "\"finish_reason\":\"tool_calls\"},{\"index\":0,\"delta\":{},\"finish_reason\":\"length\"}]}\n\n"
+    "data: {\"choices\":[],\"usage\":{\"prompt_tokens\":5,\"completion_tokens\":9,\"total_tokens\":14}}\n\n"
+    "data: [DONE]\n\n";
+
+static bool test_demultiplex(void) {
+    fake_reset();
+    g_fake->stream_payload = k_payload;
+    g_fake->stream_payload_len = sizeof(k_payload) - 1;
+    g_fake->stream_chunk_size = 13;
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct choice_capture caps[3] = {0};
+    llm_stream_callbacks_t cbs[3];
+    bind(cbs, caps, 3);
+    cbs[0].include_usage = true;
+    llm_error_t err =
+        llm_chat_stream_choices_ex(client, &msg, 1, "{\"n\":4}", NULL, NULL, cbs, 3, NULL, NULL, NULL, 0, NULL);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE && g_fake->stream_calls == 1, "one streamed request")) return false;
+    if (!require(caps[0].len == 5 && memcmp(caps[0].text, "Hello", 5) == 0, "choice 0 text")) return false;
+    if (!require(caps[1].len == 7 && memcmp(caps[1].text, "Bonjour", 7) == 0, "choice 1 text")) return false;
+    if (!require(caps[2].len == 0 && caps[2].args_len == 7 && memcmp(caps[2].args, "{\"x\":1}", 7) == 0,
+                 "choice 2 tool call")) {
+        return false;
+    }
+    if (!require(caps[0].finish == LLM_FINISH_REASON_LENGTH && caps[1].finish == LLM_FINISH_REASON_STOP &&
+                     caps[2].finish == LLM_FINISH_REASON_TOOL_CALLS,
+                 "per-choice finish reasons")) {
+        return false;
+    }
+    if (!require(caps[0].finishes == 1 && caps[1].finishes == 1 && caps[2].finishes == 1, "one finish each")) {
+        return false;
+    }
+    if (!require(caps[0].usage_calls == 1 && caps[0].total_tokens == 14 && caps[1].usage_calls == 0,
+                 "usage on choice 0")) {
+        return false;
+    }
+    if (!require(strstr(g_fake->request_bodies[0], "\"stream_options\"") != NULL, "include_usage requested")) {
+        return false;
+    }
+    return true;
+}
+
+static bool test_stop_string_ends_one_choice(void) {
+    fake_reset();
+    static const char payload[] =
+        "data: {\"choices\":[{\"index\":0,\"delta\":{\"content\":\"one END two\"}},"
+        "{\"index\":1,\"delta\":{\"content\":\"keep\"}}]}\n\n"
+        "data: {\"choices\":[{\"index\":0,\"delta\":{\"content\":\" more\"}},"
+        "{\"index\":1,\"delta\":{\"content\":\" going\"},\"finish_reason\":\"stop\"}]}\n\n"
+        "data: [DONE]\n\n";
+    g_fake->stream_payload = payload;
+    g_fake->stream_payload_len = sizeof(payload) - 1;
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct choice_capture caps[2] = {0};
+    llm_stream_callbacks_t cbs[2];
+    bind(cbs, caps, 2);
+    static const char* const stops[] = {"END"};
+    static const size_t stop_lens[] = {3};
+    cbs[0].stop_list = stops;
+    cbs[0].stop_lens = stop_lens;
+    cbs[0].stop_count = 1;
+    llm_error_t err =
+        llm_chat_stream_choices_ex(client, &msg, 1, "{\"n\":2}", NULL, NULL, cbs, 2, NULL, NULL, NULL, 0, NULL);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE, "stream succeeds")) return false;
+    if (!require(caps[0].len == 4 && memcmp(caps[0].text, "one ", 4) == 0 && caps[0].finishes == 1,
+                 "choice 0 cut at its stop string")) {
+        return false;
+    }
+    if (!require(caps[1].len == 10 && memcmp(caps[1].text, "keep going", 10) == 0, "choice 1 continues")) {
+        return false;
+    }
+    return true;
+}
+
+static bool test_invalid_args_fail_stream(void) {
+    fake_reset();
+    static const char payload[] =
+        "data: {\"choices\":[{\"index\":1,\"delta\":{\"tool_calls\":[{\"index\":0,\"id\":\"c\",\"function\":"
+        "{\"name\":\"f\",\"arguments\":\"}\"}}]}}]}\n\n"
+        "data: [DONE]\n\n";
+    g_fake->stream_payload = payload;
+    g_fake->stream_payload_len = sizeof(payload) - 1;
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct choice_capture caps[2] = {0};
+    llm_stream_callbacks_t cbs[2];
+    bind(cbs, caps, 2);
+    llm_error_t err =
+        llm_chat_stream_choices_ex(client, &msg, 1, "{\"n\":2}", NULL, NULL, cbs, 2, NULL, NULL, NULL, 0, NULL);
+    llm_client_destroy(client);
+    return require(err == LLM_ERR_INVALID_TOOL_ARGS, "malformed args in one choice fail the stream");
+}
+
+int main(void) {
+    if (!test_demultiplex()) return 1;
+    if (!test_stop_string_ends_one_choice()) return 1;
+    if (!test_invalid_args_fail_stream()) return 1;
+    printf("Multi-choice stream tests passed.\n");
+    return 0;
+}
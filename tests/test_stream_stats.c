@@ -0,0 +1,209 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static llm_client_t* make_client(void) {
+    llm_model_t model = {"test-model"};
+    return llm_client_create("http://fake", &model, NULL, NULL);
+}
+
+enum { EVENT_BYTES = 128, INTERVAL_US = 20000 };
+
+static char g_payload[16 * EVENT_BYTES + 1];
+
+// Pads every event to EVENT_BYTES with a leading SSE comment, so a fixed chunk size paces one event per chunk.
+static void build_payload(const char* const* events, size_t count) {
+    size_t off = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(events[i]);
+        size_t pad = EVENT_BYTES - len - 1;
+        g_payload[off] = ':';
+        memset(g_payload + off + 1, ' ', pad - 1);
+        g_payload[off + pad] = '\n';
+        memcpy(g_payload + off + pad + 1, events[i], len);
+        off += EVENT_BYTES;
+    }
+    g_payload[off] = '\0';
+    g_fake->stream_payload = g_payload;
+    g_fake->stream_payload_len = off;
+    g_fake->stream_chunk_size = EVENT_BYTES;
+    g_fake->stream_chunk_interval_us = INTERVAL_US;
+}
+
+static bool near_us(uint64_t got, uint64_t want, uint64_t slack) {
+    return got + slack / 4 >= want && got <= want + slack;
+}
+
+static bool histogram_matches(const llm_stream_stats_t* stats) {
+    uint64_t counted = 0;
+    for (size_t b = 0; b < LLM_STREAM_STATS_BUCKETS; b++) {
+        counted += stats->gap_buckets[b];
+        if (stats->gap_buckets[b] == 0) continue;
+        uint64_t lo = llm_stream_stats_bucket_floor_us(b);
+        if (lo > stats->gap_max_us) return false;
+    }
+    return counted == stats->delta_count - 1;
+}
+
+static bool test_chat_stream_stats(void) {
+    fake_reset();
+    // The role-only chunk and the empty content delta do not count; the first delta arrives one interval in.
+    const char* const events[] = {
+        "data: {\"choices\":[{\"delta\":{\"role\":\"assistant\",\"content\":\"\"}}]}\n\n",
+        "data: {\"choices\":[{\"delta\":{\"reasoning_content\":\"hm\"}}]}\n\n",
+        "data: {\"choices\":[{\"delta\":{\"content\":\"a\"}}]}\n\n",
+        "data: {\"choices\":[{\"delta\":{\"content\":\"b\"}}]}\n\n",
+        "data: {\"choices\":[{\"delta\":{\"content\":\"c\"}}]}\n\n",
+        "data: {\"choices\":[{\"delta\":{\"content\":\"d\"}}]}\n\n",
+        "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"stop\"}]}\n\ndata: [DONE]\n\n",
+    };
+    build_payload(events, sizeof(events) / sizeof(events[0]));
+
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    llm_stream_stats_t stats;
+    memset(&stats, 0xab, sizeof(stats));  // every field is reset by the call
+    llm_stream_callbacks_t callbacks = {0};
+    callbacks.stats = &stats;
+    llm_error_t err = llm_chat_stream_ex(client, &msg, 1, NULL, NULL, NULL, &callbacks, NULL, NULL);
+    llm_client_destroy(client);
+
+    if (!require(err == LLM_ERR_NONE, "stream ok")) return false;
+    if (!require(stats.has_first_byte && stats.has_first_delta && stats.delta_count == 5, "deltas counted")) {
+        return false;
+    }
+    if (!require(stats.first_byte_us < INTERVAL_US && near_us(stats.ttft_us, INTERVAL_US, INTERVAL_US), "ttft")) {
+        return false;
+    }
+    if (!require(near_us(stats.total_us, 6 * INTERVAL_US, 2 * INTERVAL_US), "total")) return false;
+    if (!require(near_us(stats.gap_mean_us, INTERVAL_US, INTERVAL_US) &&
+                     near_us(stats.gap_p50_us, INTERVAL_US, INTERVAL_US) && stats.gap_p99_us >= stats.gap_p50_us &&
+                     stats.gap_max_us >= stats.gap_p99_us,
+                 "gap summary")) {
+        return false;
+    }
+    if (!require(stats.deltas_per_sec > 20.0 && stats.deltas_per_sec <= 55.0, "throughput")) return false;
+    if (!require(histogram_matches(&stats), "histogram holds every gap")) return false;
+    return true;
+}
+
+static bool test_completions_stream_stats(void) {
+    fake_reset();
+    const char* const events[] = {
+        "data: {\"choices\":[{\"text\":\"x\"}]}\n\n",
+        "data: {\"choices\":[{\"text\":\"y\"}]}\n\n",
+        "data: {\"choices\":[{\"text\":\"z\",\"finish_reason\":\"stop\"}]}\n\ndata: [DONE]\n\n",
+    };
+    build_payload(events, 3);
+
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_stream_stats_t stats;
+    llm_stream_callbacks_t callbacks = {0};
+    callbacks.stats = &stats;
+    bool ok = llm_completions_stream(client, "p", 1, NULL, &callbacks);
+    llm_client_destroy(client);
+    if (!require(ok && stats.delta_count == 3 && stats.ttft_us < INTERVAL_US, "completions deltas")) return false;
+    if (!require(near_us(stats.gap_p50_us, INTERVAL_US, INTERVAL_US) && histogram_matches(&stats), "gaps")) {
+        return false;
+    }
+    return true;
+}
+
+// Every allocation takes a millisecond, so a call that builds its request has a measurable duration.
+static void* slow_alloc(void* user_data, size_t size) {
+    (void)user_data;
+    struct timespec ts = {0, 1000000L};
+    nanosleep(&ts, NULL);
+    return malloc(size);
+}
+
+static void* slow_realloc(void* user_data, void* ptr, size_t size) {
+    (void)user_data;
+    return realloc(ptr, size);
+}
+
+static void slow_free(void* user_data, void* ptr) {
+    (void)user_data;
+    free(ptr);
+}
+
+// A request that fails before the transport (here on a malformed header) still closes its stats.
+static bool test_stats_finish_on_early_failure(void) {
+    fake_reset();
+    llm_allocator_t alloc = {slow_alloc, slow_realloc, slow_free, NULL};
+    llm_client_init_opts_t opts = {0};
+    opts.allocator = &alloc;
+    llm_model_t model = {"test-model"};
+    llm_client_t* client = llm_client_create_opts("http://fake", &model, NULL, NULL, &opts);
+    if (!require(client != NULL, "client create")) return false;
+    const char* const bad_headers[] = {"no colon here"};
+    llm_message_t msg = {LLM_ROLE_USER, "hi", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    llm_stream_stats_t chat_stats;
+    llm_stream_stats_t completions_stats;
+    llm_stream_callbacks_t callbacks = {0};
+    callbacks.stats = &chat_stats;
+    llm_error_t chat_err = llm_chat_stream_with_headers_ex(client, &msg, 1, NULL, NULL, NULL, &callbacks, NULL, NULL,
+                                                           bad_headers, 1);
+    callbacks.stats = &completions_stats;
+    llm_error_t completions_err = llm_completions_stream_with_headers_ex(client, "p", 1, NULL, &callbacks, NULL, NULL,
+                                                                         bad_headers, 1);
+    llm_client_destroy(client);
+
+    if (!require(chat_err == LLM_ERR_FAILED && completions_err == LLM_ERR_FAILED && g_fake->request_count == 0,
+                 "failed before the transport")) {
+        return false;
+    }
+    if (!require(chat_stats.total_us >= 1000 && chat_stats.delta_count == 0 && !chat_stats.has_first_byte,
+                 "chat stats finished")) {
+        return false;
+    }
+    return require(completions_stats.total_us >= 1000 && completions_stats.delta_count == 0,
+                   "completions stats finished");
+}
+
+static bool test_bucket_layout(void) {
+    const uint64_t want[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 16, 20, 24, 28, 32};
+    for (size_t i = 0; i < sizeof(want) / sizeof(want[0]); i++) {
+        if (!require(llm_stream_stats_bucket_floor_us(i) == want[i], "bucket floors")) return false;
+    }
+    for (size_t b = 1; b < LLM_STREAM_STATS_BUCKETS; b++) {
+        if (!require(llm_stream_stats_bucket_floor_us(b) > llm_stream_stats_bucket_floor_us(b - 1), "increasing")) {
+            return false;
+        }
+    }
+    // The last bucket starts past a minute, far beyond any useful inter-token gap.
+    if (!require(llm_stream_stats_bucket_floor_us(LLM_STREAM_STATS_BUCKETS - 1) > 60000000u, "range")) return false;
+    return require(llm_stream_stats_bucket_floor_us(LLM_STREAM_STATS_BUCKETS) == UINT64_MAX, "out of range");
+}
+
+int main(void) {
+    if (!test_bucket_layout()) return 1;
+    if (!test_chat_stream_stats()) return 1;
+    if (!test_completions_stream_stats()) return 1;
+    if (!test_stats_finish_on_early_failure()) return 1;
+    printf("Stream stats tests passed.\n");
+    return 0;
+}
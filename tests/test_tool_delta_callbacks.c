@@ -654,6 +654,47 @@ int main(void) {
         return 1;
     }
 
+    // A syntax error in the first fragment stops the stream before the remaining frames are read.
+    fake_reset();
+    const char* early_payload =
+        "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":0,\"id\":\"call_0\","
+        "\"function\":{\"name\":\"ping\",\"arguments\":\"{\\\"a\\\":]\"}}]}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{\"content\":\"still generating\"}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{\"content\":\"still generating\"}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"tool_calls\"}]}\n\n"
+        "data: [DONE]\n\n";
+    g_fake->stream_payload = early_payload;
+    g_fake->stream_payload_len = strlen(early_payload);
+    g_fake->stream_chunk_size = 16;
+    memset(&bad_cap, 0, sizeof(bad_cap));
+    llm_error_detail_t detail = {0};
+    llm_error_t err = llm_chat_stream_detail_ex(client, messages, 1, NULL, NULL, NULL, &bad_cbs, NULL, NULL, &detail);
+    if (!require(err == LLM_ERR_INVALID_TOOL_ARGS, "invalid args error code") ||
+        !require(detail.code == LLM_ERR_INVALID_TOOL_ARGS && detail.stage == LLM_ERROR_STAGE_PROTOCOL,
+                 "invalid args detail") ||
+        !require(g_fake->stream_cb_calls < (strlen(early_payload) + 15) / 16, "stream aborted early") ||
+        !require(bad_cap.final_calls == 0, "no final args after abort")) {
+        llm_error_detail_free(&detail);
+        llm_client_destroy(client);
+        return 1;
+    }
+    llm_error_detail_free(&detail);
+
+    // Truncated but well-formed-so-far args are only rejected at finish_reason.
+    fake_reset();
+    const char* truncated_payload =
+        "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":0,\"id\":\"call_0\","
+        "\"function\":{\"name\":\"ping\",\"arguments\":\"{\\\"a\\\":1\"}}]}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"tool_calls\"}]}\n\n"
+        "data: [DONE]\n\n";
+    g_fake->stream_payload = truncated_payload;
+    g_fake->stream_payload_len = strlen(truncated_payload);
+    err = llm_chat_stream_ex(client, messages, 1, NULL, NULL, NULL, &bad_cbs, NULL, NULL);
+    if (!require(err == LLM_ERR_INVALID_TOOL_ARGS, "truncated args error code")) {
+        llm_client_destroy(client);
+        return 1;
+    }
+
     llm_client_destroy(client);
 
     printf("Tool delta callbacks test passed.\n");
@@ -0,0 +1,230 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static llm_client_t* make_client(void) {
+    llm_model_t model = {"test-model"};
+    return llm_client_create("http://fake", &model, NULL, NULL);
+}
+
+struct dispatch_log {
+    size_t calls;
+    size_t weather_calls;
+};
+
+// Every result carries the dispatch sequence number, so a cached answer is recognizable.
+static bool dispatch(void* user_data, const char* tool_name, size_t name_len, const char* args_json, size_t args_len,
+                     char** result_json, size_t* result_len) {
+    struct dispatch_log* log = user_data;
+    (void)args_json;
+    (void)args_len;
+    size_t n = ++log->calls;
+    if (name_len == 7 && memcmp(tool_name, "weather", 7) == 0) log->weather_calls++;
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "{\"seq\":%zu}", n);
+    *result_json = malloc((size_t)len + 1);
+    if (!*result_json) return false;
+    memcpy(*result_json, buf, (size_t)len + 1);
+    *result_len = (size_t)len;
+    return true;
+}
+
+#define POST_CALL(id, name, args) \
+    "{\"id\":\"" id "\",\"type\":\"function\",\"function\":{\"name\":\"" name "\",\"arguments\":\"" args "\"}}"
+#define POST_TURN(calls)                                                                                        \
+    "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"tool_calls\":[" calls "]},\"finish_reason\":\"tool_" \
+    "calls\"}]}"
+
+// Turn 2 repeats the Oslo lookup with other whitespace and key order, and repeats the uncacheable clock.
+#define OSLO_ARGS "{\\\"city\\\":\\\"Oslo\\\",\\\"units\\\":\\\"c\\\"}"
+static const char k_post_turn1[] = POST_TURN(POST_CALL("c1", "weather", OSLO_ARGS) "," POST_CALL("c2", "clock", "{}"));
+static const char k_post_turn2[] =
+    POST_TURN(POST_CALL("c3", "weather", "{ \\\"units\\\": \\\"c\\\", \\\"city\\\": \\\"Oslo\\\" }")
+              "," POST_CALL("c4", "weather", "{\\\"city\\\":\\\"Bergen\\\",\\\"units\\\":\\\"c\\\"}")
+              "," POST_CALL("c5", "clock", "{}"));
+static const char k_post_final[] =
+    "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"done\"},\"finish_reason\":\"stop\"}]}";
+
+static const char* const k_cacheable[] = {"weather"};
+
+static bool test_repeat_call_served_from_cache(void) {
+    fake_reset();
+    g_fake->post_responses[0] = k_post_turn1;
+    g_fake->post_responses[1] = k_post_turn2;
+    g_fake->post_responses[2] = k_post_final;
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "weather?", 8, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct dispatch_log log = {0};
+    llm_tool_loop_stats_t stats = {0};
+    llm_tool_loop_opts_t opts = {0};
+    opts.cacheable_tools = k_cacheable;
+    opts.cacheable_tools_count = 1;
+    opts.cache_max_entries = 8;
+    opts.stats = &stats;
+    llm_error_t err =
+        llm_tool_loop_run_opts(client, &msg, 1, NULL, NULL, NULL, dispatch, &log, NULL, NULL, 4, NULL, 0, &opts);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE && g_fake->request_count == 3, "loop succeeds")) return false;
+    if (!require(log.calls == 4 && log.weather_calls == 2, "repeat weather call not dispatched")) return false;
+    if (!require(stats.dispatches == 4 && stats.cache_hits == 1 && stats.cache_misses == 2, "stats")) return false;
+    // c3 gets the result of c1; the clock is dispatched again.
+    const char* body = g_fake->request_bodies[2];
+    if (!require(strstr(body, "\"content\":\"{\\\"seq\\\":1}\",\"tool_call_id\":\"c3\"") != NULL, "cached result")) {
+        return false;
+    }
+    if (!require(strstr(body, "\"content\":\"{\\\"seq\\\":4}\",\"tool_call_id\":\"c5\"") != NULL, "clock rerun")) {
+        return false;
+    }
+    return true;
+}
+
+static bool test_cache_disabled_by_default(void) {
+    fake_reset();
+    g_fake->post_responses[0] = k_post_turn1;
+    g_fake->post_responses[1] = k_post_turn2;
+    g_fake->post_responses[2] = k_post_final;
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "weather?", 8, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct dispatch_log log = {0};
+    llm_tool_loop_stats_t stats = {0};
+    llm_tool_loop_opts_t opts = {0};
+    opts.stats = &stats;
+    llm_error_t err =
+        llm_tool_loop_run_opts(client, &msg, 1, NULL, NULL, NULL, dispatch, &log, NULL, NULL, 4, NULL, 0, &opts);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE && log.calls == 5, "every call dispatched")) return false;
+    if (!require(stats.dispatches == 5 && stats.cache_hits == 0 && stats.cache_misses == 0, "no cache stats")) {
+        return false;
+    }
+    return true;
+}
+
+static bool test_oldest_entry_evicted(void) {
+    fake_reset();
+    g_fake->post_responses[0] = k_post_turn1;
+    g_fake->post_responses[1] = k_post_turn2;
+    g_fake->post_responses[2] = POST_TURN(POST_CALL("c6", "weather", OSLO_ARGS));
+    g_fake->post_responses[3] = k_post_final;
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "weather?", 8, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct dispatch_log log = {0};
+    llm_tool_loop_stats_t stats = {0};
+    llm_tool_loop_opts_t opts = {0};
+    opts.cacheable_tools = k_cacheable;
+    opts.cacheable_tools_count = 1;
+    opts.cache_max_entries = 1;
+    opts.stats = &stats;
+    llm_error_t err =
+        llm_tool_loop_run_opts(client, &msg, 1, NULL, NULL, NULL, dispatch, &log, NULL, NULL, 5, NULL, 0, &opts);
+    llm_client_destroy(client);
+    // Bergen displaced Oslo, so the third Oslo lookup is dispatched again.
+    if (!require(err == LLM_ERR_NONE && log.weather_calls == 3, "evicted entry dispatched")) return false;
+    if (!require(stats.cache_hits == 1 && stats.cache_misses == 3, "eviction stats")) return false;
+    return true;
+}
+
+// The same duplicated key in another order is another call; canonicalization must not make them equal.
+#define DUP_OSLO_FIRST "{\\\"city\\\":\\\"Oslo\\\",\\\"city\\\":\\\"Bergen\\\"}"
+#define DUP_BERGEN_FIRST "{\\\"city\\\":\\\"Bergen\\\",\\\"city\\\":\\\"Oslo\\\"}"
+
+static bool test_duplicate_keys_keep_order(void) {
+    fake_reset();
+    g_fake->post_responses[0] = POST_TURN(POST_CALL("d1", "weather", DUP_OSLO_FIRST));
+    g_fake->post_responses[1] =
+        POST_TURN(POST_CALL("d2", "weather", DUP_BERGEN_FIRST) "," POST_CALL("d3", "weather", DUP_OSLO_FIRST));
+    g_fake->post_responses[2] = k_post_final;
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "weather?", 8, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct dispatch_log log = {0};
+    llm_tool_loop_stats_t stats = {0};
+    llm_tool_loop_opts_t opts = {0};
+    opts.cacheable_tools = k_cacheable;
+    opts.cacheable_tools_count = 1;
+    opts.cache_max_entries = 8;
+    opts.stats = &stats;
+    llm_error_t err =
+        llm_tool_loop_run_opts(client, &msg, 1, NULL, NULL, NULL, dispatch, &log, NULL, NULL, 4, NULL, 0, &opts);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE && log.weather_calls == 2, "reordered duplicates dispatched")) return false;
+    if (!require(stats.cache_hits == 1 && stats.cache_misses == 2, "duplicate key stats")) return false;
+    return true;
+}
+
+static const char k_stream_turn1[] =
+    "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":0,\"id\":\"s1\",\"function\":{\"name\":\"weather\","
+    "\"arguments\":\"{\\\"city\\\":\\\"Oslo\\\"}\"}}]}}]}\n\n"
+    "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"tool_calls\"}]}\n\n"
+    "data: [DONE]\n\n";
+static const char k_stream_turn2[] =
+    "data: {\"choices\":[{\"delta\":{\"content\":\"again\",\"tool_calls\":[{\"index\":0,\"id\":\"s2\",\"function\":"
+    "{\"name\":\"weather\",\"arguments\":\"{ \\\"city\\\" : \\\"Oslo\\\" }\"}}]}}]}\n\n"
+    "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"tool_calls\"}]}\n\n"
+    "data: [DONE]\n\n";
+static const char k_stream_final[] =
+    "data: {\"choices\":[{\"delta\":{\"content\":\"done\"}}]}\n\n"
+    "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"stop\"}]}\n\n"
+    "data: [DONE]\n\n";
+
+static bool test_stream_cache(void) {
+    fake_reset();
+    g_fake->stream_payloads[0] = k_stream_turn1;
+    g_fake->stream_payloads[1] = k_stream_turn2;
+    g_fake->stream_payloads[2] = k_stream_final;
+    g_fake->stream_payloads_count = 3;
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "weather?", 8, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct dispatch_log log = {0};
+    llm_tool_loop_stats_t stats = {0};
+    llm_tool_loop_opts_t opts = {0};
+    opts.cacheable_tools = k_cacheable;
+    opts.cacheable_tools_count = 1;
+    opts.cache_max_entries = 8;
+    opts.stats = &stats;
+    llm_error_t err = llm_tool_loop_run_stream_opts(client, &msg, 1, NULL, NULL, NULL, NULL, dispatch, &log, NULL,
+                                                    NULL, 4, NULL, 0, &opts);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE && g_fake->stream_calls == 3, "stream loop succeeds")) return false;
+    if (!require(log.calls == 1 && stats.cache_hits == 1 && stats.dispatches == 1, "stream repeat cached")) {
+        return false;
+    }
+    if (!require(strstr(g_fake->request_bodies[2], "\"content\":\"{\\\"seq\\\":1}\",\"tool_call_id\":\"s2\"") != NULL,
+                 "stream cached result")) {
+        return false;
+    }
+    return true;
+}
+
+int main(void) {
+    if (!test_repeat_call_served_from_cache()) return 1;
+    if (!test_cache_disabled_by_default()) return 1;
+    if (!test_oldest_entry_evicted()) return 1;
+    if (!test_duplicate_keys_keep_order()) return 1;
+    if (!test_stream_cache()) return 1;
+    printf("Tool result cache tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,235 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static llm_client_t* make_client(const llm_limits_t* limits) {
+    llm_model_t model = {"test-model"};
+    return llm_client_create("http://fake", &model, NULL, limits);
+}
+
+enum { TOOLS = 5, TOOL_MS = 100, LATCH_TIMEOUT_S = 10 };
+
+// Every call waits at a latch until want calls are running at once, so a loop that dispatches fewer at a time
+// stalls there until the timeout and is caught by latch_timed_out rather than by how long it took.
+struct lookup_state {
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    int want;
+    int active;
+    int peak;
+    int calls;
+    bool latch_timed_out;
+};
+
+static void lookup_state_init(struct lookup_state* st, int want) {
+    memset(st, 0, sizeof(*st));
+    pthread_mutex_init(&st->mu, NULL);
+    pthread_cond_init(&st->cond, NULL);
+    st->want = want;
+}
+
+static void lookup_state_destroy(struct lookup_state* st) {
+    pthread_cond_destroy(&st->cond);
+    pthread_mutex_destroy(&st->mu);
+}
+
+// Past the latch, later calls finish first, so completion order is the reverse of call order.
+static bool lookup(void* user_data, const char* tool_name, size_t name_len, const char* args_json, size_t args_len,
+                   char** result_json, size_t* result_len) {
+    struct lookup_state* st = user_data;
+    (void)tool_name;
+    (void)name_len;
+    int n = 0;
+    for (size_t i = 0; i < args_len; i++) {
+        if (args_json[i] >= '0' && args_json[i] <= '9') n = args_json[i] - '0';
+    }
+    pthread_mutex_lock(&st->mu);
+    st->calls++;
+    if (++st->active > st->peak) st->peak = st->active;
+    if (st->peak >= st->want) pthread_cond_broadcast(&st->cond);
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += LATCH_TIMEOUT_S;
+    while (st->peak < st->want && !st->latch_timed_out) {
+        if (pthread_cond_timedwait(&st->cond, &st->mu, &deadline) != 0) st->latch_timed_out = true;
+    }
+    pthread_mutex_unlock(&st->mu);
+
+    struct timespec ts = {0, (long)(TOOL_MS - n * 10) * 1000000L};
+    nanosleep(&ts, NULL);
+
+    pthread_mutex_lock(&st->mu);
+    st->active--;
+    pthread_mutex_unlock(&st->mu);
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "{\"n\":%d}", n);
+    *result_json = malloc((size_t)len + 1);
+    if (!*result_json) return false;
+    memcpy(*result_json, buf, (size_t)len + 1);
+    *result_len = (size_t)len;
+    return true;
+}
+
+static char g_post_turn[2048];
+static char g_stream_turn[4096];
+
+static const char k_post_final[] =
+    "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"done\"},\"finish_reason\":\"stop\"}]}";
+static const char k_stream_final[] =
+    "data: {\"choices\":[{\"delta\":{\"content\":\"done\"}}]}\n\n"
+    "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"stop\"}]}\n\n"
+    "data: [DONE]\n\n";
+
+static void build_payloads(void) {
+    size_t off = (size_t)snprintf(g_post_turn, sizeof(g_post_turn),
+                                  "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"tool_calls\":[");
+    for (int i = 0; i < TOOLS; i++) {
+        off += (size_t)snprintf(g_post_turn + off, sizeof(g_post_turn) - off,
+                                "%s{\"id\":\"c%d\",\"type\":\"function\",\"function\":{\"name\":\"lookup\","
+                                "\"arguments\":\"{\\\"n\\\":%d}\"}}",
+                                i ? "," : "", i, i);
+    }
+    snprintf(g_post_turn + off, sizeof(g_post_turn) - off, "]},\"finish_reason\":\"tool_calls\"}]}");
+
+    off = 0;
+    for (int i = 0; i < TOOLS; i++) {
+        off += (size_t)snprintf(g_stream_turn + off, sizeof(g_stream_turn) - off,
+                                "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":%d,\"id\":\"c%d\","
+                                "\"function\":{\"name\":\"lookup\",\"arguments\":\"{\\\"n\\\":%d}\"}}]}}]}\n\n",
+                                i, i, i);
+    }
+    snprintf(g_stream_turn + off, sizeof(g_stream_turn) - off,
+             "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"tool_calls\"}]}\n\ndata: [DONE]\n\n");
+}
+
+// Tool results must follow the assistant message in call order, whatever order they finished in.
+static bool results_in_order(const char* body) {
+    const char* prev = strstr(body, "\"tool_calls\"");
+    for (int i = 0; i < TOOLS; i++) {
+        char needle[64];
+        snprintf(needle, sizeof(needle), "\"content\":\"{\\\"n\\\":%d}\",\"tool_call_id\":\"c%d\"", i, i);
+        const char* at = strstr(body, needle);
+        if (!prev || !at || at < prev) return false;
+        prev = at;
+    }
+    return true;
+}
+
+static bool test_parallel_turn(void) {
+    fake_reset();
+    g_fake->post_responses[0] = g_post_turn;
+    g_fake->post_responses[1] = k_post_final;
+    llm_client_t* client = make_client(NULL);
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "look up", 7, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct lookup_state st;
+    lookup_state_init(&st, TOOLS);
+    llm_tool_loop_opts_t opts = {0};
+    opts.max_parallel_dispatch = TOOLS;
+
+    llm_error_t err =
+        llm_tool_loop_run_opts(client, &msg, 1, NULL, NULL, NULL, lookup, &st, NULL, NULL, 4, NULL, 0, &opts);
+    llm_client_destroy(client);
+    lookup_state_destroy(&st);
+    if (!require(err == LLM_ERR_NONE && st.calls == TOOLS, "parallel loop")) return false;
+    if (!require(!st.latch_timed_out && st.peak == TOOLS, "every call ran at once")) return false;
+    if (!require(g_fake->request_count == 2 && results_in_order(g_fake->request_bodies[1]), "results in order")) {
+        return false;
+    }
+
+    // Sequential dispatch without opts is unchanged.
+    fake_reset();
+    g_fake->post_responses[0] = g_post_turn;
+    g_fake->post_responses[1] = k_post_final;
+    client = make_client(NULL);
+    if (!require(client != NULL, "client create")) return false;
+    lookup_state_init(&st, 1);
+    err = llm_tool_loop_run_opts(client, &msg, 1, NULL, NULL, NULL, lookup, &st, NULL, NULL, 4, NULL, 0, NULL);
+    llm_client_destroy(client);
+    lookup_state_destroy(&st);
+    if (!require(err == LLM_ERR_NONE && st.peak == 1 && results_in_order(g_fake->request_bodies[1]), "sequential")) {
+        return false;
+    }
+    return true;
+}
+
+static bool test_output_budget_in_call_order(void) {
+    fake_reset();
+    g_fake->post_responses[0] = g_post_turn;
+    g_fake->post_responses[1] = k_post_final;
+    // Each result is 7 bytes; the budget admits three, and call 3 is the one over it even though it finished
+    // before calls 0-2.
+    llm_limits_t limits = {0};
+    limits.max_tool_output_bytes_total = 3 * 7 + 6;
+    llm_client_t* client = make_client(&limits);
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "look up", 7, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct lookup_state st;
+    lookup_state_init(&st, 2);
+    llm_tool_loop_opts_t opts = {0};
+    opts.max_parallel_dispatch = 2;
+    llm_error_t err =
+        llm_tool_loop_run_opts(client, &msg, 1, NULL, NULL, NULL, lookup, &st, NULL, NULL, 4, NULL, 0, &opts);
+    llm_client_destroy(client);
+    lookup_state_destroy(&st);
+    if (!require(err == LLM_ERR_FAILED && g_fake->request_count == 1, "budget exceeded deterministically")) {
+        return false;
+    }
+    if (!require(!st.latch_timed_out && st.peak == 2 && st.calls == TOOLS, "bounded by max_parallel_dispatch")) {
+        return false;
+    }
+    return true;
+}
+
+static bool test_parallel_stream(void) {
+    fake_reset();
+    g_fake->stream_payloads[0] = g_stream_turn;
+    g_fake->stream_payloads[1] = k_stream_final;
+    g_fake->stream_payloads_count = 2;
+    llm_client_t* client = make_client(NULL);
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "look up", 7, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct lookup_state st;
+    lookup_state_init(&st, TOOLS);
+    llm_tool_loop_opts_t opts = {0};
+    opts.max_parallel_dispatch = TOOLS;
+    llm_error_t err = llm_tool_loop_run_stream_opts(client, &msg, 1, NULL, NULL, NULL, NULL, lookup, &st, NULL, NULL,
+                                                    4, NULL, 0, &opts);
+    llm_client_destroy(client);
+    lookup_state_destroy(&st);
+    if (!require(err == LLM_ERR_NONE && st.calls == TOOLS, "parallel streaming loop")) return false;
+    if (!require(!st.latch_timed_out && st.peak == TOOLS, "every streamed call ran at once")) return false;
+    if (!require(results_in_order(g_fake->request_bodies[1]), "stream results in order")) return false;
+    return true;
+}
+
+int main(void) {
+    build_payloads();
+    if (!test_parallel_turn()) return 1;
+    if (!test_output_budget_in_call_order()) return 1;
+    if (!test_parallel_stream()) return 1;
+    printf("Parallel tool dispatch tests passed.\n");
+    return 0;
+}
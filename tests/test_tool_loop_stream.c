@@ -0,0 +1,342 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fake_transport.h"
+#include "llm/llm.h"
+
+static bool require(bool cond, const char* msg) {
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", msg);
+        return false;
+    }
+    return true;
+}
+
+static fake_transport_state_t* g_fake;
+
+static void fake_reset(void) {
+    fake_transport_reset();
+    g_fake = fake_transport_state();
+}
+
+static llm_client_t* make_client(void) {
+    llm_model_t model = {"test-model"};
+    return llm_client_create("http://fake", &model, NULL, NULL);
+}
+
+// Dispatch runs on the loop's worker thread while the stream callbacks run on the caller's; both sides meet
+// under mu.
+struct dispatch_log {
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    size_t calls;
+    size_t returned;
+    char names[4][16];
+    char args[4][64];
+    size_t fail_at;         // 1-based call that fails, 0 for none
+    bool hold_first;        // the first call waits until tool 1's arguments are streaming
+    size_t tool1_fragments; // argument fragments of tool 1 seen by the stream
+    bool overlapped;        // the first call saw tool 1 streaming
+    bool wait_at_finish;    // the first finish_reason waits until two calls have started
+    bool both_before_finish;
+    bool finished;
+};
+
+#define DISPATCH_LOG_INIT {.mu = PTHREAD_MUTEX_INITIALIZER, .cv = PTHREAD_COND_INITIALIZER}
+
+// Waits up to two seconds for *value to reach want; the caller holds mu.
+static bool log_wait(struct dispatch_log* log, const size_t* value, size_t want) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 2;
+    while (*value < want) {
+        if (pthread_cond_timedwait(&log->cv, &log->mu, &deadline) != 0) return *value >= want;
+    }
+    return true;
+}
+
+static bool dispatch_record(struct dispatch_log* log, const char* tool_name, size_t name_len, const char* args_json,
+                            size_t args_len, size_t* out_n) {
+    pthread_mutex_lock(&log->mu);
+    size_t n = log->calls++;
+    pthread_cond_broadcast(&log->cv);
+    bool ok = n < 4 && name_len < sizeof(log->names[n]) && args_len < sizeof(log->args[n]);
+    if (ok) {
+        memcpy(log->names[n], tool_name, name_len);
+        memcpy(log->args[n], args_json, args_len);
+        // If dispatch ran on the stream's thread, tool 1 could never arrive while it waits here.
+        if (n == 0 && log->hold_first) log->overlapped = log_wait(log, &log->tool1_fragments, 1);
+        ok = log->fail_at != n + 1;
+    }
+    log->returned++;
+    pthread_cond_broadcast(&log->cv);
+    pthread_mutex_unlock(&log->mu);
+    *out_n = n;
+    return ok;
+}
+
+static bool dispatch(void* user_data, const char* tool_name, size_t name_len, const char* args_json, size_t args_len,
+                     char** result_json, size_t* result_len) {
+    struct dispatch_log* log = user_data;
+    size_t n;
+    if (!dispatch_record(log, tool_name, name_len, args_json, args_len, &n)) return false;
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "{\"r\":\"%s\"}", log->names[n]);
+    *result_json = malloc((size_t)len + 1);
+    if (!*result_json) return false;
+    memcpy(*result_json, buf, (size_t)len + 1);
+    *result_len = (size_t)len;
+    return true;
+}
+
+struct text_capture {
+    char text[64];
+    size_t len;
+    size_t finishes;
+    struct dispatch_log* log;
+};
+
+static void on_content(void* user_data, const char* delta, size_t len) {
+    struct text_capture* c = user_data;
+    if (c->len + len > sizeof(c->text)) return;
+    memcpy(c->text + c->len, delta, len);
+    c->len += len;
+}
+
+static void on_finish(void* user_data, llm_finish_reason_t reason) {
+    struct text_capture* c = user_data;
+    (void)reason;
+    c->finishes++;
+    struct dispatch_log* log = c->log;
+    if (!log) return;
+    pthread_mutex_lock(&log->mu);
+    if (log->wait_at_finish && !log->finished) log->both_before_finish = log_wait(log, &log->calls, 2);
+    log->finished = true;
+    pthread_mutex_unlock(&log->mu);
+}
+
+// Counts tool 1's fragments. When tool 0 is set to fail, tool 1 waits for that failure before it streams on.
+static void on_args_fragment(void* user_data, size_t tool_index, const char* fragment, size_t len) {
+    struct text_capture* c = user_data;
+    (void)fragment;
+    (void)len;
+    if (tool_index != 1 || !c->log) return;
+    pthread_mutex_lock(&c->log->mu);
+    c->log->tool1_fragments++;
+    pthread_cond_broadcast(&c->log->cv);
+    if (c->log->fail_at == 1) log_wait(c->log, &c->log->returned, 1);
+    pthread_mutex_unlock(&c->log->mu);
+}
+
+// Tool 0 closes in the first frame; tool 1 is still being generated over the following frames.
+static const char k_turn1[] =
+    "data: {\"choices\":[{\"delta\":{\"content\":\"Checking\\u2026\",\"tool_calls\":[{\"index\":0,\"id\":\"call_a\","
+    "\"function\":{\"name\":\"weather\",\"arguments\":\"{\\\"city\\\":\\\"Oslo\\\"}\"}}]}}]}\n\n"
+    "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":1,\"id\":\"call_b\","
+    "\"function\":{\"name\":\"time\",\"arguments\":\"{\\\"tz\\\":\"}}]}}]}\n\n"
+    "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":1,"
+    "\"function\":{\"arguments\":\"\\\"CET\\\"\"}}]}}]}\n\n"
+    "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":1,\"function\":{\"arguments\":\"}\"}}]}}]}\n\n"
+    "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"tool_calls\"}]}\n\n"
+    "data: [DONE]\n\n";
+
+static const char k_turn2[] =
+    "data: {\"choices\":[{\"delta\":{\"content\":\"Sunny\"}}]}\n\n"
+    "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"stop\"}]}\n\n"
+    "data: [DONE]\n\n";
+
+static bool test_dispatch_while_streaming(void) {
+    fake_reset();
+    g_fake->stream_payloads[0] = k_turn1;
+    g_fake->stream_payloads[1] = k_turn2;
+    g_fake->stream_payloads_count = 2;
+    g_fake->stream_chunk_size = 32;
+
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "weather?", 8, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct dispatch_log log = DISPATCH_LOG_INIT;
+    log.hold_first = true;
+    log.wait_at_finish = true;
+    struct text_capture cap = {.log = &log};
+    llm_stream_callbacks_t cbs = {0};
+    cbs.user_data = &cap;
+    cbs.on_content_delta = on_content;
+    cbs.on_finish_reason = on_finish;
+    cbs.on_tool_args_fragment = on_args_fragment;
+
+    llm_error_t err =
+        llm_tool_loop_run_stream_ex(client, &msg, 1, NULL, NULL, NULL, &cbs, dispatch, &log, NULL, NULL, 4);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE, "loop succeeds")) return false;
+    if (!require(g_fake->stream_calls == 2 && !g_fake->called_post, "two streamed turns")) return false;
+    if (!require(log.calls == 2, "two dispatches")) return false;
+    if (!require(strcmp(log.names[0], "weather") == 0 && strcmp(log.args[0], "{\"city\":\"Oslo\"}") == 0, "tool 0")) {
+        return false;
+    }
+    if (!require(strcmp(log.names[1], "time") == 0 && strcmp(log.args[1], "{\"tz\":\"CET\"}") == 0, "tool 1")) {
+        return false;
+    }
+    if (!require(log.overlapped && log.both_before_finish, "tools dispatched mid-stream, off the stream's thread")) {
+        return false;
+    }
+    if (!require(cap.finishes == 2 && cap.len == 19 && memcmp(cap.text, "Checking\\u2026Sunny", 19) == 0,
+                 "user callbacks see both turns")) {
+        return false;
+    }
+
+    const char* body = g_fake->request_bodies[1];
+    const char* assistant = strstr(body, "\"tool_calls\":[{\"id\":\"call_a\"");
+    const char* args = strstr(body, "\"arguments\":\"{\\\"city\\\":\\\"Oslo\\\"}\"");
+    const char* res_a = strstr(body, "{\\\"r\\\":\\\"weather\\\"}");
+    const char* res_b = strstr(body, "{\\\"r\\\":\\\"time\\\"}");
+    if (!require(assistant && args && res_a && res_b && res_a < res_b, "history in call order")) return false;
+    if (!require(strstr(body, "\"content\":\"Checking\xe2\x80\xa6\"") != NULL, "assistant content unescaped")) {
+        return false;
+    }
+    if (!require(strstr(body, "\"tool_call_id\":\"call_b\"") != NULL, "tool call ids")) return false;
+    return true;
+}
+
+static bool test_out_of_order_completion(void) {
+    fake_reset();
+    // Tool 1 closes before tool 0; history must still list tool 0 first.
+    static const char turn1[] =
+        "data: {\"choices\":[{\"delta\":{\"tool_calls\":["
+        "{\"index\":0,\"id\":\"c0\",\"function\":{\"name\":\"slow\",\"arguments\":\"{\\\"a\\\":\"}},"
+        "{\"index\":1,\"id\":\"c1\",\"function\":{\"name\":\"fast\",\"arguments\":\"{}\"}}]}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":0,\"function\":{\"arguments\":\"1}\"}}]}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"tool_calls\"}]}\n\n"
+        "data: [DONE]\n\n";
+    g_fake->stream_payloads[0] = turn1;
+    g_fake->stream_payloads[1] = k_turn2;
+    g_fake->stream_payloads_count = 2;
+
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "go", 2, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct dispatch_log log = DISPATCH_LOG_INIT;
+    llm_error_t err =
+        llm_tool_loop_run_stream_ex(client, &msg, 1, NULL, NULL, NULL, NULL, dispatch, &log, NULL, NULL, 4);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE, "loop succeeds")) return false;
+    if (!require(log.calls == 2 && strcmp(log.names[0], "fast") == 0 && strcmp(log.names[1], "slow") == 0,
+                 "dispatched in completion order")) {
+        return false;
+    }
+    const char* body = g_fake->request_bodies[1];
+    const char* res_slow = strstr(body, "{\\\"r\\\":\\\"slow\\\"}");
+    const char* res_fast = strstr(body, "{\\\"r\\\":\\\"fast\\\"}");
+    if (!require(res_slow && res_fast && res_slow < res_fast, "results in call order")) return false;
+    return true;
+}
+
+static bool test_dispatch_failure_aborts(void) {
+    fake_reset();
+    g_fake->stream_payloads[0] = k_turn1;
+    g_fake->stream_payloads_count = 1;
+    g_fake->stream_chunk_size = 32;
+    // The failure lands on the worker; pacing leaves the stream a few frames to notice it.
+    g_fake->stream_chunk_interval_us = 5000;
+
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "weather?", 8, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct dispatch_log log = DISPATCH_LOG_INIT;
+    log.fail_at = 1;
+    struct text_capture cap = {.log = &log};
+    llm_stream_callbacks_t cbs = {0};
+    cbs.user_data = &cap;
+    cbs.on_tool_args_fragment = on_args_fragment;
+    llm_error_t err =
+        llm_tool_loop_run_stream_ex(client, &msg, 1, NULL, NULL, NULL, &cbs, dispatch, &log, NULL, NULL, 4);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_FAILED, "dispatch failure fails the loop")) return false;
+    if (!require(log.calls == 1 && g_fake->stream_cb_calls < (sizeof(k_turn1) - 1 + 31) / 32, "stream aborted")) {
+        return false;
+    }
+    return true;
+}
+
+// The last allowed turn is refused whatever it asks for, so none of its tools may run from the stream.
+static bool test_last_turn_runs_nothing(void) {
+    fake_reset();
+    g_fake->stream_payloads[0] = k_turn1;
+    g_fake->stream_payloads_count = 1;
+    g_fake->stream_chunk_size = 32;
+
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "weather?", 8, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct dispatch_log log = DISPATCH_LOG_INIT;
+    llm_tool_loop_stats_t stats = {0};
+    llm_tool_loop_opts_t opts = {0};
+    opts.stats = &stats;
+    llm_error_t err = llm_tool_loop_run_stream_opts(client, &msg, 1, NULL, NULL, NULL, NULL, dispatch, &log, NULL,
+                                                    NULL, 1, NULL, 0, &opts);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_FAILED, "out of turns")) return false;
+    if (!require(log.calls == 0 && stats.dispatches == 0, "no dispatch on the final turn")) return false;
+    return true;
+}
+
+static bool test_repeated_turn_runs_nothing(void) {
+    // The model asks for exactly the same turn again: the guard refuses it, so its tools must not have run.
+    fake_reset();
+    g_fake->stream_payloads[0] = k_turn1;
+    g_fake->stream_payloads[1] = k_turn1;
+    g_fake->stream_payloads_count = 2;
+    g_fake->stream_chunk_size = 32;
+
+    llm_client_t* client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    llm_message_t msg = {LLM_ROLE_USER, "weather?", 8, NULL, 0, NULL, 0, NULL, 0, NULL, 0};
+    struct dispatch_log log = DISPATCH_LOG_INIT;
+    llm_error_t err =
+        llm_tool_loop_run_stream_ex(client, &msg, 1, NULL, NULL, NULL, NULL, dispatch, &log, NULL, NULL, 4);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_FAILED, "repeated turn refused")) return false;
+    if (!require(g_fake->stream_calls == 2 && log.calls == 2, "only the first turn's tools ran")) return false;
+
+    // The same first call with a different second one is a new turn: the held call runs once it diverges.
+    static const char turn2[] =
+        "data: {\"choices\":[{\"delta\":{\"content\":\"Checking\\u2026\",\"tool_calls\":["
+        "{\"index\":0,\"id\":\"call_c\",\"function\":{\"name\":\"weather\","
+        "\"arguments\":\"{ \\\"city\\\": \\\"Oslo\\\" }\"}}]}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{\"tool_calls\":[{\"index\":1,\"id\":\"call_d\","
+        "\"function\":{\"name\":\"time\",\"arguments\":\"{\\\"tz\\\":\\\"UTC\\\"}\"}}]}}]}\n\n"
+        "data: {\"choices\":[{\"delta\":{},\"finish_reason\":\"tool_calls\"}]}\n\n"
+        "data: [DONE]\n\n";
+    fake_reset();
+    g_fake->stream_payloads[0] = k_turn1;
+    g_fake->stream_payloads[1] = turn2;
+    g_fake->stream_payloads[2] = k_turn2;
+    g_fake->stream_payloads_count = 3;
+    client = make_client();
+    if (!require(client != NULL, "client create")) return false;
+    struct dispatch_log log2 = DISPATCH_LOG_INIT;
+    err = llm_tool_loop_run_stream_ex(client, &msg, 1, NULL, NULL, NULL, NULL, dispatch, &log2, NULL, NULL, 4);
+    llm_client_destroy(client);
+    if (!require(err == LLM_ERR_NONE && g_fake->stream_calls == 3, "diverging turn accepted")) return false;
+    if (!require(log2.calls == 4 && strcmp(log2.names[2], "weather") == 0 &&
+                     strcmp(log2.args[3], "{\"tz\":\"UTC\"}") == 0,
+                 "held call ran after the turn diverged")) {
+        return false;
+    }
+    return true;
+}
+
+int main(void) {
+    if (!test_dispatch_while_streaming()) return 1;
+    if (!test_out_of_order_completion()) return 1;
+    if (!test_dispatch_failure_aborts()) return 1;
+    if (!test_last_turn_runs_nothing()) return 1;
+    if (!test_repeated_turn_runs_nothing()) return 1;
+    printf("Streaming tool loop tests passed.\n");
+    return 0;
+}
@@ -6,7 +6,7 @@
 
 int main(void) {
     struct tool_call_accumulator acc;
-    accum_init(&acc);
+    accum_init(&acc, NULL);
 
     const char* f1 = "{\"loc";
     llm_tool_call_delta_t d1 = {0, "call_123", 8, "get_weather", 11, f1, strlen(f1)};
@@ -29,7 +29,7 @@ int main(void) {
     accum_free(&acc);
 
     // Test cap
-    accum_init(&acc);
+    accum_init(&acc, NULL);
     llm_tool_call_delta_t d3 = {0, "id", 2, "name", 4, "too long", 8};
     if (accum_feed_delta(&acc, &d3, 5)) {
         fprintf(stderr, "Cap should have been enforced\n");
@@ -38,6 +38,35 @@ int main(void) {
     }
     accum_free(&acc);
 
+    // Escapes split across fragments are unescaped before validation.
+    accum_init(&acc, NULL);
+    const char* frags[] = {"{\\", "\"k\\u00", "e9\\u00", "22:[1, \\\"\\\\\\", "\\n\\\"]", "}"};
+    for (size_t i = 0; i < sizeof(frags) / sizeof(frags[0]); i++) {
+        llm_tool_call_delta_t d = {0, NULL, 0, NULL, 0, frags[i], strlen(frags[i])};
+        if (!accum_feed_delta(&acc, &d, 1024)) {
+            fprintf(stderr, "Escaped fragment %zu rejected\n", i);
+            accum_free(&acc);
+            return 1;
+        }
+        if (accum_args_complete(&acc) != (i + 1 == sizeof(frags) / sizeof(frags[0]))) {
+            fprintf(stderr, "Completion wrong after fragment %zu\n", i);
+            accum_free(&acc);
+            return 1;
+        }
+    }
+    accum_free(&acc);
+
+    // The first hard syntax error fails the feed and every later one.
+    accum_init(&acc, NULL);
+    llm_tool_call_delta_t d4 = {0, NULL, 0, NULL, 0, "{\\\"a\\\":,", 8};
+    llm_tool_call_delta_t d5 = {0, NULL, 0, NULL, 0, "1}", 2};
+    if (accum_feed_delta(&acc, &d4, 1024) || !acc.args_invalid || accum_feed_delta(&acc, &d5, 1024)) {
+        fprintf(stderr, "Malformed args should be rejected early\n");
+        accum_free(&acc);
+        return 1;
+    }
+    accum_free(&acc);
+
     printf("Tool accum test passed!\n");
     return 0;
 }